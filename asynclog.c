@@ -0,0 +1,435 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include "asynclog.h"
+#include "stats.h"
+#include "messages.h"
+
+G_STATIC_ASSERT((ASYNCLOG_SIZE & (ASYNCLOG_SIZE - 1)) == 0);
+
+struct LogMessage
+{
+    /*! Format string the message was made from, for rate limiting. */
+    const char *format;
+
+    int error_code;
+    int priority;
+    char text[ASYNCLOG_MESSAGE_SIZE];
+};
+
+/*!
+ * A slot in the ring.
+ *
+ * The \c sequence member is the ring position the slot may be written for
+ * next, and that position plus 1 once the message is complete and may be
+ * taken by the writer thread.
+ */
+struct Slot
+{
+    atomic_uint_fast64_t sequence;
+    struct LogMessage message;
+};
+
+/*!
+ * Messages written for a format string during the current interval.
+ */
+struct RateLimit
+{
+    const char *format;
+    int priority;
+    int64_t interval_start;
+    unsigned int count;
+    unsigned int suppressed;
+};
+
+static struct
+{
+    AsyncLogSink sink;
+    GThread *writer;
+
+    /*! Next ring position to be written by any thread. */
+    atomic_uint_fast64_t head;
+
+    /*! Next ring position to be read, used by writer thread only. */
+    uint64_t tail;
+
+    struct Slot ring[ASYNCLOG_SIZE];
+
+    /*! Messages dropped since last reported by the writer thread. */
+    atomic_uint dropped;
+
+    /*! The writer thread has nothing to do and may be waiting for
+     *  #asynclog_data::wakeup. */
+    atomic_bool is_writer_idle;
+
+    GMutex lock;
+    GCond wakeup;
+    bool is_stopping;
+
+    /*! Map of format string to #RateLimit, used by writer thread only. */
+    GHashTable *rate_limits;
+}
+asynclog_data;
+
+static void write_to_messages(int error_code, int priority,
+                              const char *message)
+{
+    if(priority == LOG_INFO)
+        msg_info("%s", message);
+    else
+        msg_error(error_code, priority, "%s", message);
+}
+
+static void report_suppressed(struct RateLimit *rl)
+{
+    if(rl->suppressed == 0)
+        return;
+
+    char text[ASYNCLOG_MESSAGE_SIZE];
+
+    g_snprintf(text, sizeof(text), "Suppressed %u messages like \"%s\"",
+               rl->suppressed, rl->format);
+    asynclog_data.sink(0, rl->priority, text);
+    rl->suppressed = 0;
+}
+
+/*!
+ * Whether or not the message is one too many of its kind.
+ */
+static bool is_rate_limited(const struct LogMessage *msg, int64_t now)
+{
+    struct RateLimit *rl =
+        g_hash_table_lookup(asynclog_data.rate_limits, msg->format);
+
+    if(rl == NULL)
+    {
+        rl = g_new0(struct RateLimit, 1);
+        rl->format = msg->format;
+        rl->interval_start = now;
+        g_hash_table_insert(asynclog_data.rate_limits,
+                            (gpointer)msg->format, rl);
+    }
+    else if(now - rl->interval_start >=
+            ASYNCLOG_RATE_LIMIT_INTERVAL_MS * 1000)
+    {
+        report_suppressed(rl);
+        rl->interval_start = now;
+        rl->count = 0;
+    }
+
+    rl->priority = msg->priority;
+
+    if(rl->count < ASYNCLOG_RATE_LIMIT_BURST)
+    {
+        ++rl->count;
+        return false;
+    }
+
+    ++rl->suppressed;
+    stats_inc(STATS_LOG_MESSAGES_SUPPRESSED);
+
+    return true;
+}
+
+/*!
+ * Report suppressed messages of intervals which have ended.
+ *
+ * \returns
+ *     Monotonic time the next interval with suppressed messages ends, 0 if
+ *     there is none.
+ */
+static int64_t report_expired_rate_limits(int64_t now, bool report_all)
+{
+    GHashTableIter iter;
+    gpointer value;
+    int64_t next = 0;
+
+    g_hash_table_iter_init(&iter, asynclog_data.rate_limits);
+
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        struct RateLimit *rl = value;
+
+        if(rl->suppressed == 0)
+            continue;
+
+        const int64_t end =
+            rl->interval_start + ASYNCLOG_RATE_LIMIT_INTERVAL_MS * 1000;
+
+        if(report_all || end <= now)
+            report_suppressed(rl);
+        else if(next == 0 || end < next)
+            next = end;
+    }
+
+    return next;
+}
+
+static void report_dropped_messages(void)
+{
+    const unsigned int count =
+        atomic_exchange_explicit(&asynclog_data.dropped, 0,
+                                 memory_order_relaxed);
+
+    if(count == 0)
+        return;
+
+    char text[ASYNCLOG_MESSAGE_SIZE];
+
+    g_snprintf(text, sizeof(text), "Dropped %u log messages, buffer full",
+               count);
+    asynclog_data.sink(0, LOG_WARNING, text);
+}
+
+static bool is_message_available(void)
+{
+    const struct Slot *slot =
+        &asynclog_data.ring[asynclog_data.tail & (ASYNCLOG_SIZE - 1)];
+
+    return atomic_load_explicit(&slot->sequence, memory_order_acquire) ==
+           asynclog_data.tail + 1;
+}
+
+/*!
+ * Copy next message out of the ring so that its slot can be reused while
+ * the message is being written.
+ */
+static bool take_message(struct LogMessage *msg)
+{
+    if(!is_message_available())
+        return false;
+
+    struct Slot *slot =
+        &asynclog_data.ring[asynclog_data.tail & (ASYNCLOG_SIZE - 1)];
+
+    *msg = slot->message;
+    atomic_store_explicit(&slot->sequence,
+                          asynclog_data.tail + ASYNCLOG_SIZE,
+                          memory_order_release);
+    ++asynclog_data.tail;
+
+    return true;
+}
+
+static gpointer writer_main(gpointer data)
+{
+    struct LogMessage msg;
+
+    while(true)
+    {
+        while(take_message(&msg))
+        {
+            if(!is_rate_limited(&msg, g_get_monotonic_time()))
+                asynclog_data.sink(msg.error_code, msg.priority, msg.text);
+        }
+
+        report_dropped_messages();
+
+        const int64_t flush_time =
+            report_expired_rate_limits(g_get_monotonic_time(), false);
+
+        g_mutex_lock(&asynclog_data.lock);
+
+        /* pairs with the fence in #wake_up_writer() so that either we see
+         * the new message, or the producer sees us idle */
+        atomic_store(&asynclog_data.is_writer_idle, true);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        if(!is_message_available())
+        {
+            if(asynclog_data.is_stopping)
+            {
+                g_mutex_unlock(&asynclog_data.lock);
+                break;
+            }
+
+            if(flush_time == 0)
+                g_cond_wait(&asynclog_data.wakeup, &asynclog_data.lock);
+            else
+                g_cond_wait_until(&asynclog_data.wakeup, &asynclog_data.lock,
+                                  flush_time);
+        }
+
+        atomic_store(&asynclog_data.is_writer_idle, false);
+        g_mutex_unlock(&asynclog_data.lock);
+    }
+
+    report_expired_rate_limits(0, true);
+
+    return NULL;
+}
+
+static void wake_up_writer(void)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(!atomic_exchange(&asynclog_data.is_writer_idle, false))
+        return;
+
+    g_mutex_lock(&asynclog_data.lock);
+    g_cond_signal(&asynclog_data.wakeup);
+    g_mutex_unlock(&asynclog_data.lock);
+}
+
+/*!
+ * Format message into a free slot and hand it over to the writer thread.
+ *
+ * Messages are dropped if the ring is full, the caller never waits for the
+ * writer. Before #asynclog_init() and after #asynclog_deinit(), messages
+ * are written synchronously.
+ */
+static void enqueue(int error_code, int priority, const char *format,
+                    va_list ap)
+{
+    if(asynclog_data.writer == NULL)
+    {
+        char text[ASYNCLOG_MESSAGE_SIZE];
+
+        vsnprintf(text, sizeof(text), format, ap);
+        write_to_messages(error_code, priority, text);
+        return;
+    }
+
+    uint64_t pos = atomic_load_explicit(&asynclog_data.head,
+                                        memory_order_relaxed);
+    struct Slot *slot;
+
+    while(true)
+    {
+        slot = &asynclog_data.ring[pos & (ASYNCLOG_SIZE - 1)];
+
+        const uint64_t seq =
+            atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const int64_t diff = (int64_t)(seq - pos);
+
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&asynclog_data.head,
+                                                     &pos, pos + 1,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0)
+        {
+            atomic_fetch_add_explicit(&asynclog_data.dropped, 1,
+                                      memory_order_relaxed);
+            stats_inc(STATS_LOG_MESSAGES_DROPPED);
+            return;
+        }
+        else
+            pos = atomic_load_explicit(&asynclog_data.head,
+                                       memory_order_relaxed);
+    }
+
+    slot->message.format = format;
+    slot->message.error_code = error_code;
+    slot->message.priority = priority;
+    vsnprintf(slot->message.text, sizeof(slot->message.text), format, ap);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+    wake_up_writer();
+}
+
+/*!
+ * Start writer thread.
+ *
+ * \param sink
+ *     Where messages are written to, \c NULL for the regular log.
+ */
+void asynclog_init(AsyncLogSink sink)
+{
+    msg_log_assert(asynclog_data.writer == NULL);
+
+    asynclog_data.sink = sink != NULL ? sink : write_to_messages;
+    atomic_init(&asynclog_data.head, 0);
+    asynclog_data.tail = 0;
+
+    for(uint64_t i = 0; i < ASYNCLOG_SIZE; ++i)
+        atomic_init(&asynclog_data.ring[i].sequence, i);
+
+    atomic_init(&asynclog_data.dropped, 0);
+    atomic_init(&asynclog_data.is_writer_idle, false);
+    g_mutex_init(&asynclog_data.lock);
+    g_cond_init(&asynclog_data.wakeup);
+    asynclog_data.is_stopping = false;
+    asynclog_data.rate_limits =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    asynclog_data.writer = g_thread_new("log-writer", writer_main, NULL);
+}
+
+/*!
+ * Write all pending messages and stop writer thread.
+ *
+ * No other thread may log through this module while this function is
+ * running.
+ */
+void asynclog_deinit(void)
+{
+    if(asynclog_data.writer == NULL)
+        return;
+
+    g_mutex_lock(&asynclog_data.lock);
+    asynclog_data.is_stopping = true;
+    g_cond_signal(&asynclog_data.wakeup);
+    g_mutex_unlock(&asynclog_data.lock);
+
+    g_thread_join(asynclog_data.writer);
+    asynclog_data.writer = NULL;
+
+    g_hash_table_destroy(asynclog_data.rate_limits);
+    asynclog_data.rate_limits = NULL;
+    g_mutex_clear(&asynclog_data.lock);
+    g_cond_clear(&asynclog_data.wakeup);
+}
+
+/*!
+ * Like #msg_error(), but without waiting for the log.
+ */
+void asynclog_error(int error_code, int priority, const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    enqueue(error_code, priority, format, ap);
+    va_end(ap);
+}
+
+/*!
+ * Like #msg_info(), but without waiting for the log.
+ */
+void asynclog_info(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    enqueue(0, LOG_INFO, format, ap);
+    va_end(ap);
+}
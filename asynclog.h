@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <glib.h>
+
+/*!
+ * Number of messages which may be waiting for the writer thread, must be a
+ * power of 2.
+ */
+#define ASYNCLOG_SIZE 256
+
+/*!
+ * Maximum length of a formatted message, including the terminating 0.
+ */
+#define ASYNCLOG_MESSAGE_SIZE 200
+
+/*!
+ * Number of messages with the same format string written per
+ * #ASYNCLOG_RATE_LIMIT_INTERVAL_MS, more are suppressed.
+ */
+#define ASYNCLOG_RATE_LIMIT_BURST 10
+
+#define ASYNCLOG_RATE_LIMIT_INTERVAL_MS 1000
+
+/*!
+ * Where the writer thread sends messages to.
+ */
+typedef void (*AsyncLogSink)(int error_code, int priority,
+                             const char *message);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void asynclog_init(AsyncLogSink sink);
+void asynclog_deinit(void);
+void asynclog_error(int error_code, int priority, const char *format, ...)
+    G_GNUC_PRINTF(3, 4);
+void asynclog_info(const char *format, ...) G_GNUC_PRINTF(1, 2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ASYNCLOG_H */
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -23,8 +23,19 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <gio/gunixfdlist.h>
+
 #include "dbus_handlers.h"
 #include "events.h"
+#include "registry.h"
+#include "schedclass.h"
+#include "stats.h"
+#include "flightrec.h"
+#include "pathroots.h"
 #include "messages.h"
 
 static void enter_handler(GDBusMethodInvocation *invocation)
@@ -36,19 +47,85 @@ static void enter_handler(GDBusMethodInvocation *invocation)
              g_dbus_method_invocation_get_method_name(invocation));
 }
 
+/*!
+ * Create event for starting a download or upload, register the item.
+ *
+ * \returns
+ *     The event on success, \c NULL on error. The \p item remains owned by
+ *     the caller in the latter case.
+ */
+static struct EventFromUser *prepare_download(struct XferItem *item,
+                                              GDBusMethodInvocation *invocation,
+                                              const char *tag)
+{
+    struct EventFromUser *event = events_from_user_new_start_download(item);
+
+    if(event == NULL)
+        return NULL;
+
+    if(!registry_add(item->item_id, item->priority,
+                     g_dbus_method_invocation_get_sender(invocation), tag,
+                     item->status))
+    {
+        event->d.item = NULL;
+        events_from_user_free(event);
+        return NULL;
+    }
+
+    registry_set_deadline(item->item_id, item->deadline);
+
+    return event;
+}
+
+/*!
+ * Check URL passed by a client, restricting local files to the allowed
+ * directories.
+ *
+ * \returns
+ *     The URL to be downloaded as newly allocated string, or \c NULL on
+ *     error. An error is returned to the D-Bus caller in the latter case.
+ */
+static char *resolve_url(GDBusMethodInvocation *invocation, const char *url)
+{
+    char *result = pathroots_resolve_url(url);
+
+    if(result != NULL)
+        return result;
+
+    const int error = errno;
+
+    g_dbus_method_invocation_return_error(invocation,
+                                          G_DBUS_ERROR,
+                                          error == EACCES
+                                          ? G_DBUS_ERROR_ACCESS_DENIED
+                                          : (error == EINVAL
+                                             ? G_DBUS_ERROR_INVALID_ARGS
+                                             : G_DBUS_ERROR_FILE_NOT_FOUND),
+                                          "Cannot download \"%s\": %s",
+                                          url, g_strerror(error));
+    return NULL;
+}
+
 gboolean dbusmethod_download_start(tdbusFileTransfer *object,
                                    GDBusMethodInvocation *invocation,
                                    const gchar *url, guint ticks)
 {
     enter_handler(invocation);
 
-    struct XferItem *item = xferitem_allocate(url, ticks);
+    char *resolved_url = resolve_url(invocation, url);
+
+    if(resolved_url == NULL)
+        return TRUE;
+
+    struct XferItem *item = xferitem_allocate(resolved_url, ticks);
     bool failed = true;
 
+    g_free(resolved_url);
+
     if(item != NULL)
     {
         struct EventFromUser *event =
-            events_from_user_new_start_download(item);
+            prepare_download(item, invocation, NULL);
 
         if(event != NULL)
         {
@@ -56,12 +133,402 @@ gboolean dbusmethod_download_start(tdbusFileTransfer *object,
                                                   item->item_id);
             msg_info("Queue download of \"%s\", ID %u, ticks resolution %u",
                      item->url, item->item_id, item->total_ticks);
-            events_from_user_send(event);
+            events_from_user_send(item->priority, event);
+            failed = false;
+        }
+        else
+            xferitem_free(item);
+    }
+
+    if(failed)
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                              "Failed queuing download of URL \"%s\"", url);
+
+    return TRUE;
+}
+
+/*!
+ * Get file descriptor passed as option "fd" with a D-Bus method call.
+ *
+ * \returns
+ *     A file descriptor owned by the caller, -1 if the option was not
+ *     passed, or -2 on error. An error is returned to the D-Bus caller in the
+ *     latter case.
+ */
+static int get_fd_option(GDBusMethodInvocation *invocation,
+                         GUnixFDList *fd_list, GVariant *options)
+{
+    gint32 fd_index;
+
+    if(!g_variant_lookup(options, "fd", "h", &fd_index))
+        return -1;
+
+    GError *error = NULL;
+    const int fd = fd_list != NULL
+        ? g_unix_fd_list_get(fd_list, fd_index, &error)
+        : -1;
+
+    if(fd < 0)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Invalid file descriptor: %s",
+                                              error != NULL
+                                              ? error->message
+                                              : "not passed");
+        g_clear_error(&error);
+        return -2;
+    }
+
+    return fd;
+}
+
+/*!
+ * Get priority class passed as option "priority" with a D-Bus method call.
+ *
+ * \returns
+ *     True on success, false on error. An error is returned to the D-Bus
+ *     caller in the latter case.
+ */
+static bool get_priority_option(GDBusMethodInvocation *invocation,
+                                GVariant *options,
+                                enum XferPriority *priority)
+{
+    const gchar *name;
+
+    *priority = XFER_PRIORITY_NORMAL;
+
+    if(!g_variant_lookup(options, "priority", "&s", &name) ||
+       schedclass_parse_name(name, priority))
+        return true;
+
+    g_dbus_method_invocation_return_error(invocation,
+                                          G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                          "Invalid priority \"%s\"", name);
+    return false;
+}
+
+/*!
+ * Apply hints passed by the client.
+ *
+ * The client may pass the expected file size as option "size", whether or
+ * not it is going to remove the file soon after download as option
+ * "short-lived", and the number of milliseconds from now the download
+ * must have finished in as option "deadline". The first two options are
+ * used for placing files in the download directory, and for predicting
+ * completion of downloads with a deadline.
+ *
+ */
+static void apply_item_hints(struct XferItem *item, GVariant *options)
+{
+    guint64 size;
+    gboolean is_short_lived;
+    guint32 deadline_ms;
+
+    if(g_variant_lookup(options, "short-lived", "b", &is_short_lived))
+        item->is_short_lived = is_short_lived;
+
+    if(g_variant_lookup(options, "deadline", "u", &deadline_ms))
+        item->deadline = g_get_monotonic_time() +
+                         (int64_t)deadline_ms * G_USEC_PER_SEC / 1000;
+
+    if(!g_variant_lookup(options, "size", "t", &size))
+        size = 0;
+
+    item->expected_size = size;
+
+    if(size > 0 || item->is_short_lived)
+        xferitem_place(item, size);
+}
+
+static char *resolve_delta_path(GDBusMethodInvocation *invocation,
+                                const char *path)
+{
+    char *resolved = pathroots_resolve_source(path);
+
+    if(resolved == NULL)
+    {
+        const int error = errno;
+
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              error == EACCES
+                                              ? G_DBUS_ERROR_ACCESS_DENIED
+                                              : G_DBUS_ERROR_FILE_NOT_FOUND,
+                                              "Cannot use \"%s\" for delta "
+                                              "download: %s",
+                                              path, g_strerror(error));
+    }
+
+    return resolved;
+}
+
+/*!
+ * Resolve local files for delta download passed by the client.
+ *
+ * Options "delta-manifest" and "delta-seed" name a local manifest of the
+ * file and a previous version of it. Given both, only the blocks not found
+ * in the previous version are downloaded. Both files must be located in
+ * allowed directories, they are subject to the same checks as files to be
+ * uploaded.
+ *
+ * \param invocation
+ *     Method invocation, an error is returned through it on failure.
+ *
+ * \param options
+ *     Options passed by the client.
+ *
+ * \param[out] manifest, seed
+ *     Resolved paths, both set to \c NULL if delta download is not
+ *     requested.
+ *
+ * \returns
+ *     True on success, false if an error has been returned to the client.
+ */
+static bool get_delta_options(GDBusMethodInvocation *invocation,
+                              GVariant *options, char **manifest, char **seed)
+{
+    const gchar *delta_manifest;
+    const gchar *delta_seed;
+
+    *manifest = NULL;
+    *seed = NULL;
+
+    if(!g_variant_lookup(options, "delta-manifest", "&s", &delta_manifest))
+        delta_manifest = NULL;
+
+    if(!g_variant_lookup(options, "delta-seed", "&s", &delta_seed))
+        delta_seed = NULL;
+
+    if(delta_manifest == NULL || delta_seed == NULL)
+    {
+        if(delta_manifest != NULL || delta_seed != NULL)
+            msg_info("Ignoring delta option, need both manifest and seed");
+
+        return true;
+    }
+
+    *manifest = resolve_delta_path(invocation, delta_manifest);
+
+    if(*manifest == NULL)
+        return false;
+
+    *seed = resolve_delta_path(invocation, delta_seed);
+
+    if(*seed == NULL)
+    {
+        g_free(*manifest);
+        *manifest = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static bool is_nonempty_directory(const char *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+
+    if(dir == NULL)
+        return false;
+
+    const bool result = g_dir_read_name(dir) != NULL;
+
+    g_dir_close(dir);
+
+    return result;
+}
+
+gboolean dbusmethod_download_to(tdbusFileTransfer *object,
+                                GDBusMethodInvocation *invocation,
+                                GUnixFDList *fd_list,
+                                const gchar *url, guint ticks,
+                                const gchar *destination, GVariant *options)
+{
+    enter_handler(invocation);
+
+    enum XferPriority priority;
+
+    if(!get_priority_option(invocation, options, &priority))
+        return TRUE;
+
+    const gchar *tag;
+
+    if(!g_variant_lookup(options, "tag", "&s", &tag))
+        tag = NULL;
+
+    const int fd = get_fd_option(invocation, fd_list, options);
+
+    if(fd < -1)
+        return TRUE;
+
+    if(destination[0] != '\0' && fd >= 0)
+    {
+        close(fd);
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Need either destination path or file descriptor, not both");
+        return TRUE;
+    }
+
+    const bool use_download_dir = destination[0] == '\0' && fd < 0;
+    gboolean in_memory;
+
+    if(!g_variant_lookup(options, "in-memory", "b", &in_memory))
+        in_memory = FALSE;
+
+    if(in_memory && !use_download_dir)
+    {
+        if(fd >= 0)
+            close(fd);
+
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Cannot download to memory and to destination");
+        return TRUE;
+    }
+
+    gboolean extract;
+
+    if(!g_variant_lookup(options, "extract", "b", &extract))
+        extract = FALSE;
+
+    if(extract && (in_memory || fd >= 0))
+    {
+        if(fd >= 0)
+            close(fd);
+
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Archives can only be extracted to a directory");
+        return TRUE;
+    }
+
+    gboolean replace;
+
+    if(!g_variant_lookup(options, "replace", "b", &replace))
+        replace = FALSE;
+
+    if(!use_download_dir && fd < 0 && !g_path_is_absolute(destination))
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Destination path must be absolute");
+        return TRUE;
+    }
+
+    char *resolved_destination = NULL;
+
+    if(!use_download_dir && fd < 0)
+    {
+        resolved_destination = pathroots_resolve_destination(destination);
+
+        if(resolved_destination == NULL)
+        {
+            const int error = errno;
+
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR,
+                                                  error == EACCES
+                                                  ? G_DBUS_ERROR_ACCESS_DENIED
+                                                  : G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Cannot download to \"%s\": %s",
+                                                  destination, g_strerror(error));
+            return TRUE;
+        }
+
+        if(extract && !replace && is_nonempty_directory(resolved_destination))
+        {
+            g_free(resolved_destination);
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR, G_DBUS_ERROR_FILE_EXISTS,
+                                                  "Destination directory \"%s\" is not empty, "
+                                                  "need option \"replace\"",
+                                                  destination);
+            return TRUE;
+        }
+    }
+
+    char *delta_manifest;
+    char *delta_seed;
+
+    if(!get_delta_options(invocation, options, &delta_manifest, &delta_seed))
+    {
+        if(fd >= 0)
+            close(fd);
+
+        g_free(resolved_destination);
+        return TRUE;
+    }
+
+    char *resolved_url = resolve_url(invocation, url);
+
+    if(resolved_url == NULL)
+    {
+        if(fd >= 0)
+            close(fd);
+
+        g_free(resolved_destination);
+        g_free(delta_manifest);
+        g_free(delta_seed);
+        return TRUE;
+    }
+
+    struct XferItem *item = use_download_dir
+        ? xferitem_allocate(resolved_url, ticks)
+        : xferitem_allocate_to(resolved_url, ticks, resolved_destination, fd);
+    bool failed = true;
+
+    g_free(resolved_url);
+    g_free(resolved_destination);
+
+    if(item != NULL)
+    {
+        item->priority = priority;
+        item->extract_archive = extract;
+        item->replace_existing = replace;
+        apply_item_hints(item, options);
+
+        if(delta_manifest != NULL)
+            xferitem_set_delta(item, delta_manifest, delta_seed);
+
+        g_free(delta_manifest);
+        g_free(delta_seed);
+
+        if(in_memory)
+            xferitem_keep_in_memory(item);
+
+        struct EventFromUser *event =
+            prepare_download(item, invocation, tag);
+
+        if(event != NULL)
+        {
+            tdbus_file_transfer_complete_download_to(object, invocation, NULL,
+                                                     item->item_id);
+            const bool is_path = use_download_dir || fd < 0;
+
+            msg_info("Queue %s download of \"%s\" to %s%s%s, ID %u, "
+                     "ticks resolution %u",
+                     schedclass_get_name(item->priority), item->url,
+                     is_path ? "\"" : "",
+                     is_path ? item->destfile_path : "passed fd",
+                     is_path ? "\"" : "",
+                     item->item_id, item->total_ticks);
+            events_from_user_send(item->priority, event);
             failed = false;
         }
         else
             xferitem_free(item);
     }
+    else
+    {
+        if(fd >= 0)
+            close(fd);
+
+        g_free(delta_manifest);
+        g_free(delta_seed);
+    }
 
     if(failed)
         g_dbus_method_invocation_return_error(invocation,
@@ -71,19 +538,149 @@ gboolean dbusmethod_download_start(tdbusFileTransfer *object,
     return TRUE;
 }
 
+static bool parse_upload_method(const char *name, enum XferMethod *method)
+{
+    if(name[0] == '\0' || strcmp(name, "PUT") == 0)
+        *method = XFER_METHOD_PUT;
+    else if(strcmp(name, "POST") == 0)
+        *method = XFER_METHOD_POST;
+    else
+        return false;
+
+    return true;
+}
+
+gboolean dbusmethod_upload(tdbusFileTransfer *object,
+                           GDBusMethodInvocation *invocation,
+                           const gchar *path, const gchar *url,
+                           const gchar *method_name, guint ticks,
+                           GVariant *options)
+{
+    enter_handler(invocation);
+
+    enum XferMethod method;
+
+    if(!parse_upload_method(method_name, &method))
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Invalid upload method \"%s\"",
+                                              method_name);
+        return TRUE;
+    }
+
+    if(!g_path_is_absolute(path))
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Source path must be absolute");
+        return TRUE;
+    }
+
+    enum XferPriority priority;
+
+    if(!get_priority_option(invocation, options, &priority))
+        return TRUE;
+
+    char *source = pathroots_resolve_source(path);
+
+    if(source == NULL)
+    {
+        const int error = errno;
+
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR,
+                                              error == EACCES
+                                              ? G_DBUS_ERROR_ACCESS_DENIED
+                                              : G_DBUS_ERROR_FILE_NOT_FOUND,
+                                              "Cannot upload \"%s\": %s",
+                                              path, g_strerror(error));
+        return TRUE;
+    }
+
+    if(!g_file_test(source, G_FILE_TEST_IS_REGULAR))
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Cannot upload \"%s\": "
+                                              "not a regular file", path);
+        g_free(source);
+        return TRUE;
+    }
+
+    const gchar *tag;
+
+    if(!g_variant_lookup(options, "tag", "&s", &tag))
+        tag = NULL;
+
+    struct XferItem *item =
+        xferitem_allocate_upload(url, ticks, source, method);
+    bool failed = true;
+
+    g_free(source);
+
+    if(item != NULL)
+    {
+        item->priority = priority;
+
+        struct EventFromUser *event =
+            prepare_download(item, invocation, tag);
+
+        if(event != NULL)
+        {
+            tdbus_file_transfer_complete_upload(object, invocation,
+                                                item->item_id);
+            msg_info("Queue %s upload of \"%s\" to \"%s\" (%s), ID %u, "
+                     "ticks resolution %u",
+                     schedclass_get_name(item->priority),
+                     item->srcfile_path, item->url,
+                     method == XFER_METHOD_POST ? "POST" : "PUT",
+                     item->item_id, item->total_ticks);
+            events_from_user_send(item->priority, event);
+            failed = false;
+        }
+        else
+            xferitem_free(item);
+    }
+
+    if(failed)
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                              "Failed queuing upload to URL \"%s\"", url);
+
+    return TRUE;
+}
+
+static bool send_cancel(const struct RegistryEntry *entry)
+{
+    struct EventFromUser *event = events_from_user_new_cancel(entry->item_id);
+
+    if(event == NULL)
+        return false;
+
+    events_from_user_send(entry->priority, event);
+
+    return true;
+}
+
 gboolean dbusmethod_transfer_cancel(tdbusFileTransfer *object,
                                     GDBusMethodInvocation *invocation,
                                     guint item_id)
 {
     enter_handler(invocation);
 
-    struct EventFromUser *event;
+    const struct RegistryEntry *entry;
 
     if(item_id == 0)
         g_dbus_method_invocation_return_error(invocation,
                                               G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
                                               "Item ID 0 is invalid");
-    else if((event = events_from_user_new_cancel(item_id)) == NULL)
+    else if((entry = registry_lookup(item_id)) == NULL)
+    {
+        tdbus_file_transfer_complete_cancel(object, invocation);
+        msg_info("Cancel download of ID %u: not queued", item_id);
+    }
+    else if(!send_cancel(entry))
         g_dbus_method_invocation_return_error(invocation,
                                               G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
                                               "Failed creating cancel event");
@@ -91,8 +688,479 @@ gboolean dbusmethod_transfer_cancel(tdbusFileTransfer *object,
     {
         tdbus_file_transfer_complete_cancel(object, invocation);
         msg_info("Cancel download of ID %u", item_id);
-        events_from_user_send(event);
     }
 
     return TRUE;
 }
+
+gboolean dbusmethod_transfer_cancel_all(tdbusFileTransfer *object,
+                                        GDBusMethodInvocation *invocation)
+{
+    enter_handler(invocation);
+
+    struct EventFromUser *events[XFER_PRIORITY_LAST + 1];
+
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+    {
+        events[i] = events_from_user_new_cancel_all();
+
+        if(events[i] == NULL)
+        {
+            while(i > 0)
+                events_from_user_free(events[--i]);
+
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                                  "Failed creating cancel event");
+            return TRUE;
+        }
+    }
+
+    const unsigned int count = registry_get_count();
+
+    tdbus_file_transfer_complete_cancel_all(object, invocation, count);
+    msg_info("Cancel all %u downloads", count);
+
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+        events_from_user_send(i, events[i]);
+
+    return TRUE;
+}
+
+/*!
+ * Send pause or resume event for a download.
+ *
+ * \returns
+ *     True on success, false on error. An error is returned to the D-Bus
+ *     caller in the latter case.
+ */
+static bool send_pause(GDBusMethodInvocation *invocation, guint item_id,
+                       bool is_paused)
+{
+    const struct RegistryEntry *entry;
+
+    if(item_id == 0)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Item ID 0 is invalid");
+        return false;
+    }
+
+    if((entry = registry_lookup(item_id)) == NULL)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Unknown item ID %u", item_id);
+        return false;
+    }
+
+    struct EventFromUser *event = is_paused
+        ? events_from_user_new_pause(item_id)
+        : events_from_user_new_resume(item_id);
+
+    if(event == NULL)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                              "Failed creating %s event",
+                                              is_paused ? "pause" : "resume");
+        return false;
+    }
+
+    events_from_user_send(entry->priority, event);
+    msg_info("%s transfer of ID %u", is_paused ? "Pause" : "Resume", item_id);
+
+    return true;
+}
+
+/*!
+ * Pause a running transfer without closing its connection.
+ *
+ * Transfers which have not been started yet are not affected.
+ */
+gboolean dbusmethod_transfer_pause(tdbusFileTransfer *object,
+                                   GDBusMethodInvocation *invocation,
+                                   guint item_id)
+{
+    enter_handler(invocation);
+
+    if(send_pause(invocation, item_id, true))
+        tdbus_file_transfer_complete_pause(object, invocation);
+
+    return TRUE;
+}
+
+gboolean dbusmethod_transfer_resume(tdbusFileTransfer *object,
+                                    GDBusMethodInvocation *invocation,
+                                    guint item_id)
+{
+    enter_handler(invocation);
+
+    if(send_pause(invocation, item_id, false))
+        tdbus_file_transfer_complete_resume(object, invocation);
+
+    return TRUE;
+}
+
+/*!
+ * Send pause or resume event to the transfer threads of a priority class,
+ * or to all of them if \p class_name is empty.
+ *
+ * \returns
+ *     True on success, false on error. An error is returned to the D-Bus
+ *     caller in the latter case.
+ */
+static bool send_pause_all(GDBusMethodInvocation *invocation,
+                           const gchar *class_name, bool is_paused)
+{
+    enum XferPriority first = 0;
+    enum XferPriority last = XFER_PRIORITY_LAST;
+
+    if(class_name[0] != '\0')
+    {
+        if(!schedclass_parse_name(class_name, &first))
+        {
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Invalid priority \"%s\"",
+                                                  class_name);
+            return false;
+        }
+
+        last = first;
+    }
+
+    struct EventFromUser *events[XFER_PRIORITY_LAST + 1];
+
+    for(unsigned int i = first; i <= last; ++i)
+    {
+        events[i] = is_paused
+            ? events_from_user_new_pause_all()
+            : events_from_user_new_resume_all();
+
+        if(events[i] == NULL)
+        {
+            while(i > first)
+                events_from_user_free(events[--i]);
+
+            g_dbus_method_invocation_return_error(invocation,
+                                                  G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                                  "Failed creating %s event",
+                                                  is_paused ? "pause" : "resume");
+            return false;
+        }
+    }
+
+    for(unsigned int i = first; i <= last; ++i)
+        events_from_user_send(i, events[i]);
+
+    msg_info("%s %s transfers", is_paused ? "Pause" : "Resume",
+             class_name[0] != '\0' ? class_name : "all");
+
+    return true;
+}
+
+/*!
+ * Pause running transfers of a priority class and stop starting queued
+ * ones, all classes if \p class_name is empty.
+ */
+gboolean dbusmethod_transfer_pause_all(tdbusFileTransfer *object,
+                                       GDBusMethodInvocation *invocation,
+                                       const gchar *class_name)
+{
+    enter_handler(invocation);
+
+    if(send_pause_all(invocation, class_name, true))
+        tdbus_file_transfer_complete_pause_all(object, invocation);
+
+    return TRUE;
+}
+
+gboolean dbusmethod_transfer_resume_all(tdbusFileTransfer *object,
+                                        GDBusMethodInvocation *invocation,
+                                        const gchar *class_name)
+{
+    enter_handler(invocation);
+
+    if(send_pause_all(invocation, class_name, false))
+        tdbus_file_transfer_complete_resume_all(object, invocation);
+
+    return TRUE;
+}
+
+struct CancelContext
+{
+    unsigned int failed;
+};
+
+static void cancel_entry(const struct RegistryEntry *entry, void *user_data)
+{
+    struct CancelContext *ctx = user_data;
+
+    if(!send_cancel(entry))
+        ++ctx->failed;
+}
+
+/*!
+ * Cancel downloads requested by a client.
+ *
+ * An empty \p sender refers to the calling client.
+ */
+gboolean dbusmethod_transfer_cancel_by_sender(tdbusFileTransfer *object,
+                                              GDBusMethodInvocation *invocation,
+                                              const gchar *sender)
+{
+    enter_handler(invocation);
+
+    if(sender[0] == '\0')
+        sender = g_dbus_method_invocation_get_sender(invocation);
+
+    struct CancelContext ctx = { .failed = 0 };
+    const unsigned int count =
+        sender != NULL
+        ? registry_foreach_by_sender(sender, cancel_entry, &ctx)
+        : 0;
+
+    if(ctx.failed > 0)
+        msg_error(0, LOG_ERR, "Failed canceling %u downloads", ctx.failed);
+
+    tdbus_file_transfer_complete_cancel_by_sender(object, invocation,
+                                                  count - ctx.failed);
+    msg_info("Canceled %u downloads of client '%s'", count - ctx.failed,
+             sender != NULL ? sender : "");
+
+    return TRUE;
+}
+
+gboolean dbusmethod_transfer_cancel_by_tag(tdbusFileTransfer *object,
+                                           GDBusMethodInvocation *invocation,
+                                           const gchar *tag)
+{
+    enter_handler(invocation);
+
+    struct CancelContext ctx = { .failed = 0 };
+    const unsigned int count =
+        registry_foreach_by_tag(tag, cancel_entry, &ctx);
+
+    if(ctx.failed > 0)
+        msg_error(0, LOG_ERR, "Failed canceling %u downloads", ctx.failed);
+
+    tdbus_file_transfer_complete_cancel_by_tag(object, invocation,
+                                               count - ctx.failed);
+    msg_info("Canceled %u downloads tagged \"%s\"", count - ctx.failed, tag);
+
+    return TRUE;
+}
+
+/*!
+ * Status of a download as reported to clients.
+ */
+struct TransferInfo
+{
+    const struct RegistryEntry *entry;
+    struct XferStatusSnapshot status;
+
+    /*! Number of downloads of the same priority class queued before this
+     *  one, 0 if not queued. */
+    uint32_t position;
+};
+
+static void collect_transfer(const struct RegistryEntry *entry,
+                             void *user_data)
+{
+    GArray *infos = user_data;
+    struct TransferInfo info = { .entry = entry, .position = 0 };
+
+    xferstatus_read(entry->status, &info.status);
+    g_array_append_val(infos, info);
+}
+
+/*
+ * Downloads are queued per priority class, earliest deadline first, then
+ * in order of their IDs.
+ */
+static gint compare_queue_order_of_entries(const struct RegistryEntry *ea,
+                                           const struct RegistryEntry *eb)
+{
+    if(ea->priority != eb->priority)
+        return ea->priority < eb->priority ? -1 : 1;
+
+    if(ea->deadline != eb->deadline)
+    {
+        if(ea->deadline == 0 || eb->deadline == 0)
+            return ea->deadline != 0 ? -1 : 1;
+
+        return ea->deadline < eb->deadline ? -1 : 1;
+    }
+
+    if(ea->item_id != eb->item_id)
+        return ea->item_id < eb->item_id ? -1 : 1;
+
+    return 0;
+}
+
+static gint compare_queue_order(gconstpointer a, gconstpointer b)
+{
+    return compare_queue_order_of_entries(
+                ((const struct TransferInfo *)a)->entry,
+                ((const struct TransferInfo *)b)->entry);
+}
+
+static void add_transfer_info(GVariantBuilder *builder,
+                              const struct TransferInfo *info)
+{
+    g_variant_builder_add(builder, "(uyytttut)",
+                          info->entry->item_id,
+                          (guchar)info->status.state,
+                          (guchar)info->entry->priority,
+                          info->status.bytes, info->status.total,
+                          info->status.rate, info->position,
+                          (guint64)(info->status.paused_us / 1000));
+}
+
+gboolean dbusmethod_get_transfers(tdbusFileTransfer *object,
+                                  GDBusMethodInvocation *invocation)
+{
+    enter_handler(invocation);
+
+    GArray *infos = g_array_sized_new(FALSE, FALSE, sizeof(struct TransferInfo),
+                                      registry_get_count());
+
+    registry_foreach(collect_transfer, infos);
+    g_array_sort(infos, compare_queue_order);
+
+    uint32_t queued_ahead[XFER_PRIORITY_LAST + 1] = { 0 };
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(uyytttut)"));
+
+    for(guint i = 0; i < infos->len; ++i)
+    {
+        struct TransferInfo *info = &g_array_index(infos, struct TransferInfo, i);
+
+        if(info->status.state == XFER_STATE_QUEUED)
+            info->position = queued_ahead[info->entry->priority]++;
+
+        add_transfer_info(&builder, info);
+    }
+
+    g_array_free(infos, TRUE);
+
+    tdbus_file_transfer_complete_get_transfers(object, invocation,
+                                               g_variant_builder_end(&builder));
+
+    return TRUE;
+}
+
+struct CountQueuedAhead
+{
+    const struct RegistryEntry *entry;
+    uint32_t count;
+};
+
+static void count_queued_ahead(const struct RegistryEntry *entry,
+                               void *user_data)
+{
+    struct CountQueuedAhead *ctx = user_data;
+
+    if(entry->priority != ctx->entry->priority ||
+       compare_queue_order_of_entries(entry, ctx->entry) >= 0)
+        return;
+
+    struct XferStatusSnapshot status;
+    xferstatus_read(entry->status, &status);
+
+    if(status.state == XFER_STATE_QUEUED)
+        ++ctx->count;
+}
+
+gboolean dbusmethod_get_transfer(tdbusFileTransfer *object,
+                                 GDBusMethodInvocation *invocation,
+                                 guint item_id)
+{
+    enter_handler(invocation);
+
+    const struct RegistryEntry *entry = registry_lookup(item_id);
+
+    if(entry == NULL)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Unknown item ID %u", item_id);
+        return TRUE;
+    }
+
+    struct TransferInfo info = { .entry = entry, .position = 0 };
+    xferstatus_read(entry->status, &info.status);
+
+    if(info.status.state == XFER_STATE_QUEUED)
+    {
+        struct CountQueuedAhead ctx = { .entry = entry, .count = 0 };
+        registry_foreach(count_queued_ahead, &ctx);
+        info.position = ctx.count;
+    }
+
+    tdbus_file_transfer_complete_get_transfer(object, invocation,
+                                              info.status.state,
+                                              entry->priority,
+                                              info.status.bytes,
+                                              info.status.total,
+                                              info.status.rate,
+                                              info.position,
+                                              info.status.paused_us / 1000);
+
+    return TRUE;
+}
+
+gboolean dbusmethod_get_statistics(tdbusFileTransfer *object,
+                                   GDBusMethodInvocation *invocation)
+{
+    enter_handler(invocation);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+
+    for(unsigned int i = 0; i <= STATS_LAST_COUNTER; ++i)
+        g_variant_builder_add(&builder, "{st}",
+                              stats_get_name(i), stats_get(i));
+
+    tdbus_file_transfer_complete_get_statistics(object, invocation,
+                                                g_variant_builder_end(&builder));
+
+    return TRUE;
+}
+
+gboolean dbusmethod_get_trace_records(tdbusFileTransfer *object,
+                                      GDBusMethodInvocation *invocation)
+{
+    enter_handler(invocation);
+
+    struct FlightrecRecord *records =
+        g_try_malloc(FLIGHTREC_SIZE * sizeof(*records));
+
+    if(records == NULL)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_NO_MEMORY,
+                                              "Failed copying trace records");
+        return TRUE;
+    }
+
+    const size_t count = flightrec_snapshot(records, FLIGHTREC_SIZE);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(tqut)"));
+
+    for(size_t i = 0; i < count; ++i)
+        g_variant_builder_add(&builder, "(tqut)",
+                              records[i].timestamp_us,
+                              (guint16)records[i].event,
+                              records[i].item_id, records[i].arg);
+
+    g_free(records);
+
+    tdbus_file_transfer_complete_get_trace_records(object, invocation,
+                                                   g_variant_builder_end(&builder));
+
+    return TRUE;
+}
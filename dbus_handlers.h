@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -31,9 +31,48 @@ extern "C" {
 gboolean dbusmethod_download_start(tdbusFileTransfer *object,
                                    GDBusMethodInvocation *invocation,
                                    const gchar *url, guint ticks);
+gboolean dbusmethod_download_to(tdbusFileTransfer *object,
+                                GDBusMethodInvocation *invocation,
+                                GUnixFDList *fd_list,
+                                const gchar *url, guint ticks,
+                                const gchar *destination, GVariant *options);
+gboolean dbusmethod_upload(tdbusFileTransfer *object,
+                           GDBusMethodInvocation *invocation,
+                           const gchar *path, const gchar *url,
+                           const gchar *method_name, guint ticks,
+                           GVariant *options);
 gboolean dbusmethod_transfer_cancel(tdbusFileTransfer *object,
                                     GDBusMethodInvocation *invocation,
                                     guint item_id);
+gboolean dbusmethod_transfer_cancel_all(tdbusFileTransfer *object,
+                                        GDBusMethodInvocation *invocation);
+gboolean dbusmethod_transfer_cancel_by_sender(tdbusFileTransfer *object,
+                                              GDBusMethodInvocation *invocation,
+                                              const gchar *sender);
+gboolean dbusmethod_transfer_cancel_by_tag(tdbusFileTransfer *object,
+                                           GDBusMethodInvocation *invocation,
+                                           const gchar *tag);
+gboolean dbusmethod_transfer_pause(tdbusFileTransfer *object,
+                                   GDBusMethodInvocation *invocation,
+                                   guint item_id);
+gboolean dbusmethod_transfer_resume(tdbusFileTransfer *object,
+                                    GDBusMethodInvocation *invocation,
+                                    guint item_id);
+gboolean dbusmethod_transfer_pause_all(tdbusFileTransfer *object,
+                                       GDBusMethodInvocation *invocation,
+                                       const gchar *class_name);
+gboolean dbusmethod_transfer_resume_all(tdbusFileTransfer *object,
+                                        GDBusMethodInvocation *invocation,
+                                        const gchar *class_name);
+gboolean dbusmethod_get_transfers(tdbusFileTransfer *object,
+                                  GDBusMethodInvocation *invocation);
+gboolean dbusmethod_get_transfer(tdbusFileTransfer *object,
+                                 GDBusMethodInvocation *invocation,
+                                 guint item_id);
+gboolean dbusmethod_get_statistics(tdbusFileTransfer *object,
+                                   GDBusMethodInvocation *invocation);
+gboolean dbusmethod_get_trace_records(tdbusFileTransfer *object,
+                                      GDBusMethodInvocation *invocation);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019, 2020, 2023  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2020, 2023, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -29,6 +29,9 @@
 #include "dbus_handlers.h"
 #include "de_tahifi_filetransfer.h"
 #include "events.h"
+#include "registry.h"
+#include "flightrec.h"
+#include "probes.h"
 #include "messages.h"
 
 struct dbus_data
@@ -36,6 +39,9 @@ struct dbus_data
     guint owner_id;
     int name_acquired;
 
+    /*! Send signals about an item only to the client which requested it. */
+    bool unicast_signals;
+
     tdbusFileTransfer *filetransfer_iface;
 };
 
@@ -76,8 +82,34 @@ static void bus_acquired(GDBusConnection *connection,
 
     g_signal_connect(data->filetransfer_iface, "handle-download",
                      G_CALLBACK(dbusmethod_download_start), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-download-to",
+                     G_CALLBACK(dbusmethod_download_to), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-upload",
+                     G_CALLBACK(dbusmethod_upload), NULL);
     g_signal_connect(data->filetransfer_iface, "handle-cancel",
                      G_CALLBACK(dbusmethod_transfer_cancel), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-cancel-all",
+                     G_CALLBACK(dbusmethod_transfer_cancel_all), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-cancel-by-sender",
+                     G_CALLBACK(dbusmethod_transfer_cancel_by_sender), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-cancel-by-tag",
+                     G_CALLBACK(dbusmethod_transfer_cancel_by_tag), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-pause",
+                     G_CALLBACK(dbusmethod_transfer_pause), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-resume",
+                     G_CALLBACK(dbusmethod_transfer_resume), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-pause-all",
+                     G_CALLBACK(dbusmethod_transfer_pause_all), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-resume-all",
+                     G_CALLBACK(dbusmethod_transfer_resume_all), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-get-transfers",
+                     G_CALLBACK(dbusmethod_get_transfers), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-get-transfer",
+                     G_CALLBACK(dbusmethod_get_transfer), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-get-statistics",
+                     G_CALLBACK(dbusmethod_get_statistics), NULL);
+    g_signal_connect(data->filetransfer_iface, "handle-get-trace-records",
+                     G_CALLBACK(dbusmethod_get_trace_records), NULL);
 
     try_export_iface(connection, G_DBUS_INTERFACE_SKELETON(data->filetransfer_iface));
 }
@@ -107,6 +139,88 @@ static void destroy_notification(gpointer user_data)
 
 static struct dbus_data dbus_data;
 
+/*!
+ * Determine the peer a signal about the given item should be sent to.
+ *
+ * \returns
+ *     The unique bus name of the client which requested the item, or
+ *     \c NULL if the signal should be broadcast.
+ */
+static const char *get_signal_destination(uint32_t item_id)
+{
+    if(!dbus_data.unicast_signals)
+        return NULL;
+
+    const struct RegistryEntry *entry = registry_lookup(item_id);
+
+    return entry != NULL ? entry->sender : NULL;
+}
+
+static void emit_unicast_signal(const char *destination,
+                                const char *signal_name, GVariant *parameters)
+{
+    GDBusConnection *connection =
+        g_dbus_interface_skeleton_get_connection(
+            G_DBUS_INTERFACE_SKELETON(dbus_data.filetransfer_iface));
+    GError *error = NULL;
+
+    g_dbus_connection_emit_signal(connection, destination,
+                                  "/de/tahifi/DBusDL", "de.tahifi.FileTransfer",
+                                  signal_name, parameters, &error);
+    handle_dbus_error(&error);
+}
+
+static void emit_done(const struct XferItem *item,
+                      enum DBusListsErrorCode error_code)
+{
+    const char *path =
+        error_code == LIST_ERROR_OK && item->destfile_path != NULL
+        ? item->destfile_path
+        : "";
+    const char *destination = get_signal_destination(item->item_id);
+
+    flightrec_record(FLIGHTREC_SIGNAL_DONE, item->item_id, error_code);
+    DBUSDL_PROBE3(signal_done, item->item_id, error_code, destination != NULL);
+
+    if(destination != NULL)
+        emit_unicast_signal(destination, "Done",
+                            g_variant_new("(uys)", item->item_id,
+                                          (guchar)error_code, path));
+    else
+        tdbus_file_transfer_emit_done(dbus_data.filetransfer_iface,
+                                      item->item_id, error_code, path);
+
+    /* destination points into the registry entry */
+    registry_remove(item->item_id);
+}
+
+/*!
+ * Send data downloaded to memory to the client.
+ */
+static void emit_done_with_content(const struct XferItem *item)
+{
+    const char *destination = get_signal_destination(item->item_id);
+    GVariant *content =
+        g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                  item->content->data, item->content->len,
+                                  sizeof(guint8));
+
+    flightrec_record(FLIGHTREC_SIGNAL_DONE, item->item_id, LIST_ERROR_OK);
+    DBUSDL_PROBE3(signal_done_with_content, item->item_id,
+                  item->content->len, destination != NULL);
+
+    if(destination != NULL)
+        emit_unicast_signal(destination, "DoneWithContent",
+                            g_variant_new("(uy@ay)", item->item_id,
+                                          (guchar)LIST_ERROR_OK, content));
+    else
+        tdbus_file_transfer_emit_done_with_content(dbus_data.filetransfer_iface,
+                                                   item->item_id,
+                                                   LIST_ERROR_OK, content);
+
+    registry_remove(item->item_id);
+}
+
 gboolean dbus_poll_event_queue(gpointer user_data)
 {
     while(1)
@@ -114,7 +228,7 @@ gboolean dbus_poll_event_queue(gpointer user_data)
         struct EventToUser *event = events_to_user_receive(false);
 
         if(event == NULL)
-            return G_SOURCE_REMOVE;
+            return G_SOURCE_CONTINUE;
 
         switch(event->event_id)
         {
@@ -122,25 +236,34 @@ gboolean dbus_poll_event_queue(gpointer user_data)
             {
                 const struct XferItem *item = event->xi.const_item;
 
-                tdbus_file_transfer_emit_progress(dbus_data.filetransfer_iface,
-                                                  item->item_id,
-                                                  event->d.tick,
-                                                  item->total_ticks);
+                const char *destination =
+                    get_signal_destination(item->item_id);
+
+                flightrec_record(FLIGHTREC_SIGNAL_PROGRESS,
+                                 item->item_id, event->d.tick);
+                DBUSDL_PROBE3(signal_progress, item->item_id, event->d.tick,
+                              item->total_ticks);
+
+                if(destination != NULL)
+                    emit_unicast_signal(destination, "Progress",
+                                        g_variant_new("(uuu)", item->item_id,
+                                                      event->d.tick,
+                                                      item->total_ticks));
+                else
+                    tdbus_file_transfer_emit_progress(dbus_data.filetransfer_iface,
+                                                      item->item_id,
+                                                      event->d.tick,
+                                                      item->total_ticks);
             }
 
             break;
 
           case EVENT_TO_USER_DONE:
-            {
-                const struct XferItem *item = event->xi.const_item;
-                const char *path = event->d.error_code == LIST_ERROR_OK
-                    ? item->destfile_path
-                    : "";
-
-                tdbus_file_transfer_emit_done(dbus_data.filetransfer_iface,
-                                              item->item_id,
-                                              event->d.error_code, path);
-            }
+            if(event->d.error_code == LIST_ERROR_OK &&
+               event->xi.const_item->content != NULL)
+                emit_done_with_content(event->xi.const_item);
+            else
+                emit_done(event->xi.const_item, event->d.error_code);
 
             break;
         }
@@ -149,9 +272,10 @@ gboolean dbus_poll_event_queue(gpointer user_data)
     }
 }
 
-int dbus_setup(GMainLoop *loop, const char *bus_name)
+int dbus_setup(GMainLoop *loop, const char *bus_name, bool unicast_signals)
 {
     memset(&dbus_data, 0, sizeof(dbus_data));
+    dbus_data.unicast_signals = unicast_signals;
 
     dbus_data.owner_id =
         g_bus_own_name(G_BUS_TYPE_SESSION, bus_name,
@@ -23,12 +23,13 @@
 #define DBUS_IFACE_H
 
 #include <glib.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int dbus_setup(GMainLoop *loop, const char *bus_name);
+int dbus_setup(GMainLoop *loop, const char *bus_name, bool unicast_signals);
 void dbus_shutdown(GMainLoop *loop);
 gboolean dbus_poll_event_queue(gpointer user_data);
 
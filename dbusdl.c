@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -27,12 +27,23 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glib-unix.h>
 
 #include "dbus_iface.h"
 #include "events.h"
+#include "registry.h"
 #include "xferthread.h"
+#include "asynclog.h"
+#include "flightrec.h"
+#include "membudget.h"
+#include "hostprofile.h"
+#include "storagetier.h"
+#include "pathroots.h"
+#include "transport.h"
 #include "messages.h"
 #include "versioninfo.h"
 
@@ -86,6 +97,26 @@ static int setup(bool run_in_foreground)
     return 0;
 }
 
+#define DEFAULT_MAX_TRANSFERS           4U
+#define DEFAULT_MAX_HOST_CONNECTIONS    2U
+#define DEFAULT_MAX_STREAMS             100U
+#define DEFAULT_PREWARM_LOOKAHEAD       2U
+#define DEFAULT_TRACE_FILE              "/tmp/dbusdl-trace.txt"
+#define DEFAULT_MEMORY_BUDGET_KIB       4096U
+#define DEFAULT_MEMORY_PRESSURE         10U
+#define DEFAULT_STALL_WINDOW            15U
+#define DEFAULT_STALL_SPEED             1024U
+#define DEFAULT_BATCH_WINDOW            0U
+#define DEFAULT_MAX_EXTRACTED_MIB       1024U
+#define DEFAULT_MAX_EXTRACTED_ENTRIES   10000U
+#define DEFAULT_MAX_IN_MEMORY_KIB       64U
+#define DEFAULT_HOST_PROFILES           "/var/local/lib/dbusdl/hosts.ini"
+
+/*!
+ * How often learned host profiles are written to file.
+ */
+#define HOST_PROFILES_SAVE_INTERVAL_S   600U
+
 static void usage(const char *program_name)
 {
     printf("Usage: %s [options]\n"
@@ -94,21 +125,216 @@ static void usage(const char *program_name)
            "  --help         Show this help.\n"
            "  --version      Print version information to stdout.\n"
            "  --fg           Run in foreground, don't run as daemon.\n"
-           "  --tmpdir PATH  Download files to directory PATH.\n",
-           program_name);
+           "  --tmpdir PATH  Download files to directory PATH.\n"
+           "  --max-transfers N\n"
+           "                 Run up to N downloads of each priority class\n"
+           "                 concurrently (default: %u).\n"
+           "  --max-host-connections N\n"
+           "                 Open at most N connections per host, 0 for no\n"
+           "                 limit (default: %u). The connections are split\n"
+           "                 among priority classes, with at least one per\n"
+           "                 class. Connections are not shared by classes.\n"
+           "  --max-streams N\n"
+           "                 Multiplex at most N HTTP/2 streams over a single\n"
+           "                 connection (default: %u).\n"
+           "  --prewarm MODE\n"
+           "                 Prepare queued downloads in advance, MODE is one\n"
+           "                 of \"none\", \"dns\", or \"connect\" (default: dns).\n"
+           "  --prewarm-lookahead N\n"
+           "                 Prepare up to N queued downloads (default: %u).\n"
+           "  --trace-file PATH\n"
+           "                 Write flight recorder contents to PATH on SIGUSR1\n"
+           "                 (default: %s).\n"
+           "  --memory-budget KIB\n"
+           "                 Keep buffers and queued downloads within KIB\n"
+           "                 kilobytes, 0 for no limit (default: %u).\n"
+           "                 Downloads are rejected while queued downloads\n"
+           "                 take more than half of it.\n"
+           "  --memory-pressure PERCENT\n"
+           "                 Reduce memory usage while the kernel reports\n"
+           "                 memory stalls of at least PERCENT, 0 to ignore\n"
+           "                 (default: %u).\n"
+           "  --stall-window SECONDS\n"
+           "                 Average download throughput over SECONDS seconds\n"
+           "                 for detecting stalled downloads, up to %u, 0 to\n"
+           "                 disable hedged requests (default: %u).\n"
+           "  --stall-speed BYTES\n"
+           "                 Start a hedged request for downloads slower than\n"
+           "                 BYTES bytes per second (default: %u).\n"
+           "  --batch-window MS\n"
+           "                 Collect background downloads for MS milliseconds\n"
+           "                 and start them together, 0 to start them right\n"
+           "                 away (default: %u).\n"
+           "  --max-extracted-size MIB\n"
+           "                 Fail extraction of archives containing more than\n"
+           "                 MIB mebibytes of files, 0 for no limit\n"
+           "                 (default: %u).\n"
+           "  --max-extracted-entries N\n"
+           "                 Fail extraction of archives containing more than\n"
+           "                 N files and directories, 0 for no limit\n"
+           "                 (default: %u).\n"
+           "  --host-profiles PATH\n"
+           "                 Store settings learned per host in PATH, empty\n"
+           "                 to keep them in memory only (default: %s).\n"
+           "  --max-in-memory KIB\n"
+           "                 Keep downloads requested to memory in memory if\n"
+           "                 not larger than KIB kilobytes, 0 to always write\n"
+           "                 them to file (default: %u).\n"
+           "  --storage-tier PATH[:KIB]\n"
+           "                 Store downloads in directory PATH, limited to\n"
+           "                 files of up to KIB kilobytes if given. May be\n"
+           "                 given up to %u times, fastest storage first.\n"
+           "                 Overrides --tmpdir for downloads (default: none).\n"
+           "  --allow-path PATH\n"
+           "                 Allow clients to upload files from, download\n"
+           "                 file:// URLs from, and download files to\n"
+           "                 directory PATH. May be given up to %u times. The\n"
+           "                 download directory and the storage tiers are\n"
+           "                 always allowed.\n"
+           "  --unicast-signals\n"
+           "                 Send Progress and Done signals only to the client\n"
+           "                 which requested the transfer instead of\n"
+           "                 broadcasting them.\n"
+           "  --mock-transport PATH\n"
+           "                 Do not access the network, serve scripted\n"
+           "                 responses from PATH instead. For tests and\n"
+           "                 benchmarks only.\n",
+           program_name,
+           DEFAULT_MAX_TRANSFERS, DEFAULT_MAX_HOST_CONNECTIONS,
+           DEFAULT_MAX_STREAMS, DEFAULT_PREWARM_LOOKAHEAD, DEFAULT_TRACE_FILE,
+           DEFAULT_MEMORY_BUDGET_KIB, DEFAULT_MEMORY_PRESSURE,
+           XFER_STALL_WINDOW_MAX_SECONDS, DEFAULT_STALL_WINDOW,
+           DEFAULT_STALL_SPEED, DEFAULT_BATCH_WINDOW,
+           DEFAULT_MAX_EXTRACTED_MIB, DEFAULT_MAX_EXTRACTED_ENTRIES,
+           DEFAULT_HOST_PROFILES,
+           DEFAULT_MAX_IN_MEMORY_KIB, STORAGETIER_MAX_TIERS,
+           PATHROOTS_MAX_EXTRA_ROOTS);
 }
 
+struct StorageTierParameters
+{
+    const char *path;
+    uint64_t max_file_size;
+};
+
 struct Parameters
 {
     bool run_in_foreground;
+    bool unicast_signals;
     const char *download_path;
+    const char *trace_file;
+    const char *host_profiles_file;
+    const char *mock_transport_script;
+    unsigned int memory_budget_kib;
+    unsigned int memory_pressure;
+    unsigned int max_in_memory_kib;
+    struct StorageTierParameters storage_tiers[STORAGETIER_MAX_TIERS];
+    unsigned int storage_tiers_count;
+    const char *allowed_paths[PATHROOTS_MAX_EXTRA_ROOTS];
+    unsigned int allowed_paths_count;
+    struct XferConfig xfer_config;
 };
 
+static bool parse_unsigned(const char *option, const char *arg,
+                           unsigned int min_value, unsigned int *value)
+{
+    char *endptr;
+
+    errno = 0;
+    const unsigned long temp = strtoul(arg, &endptr, 10);
+
+    if(errno != 0 || *endptr != '\0' || *arg == '\0' || *arg == '-' ||
+       temp < min_value || temp > UINT_MAX)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for option %s.\n", arg, option);
+        return false;
+    }
+
+    *value = temp;
+    return true;
+}
+
+/*!
+ * Parse argument of option --storage-tier, which is modified in place.
+ */
+static bool parse_storage_tier(char *arg, struct Parameters *parameters)
+{
+    if(parameters->storage_tiers_count >= STORAGETIER_MAX_TIERS)
+    {
+        fprintf(stderr, "Too many storage tiers, at most %u are supported.\n",
+                STORAGETIER_MAX_TIERS);
+        return false;
+    }
+
+    struct StorageTierParameters *tier =
+        &parameters->storage_tiers[parameters->storage_tiers_count];
+    char *sep = strrchr(arg, ':');
+    unsigned int max_file_size_kib = 0;
+
+    if(sep != NULL)
+    {
+        *sep = '\0';
+
+        if(!parse_unsigned("--storage-tier", sep + 1, 1, &max_file_size_kib))
+            return false;
+    }
+
+    if(arg[0] == '\0')
+    {
+        fprintf(stderr, "Storage tier path must not be empty.\n");
+        return false;
+    }
+
+    tier->path = arg;
+    tier->max_file_size = (uint64_t)max_file_size_kib * 1024U;
+    ++parameters->storage_tiers_count;
+
+    return true;
+}
+
+static bool parse_prewarm_mode(const char *arg, enum XferPrewarm *mode)
+{
+    if(strcmp(arg, "none") == 0)
+        *mode = XFER_PREWARM_NONE;
+    else if(strcmp(arg, "dns") == 0)
+        *mode = XFER_PREWARM_DNS;
+    else if(strcmp(arg, "connect") == 0)
+        *mode = XFER_PREWARM_CONNECTION;
+    else
+    {
+        fprintf(stderr, "Invalid prewarm mode \"%s\".\n", arg);
+        return false;
+    }
+
+    return true;
+}
+
 static int process_command_line(int argc, char *argv[],
                                 struct Parameters *parameters)
 {
     parameters->run_in_foreground = false;
+    parameters->unicast_signals = false;
     parameters->download_path = "/tmp/downloads";
+    parameters->trace_file = DEFAULT_TRACE_FILE;
+    parameters->host_profiles_file = DEFAULT_HOST_PROFILES;
+    parameters->mock_transport_script = NULL;
+    parameters->memory_budget_kib = DEFAULT_MEMORY_BUDGET_KIB;
+    parameters->memory_pressure = DEFAULT_MEMORY_PRESSURE;
+    parameters->max_in_memory_kib = DEFAULT_MAX_IN_MEMORY_KIB;
+    parameters->storage_tiers_count = 0;
+    parameters->allowed_paths_count = 0;
+    parameters->xfer_config.max_transfers = DEFAULT_MAX_TRANSFERS;
+    parameters->xfer_config.max_host_connections = DEFAULT_MAX_HOST_CONNECTIONS;
+    parameters->xfer_config.max_streams_per_connection = DEFAULT_MAX_STREAMS;
+    parameters->xfer_config.prewarm = XFER_PREWARM_DNS;
+    parameters->xfer_config.prewarm_lookahead = DEFAULT_PREWARM_LOOKAHEAD;
+    parameters->xfer_config.stall_window_seconds = DEFAULT_STALL_WINDOW;
+    parameters->xfer_config.stall_speed_limit = DEFAULT_STALL_SPEED;
+    parameters->xfer_config.batch_window_ms = DEFAULT_BATCH_WINDOW;
+    parameters->xfer_config.max_extracted_mib = DEFAULT_MAX_EXTRACTED_MIB;
+    parameters->xfer_config.max_extracted_entries =
+        DEFAULT_MAX_EXTRACTED_ENTRIES;
+    parameters->xfer_config.mock_script = NULL;
 
 #define CHECK_ARGUMENT() \
     do \
@@ -130,11 +356,146 @@ static int process_command_line(int argc, char *argv[],
             return 2;
         else if(strcmp(argv[i], "--fg") == 0)
             parameters->run_in_foreground = true;
+        else if(strcmp(argv[i], "--unicast-signals") == 0)
+            parameters->unicast_signals = true;
         else if(strcmp(argv[i], "--tmpdir") == 0)
         {
             CHECK_ARGUMENT();
             parameters->download_path = argv[i];
         }
+        else if(strcmp(argv[i], "--storage-tier") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_storage_tier(argv[i], parameters))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--allow-path") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(parameters->allowed_paths_count >= PATHROOTS_MAX_EXTRA_ROOTS)
+            {
+                fprintf(stderr, "Too many allowed paths, at most %u are "
+                        "supported.\n", PATHROOTS_MAX_EXTRA_ROOTS);
+                return -1;
+            }
+
+            parameters->allowed_paths[parameters->allowed_paths_count++] =
+                argv[i];
+        }
+        else if(strcmp(argv[i], "--prewarm") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_prewarm_mode(argv[i], &parameters->xfer_config.prewarm))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--prewarm-lookahead") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.prewarm_lookahead))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--trace-file") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->trace_file = argv[i];
+        }
+        else if(strcmp(argv[i], "--host-profiles") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->host_profiles_file = argv[i][0] != '\0' ? argv[i] : NULL;
+        }
+        else if(strcmp(argv[i], "--mock-transport") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->mock_transport_script = argv[i];
+        }
+        else if(strcmp(argv[i], "--max-transfers") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 1,
+                               &parameters->xfer_config.max_transfers))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--max-host-connections") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.max_host_connections))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--max-streams") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 1,
+                               &parameters->xfer_config.max_streams_per_connection))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--memory-budget") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->memory_budget_kib))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--max-in-memory") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->max_in_memory_kib))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--memory-pressure") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->memory_pressure))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--stall-window") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.stall_window_seconds))
+                return -1;
+
+            if(parameters->xfer_config.stall_window_seconds >
+               XFER_STALL_WINDOW_MAX_SECONDS)
+            {
+                fprintf(stderr, "Stall window must not exceed %u seconds.\n",
+                        XFER_STALL_WINDOW_MAX_SECONDS);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--batch-window") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.batch_window_ms))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--max-extracted-size") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.max_extracted_mib))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--max-extracted-entries") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 0,
+                               &parameters->xfer_config.max_extracted_entries))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--stall-speed") == 0)
+        {
+            CHECK_ARGUMENT();
+            if(!parse_unsigned(argv[i - 1], argv[i], 1,
+                               &parameters->xfer_config.stall_speed_limit))
+                return -1;
+        }
         else
         {
             fprintf(stderr, "Unknown option \"%s\". Please try --help.\n", argv[i]);
@@ -153,10 +514,69 @@ static gboolean signal_handler(gpointer user_data)
     return G_SOURCE_REMOVE;
 }
 
-static void connect_unix_signals(GMainLoop *loop)
+/*!
+ * Write flight recorder contents to trace file.
+ *
+ * The trace is written to a new file which is then renamed to the trace
+ * file name. Existing files and symlinks are never opened for writing, so
+ * that a trace file in a shared directory such as /tmp cannot be used to
+ * overwrite other files.
+ */
+static gboolean dump_flight_recorder(gpointer user_data)
+{
+    const char *filename = user_data;
+    char *temp_name = g_strconcat(filename, ".XXXXXX", NULL);
+    const int fd = g_mkstemp_full(temp_name, O_WRONLY | O_CLOEXEC, 0600);
+
+    if(fd < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed creating trace file \"%s\"",
+                  temp_name);
+        g_free(temp_name);
+        return G_SOURCE_CONTINUE;
+    }
+
+    FILE *f = fdopen(fd, "w");
+
+    if(f == NULL)
+    {
+        msg_error(errno, LOG_ERR, "Failed opening trace file \"%s\"",
+                  temp_name);
+        close(fd);
+        unlink(temp_name);
+        g_free(temp_name);
+        return G_SOURCE_CONTINUE;
+    }
+
+    int count = flightrec_dump(f);
+
+    if(fclose(f) != 0)
+        count = -1;
+
+    if(count < 0 || rename(temp_name, filename) < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed writing trace file \"%s\"", filename);
+        unlink(temp_name);
+    }
+    else
+        msg_info("Wrote %d trace records to \"%s\"", count, filename);
+
+    g_free(temp_name);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean save_host_profiles(gpointer user_data)
+{
+    hostprofile_save();
+    return G_SOURCE_CONTINUE;
+}
+
+static void connect_unix_signals(GMainLoop *loop, const char *trace_file)
 {
     g_unix_signal_add(SIGINT, signal_handler, loop);
     g_unix_signal_add(SIGTERM, signal_handler, loop);
+    g_unix_signal_add(SIGUSR1, dump_flight_recorder, (gpointer)trace_file);
 }
 
 int main(int argc, char *argv[])
@@ -180,23 +600,66 @@ int main(int argc, char *argv[])
     if(setup(parameters.run_in_foreground) < 0)
         return EXIT_FAILURE;
 
+    struct TransportMockScript *mock_script = NULL;
+
+    if(parameters.mock_transport_script != NULL)
+    {
+        mock_script =
+            transport_mock_script_load(parameters.mock_transport_script);
+
+        if(mock_script == NULL)
+            return EXIT_FAILURE;
+
+        parameters.xfer_config.mock_script = mock_script;
+    }
+
+    membudget_init((size_t)parameters.memory_budget_kib * 1024U,
+                   parameters.memory_pressure);
+    storagetier_init();
+
+    for(unsigned int i = 0; i < parameters.storage_tiers_count; ++i)
+        storagetier_add(parameters.storage_tiers[i].path,
+                        parameters.storage_tiers[i].max_file_size, true);
+
     xferitem_init(parameters.download_path, true);
+    pathroots_init();
+    pathroots_add(parameters.download_path);
+
+    for(unsigned int i = 0; i < parameters.storage_tiers_count; ++i)
+        pathroots_add(parameters.storage_tiers[i].path);
+
+    for(unsigned int i = 0; i < parameters.allowed_paths_count; ++i)
+        pathroots_add(parameters.allowed_paths[i]);
+
+    xferitem_set_content_limit((size_t)parameters.max_in_memory_kib * 1024U);
     events_init(dbus_poll_event_queue);
-    xferthread_init();
+    registry_init();
+    hostprofile_init(parameters.host_profiles_file,
+                     parameters.xfer_config.max_transfers);
+    asynclog_init(NULL);
+    xferthread_init(&parameters.xfer_config);
 
     GMainLoop *loop = create_glib_main_loop();
 
-    dbus_setup(loop, "de.tahifi.DBusDL");
+    dbus_setup(loop, "de.tahifi.DBusDL", parameters.unicast_signals);
 
-    connect_unix_signals(loop);
+    connect_unix_signals(loop, parameters.trace_file);
+    g_timeout_add_seconds(HOST_PROFILES_SAVE_INTERVAL_S,
+                          save_host_profiles, NULL);
     g_main_loop_run(loop);
 
     msg_info("Shutting down");
     dbus_shutdown(loop);
 
     xferthread_deinit();
+    asynclog_deinit();
+    hostprofile_deinit();
+    registry_deinit();
     events_deinit();
+    pathroots_deinit();
     xferitem_deinit();
+    storagetier_deinit();
+    transport_mock_script_free(mock_script);
 
     return EXIT_SUCCESS;
 }
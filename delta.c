@@ -0,0 +1,1028 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "delta.h"
+#include "asynclog.h"
+#include "messages.h"
+
+/*
+ * A manifest starts with a text header in the style of zsync control
+ * files, "Key: value" per line, terminated by an empty line:
+ *
+ *     DBusDL-Delta: 1
+ *     Length: <size of the file in bytes>
+ *     Blocksize: <block size in bytes>
+ *     Hash-Length: <bytes of SHA-256 stored per block>
+ *     SHA-256: <hex digest of the whole file>
+ *
+ * The header is followed by one record per block: the rolling checksum of
+ * the block as 32 bit big-endian number, then the first Hash-Length bytes
+ * of the SHA-256 digest of the block. The last block may be shorter than
+ * the block size, its checksums are computed over its actual length.
+ */
+
+#define MANIFEST_VERSION        1
+#define MIN_BLOCK_SIZE          512U
+#define MAX_BLOCK_SIZE          (1024U * 1024U)
+#define MIN_HASH_LENGTH         4U
+#define DIGEST_SIZE             32U
+#define SCAN_BUFFER_SIZE        (256U * 1024U)
+#define FILTER_BITS             20U
+#define MAX_FILE_LENGTH         ((uint64_t)INT64_MAX)
+#define MAX_MANIFEST_SIZE       (64 * 1024 * 1024)
+
+struct DeltaManifest
+{
+    uint64_t length;
+    size_t block_size;
+    size_t hash_length;
+    size_t block_count;
+    uint8_t digest[DIGEST_SIZE];
+
+    /*! Rolling checksum per block. */
+    uint32_t *rsums;
+
+    /*! Truncated SHA-256 per block, #DeltaManifest::hash_length bytes
+     *  each. */
+    uint8_t *hashes;
+};
+
+/*!
+ * The weak checksum of rsync, cheap to move along a file byte by byte.
+ */
+struct RollingChecksum
+{
+    uint16_t a;
+    uint16_t b;
+};
+
+static void rsum_init(struct RollingChecksum *r, const uint8_t *data,
+                      size_t len)
+{
+    r->a = 0;
+    r->b = 0;
+
+    for(size_t i = 0; i < len; ++i)
+    {
+        r->a += data[i];
+        r->b += (uint16_t)((len - i) * data[i]);
+    }
+}
+
+static void rsum_roll(struct RollingChecksum *r, uint8_t out, uint8_t in,
+                      size_t len)
+{
+    r->a += in - out;
+    r->b += r->a - (uint16_t)(len * out);
+}
+
+static uint32_t rsum_get(const struct RollingChecksum *r)
+{
+    return (uint32_t)r->b << 16 | r->a;
+}
+
+static void compute_digest(const uint8_t *data, size_t len,
+                           uint8_t digest[DIGEST_SIZE])
+{
+    GChecksum *cs = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize digest_len = DIGEST_SIZE;
+
+    g_checksum_update(cs, data, len);
+    g_checksum_get_digest(cs, digest, &digest_len);
+    g_checksum_free(cs);
+}
+
+static size_t get_block_length(const struct DeltaManifest *manifest,
+                               size_t block)
+{
+    const uint64_t offset = (uint64_t)block * manifest->block_size;
+    const uint64_t remaining = manifest->length - offset;
+
+    return remaining < manifest->block_size
+        ? (size_t)remaining
+        : manifest->block_size;
+}
+
+static bool parse_digest(const char *hex, uint8_t digest[DIGEST_SIZE])
+{
+    if(strlen(hex) != 2 * DIGEST_SIZE)
+        return false;
+
+    for(size_t i = 0; i < DIGEST_SIZE; ++i)
+    {
+        const int hi = g_ascii_xdigit_value(hex[2 * i]);
+        const int lo = g_ascii_xdigit_value(hex[2 * i + 1]);
+
+        if(hi < 0 || lo < 0)
+            return false;
+
+        digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+
+    return true;
+}
+
+static bool parse_number(const char *value, uint64_t *number)
+{
+    char *end;
+
+    errno = 0;
+    *number = g_ascii_strtoull(value, &end, 10);
+
+    return errno == 0 && end != value && *end == '\0';
+}
+
+static bool parse_header(struct DeltaManifest *manifest, char *header)
+{
+    uint64_t version = 0;
+    uint64_t block_size = 0;
+    uint64_t hash_length = 0;
+    bool have_length = false;
+    bool have_digest = false;
+    char **lines = g_strsplit(header, "\n", -1);
+    bool ok = true;
+
+    for(char **line = lines; *line != NULL && ok; ++line)
+    {
+        char *sep = strstr(*line, ": ");
+
+        if(sep == NULL)
+        {
+            ok = false;
+            break;
+        }
+
+        *sep = '\0';
+
+        const char *key = *line;
+        const char *value = sep + 2;
+
+        if(strcmp(key, "DBusDL-Delta") == 0)
+            ok = parse_number(value, &version);
+        else if(strcmp(key, "Length") == 0)
+            ok = have_length = parse_number(value, &manifest->length);
+        else if(strcmp(key, "Blocksize") == 0)
+            ok = parse_number(value, &block_size);
+        else if(strcmp(key, "Hash-Length") == 0)
+            ok = parse_number(value, &hash_length);
+        else if(strcmp(key, "SHA-256") == 0)
+            ok = have_digest = parse_digest(value, manifest->digest);
+    }
+
+    g_strfreev(lines);
+
+    if(!ok || version != MANIFEST_VERSION || !have_length || !have_digest ||
+       block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE ||
+       hash_length < MIN_HASH_LENGTH || hash_length > DIGEST_SIZE ||
+       manifest->length > MAX_FILE_LENGTH)
+        return false;
+
+    /* blocks are indexed by 32 bit numbers plus 1 */
+    const uint64_t block_count =
+        (manifest->length + block_size - 1) / block_size;
+
+    if(block_count >= UINT32_MAX ||
+       block_count > SIZE_MAX / (sizeof(uint32_t) + hash_length))
+        return false;
+
+    manifest->block_size = (size_t)block_size;
+    manifest->hash_length = (size_t)hash_length;
+    manifest->block_count = (size_t)block_count;
+
+    return true;
+}
+
+/*!
+ * Parse manifest from memory.
+ *
+ * \returns
+ *     The manifest, or \c NULL if the data is not a valid manifest.
+ */
+struct DeltaManifest *delta_manifest_parse(const uint8_t *data, size_t size)
+{
+    const uint8_t *header_end = memmem(data, size, "\n\n", 2);
+
+    if(header_end == NULL)
+    {
+        asynclog_error(0, LOG_ERR, "Delta manifest without header");
+        return NULL;
+    }
+
+    struct DeltaManifest *manifest = g_try_new0(struct DeltaManifest, 1);
+
+    if(manifest == NULL)
+    {
+        msg_out_of_memory("DeltaManifest");
+        return NULL;
+    }
+
+    char *header = g_strndup((const char *)data, header_end - data);
+    const bool is_valid = parse_header(manifest, header);
+
+    g_free(header);
+
+    const uint8_t *records = header_end + 2;
+    const size_t records_size = size - (records - data);
+    const size_t record_size = sizeof(uint32_t) + manifest->hash_length;
+
+    if(!is_valid || records_size / record_size != manifest->block_count ||
+       records_size % record_size != 0)
+    {
+        asynclog_error(0, LOG_ERR, "Invalid delta manifest");
+        g_free(manifest);
+        return NULL;
+    }
+
+    manifest->rsums = g_try_new(uint32_t, manifest->block_count + 1);
+    manifest->hashes = g_try_malloc(manifest->block_count *
+                                    manifest->hash_length + 1);
+
+    if(manifest->rsums == NULL || manifest->hashes == NULL)
+    {
+        msg_out_of_memory("DeltaManifest blocks");
+        delta_manifest_free(manifest);
+        return NULL;
+    }
+
+    for(size_t i = 0; i < manifest->block_count; ++i)
+    {
+        const uint8_t *rec = records + i * record_size;
+
+        manifest->rsums[i] = (uint32_t)rec[0] << 24 | (uint32_t)rec[1] << 16 |
+                             (uint32_t)rec[2] << 8 | rec[3];
+        memcpy(manifest->hashes + i * manifest->hash_length,
+               rec + sizeof(uint32_t), manifest->hash_length);
+    }
+
+    return manifest;
+}
+
+void delta_manifest_free(struct DeltaManifest *manifest)
+{
+    if(manifest == NULL)
+        return;
+
+    g_free(manifest->rsums);
+    g_free(manifest->hashes);
+    g_free(manifest);
+}
+
+/*!
+ * Size of the file described by the manifest.
+ */
+uint64_t delta_manifest_get_length(const struct DeltaManifest *manifest)
+{
+    return manifest->length;
+}
+
+static ssize_t read_full(int fd, uint8_t *buffer, size_t count)
+{
+    size_t done = 0;
+
+    while(done < count)
+    {
+        const ssize_t len = read(fd, buffer + done, count - done);
+
+        if(len < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        if(len == 0)
+            break;
+
+        done += len;
+    }
+
+    return done;
+}
+
+/*!
+ * Read manifest from file.
+ *
+ * The file is opened without blocking and must be a regular file not
+ * larger than #MAX_MANIFEST_SIZE, so that neither a FIFO nor a huge file
+ * passed by the client can stall the transfer thread or exhaust memory.
+ *
+ * eturns
+ *     The manifest, or \c NULL if the file cannot be read or is invalid.
+ */
+struct DeltaManifest *delta_manifest_load(const char *path)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+
+    if(fd < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed opening delta manifest \"%s\"", path);
+        return NULL;
+    }
+
+    struct stat buf;
+    int error = 0;
+
+    if(fstat(fd, &buf) < 0)
+        error = errno;
+    else if(!S_ISREG(buf.st_mode))
+        error = EINVAL;
+    else if(buf.st_size > MAX_MANIFEST_SIZE)
+        error = EFBIG;
+    else if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) < 0)
+        error = errno;
+
+    if(error != 0)
+    {
+        asynclog_error(error, LOG_ERR,
+                       "Cannot use \"%s\" as delta manifest", path);
+        close(fd);
+        return NULL;
+    }
+
+    const size_t size = buf.st_size;
+    uint8_t *data = g_try_malloc(size > 0 ? size : 1);
+
+    if(data == NULL)
+    {
+        msg_out_of_memory("DeltaManifest data");
+        close(fd);
+        return NULL;
+    }
+
+    const ssize_t len = read_full(fd, data, size);
+
+    if(len < 0)
+        asynclog_error(errno, LOG_ERR,
+                       "Failed reading delta manifest \"%s\"", path);
+
+    close(fd);
+
+    struct DeltaManifest *manifest =
+        len < 0 ? NULL : delta_manifest_parse(data, len);
+
+    g_free(data);
+
+    return manifest;
+}
+
+static bool write_full_at(int fd, const uint8_t *buffer, size_t count,
+                          uint64_t offset)
+{
+    while(count > 0)
+    {
+        const ssize_t len = pwrite(fd, buffer, count, (off_t)offset);
+
+        if(len < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        buffer += len;
+        count -= len;
+        offset += len;
+    }
+
+    return true;
+}
+
+/*!
+ * Generate manifest for the file read from \p fd, starting at its current
+ * position.
+ *
+ * \returns
+ *     The manifest, or \c NULL on read error.
+ */
+GByteArray *delta_manifest_create(int fd, size_t block_size,
+                                  size_t hash_length)
+{
+    msg_log_assert(block_size >= MIN_BLOCK_SIZE);
+    msg_log_assert(block_size <= MAX_BLOCK_SIZE);
+    msg_log_assert(hash_length >= MIN_HASH_LENGTH);
+    msg_log_assert(hash_length <= DIGEST_SIZE);
+
+    uint8_t *block = g_malloc(block_size);
+    GByteArray *records = g_byte_array_new();
+    GChecksum *file_cs = g_checksum_new(G_CHECKSUM_SHA256);
+    uint64_t length = 0;
+    ssize_t len;
+
+    while((len = read_full(fd, block, block_size)) > 0)
+    {
+        struct RollingChecksum r;
+        uint8_t digest[DIGEST_SIZE];
+
+        rsum_init(&r, block, len);
+        compute_digest(block, len, digest);
+        g_checksum_update(file_cs, block, len);
+
+        const uint32_t rsum = rsum_get(&r);
+        const uint8_t be[4] =
+            { rsum >> 24, (rsum >> 16) & 0xff, (rsum >> 8) & 0xff, rsum & 0xff };
+
+        g_byte_array_append(records, be, sizeof(be));
+        g_byte_array_append(records, digest, hash_length);
+        length += len;
+
+        if((size_t)len < block_size)
+            break;
+    }
+
+    g_free(block);
+
+    if(len < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed reading file for delta manifest");
+        g_checksum_free(file_cs);
+        g_byte_array_free(records, TRUE);
+        return NULL;
+    }
+
+    char *header =
+        g_strdup_printf("DBusDL-Delta: %u\n"
+                        "Length: %" G_GUINT64_FORMAT "\n"
+                        "Blocksize: %zu\n"
+                        "Hash-Length: %zu\n"
+                        "SHA-256: %s\n\n",
+                        MANIFEST_VERSION, length, block_size, hash_length,
+                        g_checksum_get_string(file_cs));
+
+    g_checksum_free(file_cs);
+    g_byte_array_prepend(records, (const guint8 *)header, strlen(header));
+    g_free(header);
+
+    return records;
+}
+
+/*!
+ * Map of rolling checksums to the full blocks having them.
+ */
+struct BlockIndex
+{
+    /*! Map of rolling checksum to first block index plus 1. */
+    GHashTable *first_by_rsum;
+
+    /*! Next block with the same rolling checksum plus 1, 0 for none. */
+    uint32_t *next;
+
+    /*! Bit set for each rolling checksum hash present, so that most
+     *  positions in the seed are rejected without a hash table lookup. */
+    uint8_t *filter;
+};
+
+static uint32_t get_filter_bit(uint32_t rsum)
+{
+    return (rsum * 2654435761U) >> (32 - FILTER_BITS);
+}
+
+static void build_index(struct BlockIndex *index,
+                        const struct DeltaManifest *manifest)
+{
+    index->first_by_rsum = g_hash_table_new(g_direct_hash, g_direct_equal);
+    index->next = g_new0(uint32_t, manifest->block_count);
+    index->filter = g_malloc0((1U << FILTER_BITS) / 8);
+
+    /* a short last block cannot be found by a window of block size */
+    const size_t full_blocks = manifest->length / manifest->block_size;
+
+    for(size_t i = full_blocks; i-- > 0;)
+    {
+        const uint32_t rsum = manifest->rsums[i];
+        const uint32_t bit = get_filter_bit(rsum);
+
+        index->next[i] = GPOINTER_TO_UINT(
+            g_hash_table_lookup(index->first_by_rsum, GUINT_TO_POINTER(rsum)));
+        g_hash_table_insert(index->first_by_rsum, GUINT_TO_POINTER(rsum),
+                            GUINT_TO_POINTER(i + 1));
+        index->filter[bit / 8] |= 1U << (bit % 8);
+    }
+}
+
+static void free_index(struct BlockIndex *index)
+{
+    g_hash_table_destroy(index->first_by_rsum);
+    g_free(index->next);
+    g_free(index->filter);
+}
+
+/*!
+ * Copy window of the seed to all blocks of the output file it matches.
+ *
+ * \returns
+ *     1 if the window matches any block, 0 if not, -1 on write error.
+ */
+static int reuse_window(const struct DeltaManifest *manifest,
+                        const struct BlockIndex *index,
+                        const uint8_t *window, uint32_t rsum, int out_fd,
+                        bool *is_filled, uint64_t *reused_bytes)
+{
+    const uint32_t bit = get_filter_bit(rsum);
+
+    if((index->filter[bit / 8] & (1U << (bit % 8))) == 0)
+        return 0;
+
+    uint32_t candidate = GPOINTER_TO_UINT(
+        g_hash_table_lookup(index->first_by_rsum, GUINT_TO_POINTER(rsum)));
+
+    if(candidate == 0)
+        return 0;
+
+    uint8_t digest[DIGEST_SIZE];
+    int result = 0;
+
+    compute_digest(window, manifest->block_size, digest);
+
+    for(; candidate != 0; candidate = index->next[candidate - 1])
+    {
+        const size_t block = candidate - 1;
+
+        if(memcmp(manifest->hashes + block * manifest->hash_length, digest,
+                  manifest->hash_length) != 0)
+            continue;
+
+        result = 1;
+
+        if(is_filled[block])
+            continue;
+
+        if(!write_full_at(out_fd, window, manifest->block_size,
+                          (uint64_t)block * manifest->block_size))
+            return -1;
+
+        is_filled[block] = true;
+        *reused_bytes += manifest->block_size;
+    }
+
+    return result;
+}
+
+/*!
+ * Progress of moving a window over a seed file.
+ */
+struct DeltaScan
+{
+    const struct DeltaManifest *manifest;
+    int seed_fd;
+    int out_fd;
+
+    struct BlockIndex index;
+
+    /*! Which blocks of the output file have been taken from the seed. */
+    bool *is_filled;
+    uint64_t reused_bytes;
+
+    uint8_t *buffer;
+    size_t buffer_size;
+
+    /*! Position of the window in #DeltaScan::buffer, and the number of
+     *  bytes read into the buffer. */
+    size_t start;
+    size_t avail;
+
+    struct RollingChecksum r;
+    bool is_rsum_valid;
+    bool is_eof;
+};
+
+/*!
+ * Prepare for finding blocks of the file described by \p manifest in a
+ * seed file.
+ *
+ * The work is done in steps by #delta_scan_step(), so that large seed files
+ * do not hold up the caller for long.
+ *
+ * \param manifest
+ *     Checksums of the file to be downloaded, must outlive the scan.
+ *
+ * \param seed_fd
+ *     Previous version of the file, or any file sharing content with it.
+ *     It is read from its current position on.
+ *
+ * \param out_fd
+ *     File being downloaded. It is written to at the positions of the
+ *     blocks found, and it is truncated to the size of the file by
+ *     #delta_scan_finish().
+ *
+ * \returns
+ *     The scan, or \c NULL if out of memory.
+ */
+struct DeltaScan *delta_scan_new(const struct DeltaManifest *manifest,
+                                 int seed_fd, int out_fd)
+{
+    struct DeltaScan *scan = g_try_new0(struct DeltaScan, 1);
+
+    if(scan == NULL)
+    {
+        msg_out_of_memory("DeltaScan");
+        return NULL;
+    }
+
+    scan->buffer_size = MAX(SCAN_BUFFER_SIZE, 2 * manifest->block_size);
+    scan->buffer = g_try_malloc(scan->buffer_size);
+    scan->is_filled = g_try_new0(bool, manifest->block_count + 1);
+
+    if(scan->buffer == NULL || scan->is_filled == NULL)
+    {
+        msg_out_of_memory("Delta scan buffers");
+        g_free(scan->buffer);
+        g_free(scan->is_filled);
+        g_free(scan);
+        return NULL;
+    }
+
+    scan->manifest = manifest;
+    scan->seed_fd = seed_fd;
+    scan->out_fd = out_fd;
+    build_index(&scan->index, manifest);
+
+    return scan;
+}
+
+void delta_scan_free(struct DeltaScan *scan)
+{
+    if(scan == NULL)
+        return;
+
+    free_index(&scan->index);
+    g_free(scan->buffer);
+    g_free(scan->is_filled);
+    g_free(scan);
+}
+
+/*!
+ * Find blocks of the seed file anywhere in the seed, at any offset.
+ *
+ * A window of block size is moved over the seed byte by byte. Wherever it
+ * matches a block of the manifest, the window is written to the output
+ * file and the scan continues behind the window.
+ *
+ * \param scan
+ *     The scan to continue.
+ *
+ * \param max_bytes
+ *     Stop after moving the window by this many bytes.
+ *
+ * \returns
+ *     1 if there is more to scan, 0 if the whole seed has been scanned, -1
+ *     on read or write error.
+ */
+int delta_scan_step(struct DeltaScan *scan, size_t max_bytes)
+{
+    const size_t bs = scan->manifest->block_size;
+    size_t moved = 0;
+
+    while(true)
+    {
+        if(scan->avail - scan->start < bs + 1 && !scan->is_eof)
+        {
+            memmove(scan->buffer, scan->buffer + scan->start,
+                    scan->avail - scan->start);
+            scan->avail -= scan->start;
+            scan->start = 0;
+
+            const ssize_t len = read_full(scan->seed_fd,
+                                          scan->buffer + scan->avail,
+                                          scan->buffer_size - scan->avail);
+
+            if(len < 0)
+            {
+                asynclog_error(errno, LOG_ERR, "Failed reading delta seed");
+                return -1;
+            }
+
+            scan->avail += len;
+            scan->is_eof = scan->avail < scan->buffer_size;
+            continue;
+        }
+
+        if(scan->avail - scan->start < bs)
+            return 0;
+
+        if(moved >= max_bytes)
+            return 1;
+
+        if(!scan->is_rsum_valid)
+        {
+            rsum_init(&scan->r, scan->buffer + scan->start, bs);
+            scan->is_rsum_valid = true;
+        }
+
+        const int matched =
+            reuse_window(scan->manifest, &scan->index,
+                         scan->buffer + scan->start, rsum_get(&scan->r),
+                         scan->out_fd, scan->is_filled, &scan->reused_bytes);
+
+        if(matched < 0)
+        {
+            asynclog_error(errno, LOG_ERR, "Failed writing reused block");
+            return -1;
+        }
+
+        if(matched > 0)
+        {
+            scan->start += bs;
+            scan->is_rsum_valid = false;
+            moved += bs;
+            continue;
+        }
+
+        if(scan->avail - scan->start == bs)
+            return 0;
+
+        rsum_roll(&scan->r, scan->buffer[scan->start],
+                  scan->buffer[scan->start + bs], bs);
+        ++scan->start;
+        ++moved;
+    }
+}
+
+/*!
+ * Take short last block from the same position of the seed, if it is
+ * there.
+ *
+ * The scan cannot find it because it works on full blocks only, but
+ * unchanged or appended-to files are common enough to check.
+ */
+static bool reuse_last_block(const struct DeltaManifest *manifest,
+                             int seed_fd, int out_fd, bool *is_filled,
+                             uint64_t *reused_bytes)
+{
+    if(manifest->block_count == 0)
+        return true;
+
+    const size_t block = manifest->block_count - 1;
+    const size_t length = get_block_length(manifest, block);
+
+    if(is_filled[block] || length == manifest->block_size)
+        return true;
+
+    const uint64_t offset = (uint64_t)block * manifest->block_size;
+    uint8_t *data = g_malloc(length);
+    const ssize_t len = pread(seed_fd, data, length, (off_t)offset);
+    uint8_t digest[DIGEST_SIZE];
+    bool ok = true;
+
+    if(len == (ssize_t)length)
+    {
+        compute_digest(data, length, digest);
+
+        if(memcmp(manifest->hashes + block * manifest->hash_length, digest,
+                  manifest->hash_length) == 0)
+        {
+            ok = write_full_at(out_fd, data, length, offset);
+            is_filled[block] = ok;
+            *reused_bytes += length;
+        }
+    }
+
+    g_free(data);
+
+    return ok;
+}
+
+/*!
+ * Complete a scan which has been run by #delta_scan_step() until it
+ * returned 0.
+ *
+ * \param scan
+ *     The scan, which must still be freed by the caller.
+ *
+ * \param[out] reused_bytes
+ *     Number of bytes taken from the seed.
+ *
+ * \returns
+ *     The ranges to be downloaded, ordered by offset, or \c NULL on
+ *     error.
+ */
+GArray *delta_scan_finish(struct DeltaScan *scan, uint64_t *reused_bytes)
+{
+    const struct DeltaManifest *manifest = scan->manifest;
+
+    if(!reuse_last_block(manifest, scan->seed_fd, scan->out_fd,
+                         scan->is_filled, &scan->reused_bytes) ||
+       ftruncate(scan->out_fd, (off_t)manifest->length) < 0)
+        return NULL;
+
+    *reused_bytes = scan->reused_bytes;
+
+    GArray *ranges = g_array_new(FALSE, FALSE, sizeof(struct DeltaRange));
+
+    for(size_t i = 0; i < manifest->block_count; ++i)
+    {
+        if(scan->is_filled[i])
+            continue;
+
+        const uint64_t offset = (uint64_t)i * manifest->block_size;
+        const size_t length = get_block_length(manifest, i);
+
+        if(ranges->len > 0)
+        {
+            struct DeltaRange *last =
+                &g_array_index(ranges, struct DeltaRange, ranges->len - 1);
+
+            if(last->offset + last->length == offset)
+            {
+                last->length += length;
+                continue;
+            }
+        }
+
+        const struct DeltaRange range = { .offset = offset, .length = length };
+        g_array_append_val(ranges, range);
+    }
+
+    return ranges;
+}
+
+/*!
+ * Fill output file with all blocks which can be found in the seed file.
+ *
+ * This is #delta_scan_new(), #delta_scan_step(), and #delta_scan_finish()
+ * in one go.
+ *
+ * \returns
+ *     The ranges to be downloaded, ordered by offset, or \c NULL on
+ *     error.
+ */
+GArray *delta_reuse_seed(const struct DeltaManifest *manifest,
+                         int seed_fd, int out_fd, uint64_t *reused_bytes)
+{
+    struct DeltaScan *scan = delta_scan_new(manifest, seed_fd, out_fd);
+
+    if(scan == NULL)
+        return NULL;
+
+    int result;
+
+    while((result = delta_scan_step(scan, SIZE_MAX)) > 0)
+        ;
+
+    GArray *ranges =
+        result == 0 ? delta_scan_finish(scan, reused_bytes) : NULL;
+
+    delta_scan_free(scan);
+
+    return ranges;
+}
+
+/*!
+ * Progress of checking an assembled file against its manifest.
+ */
+struct DeltaVerifier
+{
+    const struct DeltaManifest *manifest;
+    int fd;
+    GChecksum *checksum;
+    uint8_t *buffer;
+    uint64_t offset;
+};
+
+/*!
+ * Prepare for checking the file assembled by a delta download against the
+ * digest in the manifest.
+ *
+ * The file is read in steps by #delta_verifier_step().
+ *
+ * \returns
+ *     The verifier, or \c NULL if out of memory.
+ */
+struct DeltaVerifier *delta_verifier_new(const struct DeltaManifest *manifest,
+                                         int fd)
+{
+    struct DeltaVerifier *v = g_try_new0(struct DeltaVerifier, 1);
+
+    if(v != NULL)
+        v->buffer = g_try_malloc(SCAN_BUFFER_SIZE);
+
+    if(v == NULL || v->buffer == NULL)
+    {
+        msg_out_of_memory("Delta verification buffer");
+        g_free(v);
+        return NULL;
+    }
+
+    v->manifest = manifest;
+    v->fd = fd;
+    v->checksum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    return v;
+}
+
+void delta_verifier_free(struct DeltaVerifier *verifier)
+{
+    if(verifier == NULL)
+        return;
+
+    g_checksum_free(verifier->checksum);
+    g_free(verifier->buffer);
+    g_free(verifier);
+}
+
+/*!
+ * Read next part of the file being verified.
+ *
+ * \param verifier
+ *     The verifier to continue.
+ *
+ * \param max_bytes
+ *     Stop after reading this many bytes.
+ *
+ * \returns
+ *     1 if there is more to read, 0 if the file matches the manifest, -1 if
+ *     it does not match or cannot be read.
+ */
+int delta_verifier_step(struct DeltaVerifier *verifier, size_t max_bytes)
+{
+    struct DeltaVerifier *v = verifier;
+    const struct DeltaManifest *manifest = v->manifest;
+
+    if(v->offset == 0)
+    {
+        struct stat st;
+
+        if(fstat(v->fd, &st) < 0 || (uint64_t)st.st_size != manifest->length)
+            return -1;
+    }
+
+    size_t done = 0;
+
+    while(v->offset < manifest->length)
+    {
+        if(done >= max_bytes)
+            return 1;
+
+        const ssize_t len = pread(v->fd, v->buffer,
+                                  MIN(SCAN_BUFFER_SIZE, max_bytes - done),
+                                  (off_t)v->offset);
+
+        if(len < 0 && errno == EINTR)
+            continue;
+
+        if(len <= 0)
+            return -1;
+
+        g_checksum_update(v->checksum, v->buffer, len);
+        v->offset += len;
+        done += len;
+    }
+
+    uint8_t digest[DIGEST_SIZE];
+    gsize digest_len = sizeof(digest);
+
+    g_checksum_get_digest(v->checksum, digest, &digest_len);
+
+    return memcmp(digest, manifest->digest, DIGEST_SIZE) == 0 ? 0 : -1;
+}
+
+/*!
+ * Check assembled file against the digest in the manifest in one go.
+ */
+bool delta_verify(const struct DeltaManifest *manifest, int fd)
+{
+    struct DeltaVerifier *v = delta_verifier_new(manifest, fd);
+
+    if(v == NULL)
+        return false;
+
+    int result;
+
+    while((result = delta_verifier_step(v, SIZE_MAX)) > 0)
+        ;
+
+    delta_verifier_free(v);
+
+    return result == 0;
+}
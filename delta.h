@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+
+/*!
+ * Block checksums of a file, used for downloading only the parts of the
+ * file which are not contained in a local seed file.
+ */
+struct DeltaManifest;
+
+/*!
+ * Search for blocks of a file in a seed file, done in steps.
+ */
+struct DeltaScan;
+
+/*!
+ * Check of a file assembled by a delta download, done in steps.
+ */
+struct DeltaVerifier;
+
+/*!
+ * Part of a file which needs to be downloaded.
+ */
+struct DeltaRange
+{
+    uint64_t offset;
+    uint64_t length;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct DeltaManifest *delta_manifest_parse(const uint8_t *data, size_t size);
+struct DeltaManifest *delta_manifest_load(const char *path);
+void delta_manifest_free(struct DeltaManifest *manifest);
+uint64_t delta_manifest_get_length(const struct DeltaManifest *manifest);
+GByteArray *delta_manifest_create(int fd, size_t block_size,
+                                  size_t hash_length);
+struct DeltaScan *delta_scan_new(const struct DeltaManifest *manifest,
+                                 int seed_fd, int out_fd);
+int delta_scan_step(struct DeltaScan *scan, size_t max_bytes);
+GArray *delta_scan_finish(struct DeltaScan *scan, uint64_t *reused_bytes);
+void delta_scan_free(struct DeltaScan *scan);
+GArray *delta_reuse_seed(const struct DeltaManifest *manifest,
+                         int seed_fd, int out_fd, uint64_t *reused_bytes);
+struct DeltaVerifier *delta_verifier_new(const struct DeltaManifest *manifest,
+                                         int fd);
+int delta_verifier_step(struct DeltaVerifier *verifier, size_t max_bytes);
+void delta_verifier_free(struct DeltaVerifier *verifier);
+bool delta_verify(const struct DeltaManifest *manifest, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !DELTA_H */
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019, 2023  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2023, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -24,29 +24,175 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <glib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 
 #include "events.h"
+#include "flightrec.h"
+#include "probes.h"
+#include "membudget.h"
 #include "messages.h"
 
+/*!
+ * Queue of events sent to the transfer thread of a priority class.
+ */
+struct FromUserQueue
+{
+    GAsyncQueue *queue;
+    void (*notify)(void *user_data);
+    void *notify_data;
+};
+
+/*!
+ * Main loop source for events sent to the main thread.
+ *
+ * The source watches an eventfd which is written to only if it has not been
+ * signalled since the source has last been dispatched. This way, a burst of
+ * events wakes up the main loop only once, and nothing is allocated per
+ * event.
+ */
+struct ToUserSource
+{
+    GSource source;
+    int fd;
+    atomic_bool is_signalled;
+};
+
 static struct
 {
-    GAsyncQueue *from_user_to_thread_queue;
+    struct FromUserQueue from_user_to_thread[XFER_PRIORITY_LAST + 1];
     GAsyncQueue *from_thread_to_user_queue;
-    GSourceFunc notify_to_user_queue;
+    struct ToUserSource *to_user_source;
 }
 events_data;
 
+static gboolean to_user_source_dispatch(GSource *source, GSourceFunc callback,
+                                        gpointer user_data)
+{
+    struct ToUserSource *s = (struct ToUserSource *)source;
+    uint64_t count;
+
+    /* the eventfd must be cleared before the flag, otherwise a signal sent
+     * in between would get lost */
+    if(read(s->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        msg_error(errno, LOG_ERR, "Failed reading eventfd");
+
+    atomic_store(&s->is_signalled, false);
+
+    return callback != NULL ? callback(user_data) : G_SOURCE_CONTINUE;
+}
+
+static void to_user_source_finalize(GSource *source)
+{
+    close(((struct ToUserSource *)source)->fd);
+}
+
+static GSourceFuncs to_user_source_funcs =
+{
+    .dispatch = to_user_source_dispatch,
+    .finalize = to_user_source_finalize,
+};
+
+static struct ToUserSource *create_to_user_source(GSourceFunc notification)
+{
+    const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(fd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating eventfd");
+        return NULL;
+    }
+
+    GSource *source =
+        g_source_new(&to_user_source_funcs, sizeof(struct ToUserSource));
+    struct ToUserSource *s = (struct ToUserSource *)source;
+
+    s->fd = fd;
+    atomic_init(&s->is_signalled, false);
+
+    g_source_set_name(source, "events to user");
+    g_source_add_unix_fd(source, fd, G_IO_IN);
+    g_source_set_callback(source, notification, NULL, NULL);
+    g_source_attach(source, NULL);
+
+    return s;
+}
+
+static void signal_to_user_source(struct ToUserSource *s)
+{
+    if(atomic_exchange(&s->is_signalled, true))
+        return;
+
+    static const uint64_t one = 1;
+
+    if(write(s->fd, &one, sizeof(one)) < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed writing eventfd");
+        atomic_store(&s->is_signalled, false);
+    }
+}
+
+/*!
+ * Initialize event queues.
+ *
+ * \param to_user_queue_notification
+ *     Function called from the default main context after events have been
+ *     sent to the main thread. It should receive all queued events and
+ *     return \c G_SOURCE_CONTINUE. May be \c NULL, in which case the main
+ *     loop is not involved.
+ */
 void events_init(GSourceFunc to_user_queue_notification)
 {
-    events_data.from_user_to_thread_queue = g_async_queue_new();
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+        events_data.from_user_to_thread[i].queue = g_async_queue_new();
+
     events_data.from_thread_to_user_queue = g_async_queue_new();
-    events_data.notify_to_user_queue = to_user_queue_notification;
+    events_data.to_user_source = to_user_queue_notification != NULL
+        ? create_to_user_source(to_user_queue_notification)
+        : NULL;
 }
 
 void events_deinit(void)
 {
-    g_async_queue_unref(events_data.from_user_to_thread_queue);
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+    {
+        struct FromUserQueue *q = &events_data.from_user_to_thread[i];
+
+        g_async_queue_unref(q->queue);
+        q->queue = NULL;
+        q->notify = NULL;
+        q->notify_data = NULL;
+    }
+
     g_async_queue_unref(events_data.from_thread_to_user_queue);
+
+    if(events_data.to_user_source != NULL)
+    {
+        g_source_destroy(&events_data.to_user_source->source);
+        g_source_unref(&events_data.to_user_source->source);
+        events_data.to_user_source = NULL;
+    }
+}
+
+/*!
+ * Set function to be called after an event has been sent to the thread
+ * serving given priority class.
+ *
+ * The function is called in the context of the sending thread. It is meant
+ * for waking up the receiving thread in case it is blocked in some other
+ * system call than #events_from_user_receive().
+ */
+void events_from_user_set_notification(enum XferPriority priority,
+                                       void (*from_user_queue_notification)(void *user_data),
+                                       void *user_data)
+{
+    msg_log_assert(priority <= XFER_PRIORITY_LAST);
+
+    struct FromUserQueue *q = &events_data.from_user_to_thread[priority];
+    q->notify = from_user_queue_notification;
+    q->notify_data = user_data;
 }
 
 static struct EventFromUser *alloc_from_user(enum EventFromUserID id)
@@ -54,7 +200,10 @@ static struct EventFromUser *alloc_from_user(enum EventFromUserID id)
     struct EventFromUser *ev = g_try_malloc0(sizeof(*ev));
 
     if(ev != NULL)
+    {
         ev->event_id = id;
+        membudget_charge(MEMBUDGET_EVENTS, sizeof(*ev));
+    }
     else
         msg_out_of_memory("EventFromUser");
 
@@ -79,6 +228,7 @@ static struct EventToUser *alloc_to_user(enum EventToUserID id,
     {
         ev->event_id = id;
         ev->xi.const_item = item;
+        membudget_charge(MEMBUDGET_EVENTS, sizeof(*ev));
     }
     else
         msg_out_of_memory("EventToUser");
@@ -115,18 +265,101 @@ struct EventFromUser *events_from_user_new_cancel(uint32_t item_id)
     return ev;
 }
 
-void events_from_user_send(struct EventFromUser *event)
+struct EventFromUser *events_from_user_new_cancel_all(void)
+{
+    return alloc_from_user(EVENT_FROM_USER_CANCEL_ALL);
+}
+
+struct EventFromUser *events_from_user_new_pause(uint32_t item_id)
+{
+    struct EventFromUser *ev = alloc_from_user(EVENT_FROM_USER_PAUSE);
+
+    if(ev != NULL)
+        ev->d.item_id = item_id;
+
+    return ev;
+}
+
+struct EventFromUser *events_from_user_new_resume(uint32_t item_id)
+{
+    struct EventFromUser *ev = alloc_from_user(EVENT_FROM_USER_RESUME);
+
+    if(ev != NULL)
+        ev->d.item_id = item_id;
+
+    return ev;
+}
+
+struct EventFromUser *events_from_user_new_pause_all(void)
+{
+    return alloc_from_user(EVENT_FROM_USER_PAUSE_ALL);
+}
+
+struct EventFromUser *events_from_user_new_resume_all(void)
+{
+    return alloc_from_user(EVENT_FROM_USER_RESUME_ALL);
+}
+
+static uint32_t get_from_user_item_id(const struct EventFromUser *event)
 {
+    switch(event->event_id)
+    {
+      case EVENT_FROM_USER_SHUTDOWN:
+      case EVENT_FROM_USER_CANCEL_ALL:
+      case EVENT_FROM_USER_PAUSE_ALL:
+      case EVENT_FROM_USER_RESUME_ALL:
+        break;
+
+      case EVENT_FROM_USER_START_DOWNLOAD:
+        return event->d.item != NULL ? event->d.item->item_id : 0;
+
+      case EVENT_FROM_USER_CANCEL:
+      case EVENT_FROM_USER_PAUSE:
+      case EVENT_FROM_USER_RESUME:
+        return event->d.item_id;
+    }
+
+    return 0;
+}
+
+/*!
+ * Send event to the thread serving given priority class.
+ */
+void events_from_user_send(enum XferPriority priority,
+                           struct EventFromUser *event)
+{
+    msg_log_assert(priority <= XFER_PRIORITY_LAST);
     msg_log_assert(event != NULL);
 
-    g_async_queue_push(events_data.from_user_to_thread_queue, event);
+    struct FromUserQueue *q = &events_data.from_user_to_thread[priority];
+
+    flightrec_record(FLIGHTREC_FROM_USER_PUSH,
+                     get_from_user_item_id(event), event->event_id);
+    DBUSDL_PROBE3(from_user_push, get_from_user_item_id(event),
+                  event->event_id, priority);
+    g_async_queue_push(q->queue, event);
+
+    if(q->notify != NULL)
+        q->notify(q->notify_data);
 }
 
-struct EventFromUser *events_from_user_receive(bool blocking)
+struct EventFromUser *events_from_user_receive(enum XferPriority priority,
+                                               bool blocking)
 {
+    msg_log_assert(priority <= XFER_PRIORITY_LAST);
+
+    GAsyncQueue *q = events_data.from_user_to_thread[priority].queue;
     struct EventFromUser *ev = blocking
-        ? g_async_queue_pop(events_data.from_user_to_thread_queue)
-        : g_async_queue_try_pop(events_data.from_user_to_thread_queue);
+        ? g_async_queue_pop(q)
+        : g_async_queue_try_pop(q);
+
+    if(ev != NULL)
+    {
+        flightrec_record(FLIGHTREC_FROM_USER_POP,
+                         get_from_user_item_id(ev), ev->event_id);
+        DBUSDL_PROBE3(from_user_pop, get_from_user_item_id(ev),
+                      ev->event_id, priority);
+    }
 
     return ev;
 }
@@ -140,6 +373,11 @@ void events_from_user_free(struct EventFromUser *event)
     {
       case EVENT_FROM_USER_SHUTDOWN:
       case EVENT_FROM_USER_CANCEL:
+      case EVENT_FROM_USER_CANCEL_ALL:
+      case EVENT_FROM_USER_PAUSE:
+      case EVENT_FROM_USER_RESUME:
+      case EVENT_FROM_USER_PAUSE_ALL:
+      case EVENT_FROM_USER_RESUME_ALL:
         break;
 
       case EVENT_FROM_USER_START_DOWNLOAD:
@@ -151,6 +389,7 @@ void events_from_user_free(struct EventFromUser *event)
 
     }
 
+    membudget_release(MEMBUDGET_EVENTS, sizeof(*event));
     g_free(event);
 }
 
@@ -180,10 +419,14 @@ void events_to_user_send(struct EventToUser *event)
 {
     msg_log_assert(event != NULL);
 
+    flightrec_record(FLIGHTREC_TO_USER_PUSH,
+                     event->xi.const_item->item_id, event->event_id);
+    DBUSDL_PROBE2(to_user_push, event->xi.const_item->item_id,
+                  event->event_id);
     g_async_queue_push(events_data.from_thread_to_user_queue, event);
 
-    if(events_data.notify_to_user_queue != NULL)
-        g_main_context_invoke(NULL, events_data.notify_to_user_queue, NULL);
+    if(events_data.to_user_source != NULL)
+        signal_to_user_source(events_data.to_user_source);
 }
 
 struct EventToUser *events_to_user_receive(bool blocking)
@@ -192,6 +435,13 @@ struct EventToUser *events_to_user_receive(bool blocking)
         ? g_async_queue_pop(events_data.from_thread_to_user_queue)
         : g_async_queue_try_pop(events_data.from_thread_to_user_queue);
 
+    if(ev != NULL)
+    {
+        flightrec_record(FLIGHTREC_TO_USER_POP,
+                         ev->xi.const_item->item_id, ev->event_id);
+        DBUSDL_PROBE2(to_user_pop, ev->xi.const_item->item_id, ev->event_id);
+    }
+
     return ev;
 }
 
@@ -217,5 +467,6 @@ void events_to_user_free(struct EventToUser *event, bool force_free_xferitem)
         }
     }
 
+    membudget_release(MEMBUDGET_EVENTS, sizeof(*event));
     g_free(event);
 }
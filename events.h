@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -32,6 +32,11 @@ enum EventFromUserID
     EVENT_FROM_USER_SHUTDOWN,
     EVENT_FROM_USER_START_DOWNLOAD,
     EVENT_FROM_USER_CANCEL,
+    EVENT_FROM_USER_CANCEL_ALL,
+    EVENT_FROM_USER_PAUSE,
+    EVENT_FROM_USER_RESUME,
+    EVENT_FROM_USER_PAUSE_ALL,
+    EVENT_FROM_USER_RESUME_ALL,
 };
 
 struct EventFromUser
@@ -77,12 +82,22 @@ extern "C" {
 
 void events_init(int (*to_user_queue_notification)(void *user_data));
 void events_deinit(void);
+void events_from_user_set_notification(enum XferPriority priority,
+                                       void (*from_user_queue_notification)(void *user_data),
+                                       void *user_data);
 
 struct EventFromUser *events_from_user_new_shutdown(void);
 struct EventFromUser *events_from_user_new_start_download(struct XferItem *item);
 struct EventFromUser *events_from_user_new_cancel(uint32_t item_id);
-void events_from_user_send(struct EventFromUser *event);
-struct EventFromUser *events_from_user_receive(bool blocking);
+struct EventFromUser *events_from_user_new_cancel_all(void);
+struct EventFromUser *events_from_user_new_pause(uint32_t item_id);
+struct EventFromUser *events_from_user_new_resume(uint32_t item_id);
+struct EventFromUser *events_from_user_new_pause_all(void);
+struct EventFromUser *events_from_user_new_resume_all(void);
+void events_from_user_send(enum XferPriority priority,
+                           struct EventFromUser *event);
+struct EventFromUser *events_from_user_receive(enum XferPriority priority,
+                                               bool blocking);
 void events_from_user_free(struct EventFromUser *event);
 
 struct EventToUser *events_to_user_new_report_progress(const struct XferItem *item,
@@ -0,0 +1,817 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gio/gio.h>
+
+#include "extract.h"
+#include "asynclog.h"
+#include "messages.h"
+
+/*
+ * Archives are read in the POSIX ustar format, including the GNU long name
+ * and pax path extensions written by current tar implementations. Regular
+ * files and directories are extracted, other entry types such as links or
+ * device nodes are rejected.
+ *
+ * Sizes are checked against the limits when an entry header is read, so
+ * that no data beyond the limits is written. The data of an entry cannot
+ * exceed the size announced in its header.
+ */
+
+#define TAR_BLOCK_SIZE          512U
+#define MAX_PATH_LENGTH         4096U
+#define MAX_PAX_HEADER_SIZE     (64U * 1024U)
+#define INFLATE_BUFFER_SIZE     (64U * 1024U)
+
+enum ExtractState
+{
+    EXTRACT_STATE_HEADER,
+    EXTRACT_STATE_DATA,
+    EXTRACT_STATE_PADDING,
+    EXTRACT_STATE_END,
+};
+
+struct Extractor
+{
+    /*! Directory the archive is unpacked into. */
+    int dir_fd;
+
+    /*! First bytes of the archive, used for detecting compression. */
+    uint8_t magic[2];
+    size_t magic_len;
+
+    /*! Decompressor for gzip-compressed archives, \c NULL otherwise. */
+    GConverter *gunzip;
+    uint8_t *inflate_buffer;
+    bool is_gunzip_done;
+
+    enum ExtractState state;
+    enum DBusListsErrorCode error;
+
+    uint8_t header[TAR_BLOCK_SIZE];
+    size_t header_fill;
+    unsigned int zero_blocks;
+
+    /*! Bytes of data of the current entry still to be read. */
+    uint64_t remaining;
+
+    /*! Bytes to be skipped after the data of the current entry. */
+    uint64_t padding;
+
+    /*! File the data of the current entry is written to, -1 if the data
+     *  is not written to a file. */
+    int file_fd;
+
+    /*! Data of the current entry collected in memory, \c NULL if it is
+     *  not collected. Used for long names and pax headers. */
+    GString *meta;
+    char meta_type;
+
+    /*! Path of the next entry taken from a long name or pax header. */
+    char *next_path;
+
+    /*! Limits set by #extractor_set_limits(), 0 for no limit. */
+    uint64_t max_bytes;
+    unsigned int max_entries;
+
+    /*! Size of the files and number of entries extracted so far. */
+    uint64_t total_bytes;
+    unsigned int entries;
+
+    /*! Called for claiming storage space for each file, may be \c NULL. */
+    ExtractorClaimSpaceFn claim_space;
+    void *claim_space_data;
+};
+
+/*!
+ * Create directory \p path and prepare for unpacking an archive into it.
+ *
+ * \returns
+ *     The extractor, or \c NULL if the directory cannot be created.
+ */
+struct Extractor *extractor_new(const char *path)
+{
+    if(mkdir(path, 0777) < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed creating directory \"%s\"", path);
+        return NULL;
+    }
+
+    struct Extractor *x = g_try_new0(struct Extractor, 1);
+
+    if(x == NULL)
+    {
+        msg_out_of_memory("Extractor");
+        rmdir(path);
+        return NULL;
+    }
+
+    x->dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(x->dir_fd < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed opening directory \"%s\"", path);
+        rmdir(path);
+        g_free(x);
+        return NULL;
+    }
+
+    x->file_fd = -1;
+    x->state = EXTRACT_STATE_HEADER;
+    x->error = LIST_ERROR_OK;
+
+    return x;
+}
+
+/*!
+ * Limit total size of extracted files and number of extracted entries.
+ *
+ * Archives exceeding a limit are rejected with
+ * #LIST_ERROR_PHYSICAL_MEDIA_IO as soon as the offending entry is seen.
+ *
+ * \param extractor
+ *     The extractor, before any data has been fed.
+ *
+ * \param max_bytes
+ *     Maximum total size of extracted files, 0 for no limit.
+ *
+ * \param max_entries
+ *     Maximum number of extracted files and directories, 0 for no limit.
+ */
+void extractor_set_limits(struct Extractor *extractor, uint64_t max_bytes,
+                          unsigned int max_entries)
+{
+    extractor->max_bytes = max_bytes;
+    extractor->max_entries = max_entries;
+}
+
+/*!
+ * Set function for claiming storage space before a file is extracted.
+ *
+ * The function is called with the size of each non-empty file before the
+ * file is created. If it returns false, extraction fails with
+ * #LIST_ERROR_PHYSICAL_MEDIA_IO.
+ */
+void extractor_set_space_claim(struct Extractor *extractor,
+                               ExtractorClaimSpaceFn claim_space,
+                               void *user_data)
+{
+    extractor->claim_space = claim_space;
+    extractor->claim_space_data = user_data;
+}
+
+void extractor_free(struct Extractor *extractor)
+{
+    if(extractor == NULL)
+        return;
+
+    if(extractor->file_fd >= 0)
+        close(extractor->file_fd);
+
+    close(extractor->dir_fd);
+
+    if(extractor->gunzip != NULL)
+        g_object_unref(extractor->gunzip);
+
+    if(extractor->meta != NULL)
+        g_string_free(extractor->meta, TRUE);
+
+    g_free(extractor->inflate_buffer);
+    g_free(extractor->next_path);
+    g_free(extractor);
+}
+
+static bool fail(struct Extractor *x, enum DBusListsErrorCode error)
+{
+    if(x->error == LIST_ERROR_OK)
+        x->error = error;
+
+    return false;
+}
+
+static bool is_zero_block(const uint8_t *block)
+{
+    for(size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+        if(block[i] != 0)
+            return false;
+
+    return true;
+}
+
+/*!
+ * Parse numeric header field, octal or base-256 as written by GNU tar for
+ * large values.
+ */
+static bool parse_number(const uint8_t *field, size_t size, uint64_t *value)
+{
+    *value = 0;
+
+    if(field[0] & 0x80)
+    {
+        if(field[0] != 0x80)
+            return false;
+
+        for(size_t i = 1; i < size; ++i)
+        {
+            if(*value >> 56)
+                return false;
+
+            *value = *value << 8 | field[i];
+        }
+
+        return true;
+    }
+
+    size_t i = 0;
+
+    while(i < size && field[i] == ' ')
+        ++i;
+
+    for(/* nothing */; i < size && field[i] >= '0' && field[i] <= '7'; ++i)
+    {
+        if(*value >> 61)
+            return false;
+
+        *value = *value << 3 | (uint64_t)(field[i] - '0');
+    }
+
+    return i == size || field[i] == ' ' || field[i] == '\0';
+}
+
+static bool is_checksum_valid(const uint8_t *header)
+{
+    uint64_t expected;
+
+    if(!parse_number(header + 148, 8, &expected))
+        return false;
+
+    uint64_t sum = 0;
+
+    for(size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+        sum += i >= 148 && i < 156 ? ' ' : header[i];
+
+    return sum == expected;
+}
+
+/*!
+ * Turn path stored in the archive into a path relative to the target
+ * directory.
+ *
+ * Leading slashes and "." components are removed. Paths containing ".."
+ * are refused because they might point outside the target directory.
+ *
+ * \returns
+ *     The sanitized path, which is empty for the target directory itself,
+ *     or \c NULL if the path is refused.
+ */
+static char *sanitize_path(const char *path)
+{
+    char **components = g_strsplit(path, "/", -1);
+    GString *result = g_string_new(NULL);
+    bool ok = true;
+
+    for(char **c = components; *c != NULL; ++c)
+    {
+        if((*c)[0] == '\0' || strcmp(*c, ".") == 0)
+            continue;
+
+        if(strcmp(*c, "..") == 0)
+        {
+            ok = false;
+            break;
+        }
+
+        if(result->len > 0)
+            g_string_append_c(result, '/');
+
+        g_string_append(result, *c);
+    }
+
+    g_strfreev(components);
+
+    return g_string_free(result, !ok);
+}
+
+static char *get_header_path(struct Extractor *x)
+{
+    if(x->next_path != NULL)
+    {
+        char *path = x->next_path;
+        x->next_path = NULL;
+        return path;
+    }
+
+    const char *name = (const char *)x->header;
+    const char *prefix = (const char *)x->header + 345;
+
+    if(memcmp(x->header + 257, "ustar", 5) == 0 && prefix[0] != '\0')
+        return g_strdup_printf("%.155s/%.100s", prefix, name);
+
+    return g_strndup(name, 100);
+}
+
+/*!
+ * Create all directories leading to \p path.
+ */
+static bool make_parents(struct Extractor *x, char *path)
+{
+    for(char *sep = strchr(path, '/'); sep != NULL; sep = strchr(sep + 1, '/'))
+    {
+        *sep = '\0';
+        const int ret = mkdirat(x->dir_fd, path, 0777);
+        const int error = errno;
+        *sep = '/';
+
+        if(ret < 0 && error != EEXIST)
+        {
+            asynclog_error(error, LOG_ERR,
+                           "Failed creating directory \"%s\" from archive",
+                           path);
+            return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+        }
+    }
+
+    return true;
+}
+
+static bool make_directory(struct Extractor *x, char *path, mode_t mode)
+{
+    if(path[0] == '\0')
+        return true;
+
+    if(!make_parents(x, path))
+        return false;
+
+    if(mkdirat(x->dir_fd, path, mode | 0700) < 0 && errno != EEXIST)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed creating directory \"%s\" from archive", path);
+        return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+    }
+
+    return true;
+}
+
+static bool open_file(struct Extractor *x, char *path, mode_t mode)
+{
+    if(path[0] == '\0')
+    {
+        asynclog_error(0, LOG_ERR, "Archive contains file without name");
+        return fail(x, LIST_ERROR_INCONSISTENT);
+    }
+
+    if(!make_parents(x, path))
+        return false;
+
+    x->file_fd = openat(x->dir_fd, path,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                        mode | 0600);
+
+    if(x->file_fd < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed creating file \"%s\" from archive", path);
+        return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+    }
+
+    return true;
+}
+
+/*!
+ * Take path from pax extended header records "<length> <key>=<value>\n".
+ */
+static bool parse_pax_header(struct Extractor *x)
+{
+    const char *p = x->meta->str;
+    const char *end = p + x->meta->len;
+
+    while(p < end)
+    {
+        char *after_len;
+        const guint64 len = g_ascii_strtoull(p, &after_len, 10);
+
+        if(after_len == p || *after_len != ' ' || len == 0 ||
+           len > (guint64)(end - p) || p[len - 1] != '\n')
+        {
+            asynclog_error(0, LOG_ERR, "Invalid pax header in archive");
+            return fail(x, LIST_ERROR_INCONSISTENT);
+        }
+
+        const char *key = after_len + 1;
+        const char *record_end = p + len - 1;
+
+        if(record_end - key > 5 && strncmp(key, "path=", 5) == 0)
+        {
+            g_free(x->next_path);
+            x->next_path = g_strndup(key + 5, record_end - key - 5);
+        }
+
+        p += len;
+    }
+
+    return true;
+}
+
+/*!
+ * Check limits for the next entry, claim space for its data.
+ */
+static bool claim_entry(struct Extractor *x, uint64_t size)
+{
+    if(x->max_entries > 0 && x->entries >= x->max_entries)
+    {
+        asynclog_error(0, LOG_ERR, "Archive has more than %u entries",
+                       x->max_entries);
+        return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+    }
+
+    if(x->max_bytes > 0 && size > x->max_bytes - x->total_bytes)
+    {
+        asynclog_error(0, LOG_ERR,
+                       "Archive contents exceed %" PRIu64 " bytes",
+                       x->max_bytes);
+        return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+    }
+
+    if(size > 0 && x->claim_space != NULL &&
+       !x->claim_space(size, x->claim_space_data))
+    {
+        asynclog_error(0, LOG_ERR,
+                       "No space for %" PRIu64 " bytes from archive", size);
+        return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+    }
+
+    ++x->entries;
+    x->total_bytes += size;
+
+    return true;
+}
+
+static bool start_entry(struct Extractor *x)
+{
+    if(is_zero_block(x->header))
+    {
+        if(++x->zero_blocks == 2)
+            x->state = EXTRACT_STATE_END;
+
+        return true;
+    }
+
+    x->zero_blocks = 0;
+
+    uint64_t size;
+    uint64_t mode;
+
+    if(!is_checksum_valid(x->header) ||
+       !parse_number(x->header + 124, 12, &size) ||
+       !parse_number(x->header + 100, 8, &mode))
+    {
+        asynclog_error(0, LOG_ERR, "Invalid header in archive");
+        return fail(x, LIST_ERROR_INCONSISTENT);
+    }
+
+    const char type = (char)x->header[156];
+
+    x->remaining = size;
+    x->padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    x->state = EXTRACT_STATE_DATA;
+
+    if(type == 'L' || type == 'x')
+    {
+        if(size > (type == 'L' ? MAX_PATH_LENGTH : MAX_PAX_HEADER_SIZE))
+        {
+            asynclog_error(0, LOG_ERR, "Oversized extended header in archive");
+            return fail(x, LIST_ERROR_NOT_SUPPORTED);
+        }
+
+        x->meta = g_string_sized_new(size);
+        x->meta_type = type;
+        return true;
+    }
+
+    if(type == 'g')
+        return true;
+
+    if(!claim_entry(x, size))
+        return false;
+
+    char *raw_path = get_header_path(x);
+    char *path = sanitize_path(raw_path);
+    bool ok;
+
+    if(path == NULL)
+    {
+        asynclog_error(0, LOG_ERR,
+                       "Refusing path \"%s\" from archive", raw_path);
+        ok = fail(x, LIST_ERROR_PERMISSION_DENIED);
+    }
+    else if(type == '0' || type == '\0' || type == '7')
+        ok = open_file(x, path, (mode_t)(mode & 0777));
+    else if(type == '5')
+        ok = make_directory(x, path, (mode_t)(mode & 0777));
+    else
+    {
+        asynclog_error(0, LOG_ERR,
+                       "Unsupported entry type '%c' for \"%s\" in archive",
+                       type, raw_path);
+        ok = fail(x, LIST_ERROR_NOT_SUPPORTED);
+    }
+
+    g_free(raw_path);
+    g_free(path);
+
+    return ok;
+}
+
+static bool end_entry(struct Extractor *x)
+{
+    x->state = x->padding > 0 ? EXTRACT_STATE_PADDING : EXTRACT_STATE_HEADER;
+    x->header_fill = 0;
+
+    if(x->meta != NULL)
+    {
+        bool ok = true;
+
+        if(x->meta_type == 'x')
+            ok = parse_pax_header(x);
+        else
+        {
+            g_free(x->next_path);
+            x->next_path = g_strndup(x->meta->str, x->meta->len);
+        }
+
+        g_string_free(x->meta, TRUE);
+        x->meta = NULL;
+
+        return ok;
+    }
+
+    if(x->file_fd >= 0)
+    {
+        const int ret = close(x->file_fd);
+
+        x->file_fd = -1;
+
+        if(ret < 0)
+        {
+            asynclog_error(errno, LOG_ERR, "Failed writing file from archive");
+            return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+        }
+    }
+
+    return true;
+}
+
+static bool write_data(struct Extractor *x, const uint8_t *data, size_t len)
+{
+    if(x->meta != NULL)
+    {
+        g_string_append_len(x->meta, (const char *)data, len);
+        return true;
+    }
+
+    if(x->file_fd < 0)
+        return true;
+
+    while(len > 0)
+    {
+        const ssize_t written = write(x->file_fd, data, len);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            asynclog_error(errno, LOG_ERR, "Failed writing file from archive");
+            return fail(x, LIST_ERROR_PHYSICAL_MEDIA_IO);
+        }
+
+        data += written;
+        len -= written;
+    }
+
+    return true;
+}
+
+/*!
+ * Process uncompressed tar data.
+ */
+static bool untar(struct Extractor *x, const uint8_t *data, size_t len)
+{
+    while(len > 0)
+    {
+        size_t n = 0;
+
+        switch(x->state)
+        {
+          case EXTRACT_STATE_HEADER:
+            n = MIN(len, TAR_BLOCK_SIZE - x->header_fill);
+            memcpy(x->header + x->header_fill, data, n);
+            x->header_fill += n;
+
+            if(x->header_fill == TAR_BLOCK_SIZE)
+            {
+                x->header_fill = 0;
+
+                if(!start_entry(x))
+                    return false;
+
+                if(x->state == EXTRACT_STATE_DATA && x->remaining == 0 &&
+                   !end_entry(x))
+                    return false;
+            }
+
+            break;
+
+          case EXTRACT_STATE_DATA:
+            n = (size_t)MIN((uint64_t)len, x->remaining);
+
+            if(!write_data(x, data, n))
+                return false;
+
+            x->remaining -= n;
+
+            if(x->remaining == 0 && !end_entry(x))
+                return false;
+
+            break;
+
+          case EXTRACT_STATE_PADDING:
+            n = (size_t)MIN((uint64_t)len, x->padding);
+            x->padding -= n;
+
+            if(x->padding == 0)
+                x->state = EXTRACT_STATE_HEADER;
+
+            break;
+
+          case EXTRACT_STATE_END:
+            /* padding up to the blocking factor of the archive */
+            n = len;
+            break;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool gunzip(struct Extractor *x, const uint8_t *data, size_t len)
+{
+    while(len > 0 && !x->is_gunzip_done)
+    {
+        gsize bytes_read;
+        gsize bytes_written;
+        GError *error = NULL;
+        const GConverterResult result =
+            g_converter_convert(x->gunzip, data, len,
+                                x->inflate_buffer, INFLATE_BUFFER_SIZE,
+                                G_CONVERTER_NO_FLAGS,
+                                &bytes_read, &bytes_written, &error);
+
+        if(result == G_CONVERTER_ERROR)
+        {
+            if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+            {
+                g_error_free(error);
+                return true;
+            }
+
+            asynclog_error(0, LOG_ERR, "Failed decompressing archive: %s",
+                           error->message);
+            g_error_free(error);
+            return fail(x, LIST_ERROR_INCONSISTENT);
+        }
+
+        if(result == G_CONVERTER_FINISHED)
+            x->is_gunzip_done = true;
+
+        data += bytes_read;
+        len -= bytes_read;
+
+        if(!untar(x, x->inflate_buffer, bytes_written))
+            return false;
+    }
+
+    return true;
+}
+
+static bool is_gzip(const uint8_t *magic)
+{
+    return magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+/*!
+ * Process next chunk of the archive.
+ *
+ * \returns
+ *     #LIST_ERROR_OK, or the error which stopped extraction. Once an error
+ *     has occurred, all further data is rejected with the same error.
+ */
+enum DBusListsErrorCode extractor_feed(struct Extractor *extractor,
+                                       const uint8_t *data, size_t len)
+{
+    struct Extractor *x = extractor;
+
+    if(x->error != LIST_ERROR_OK)
+        return x->error;
+
+    if(x->magic_len < sizeof(x->magic))
+    {
+        while(x->magic_len < sizeof(x->magic) && len > 0)
+        {
+            x->magic[x->magic_len++] = *data++;
+            --len;
+        }
+
+        if(x->magic_len < sizeof(x->magic))
+            return LIST_ERROR_OK;
+
+        if(is_gzip(x->magic))
+        {
+            x->gunzip = G_CONVERTER(
+                g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+            x->inflate_buffer = g_try_malloc(INFLATE_BUFFER_SIZE);
+
+            if(x->inflate_buffer == NULL)
+            {
+                msg_out_of_memory("Inflate buffer");
+                fail(x, LIST_ERROR_INTERNAL);
+                return x->error;
+            }
+
+            gunzip(x, x->magic, x->magic_len);
+        }
+        else
+            untar(x, x->magic, x->magic_len);
+    }
+
+    if(x->gunzip != NULL)
+        gunzip(x, data, len);
+    else
+        untar(x, data, len);
+
+    return x->error;
+}
+
+/*!
+ * Check that the whole archive has been processed.
+ *
+ * \returns
+ *     #LIST_ERROR_OK if the end of the archive has been found,
+ *     #LIST_ERROR_INCONSISTENT if the archive is truncated, or the error
+ *     which stopped extraction before.
+ */
+enum DBusListsErrorCode extractor_finish(struct Extractor *extractor)
+{
+    struct Extractor *x = extractor;
+
+    if(x->error != LIST_ERROR_OK)
+        return x->error;
+
+    if(x->state != EXTRACT_STATE_END ||
+       (x->gunzip != NULL && !x->is_gunzip_done))
+    {
+        asynclog_error(0, LOG_ERR, "Archive is truncated");
+        fail(x, LIST_ERROR_INCONSISTENT);
+    }
+
+    return x->error;
+}
+
+enum DBusListsErrorCode extractor_get_error(const struct Extractor *extractor)
+{
+    return extractor->error;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "de_tahifi_lists_errors.h"
+
+/*!
+ * Unpacks a tar archive, optionally gzip-compressed, into a directory while
+ * the archive is being received.
+ */
+struct Extractor;
+
+/*!
+ * Claim \p size bytes of storage for a file to be extracted.
+ */
+typedef bool (*ExtractorClaimSpaceFn)(uint64_t size, void *user_data);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Extractor *extractor_new(const char *path);
+void extractor_set_limits(struct Extractor *extractor, uint64_t max_bytes,
+                          unsigned int max_entries);
+void extractor_set_space_claim(struct Extractor *extractor,
+                               ExtractorClaimSpaceFn claim_space,
+                               void *user_data);
+enum DBusListsErrorCode extractor_feed(struct Extractor *extractor,
+                                       const uint8_t *data, size_t len);
+enum DBusListsErrorCode extractor_finish(struct Extractor *extractor);
+enum DBusListsErrorCode extractor_get_error(const struct Extractor *extractor);
+void extractor_free(struct Extractor *extractor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !EXTRACT_H */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <glib.h>
+
+#include "fileops.h"
+#include "asynclog.h"
+#include "messages.h"
+
+/*!
+ * Size of chunks copied in one go by the kernel.
+ */
+#define COPY_CHUNK_SIZE (4U * 1024U * 1024U)
+
+/*!
+ * Let \p out_fd share all extents of \p in_fd (reflink).
+ *
+ * Only some file systems support this, and only within the same file
+ * system.
+ *
+ * \returns
+ *     0 on success, -1 on error with \c errno set.
+ */
+int fileops_clone(int in_fd, int out_fd)
+{
+#ifdef FICLONE
+    return ioctl(out_fd, FICLONE, in_fd);
+#else /* !FICLONE */
+    errno = EOPNOTSUPP;
+    return -1;
+#endif /* FICLONE */
+}
+
+static bool is_unsupported_copy(int error)
+{
+    return error == EXDEV || error == ENOSYS || error == EINVAL ||
+           error == EOPNOTSUPP || error == EBADF;
+}
+
+static ssize_t copy_range(int in_fd, int out_fd, size_t count)
+{
+#if HAVE_COPY_FILE_RANGE
+    const ssize_t copied = copy_file_range(in_fd, NULL, out_fd, NULL, count, 0);
+
+    if(copied >= 0 || !is_unsupported_copy(errno))
+        return copied;
+#endif /* HAVE_COPY_FILE_RANGE */
+
+    return sendfile(out_fd, in_fd, NULL, count);
+}
+
+/*!
+ * Copy up to \p count bytes from \p in_fd to \p out_fd without passing the
+ * data through user space.
+ *
+ * Data is copied from and to the current file offsets, which are advanced.
+ * \c copy_file_range() is tried first, \c sendfile() is used if the former
+ * is not supported for the two files.
+ *
+ * \returns
+ *     Number of bytes copied, 0 at end of input file, -1 on error with
+ *     \c errno set.
+ */
+ssize_t fileops_copy_chunk(int in_fd, int out_fd, size_t count)
+{
+    ssize_t copied;
+
+    do
+        copied = copy_range(in_fd, out_fd, count);
+    while(copied < 0 && errno == EINTR);
+
+    return copied;
+}
+
+/*!
+ * Copy remaining contents of \p in_fd to \p out_fd without passing the data
+ * through user space.
+ *
+ * Sharing of extents (reflink) is tried first, followed by
+ * \c copy_file_range() and \c sendfile(). The file offsets of both file
+ * descriptors must be 0 for a reflink to be attempted.
+ *
+ * \returns
+ *     0 on success, -1 on error with \c errno set.
+ */
+int fileops_copy_contents(int in_fd, int out_fd)
+{
+    if(lseek(in_fd, 0, SEEK_CUR) == 0 && lseek(out_fd, 0, SEEK_CUR) == 0 &&
+       fileops_clone(in_fd, out_fd) == 0)
+        return 0;
+
+    while(1)
+    {
+        const ssize_t copied =
+            fileops_copy_chunk(in_fd, out_fd, COPY_CHUNK_SIZE);
+
+        if(copied == 0)
+            return 0;
+
+        if(copied < 0)
+            return -1;
+    }
+}
+
+/*!
+ * Copy temporary file to a new file next to the destination, then rename
+ * the copy to the destination.
+ *
+ * An existing destination file is replaced atomically, and it is left
+ * alone if copying fails.
+ */
+static int copy_to_destination(const char *tempfile_path,
+                               const char *destfile_path)
+{
+    const int in_fd = open(tempfile_path, O_RDONLY | O_CLOEXEC);
+
+    if(in_fd < 0)
+        return -1;
+
+    char *copy_path = g_strconcat(destfile_path, ".XXXXXX", NULL);
+    const int out_fd = g_mkstemp_full(copy_path, O_WRONLY | O_CLOEXEC, 0666);
+
+    if(out_fd < 0)
+    {
+        const int error = errno;
+        close(in_fd);
+        g_free(copy_path);
+        errno = error;
+        return -1;
+    }
+
+    int ret = fileops_copy_contents(in_fd, out_fd);
+
+    if(ret == 0)
+        ret = fsync(out_fd);
+
+    int error = errno;
+
+    close(in_fd);
+
+    if(close(out_fd) < 0 && ret == 0)
+    {
+        ret = -1;
+        error = errno;
+    }
+
+    if(ret == 0 && rename(copy_path, destfile_path) < 0)
+    {
+        ret = -1;
+        error = errno;
+    }
+
+    if(ret < 0)
+        unlink(copy_path);
+    else
+        unlink(tempfile_path);
+
+    g_free(copy_path);
+    errno = error;
+
+    return ret;
+}
+
+/*!
+ * Move temporary file to its final location.
+ *
+ * In case the files are on different file systems, the contents of the
+ * temporary file are copied without passing them through user space to a
+ * new file next to the destination, which is then renamed to the
+ * destination. The temporary file is removed after that.
+ *
+ * \returns
+ *     0 on success, -1 on error with \c errno set. The temporary file is not
+ *     removed on error.
+ */
+int fileops_publish(const char *tempfile_path, const char *destfile_path)
+{
+    if(rename(tempfile_path, destfile_path) == 0)
+        return 0;
+
+    if(errno != EXDEV)
+        return -1;
+
+    asynclog_info("Copying \"%s\" to \"%s\" across file systems",
+                  tempfile_path, destfile_path);
+
+    return copy_to_destination(tempfile_path, destfile_path);
+}
+
+static int remove_entry(const char *path, const struct stat *st,
+                        int type, struct FTW *ftw)
+{
+    return remove(path);
+}
+
+/*!
+ * Remove directory \p path with all its contents.
+ *
+ * Symbolic links are removed, not followed.
+ *
+ * \returns
+ *     0 on success, -1 on error with \c errno set.
+ */
+int fileops_remove_tree(const char *path)
+{
+    return nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0 ? 0 : -1;
+}
+
+/*!
+ * Move temporary directory to its final location.
+ *
+ * An existing empty directory at \p destdir_path is always replaced. A
+ * non-empty directory is only replaced if \p replace is set, in which case
+ * it is exchanged atomically with the temporary directory, and then removed
+ * with all its contents. This requires \c renameat2(); without it, only
+ * empty directories are replaced.
+ *
+ * \returns
+ *     0 on success, -1 on error with \c errno set. The temporary directory
+ *     is not removed on error. \c errno is \c ENOTEMPTY or \c EEXIST if
+ *     a non-empty directory was not replaced.
+ */
+int fileops_publish_directory(const char *tempdir_path,
+                              const char *destdir_path, bool replace)
+{
+    if(rename(tempdir_path, destdir_path) == 0)
+        return 0;
+
+    if(errno != EEXIST && errno != ENOTEMPTY)
+        return -1;
+
+    if(!replace)
+        return -1;
+
+#if HAVE_RENAMEAT2
+    if(renameat2(AT_FDCWD, tempdir_path, AT_FDCWD, destdir_path,
+                 RENAME_EXCHANGE) < 0)
+        return -1;
+
+    if(fileops_remove_tree(tempdir_path) < 0)
+        asynclog_error(errno, LOG_ERR,
+                       "Failed removing replaced directory \"%s\"",
+                       tempdir_path);
+
+    return 0;
+#else /* !HAVE_RENAMEAT2 */
+    return -1;
+#endif /* HAVE_RENAMEAT2 */
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int fileops_clone(int in_fd, int out_fd);
+ssize_t fileops_copy_chunk(int in_fd, int out_fd, size_t count);
+int fileops_copy_contents(int in_fd, int out_fd);
+int fileops_publish(const char *tempfile_path, const char *destfile_path);
+int fileops_remove_tree(const char *path);
+int fileops_publish_directory(const char *tempdir_path,
+                              const char *destdir_path, bool replace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !FILEOPS_H */
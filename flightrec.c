@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <glib.h>
+
+#include "flightrec.h"
+
+G_STATIC_ASSERT((FLIGHTREC_SIZE & (FLIGHTREC_SIZE - 1)) == 0);
+
+/*!
+ * A slot in the ring.
+ *
+ * The \c sequence member is 0 while the slot is being written, and the
+ * ring position plus 1 once the record is complete. Readers compare the
+ * sequence number before and after copying the record to detect records
+ * which have been overwritten in the meantime.
+ */
+struct Slot
+{
+    atomic_uint_fast64_t sequence;
+    atomic_uint_fast64_t timestamp_us;
+    atomic_uint_fast64_t arg;
+    atomic_uint_fast32_t item_id;
+    atomic_uint_fast32_t event;
+};
+
+static struct
+{
+    atomic_uint_fast64_t next_position;
+    struct Slot ring[FLIGHTREC_SIZE];
+}
+flightrec_data;
+
+static const char *const event_names[FLIGHTREC_LAST_EVENT + 1] =
+{
+    [FLIGHTREC_FROM_USER_PUSH]  = "from_user_push",
+    [FLIGHTREC_FROM_USER_POP]   = "from_user_pop",
+    [FLIGHTREC_TO_USER_PUSH]    = "to_user_push",
+    [FLIGHTREC_TO_USER_POP]     = "to_user_pop",
+    [FLIGHTREC_TRANSFER_START]  = "transfer_start",
+    [FLIGHTREC_TRANSFER_DONE]   = "transfer_done",
+    [FLIGHTREC_PREWARM_START]   = "prewarm_start",
+    [FLIGHTREC_PREWARM_DONE]    = "prewarm_done",
+    [FLIGHTREC_HEDGE_START]     = "hedge_start",
+    [FLIGHTREC_CURL_WRITE]      = "curl_write",
+    [FLIGHTREC_CURL_READ]       = "curl_read",
+    [FLIGHTREC_CURL_PROGRESS]   = "curl_progress",
+    [FLIGHTREC_PROGRESS_SENT]   = "progress_sent",
+    [FLIGHTREC_SIGNAL_PROGRESS] = "signal_progress",
+    [FLIGHTREC_SIGNAL_DONE]     = "signal_done",
+};
+
+void flightrec_reset(void)
+{
+    for(size_t i = 0; i < FLIGHTREC_SIZE; ++i)
+        atomic_store_explicit(&flightrec_data.ring[i].sequence, 0,
+                              memory_order_relaxed);
+
+    atomic_store_explicit(&flightrec_data.next_position, 0,
+                          memory_order_release);
+}
+
+/*!
+ * Store a trace record in the ring, overwriting the oldest one.
+ *
+ * This function is safe to be called from any thread at any time. It never
+ * blocks and does not allocate memory.
+ */
+void flightrec_record(enum FlightrecEvent event, uint32_t item_id, uint64_t arg)
+{
+    const uint64_t pos =
+        atomic_fetch_add_explicit(&flightrec_data.next_position, 1,
+                                  memory_order_relaxed);
+    struct Slot *slot = &flightrec_data.ring[pos & (FLIGHTREC_SIZE - 1)];
+
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->timestamp_us, g_get_monotonic_time(),
+                          memory_order_relaxed);
+    atomic_store_explicit(&slot->arg, arg, memory_order_relaxed);
+    atomic_store_explicit(&slot->item_id, item_id, memory_order_relaxed);
+    atomic_store_explicit(&slot->event, event, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+/*!
+ * Copy the most recent complete records, oldest record first.
+ *
+ * Records which are being written or overwritten while taking the snapshot
+ * are skipped.
+ *
+ * \returns
+ *     The number of records copied to \p records.
+ */
+size_t flightrec_snapshot(struct FlightrecRecord *records, size_t max_records)
+{
+    const uint64_t end =
+        atomic_load_explicit(&flightrec_data.next_position,
+                             memory_order_acquire);
+    const uint64_t available = MIN(end, (uint64_t)FLIGHTREC_SIZE);
+    uint64_t pos = end - MIN(available, (uint64_t)max_records);
+    size_t count = 0;
+
+    for(/* nothing */; pos < end; ++pos)
+    {
+        const struct Slot *slot =
+            &flightrec_data.ring[pos & (FLIGHTREC_SIZE - 1)];
+
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1)
+            continue;
+
+        struct FlightrecRecord *r = &records[count];
+
+        r->timestamp_us = atomic_load_explicit(&slot->timestamp_us,
+                                               memory_order_relaxed);
+        r->arg = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+        r->item_id = atomic_load_explicit(&slot->item_id, memory_order_relaxed);
+        r->event = atomic_load_explicit(&slot->event, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+
+        if(atomic_load_explicit(&slot->sequence, memory_order_relaxed) == pos + 1)
+            ++count;
+    }
+
+    return count;
+}
+
+const char *flightrec_event_name(enum FlightrecEvent event)
+{
+    return event <= FLIGHTREC_LAST_EVENT ? event_names[event] : "unknown";
+}
+
+/*!
+ * Write the contents of the flight recorder as text to given file.
+ *
+ * \returns
+ *     The number of records written, or -1 on error.
+ */
+int flightrec_dump(FILE *f)
+{
+    struct FlightrecRecord *records =
+        g_try_malloc(FLIGHTREC_SIZE * sizeof(*records));
+
+    if(records == NULL)
+        return -1;
+
+    const size_t count = flightrec_snapshot(records, FLIGHTREC_SIZE);
+    int ret = (int)count;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const struct FlightrecRecord *r = &records[i];
+
+        if(fprintf(f, "%" PRIu64 " %-16s %10" PRIu32 " %" PRIu64 "\n",
+                   r->timestamp_us, flightrec_event_name(r->event),
+                   r->item_id, r->arg) < 0)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    g_free(records);
+
+    return ret;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*!
+ * Number of records kept in the flight recorder, must be a power of 2.
+ */
+#define FLIGHTREC_SIZE 4096U
+
+enum FlightrecEvent
+{
+    FLIGHTREC_FROM_USER_PUSH,
+    FLIGHTREC_FROM_USER_POP,
+    FLIGHTREC_TO_USER_PUSH,
+    FLIGHTREC_TO_USER_POP,
+    FLIGHTREC_TRANSFER_START,
+    FLIGHTREC_TRANSFER_DONE,
+    FLIGHTREC_PREWARM_START,
+    FLIGHTREC_PREWARM_DONE,
+    FLIGHTREC_HEDGE_START,
+    FLIGHTREC_CURL_WRITE,
+    FLIGHTREC_CURL_READ,
+    FLIGHTREC_CURL_PROGRESS,
+    FLIGHTREC_PROGRESS_SENT,
+    FLIGHTREC_SIGNAL_PROGRESS,
+    FLIGHTREC_SIGNAL_DONE,
+
+    FLIGHTREC_LAST_EVENT = FLIGHTREC_SIGNAL_DONE,
+};
+
+/*!
+ * Copy of a single trace record as returned by #flightrec_snapshot().
+ */
+struct FlightrecRecord
+{
+    /*! Monotonic time in microseconds. */
+    uint64_t timestamp_us;
+
+    /*! Event-specific value such as a byte count or error code. */
+    uint64_t arg;
+
+    /*! ID of the #XferItem the event refers to, 0 if none. */
+    uint32_t item_id;
+
+    enum FlightrecEvent event;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void flightrec_reset(void);
+void flightrec_record(enum FlightrecEvent event, uint32_t item_id, uint64_t arg);
+size_t flightrec_snapshot(struct FlightrecRecord *records, size_t max_records);
+const char *flightrec_event_name(enum FlightrecEvent event);
+int flightrec_dump(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !FLIGHTREC_H */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "hedge.h"
+#include "messages.h"
+
+/*!
+ * Prepare throughput window for a new request.
+ *
+ * \param window
+ *     The window to be initialized.
+ *
+ * \param seconds
+ *     Size of the window, up to #HEDGE_WINDOW_MAX_SECONDS. Pass 0 to
+ *     disable stall detection.
+ *
+ * \param speed_limit
+ *     Requests slower than this on average over the whole window are
+ *     considered stalled.
+ */
+void hedge_window_init(struct HedgeWindow *window, unsigned int seconds,
+                       uint64_t speed_limit)
+{
+    msg_log_assert(seconds <= HEDGE_WINDOW_MAX_SECONDS);
+
+    window->seconds = seconds;
+    window->speed_limit = speed_limit;
+    hedge_window_reset(window);
+}
+
+/*!
+ * Forget all samples, so that the window is filled from scratch.
+ *
+ * Used after pauses, which must not be mistaken for a stall.
+ */
+void hedge_window_reset(struct HedgeWindow *window)
+{
+    window->head = 0;
+    window->count = 0;
+}
+
+/*!
+ * Track throughput of a request over a sliding window.
+ *
+ * At most one sample is taken per second, further calls in the same second
+ * are ignored.
+ *
+ * \param window
+ *     The window of the request.
+ *
+ * \param second
+ *     Current monotonic time in seconds.
+ *
+ * \param received
+ *     Number of bytes received by the request so far.
+ *
+ * \returns
+ *     True if the average throughput over the whole window is below the
+ *     configured limit, false if it is not or if the window has not been
+ *     filled yet.
+ */
+bool hedge_window_is_stalled(struct HedgeWindow *window, unsigned int second,
+                             int64_t received)
+{
+    const unsigned int size = window->seconds;
+
+    if(size == 0)
+        return false;
+
+    if(window->count > 0 &&
+       window->samples[(window->head + size - 1) % size].second == second)
+        return false;
+
+    const struct ThroughputSample oldest = window->samples[window->head];
+    const bool is_full = window->count == size;
+
+    window->samples[window->head].second = second;
+    window->samples[window->head].bytes = received;
+    window->head = (window->head + 1) % size;
+
+    if(!is_full)
+    {
+        ++window->count;
+        return false;
+    }
+
+    return received - oldest.bytes <
+           (int64_t)window->speed_limit * (int64_t)(second - oldest.second);
+}
+
+/*!
+ * Find out which part of data received by one of the requests of a hedged
+ * download is new.
+ *
+ * While a download is hedged, both requests receive the same data at
+ * different positions. Only data beyond what has been written already is
+ * to be appended, so whichever request is ahead makes progress on the file
+ * and the other one just catches up.
+ *
+ * \param bytes_written
+ *     Number of bytes written to the output file so far.
+ *
+ * \param position
+ *     Position in the file of the data received by the request, advanced
+ *     by \p len.
+ *
+ * \param len
+ *     Number of bytes received.
+ *
+ * \returns
+ *     Number of bytes at the start of the data which have been written
+ *     already, \p len if there is nothing new. A negative value is
+ *     returned if the data starts beyond the end of the file, which would
+ *     leave a gap.
+ */
+ssize_t hedge_skip_received(int64_t bytes_written, int64_t *position,
+                            size_t len)
+{
+    const int64_t start = *position;
+
+    *position += (int64_t)len;
+
+    if(*position <= bytes_written)
+        return (ssize_t)len;
+
+    if(start > bytes_written)
+        return -1;
+
+    return (ssize_t)(bytes_written - start);
+}
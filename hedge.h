@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef HEDGE_H
+#define HEDGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*!
+ * Upper limit for the size of a #HedgeWindow in seconds.
+ */
+#define HEDGE_WINDOW_MAX_SECONDS 60U
+
+/*!
+ * Amount of data received by a request at some point in time.
+ */
+struct ThroughputSample
+{
+    unsigned int second;
+    int64_t bytes;
+};
+
+/*!
+ * Throughput of a request over a sliding window, for detecting stalls.
+ */
+struct HedgeWindow
+{
+    /*! Size of the window in seconds, 0 to disable stall detection. */
+    unsigned int seconds;
+
+    /*! Average rate in bytes per second below which the request is
+     *  considered stalled. */
+    uint64_t speed_limit;
+
+    /*! One sample per second, ring buffer. */
+    struct ThroughputSample samples[HEDGE_WINDOW_MAX_SECONDS];
+    unsigned int head;
+    unsigned int count;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hedge_window_init(struct HedgeWindow *window, unsigned int seconds,
+                       uint64_t speed_limit);
+void hedge_window_reset(struct HedgeWindow *window);
+bool hedge_window_is_stalled(struct HedgeWindow *window, unsigned int second,
+                             int64_t received);
+ssize_t hedge_skip_received(int64_t bytes_written, int64_t *position,
+                            size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !HEDGE_H */
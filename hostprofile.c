@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+
+#include "hostprofile.h"
+#include "messages.h"
+
+/*!
+ * Number of hosts remembered, the least recently used one is forgotten
+ * beyond that.
+ */
+#define MAX_HOSTS                   256U
+
+#define DEFAULT_CONNECT_TIMEOUT_MS  45000U
+#define MIN_CONNECT_TIMEOUT_MS      5000U
+
+/*!
+ * Connect timeout as multiple of the average connect time.
+ */
+#define CONNECT_TIMEOUT_FACTOR      8U
+
+#define MIN_RECEIVE_BUFFER_SIZE     (16U * 1024U)
+#define MAX_RECEIVE_BUFFER_SIZE     (128U * 1024U)
+
+/*!
+ * Smaller transfers are dominated by latency, their rate says little about
+ * the bandwidth available from the host.
+ */
+#define MIN_RATE_SAMPLE_BYTES       (256U * 1024U)
+
+/*!
+ * HTTP/2 is tried again after this many seconds for hosts where it has
+ * failed.
+ */
+#define HTTP1_PIN_SECONDS           (24 * 60 * 60)
+
+/*!
+ * What is known about a host.
+ */
+struct HostState
+{
+    /*! Average transfer rate in bytes per second, 0 if unknown. */
+    uint64_t rate;
+
+    /*! Average connect time in microseconds, 0 if unknown. */
+    uint64_t connect_time_us;
+
+    enum HostProfileHttpVersion http_version;
+
+    /*! Wall clock time in seconds HTTP/2 has last failed at, for trying
+     *  again after #HTTP1_PIN_SECONDS. */
+    int64_t http2_failed_at;
+
+    /*! Current concurrency limit, 0 for no limit. */
+    unsigned int concurrency;
+
+    /*! Wall clock time of last use in seconds, for forgetting hosts. */
+    int64_t last_used;
+};
+
+/*
+ * Profiles are learned by all transfer threads and saved by the main
+ * thread, so all accesses are serialized by a mutex.
+ */
+static struct
+{
+    GMutex lock;
+
+    /*! Map of origin to #HostState. */
+    GHashTable *hosts;
+
+    /*! Where profiles are stored, \c NULL if they are not. */
+    char *path;
+
+    /*! Upper limit for concurrency, reached again after throttling. */
+    unsigned int max_concurrency;
+
+    /*! Profiles have changed since last saved. */
+    bool is_dirty;
+}
+hostprofile_data;
+
+static const char *http_version_to_string(enum HostProfileHttpVersion version)
+{
+    switch(version)
+    {
+      case HOSTPROFILE_HTTP_ANY:
+        break;
+
+      case HOSTPROFILE_HTTP_1:
+        return "1";
+
+      case HOSTPROFILE_HTTP_2:
+        return "2";
+    }
+
+    return "any";
+}
+
+static enum HostProfileHttpVersion http_version_from_string(const char *str)
+{
+    if(g_strcmp0(str, "1") == 0)
+        return HOSTPROFILE_HTTP_1;
+    else if(g_strcmp0(str, "2") == 0)
+        return HOSTPROFILE_HTTP_2;
+    else
+        return HOSTPROFILE_HTTP_ANY;
+}
+
+static void load_host(GKeyFile *kf, const char *origin)
+{
+    struct HostState *state = g_try_new0(struct HostState, 1);
+
+    if(state == NULL)
+    {
+        msg_out_of_memory("HostState");
+        return;
+    }
+
+    char *http = g_key_file_get_string(kf, origin, "http", NULL);
+
+    state->rate = g_key_file_get_uint64(kf, origin, "rate", NULL);
+    state->connect_time_us =
+        g_key_file_get_uint64(kf, origin, "connect_us", NULL);
+    state->http_version = http_version_from_string(http);
+    state->http2_failed_at =
+        g_key_file_get_int64(kf, origin, "http2_failed_at", NULL);
+    state->concurrency =
+        MIN(g_key_file_get_uint64(kf, origin, "concurrency", NULL),
+            hostprofile_data.max_concurrency);
+    state->last_used = g_key_file_get_int64(kf, origin, "last_used", NULL);
+
+    if(state->concurrency >= hostprofile_data.max_concurrency)
+        state->concurrency = 0;
+
+    g_free(http);
+    g_hash_table_replace(hostprofile_data.hosts, g_strdup(origin), state);
+}
+
+static void load_profiles(const char *path)
+{
+    GKeyFile *kf = g_key_file_new();
+    GError *error = NULL;
+
+    if(!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &error))
+    {
+        if(!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            msg_error(0, LOG_NOTICE, "Failed loading host profiles from \"%s\": %s",
+                      path, error->message);
+
+        g_error_free(error);
+        g_key_file_free(kf);
+        return;
+    }
+
+    gsize count;
+    char **groups = g_key_file_get_groups(kf, &count);
+
+    for(gsize i = 0; i < count && i < MAX_HOSTS; ++i)
+        load_host(kf, groups[i]);
+
+    g_strfreev(groups);
+    g_key_file_free(kf);
+
+    msg_info("Loaded %u host profiles", g_hash_table_size(hostprofile_data.hosts));
+}
+
+void hostprofile_init(const char *path, unsigned int max_concurrency)
+{
+    msg_log_assert(max_concurrency > 0);
+
+    hostprofile_data.hosts =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    hostprofile_data.path = g_strdup(path);
+    hostprofile_data.max_concurrency = max_concurrency;
+    hostprofile_data.is_dirty = false;
+
+    if(path != NULL)
+        load_profiles(path);
+}
+
+void hostprofile_deinit(void)
+{
+    hostprofile_save();
+
+    g_hash_table_unref(hostprofile_data.hosts);
+    hostprofile_data.hosts = NULL;
+    g_free(hostprofile_data.path);
+    hostprofile_data.path = NULL;
+}
+
+/*
+ * Group names must not contain brackets, ruling out IPv6 literals. These
+ * hosts are still profiled, but not persisted.
+ */
+static bool is_valid_group_name(const char *origin)
+{
+    return strpbrk(origin, "[]\n\r") == NULL;
+}
+
+static void store_host(GKeyFile *kf, const char *origin,
+                       const struct HostState *state)
+{
+    if(!is_valid_group_name(origin))
+        return;
+
+    g_key_file_set_uint64(kf, origin, "rate", state->rate);
+    g_key_file_set_uint64(kf, origin, "connect_us", state->connect_time_us);
+    g_key_file_set_string(kf, origin, "http",
+                          http_version_to_string(state->http_version));
+    g_key_file_set_int64(kf, origin, "http2_failed_at",
+                         state->http2_failed_at);
+    g_key_file_set_uint64(kf, origin, "concurrency", state->concurrency);
+    g_key_file_set_int64(kf, origin, "last_used", state->last_used);
+}
+
+/*!
+ * Write profiles to file if they have changed.
+ *
+ * \returns
+ *     False on error, true otherwise.
+ */
+bool hostprofile_save(void)
+{
+    if(hostprofile_data.path == NULL)
+        return true;
+
+    GKeyFile *kf = g_key_file_new();
+
+    g_mutex_lock(&hostprofile_data.lock);
+
+    const bool is_dirty = hostprofile_data.is_dirty;
+
+    if(is_dirty)
+    {
+        GHashTableIter iter;
+        gpointer key;
+        gpointer value;
+
+        g_hash_table_iter_init(&iter, hostprofile_data.hosts);
+
+        while(g_hash_table_iter_next(&iter, &key, &value))
+            store_host(kf, key, value);
+
+        hostprofile_data.is_dirty = false;
+    }
+
+    g_mutex_unlock(&hostprofile_data.lock);
+
+    bool retval = true;
+
+    if(is_dirty)
+    {
+        char *dir = g_path_get_dirname(hostprofile_data.path);
+        GError *error = NULL;
+
+        if(g_mkdir_with_parents(dir, 0770) < 0)
+            msg_error(errno, LOG_ERR, "Failed creating directory \"%s\"", dir);
+
+        if(!g_key_file_save_to_file(kf, hostprofile_data.path, &error))
+        {
+            msg_error(0, LOG_ERR, "Failed saving host profiles to \"%s\": %s",
+                      hostprofile_data.path, error->message);
+            g_error_free(error);
+            retval = false;
+        }
+
+        g_free(dir);
+    }
+
+    g_key_file_free(kf);
+
+    return retval;
+}
+
+/*!
+ * Buffer large enough for about 1/8 second worth of data.
+ */
+static size_t get_buffer_size_for_rate(uint64_t rate)
+{
+    size_t size = MIN_RECEIVE_BUFFER_SIZE;
+
+    while(size < MAX_RECEIVE_BUFFER_SIZE && size < rate / 8)
+        size *= 2;
+
+    return size;
+}
+
+static unsigned int get_connect_timeout_ms(uint64_t connect_time_us)
+{
+    if(connect_time_us == 0)
+        return DEFAULT_CONNECT_TIMEOUT_MS;
+
+    const uint64_t ms = connect_time_us * CONNECT_TIMEOUT_FACTOR / 1000U;
+
+    return CLAMP(ms, MIN_CONNECT_TIMEOUT_MS, DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+/*!
+ * HTTP version to ask for, HTTP/2 is negotiated again some time after it
+ * has failed.
+ */
+static enum HostProfileHttpVersion
+get_http_version(const struct HostState *state)
+{
+    if(state->http_version == HOSTPROFILE_HTTP_1 &&
+       g_get_real_time() / G_USEC_PER_SEC - state->http2_failed_at >=
+       HTTP1_PIN_SECONDS)
+        return HOSTPROFILE_HTTP_ANY;
+
+    return state->http_version;
+}
+
+/*!
+ * Get transfer settings for given origin.
+ *
+ * Defaults are returned for unknown hosts.
+ */
+void hostprofile_get(const char *origin, struct HostProfile *profile)
+{
+    g_mutex_lock(&hostprofile_data.lock);
+
+    const struct HostState *state = origin != NULL
+        ? g_hash_table_lookup(hostprofile_data.hosts, origin)
+        : NULL;
+
+    if(state == NULL)
+    {
+        profile->receive_buffer_size = 0;
+        profile->http_version = HOSTPROFILE_HTTP_ANY;
+        profile->connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS;
+        profile->max_concurrency = 0;
+        profile->bytes_per_second = 0;
+    }
+    else
+    {
+        profile->receive_buffer_size =
+            state->rate > 0 ? get_buffer_size_for_rate(state->rate) : 0;
+        profile->http_version = get_http_version(state);
+        profile->connect_timeout_ms =
+            get_connect_timeout_ms(state->connect_time_us);
+        profile->max_concurrency = state->concurrency;
+        profile->bytes_per_second = state->rate;
+    }
+
+    g_mutex_unlock(&hostprofile_data.lock);
+}
+
+static uint64_t moving_average(uint64_t average, uint64_t sample)
+{
+    return average == 0 ? sample : (3 * average + sample) / 4;
+}
+
+static void forget_least_recently_used_host(void)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+    const char *oldest = NULL;
+    int64_t oldest_time = INT64_MAX;
+
+    g_hash_table_iter_init(&iter, hostprofile_data.hosts);
+
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+        const struct HostState *state = value;
+
+        if(state->last_used < oldest_time)
+        {
+            oldest = key;
+            oldest_time = state->last_used;
+        }
+    }
+
+    if(oldest != NULL)
+        g_hash_table_remove(hostprofile_data.hosts, oldest);
+}
+
+static struct HostState *get_or_add_host(const char *origin)
+{
+    struct HostState *state = g_hash_table_lookup(hostprofile_data.hosts, origin);
+
+    if(state != NULL)
+        return state;
+
+    state = g_try_new0(struct HostState, 1);
+
+    if(state == NULL)
+    {
+        msg_out_of_memory("HostState");
+        return NULL;
+    }
+
+    if(g_hash_table_size(hostprofile_data.hosts) >= MAX_HOSTS)
+        forget_least_recently_used_host();
+
+    g_hash_table_insert(hostprofile_data.hosts, g_strdup(origin), state);
+
+    return state;
+}
+
+/*!
+ * Update profile of given origin with results of a finished transfer.
+ *
+ * Concurrency is adapted additively on success and multiplicatively when
+ * the host could not be reached or refused service. A failed connection
+ * also resets the connect timeout to the default. HTTP/1.1 is asked for only
+ * after an HTTP/2 failure, for #HTTP1_PIN_SECONDS.
+ */
+void hostprofile_learn(const char *origin,
+                       const struct HostObservation *observation)
+{
+    if(origin == NULL)
+        return;
+
+    g_mutex_lock(&hostprofile_data.lock);
+
+    struct HostState *state = get_or_add_host(origin);
+
+    if(state == NULL)
+    {
+        g_mutex_unlock(&hostprofile_data.lock);
+        return;
+    }
+
+    state->last_used = g_get_real_time() / G_USEC_PER_SEC;
+
+    if(observation->connect_failed)
+        state->connect_time_us = 0;
+    else if(observation->connect_time_us > 0)
+        state->connect_time_us =
+            moving_average(state->connect_time_us, observation->connect_time_us);
+
+    if(observation->bytes >= MIN_RATE_SAMPLE_BYTES &&
+       observation->bytes_per_second > 0)
+        state->rate = moving_average(state->rate, observation->bytes_per_second);
+
+    /* hosts which answer with HTTP/1.x are not pinned to it, negotiating
+     * costs nothing and the host may support HTTP/2 later */
+    if(observation->http2_failed)
+    {
+        state->http_version = HOSTPROFILE_HTTP_1;
+        state->http2_failed_at = state->last_used;
+    }
+    else if(observation->http_major == 2)
+        state->http_version = HOSTPROFILE_HTTP_2;
+    else if(observation->http_major == 1 &&
+            state->http_version == HOSTPROFILE_HTTP_2)
+        state->http_version = HOSTPROFILE_HTTP_ANY;
+
+    if(observation->connect_failed || observation->throttled)
+    {
+        const unsigned int current = state->concurrency > 0
+            ? state->concurrency
+            : hostprofile_data.max_concurrency;
+
+        state->concurrency = current > 1 ? current / 2 : 1;
+    }
+    else if(observation->succeeded && state->concurrency > 0 &&
+            ++state->concurrency >= hostprofile_data.max_concurrency)
+        state->concurrency = 0;
+
+    hostprofile_data.is_dirty = true;
+
+    g_mutex_unlock(&hostprofile_data.lock);
+}
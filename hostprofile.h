@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef HOSTPROFILE_H
+#define HOSTPROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * HTTP version to ask a host for.
+ */
+enum HostProfileHttpVersion
+{
+    /*! Negotiate, prefer HTTP/2. */
+    HOSTPROFILE_HTTP_ANY,
+
+    /*! HTTP/2 support of the host has recently turned out to be broken. */
+    HOSTPROFILE_HTTP_1,
+
+    /*! The host speaks HTTP/2. */
+    HOSTPROFILE_HTTP_2,
+};
+
+/*!
+ * Transfer settings for a host, derived from past transfers.
+ */
+struct HostProfile
+{
+    /*! Receive buffer size in bytes, 0 for the default size. */
+    size_t receive_buffer_size;
+
+    enum HostProfileHttpVersion http_version;
+
+    /*! Connect timeout in milliseconds. */
+    unsigned int connect_timeout_ms;
+
+    /*! Maximum number of concurrent transfers to the host per priority
+     *  class, 0 for no limit. */
+    unsigned int max_concurrency;
+
+    /*! Average transfer rate in bytes per second, 0 if unknown. */
+    uint64_t bytes_per_second;
+};
+
+/*!
+ * What has been observed during a single transfer.
+ */
+struct HostObservation
+{
+    /*! The transfer has completed successfully. */
+    bool succeeded;
+
+    /*! No connection to the host could be established. */
+    bool connect_failed;
+
+    /*! The host has refused to serve the request for now (HTTP status 429
+     *  or 503). */
+    bool throttled;
+
+    /*! An HTTP/2 protocol error has occurred. */
+    bool http2_failed;
+
+    /*! Major HTTP version used, 0 if unknown. */
+    unsigned int http_major;
+
+    /*! Time needed for connecting in microseconds, 0 if an existing
+     *  connection has been used. */
+    uint64_t connect_time_us;
+
+    /*! Number of bytes transferred. */
+    uint64_t bytes;
+
+    /*! Average transfer rate in bytes per second. */
+    uint64_t bytes_per_second;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hostprofile_init(const char *path, unsigned int max_concurrency);
+void hostprofile_deinit(void);
+bool hostprofile_save(void);
+void hostprofile_get(const char *origin, struct HostProfile *profile);
+void hostprofile_learn(const char *origin,
+                       const struct HostObservation *observation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !HOSTPROFILE_H */
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <glib.h>
+
+#include "membudget.h"
+#include "stats.h"
+#include "asynclog.h"
+#include "messages.h"
+
+/*!
+ * Usage above this percentage of the budget counts as memory pressure.
+ */
+#define HIGH_WATERMARK_PERCENT 75U
+
+/*!
+ * Queued and running downloads may use up to this percentage of the budget,
+ * more are rejected.
+ */
+#define ITEMS_LIMIT_PERCENT 50U
+
+/*!
+ * Minimum time between two reads of the kernel's pressure information.
+ */
+#define PRESSURE_POLL_INTERVAL_US (2 * G_USEC_PER_SEC)
+
+static const char pressure_file[] = "/proc/pressure/memory";
+
+static struct
+{
+    size_t budget_bytes;
+    unsigned int pressure_threshold;
+
+    atomic_size_t usage[MEMBUDGET_LAST_CATEGORY + 1];
+    atomic_size_t total_usage;
+    atomic_size_t peak_usage;
+
+    /*! Set by the thread which polls the kernel's pressure information. */
+    atomic_bool kernel_reports_pressure;
+
+    /*! Serializes polling of the kernel's pressure information. */
+    GMutex poll_lock;
+    gint64 next_pressure_poll;
+    bool pressure_file_missing;
+}
+membudget_data;
+
+/*!
+ * Set up memory budget.
+ *
+ * \param budget_bytes
+ *     Amount of memory the daemon should stay within, 0 for no limit.
+ *
+ * \param pressure_threshold
+ *     Percentage of time stalled on memory over the last 10 seconds as
+ *     reported by the kernel ("some avg10") above which the system is
+ *     considered under memory pressure, 0 to ignore the kernel's
+ *     information.
+ */
+void membudget_init(size_t budget_bytes, unsigned int pressure_threshold)
+{
+    membudget_data.budget_bytes = budget_bytes;
+    membudget_data.pressure_threshold = pressure_threshold;
+    membudget_data.pressure_file_missing = false;
+    membudget_data.next_pressure_poll = 0;
+    atomic_store(&membudget_data.kernel_reports_pressure, false);
+    atomic_store(&membudget_data.peak_usage,
+                 atomic_load(&membudget_data.total_usage));
+
+    if(budget_bytes > 0)
+        msg_info("Memory budget %zu kiB", budget_bytes / 1024);
+}
+
+void membudget_charge(enum MembudgetCategory category, size_t bytes)
+{
+    msg_log_assert(category <= MEMBUDGET_LAST_CATEGORY);
+
+    atomic_fetch_add_explicit(&membudget_data.usage[category], bytes,
+                              memory_order_relaxed);
+
+    const size_t total =
+        atomic_fetch_add_explicit(&membudget_data.total_usage, bytes,
+                                  memory_order_relaxed) + bytes;
+    size_t peak = atomic_load_explicit(&membudget_data.peak_usage,
+                                       memory_order_relaxed);
+
+    while(total > peak &&
+          !atomic_compare_exchange_weak_explicit(&membudget_data.peak_usage,
+                                                 &peak, total,
+                                                 memory_order_relaxed,
+                                                 memory_order_relaxed))
+        ;
+
+    stats_set(STATS_MEMORY_USED, total);
+    stats_set(STATS_MEMORY_PEAK,
+              atomic_load_explicit(&membudget_data.peak_usage,
+                                   memory_order_relaxed));
+}
+
+void membudget_release(enum MembudgetCategory category, size_t bytes)
+{
+    msg_log_assert(category <= MEMBUDGET_LAST_CATEGORY);
+
+    atomic_fetch_sub_explicit(&membudget_data.usage[category], bytes,
+                              memory_order_relaxed);
+
+    const size_t total =
+        atomic_fetch_sub_explicit(&membudget_data.total_usage, bytes,
+                                  memory_order_relaxed) - bytes;
+
+    stats_set(STATS_MEMORY_USED, total);
+}
+
+size_t membudget_get_usage(enum MembudgetCategory category)
+{
+    msg_log_assert(category <= MEMBUDGET_LAST_CATEGORY);
+    return atomic_load_explicit(&membudget_data.usage[category],
+                                memory_order_relaxed);
+}
+
+size_t membudget_get_total_usage(void)
+{
+    return atomic_load_explicit(&membudget_data.total_usage,
+                                memory_order_relaxed);
+}
+
+/*!
+ * Check whether or not allocating given amount of memory stays within budget.
+ */
+bool membudget_fits(size_t bytes)
+{
+    if(membudget_data.budget_bytes == 0)
+        return true;
+
+    return membudget_get_total_usage() + bytes <= membudget_data.budget_bytes;
+}
+
+/*!
+ * Check whether or not downloads stay within their share of the budget.
+ *
+ * The share is checked after the items have been charged, so the last item
+ * charged is the one which does not fit anymore.
+ */
+bool membudget_items_fit(void)
+{
+    if(membudget_data.budget_bytes == 0)
+        return true;
+
+    return membudget_get_usage(MEMBUDGET_ITEMS) <=
+           membudget_data.budget_bytes / 100 * ITEMS_LIMIT_PERCENT;
+}
+
+/*!
+ * Whether or not memory usage should be reduced.
+ *
+ * This is the case if usage is close to the budget, or if the kernel reports
+ * memory pressure for the whole system.
+ */
+bool membudget_is_under_pressure(void)
+{
+    if(atomic_load_explicit(&membudget_data.kernel_reports_pressure,
+                            memory_order_relaxed))
+        return true;
+
+    if(membudget_data.budget_bytes == 0)
+        return false;
+
+    return membudget_get_total_usage() >
+           membudget_data.budget_bytes / 100 * HIGH_WATERMARK_PERCENT;
+}
+
+static bool read_pressure(double *avg10)
+{
+    FILE *f = fopen(pressure_file, "r");
+
+    if(f == NULL)
+        return false;
+
+    char line[128];
+    bool found = false;
+
+    while(!found && fgets(line, sizeof(line), f) != NULL)
+    {
+        if(strncmp(line, "some ", 5) != 0)
+            continue;
+
+        const char *value = strstr(line, "avg10=");
+
+        if(value != NULL)
+        {
+            *avg10 = g_ascii_strtod(value + 6, NULL);
+            found = true;
+        }
+    }
+
+    fclose(f);
+
+    return found;
+}
+
+/*!
+ * Read the kernel's memory pressure information, if it is time to do so.
+ *
+ * This function is meant to be called regularly. In case it is called by
+ * multiple threads at the same time, only one of them does the work.
+ */
+void membudget_update_pressure(void)
+{
+    if(membudget_data.pressure_threshold == 0 ||
+       !g_mutex_trylock(&membudget_data.poll_lock))
+        return;
+
+    const gint64 now = g_get_monotonic_time();
+
+    if(membudget_data.pressure_file_missing ||
+       now < membudget_data.next_pressure_poll)
+    {
+        g_mutex_unlock(&membudget_data.poll_lock);
+        return;
+    }
+
+    membudget_data.next_pressure_poll = now + PRESSURE_POLL_INTERVAL_US;
+
+    double avg10;
+
+    if(!read_pressure(&avg10))
+    {
+        asynclog_info("Memory pressure information not available in %s",
+                      pressure_file);
+        membudget_data.pressure_file_missing = true;
+        g_mutex_unlock(&membudget_data.poll_lock);
+        return;
+    }
+
+    g_mutex_unlock(&membudget_data.poll_lock);
+
+    const bool pressure = avg10 >= membudget_data.pressure_threshold;
+    const bool previous =
+        atomic_exchange_explicit(&membudget_data.kernel_reports_pressure,
+                                 pressure, memory_order_relaxed);
+
+    if(pressure && !previous)
+    {
+        asynclog_info("System under memory pressure (avg10=%.2f)", avg10);
+        stats_inc(STATS_MEMORY_PRESSURE_EVENTS);
+    }
+    else if(!pressure && previous)
+        asynclog_info("System memory pressure relieved (avg10=%.2f)",
+                      avg10);
+}
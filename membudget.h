@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*!
+ * Kinds of memory accounted for by the memory budget.
+ */
+enum MembudgetCategory
+{
+    MEMBUDGET_RECEIVE_BUFFERS,
+    MEMBUDGET_WRITE_BUFFERS,
+    MEMBUDGET_ITEMS,
+    MEMBUDGET_EVENTS,
+
+    MEMBUDGET_LAST_CATEGORY = MEMBUDGET_EVENTS,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void membudget_init(size_t budget_bytes, unsigned int pressure_threshold);
+void membudget_charge(enum MembudgetCategory category, size_t bytes);
+void membudget_release(enum MembudgetCategory category, size_t bytes);
+size_t membudget_get_usage(enum MembudgetCategory category);
+size_t membudget_get_total_usage(void);
+bool membudget_fits(size_t bytes);
+bool membudget_items_fit(void);
+bool membudget_is_under_pressure(void);
+void membudget_update_pressure(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !MEMBUDGET_H */
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+
+#include "pathroots.h"
+#include "messages.h"
+
+/*
+ * Roots are added by the main thread during initialization and only read
+ * afterwards, also by the main thread.
+ */
+static struct
+{
+    /*! Canonical absolute paths without trailing slash, except for "/". */
+    GPtrArray *roots;
+}
+pathroots_data;
+
+void pathroots_init(void)
+{
+    pathroots_data.roots = g_ptr_array_new_with_free_func(g_free);
+}
+
+void pathroots_deinit(void)
+{
+    if(pathroots_data.roots == NULL)
+        return;
+
+    g_ptr_array_free(pathroots_data.roots, TRUE);
+    pathroots_data.roots = NULL;
+}
+
+/*!
+ * Allow clients to read files from and write files to given directory and
+ * anything below it.
+ *
+ * Symlinks in \p path are resolved, so the directory must exist.
+ *
+ * \returns
+ *     True on success, false if the directory cannot be resolved.
+ */
+bool pathroots_add(const char *path)
+{
+    msg_log_assert(path != NULL);
+
+    char *resolved = realpath(path, NULL);
+
+    if(resolved == NULL)
+    {
+        msg_error(errno, LOG_ERR, "Cannot allow access to \"%s\"", path);
+        return false;
+    }
+
+    g_ptr_array_add(pathroots_data.roots, g_strdup(resolved));
+    free(resolved);
+
+    return true;
+}
+
+static bool is_below(const char *path, const char *root)
+{
+    const size_t len = strlen(root);
+
+    if(strncmp(path, root, len) != 0)
+        return false;
+
+    return root[len - 1] == '/' || path[len] == '/' || path[len] == '\0';
+}
+
+static bool is_below_any_root(const char *path)
+{
+    for(guint i = 0; i < pathroots_data.roots->len; ++i)
+        if(is_below(path, g_ptr_array_index(pathroots_data.roots, i)))
+            return true;
+
+    return false;
+}
+
+/*!
+ * Check file to be read on behalf of a client.
+ *
+ * \returns
+ *     The canonical path of \p path as newly allocated string, or \c NULL
+ *     with \c errno set if the file does not exist (\c ENOENT or similar)
+ *     or is not below any allowed directory (\c EACCES).
+ */
+char *pathroots_resolve_source(const char *path)
+{
+    char *resolved = realpath(path, NULL);
+
+    if(resolved == NULL)
+        return NULL;
+
+    char *result = is_below_any_root(resolved) ? g_strdup(resolved) : NULL;
+
+    free(resolved);
+
+    if(result == NULL)
+        errno = EACCES;
+
+    return result;
+}
+
+/*!
+ * Check URL of a download on behalf of a client.
+ *
+ * URLs of local files (\c file://) are subject to the same restrictions as
+ * files read by path, see #pathroots_resolve_source(). Any other URL is
+ * taken as is.
+ *
+ * \returns
+ *     The URL as newly allocated string, with the canonical path for local
+ *     files, or \c NULL with \c errno set if a local file is refused as by
+ *     #pathroots_resolve_source(), or if a \c file URL is malformed or names
+ *     another host (\c EINVAL).
+ */
+char *pathroots_resolve_url(const char *url)
+{
+    if(g_ascii_strncasecmp(url, "file:", 5) != 0)
+        return g_strdup(url);
+
+    char *hostname = NULL;
+    char *path = g_filename_from_uri(url, &hostname, NULL);
+    const bool is_local =
+        path != NULL &&
+        (hostname == NULL || g_ascii_strcasecmp(hostname, "localhost") == 0);
+
+    g_free(hostname);
+
+    if(!is_local)
+    {
+        g_free(path);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    char *resolved = pathroots_resolve_source(path);
+    const int error = errno;
+
+    g_free(path);
+
+    if(resolved == NULL)
+    {
+        errno = error;
+        return NULL;
+    }
+
+    char *result = g_filename_to_uri(resolved, NULL, NULL);
+
+    g_free(resolved);
+
+    if(result == NULL)
+        errno = EINVAL;
+
+    return result;
+}
+
+/*!
+ * Check file to be written on behalf of a client.
+ *
+ * The directory containing \p path must exist and is resolved. The last
+ * path component is taken as is, it may or may not exist. Files are put in
+ * place by renaming, so a symlink of that name is replaced, not followed.
+ *
+ * \returns
+ *     \p path below the canonical path of its directory as newly allocated
+ *     string, or \c NULL with \c errno set if the directory does not exist
+ *     (\c ENOENT or similar), if the last component is not a name
+ *     (\c EINVAL), or if the directory is not below any allowed directory
+ *     (\c EACCES).
+ */
+char *pathroots_resolve_destination(const char *path)
+{
+    char *name = g_path_get_basename(path);
+    int error = 0;
+
+    if(!g_path_is_absolute(path) || g_str_has_suffix(path, "/") ||
+       strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+        error = EINVAL;
+
+    char *dir = g_path_get_dirname(path);
+    char *resolved = error == 0 ? realpath(dir, NULL) : NULL;
+    char *result = NULL;
+
+    if(error == 0 && resolved == NULL)
+        error = errno;
+    else if(resolved != NULL && !is_below_any_root(resolved))
+        error = EACCES;
+    else if(resolved != NULL)
+        result = g_build_filename(resolved, name, NULL);
+
+    free(resolved);
+    g_free(dir);
+    g_free(name);
+
+    if(result == NULL)
+        errno = error;
+
+    return result;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef PATHROOTS_H
+#define PATHROOTS_H
+
+#include <stdbool.h>
+
+/*!
+ * Maximum number of directories which may be configured in addition to the
+ * download directory and the storage tiers.
+ */
+#define PATHROOTS_MAX_EXTRA_ROOTS 8U
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pathroots_init(void);
+void pathroots_deinit(void);
+bool pathroots_add(const char *path);
+char *pathroots_resolve_source(const char *path);
+char *pathroots_resolve_url(const char *url);
+char *pathroots_resolve_destination(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PATHROOTS_H */
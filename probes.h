@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*!
+ * \file
+ * USDT probes for tracing with perf, bpftrace, or SystemTap.
+ *
+ * All probes belong to provider \c dbusdl. A probe compiles to a single
+ * \c nop instruction plus a note in the ELF file, so it costs nothing while
+ * no tracer is attached. Arguments are evaluated in any case, so they
+ * should be cheap to compute.
+ *
+ * Without \c sys/sdt.h, the probes compile to nothing.
+ */
+
+#if HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define DBUSDL_PROBE(name)           DTRACE_PROBE(dbusdl, name)
+#define DBUSDL_PROBE1(name, a)       DTRACE_PROBE1(dbusdl, name, a)
+#define DBUSDL_PROBE2(name, a, b)    DTRACE_PROBE2(dbusdl, name, a, b)
+#define DBUSDL_PROBE3(name, a, b, c) DTRACE_PROBE3(dbusdl, name, a, b, c)
+
+#else /* !HAVE_SYS_SDT_H */
+
+#define DBUSDL_PROBE(name)           do {} while(0)
+#define DBUSDL_PROBE1(name, a)       do {} while(0)
+#define DBUSDL_PROBE2(name, a, b)    do {} while(0)
+#define DBUSDL_PROBE3(name, a, b, c) do {} while(0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* !PROBES_H */
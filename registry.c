@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+
+#include "registry.h"
+#include "messages.h"
+
+/*
+ * All downloads known to the main thread, indexed by ID, by sender, and by
+ * tag. The secondary indices map a name to a set of entries so that entries
+ * can be added and removed in constant time.
+ *
+ * This is accessed from the main thread only.
+ */
+static struct
+{
+    /*! Map of item ID to #RegistryEntry, owns the entries. */
+    GHashTable *by_id;
+
+    /*! Map of sender name to set of #RegistryEntry. */
+    GHashTable *by_sender;
+
+    /*! Map of tag to set of #RegistryEntry. */
+    GHashTable *by_tag;
+}
+registry_data;
+
+static void free_entry(gpointer data)
+{
+    struct RegistryEntry *entry = data;
+
+    g_free(entry->sender);
+    g_free(entry->tag);
+    xferstatus_unref(entry->status);
+    g_free(entry);
+}
+
+void registry_init(void)
+{
+    registry_data.by_id =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free_entry);
+    registry_data.by_sender =
+        g_hash_table_new_full(g_str_hash, g_str_equal,
+                              g_free, (GDestroyNotify)g_hash_table_unref);
+    registry_data.by_tag =
+        g_hash_table_new_full(g_str_hash, g_str_equal,
+                              g_free, (GDestroyNotify)g_hash_table_unref);
+}
+
+void registry_deinit(void)
+{
+    g_hash_table_unref(registry_data.by_sender);
+    registry_data.by_sender = NULL;
+    g_hash_table_unref(registry_data.by_tag);
+    registry_data.by_tag = NULL;
+    g_hash_table_unref(registry_data.by_id);
+    registry_data.by_id = NULL;
+}
+
+static void index_insert(GHashTable *index, const char *key,
+                         struct RegistryEntry *entry)
+{
+    if(key == NULL)
+        return;
+
+    GHashTable *set = g_hash_table_lookup(index, key);
+
+    if(set == NULL)
+    {
+        set = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_insert(index, g_strdup(key), set);
+    }
+
+    g_hash_table_add(set, entry);
+}
+
+static void index_remove(GHashTable *index, const char *key,
+                         struct RegistryEntry *entry)
+{
+    if(key == NULL)
+        return;
+
+    GHashTable *set = g_hash_table_lookup(index, key);
+
+    if(set == NULL)
+        return;
+
+    g_hash_table_remove(set, entry);
+
+    if(g_hash_table_size(set) == 0)
+        g_hash_table_remove(index, key);
+}
+
+bool registry_add(uint32_t item_id, enum XferPriority priority,
+                  const char *sender, const char *tag,
+                  struct XferStatus *status)
+{
+    msg_log_assert(item_id != 0);
+
+    if(g_hash_table_contains(registry_data.by_id, GUINT_TO_POINTER(item_id)))
+    {
+        msg_error(0, LOG_CRIT, "BUG: Item ID %u registered twice", item_id);
+        return false;
+    }
+
+    struct RegistryEntry *entry = g_try_malloc0(sizeof(*entry));
+
+    if(entry == NULL)
+    {
+        msg_out_of_memory("RegistryEntry");
+        return false;
+    }
+
+    entry->item_id = item_id;
+    entry->priority = priority;
+    entry->sender = g_strdup(sender);
+    entry->tag = g_strdup(tag);
+    entry->status = xferstatus_ref(status);
+
+    g_hash_table_insert(registry_data.by_id, GUINT_TO_POINTER(item_id), entry);
+    index_insert(registry_data.by_sender, entry->sender, entry);
+    index_insert(registry_data.by_tag, entry->tag, entry);
+
+    return true;
+}
+
+void registry_remove(uint32_t item_id)
+{
+    struct RegistryEntry *entry =
+        g_hash_table_lookup(registry_data.by_id, GUINT_TO_POINTER(item_id));
+
+    if(entry == NULL)
+        return;
+
+    index_remove(registry_data.by_sender, entry->sender, entry);
+    index_remove(registry_data.by_tag, entry->tag, entry);
+    g_hash_table_remove(registry_data.by_id, GUINT_TO_POINTER(item_id));
+}
+
+const struct RegistryEntry *registry_lookup(uint32_t item_id)
+{
+    return g_hash_table_lookup(registry_data.by_id, GUINT_TO_POINTER(item_id));
+}
+
+void registry_set_deadline(uint32_t item_id, int64_t deadline)
+{
+    struct RegistryEntry *entry =
+        g_hash_table_lookup(registry_data.by_id, GUINT_TO_POINTER(item_id));
+
+    if(entry != NULL)
+        entry->deadline = deadline;
+}
+
+unsigned int registry_get_count(void)
+{
+    return g_hash_table_size(registry_data.by_id);
+}
+
+/*
+ * Works for the main table as well as for the sets in the secondary indices
+ * because values equal keys in the latter.
+ */
+static unsigned int foreach_in_table(GHashTable *table,
+                                     RegistryForeachFn fn, void *user_data)
+{
+    if(table == NULL)
+        return 0;
+
+    GHashTableIter iter;
+    gpointer value;
+    unsigned int count = 0;
+
+    g_hash_table_iter_init(&iter, table);
+
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        fn(value, user_data);
+        ++count;
+    }
+
+    return count;
+}
+
+/*!
+ * Call function for each registered download.
+ *
+ * The registry must not be modified by \p fn.
+ *
+ * \returns
+ *     The number of entries passed to \p fn.
+ */
+unsigned int registry_foreach(RegistryForeachFn fn, void *user_data)
+{
+    return foreach_in_table(registry_data.by_id, fn, user_data);
+}
+
+unsigned int registry_foreach_by_sender(const char *sender,
+                                        RegistryForeachFn fn, void *user_data)
+{
+    return foreach_in_table(g_hash_table_lookup(registry_data.by_sender,
+                                                sender),
+                            fn, user_data);
+}
+
+unsigned int registry_foreach_by_tag(const char *tag,
+                                     RegistryForeachFn fn, void *user_data)
+{
+    return foreach_in_table(g_hash_table_lookup(registry_data.by_tag, tag),
+                            fn, user_data);
+}
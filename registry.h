@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xferitem.h"
+#include "xferstatus.h"
+
+/*!
+ * What the main thread knows about a download which has not finished yet.
+ */
+struct RegistryEntry
+{
+    uint32_t item_id;
+    enum XferPriority priority;
+
+    /*! Unique D-Bus name of the client which requested the download,
+     *  \c NULL if unknown. */
+    char *sender;
+
+    /*! Tag passed by the client, \c NULL if none. */
+    char *tag;
+
+    /*! Deadline of the item, see #XferItem::deadline. */
+    int64_t deadline;
+
+    /*! Status published by the transfer thread. */
+    struct XferStatus *status;
+};
+
+typedef void (*RegistryForeachFn)(const struct RegistryEntry *entry,
+                                  void *user_data);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void registry_init(void);
+void registry_deinit(void);
+bool registry_add(uint32_t item_id, enum XferPriority priority,
+                  const char *sender, const char *tag,
+                  struct XferStatus *status);
+void registry_remove(uint32_t item_id);
+const struct RegistryEntry *registry_lookup(uint32_t item_id);
+void registry_set_deadline(uint32_t item_id, int64_t deadline);
+unsigned int registry_get_count(void);
+unsigned int registry_foreach(RegistryForeachFn fn, void *user_data);
+unsigned int registry_foreach_by_sender(const char *sender,
+                                        RegistryForeachFn fn, void *user_data);
+unsigned int registry_foreach_by_tag(const char *tag,
+                                     RegistryForeachFn fn, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !REGISTRY_H */
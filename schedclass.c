@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "schedclass.h"
+#include "messages.h"
+
+/*
+ * Not exported by the C library, see ioprio_set(2).
+ */
+#define IOPRIO_CLASS_SHIFT      13
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#define IOPRIO_WHO_PROCESS      1
+#define IOPRIO_CLASS_BE         2
+#define IOPRIO_CLASS_IDLE       3
+
+/*!
+ * How threads of a priority class are scheduled by the kernel.
+ */
+struct SchedClass
+{
+    const char *name;
+
+    /*! Nice level of the thread. */
+    int nice_level;
+
+    /*! Whether or not to use \c SCHED_IDLE instead of \c SCHED_OTHER. */
+    bool idle_policy;
+
+    /*! I/O scheduling class, one of the \c IOPRIO_CLASS_* values. */
+    int io_class;
+
+    /*! Priority within the I/O scheduling class, 0 is highest. */
+    int io_level;
+};
+
+/*
+ * Only the background class is allowed to starve. Nice levels below 0 and
+ * the real-time I/O class would require privileges we usually don't have,
+ * so the interactive class is faster only by comparison.
+ */
+static const struct SchedClass sched_classes[XFER_PRIORITY_LAST + 1] =
+{
+    [XFER_PRIORITY_INTERACTIVE] = { "interactive", 0,  false, IOPRIO_CLASS_BE,   0 },
+    [XFER_PRIORITY_NORMAL]      = { "normal",      5,  false, IOPRIO_CLASS_BE,   4 },
+    [XFER_PRIORITY_BACKGROUND]  = { "background",  19, true,  IOPRIO_CLASS_IDLE, 0 },
+};
+
+const char *schedclass_get_name(enum XferPriority priority)
+{
+    msg_log_assert(priority <= XFER_PRIORITY_LAST);
+    return sched_classes[priority].name;
+}
+
+bool schedclass_parse_name(const char *name, enum XferPriority *priority)
+{
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+    {
+        if(strcmp(name, sched_classes[i].name) == 0)
+        {
+            *priority = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void set_io_priority(const struct SchedClass *sc)
+{
+#ifdef SYS_ioprio_set
+    /* "who" 0 refers to the calling thread */
+    if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+               IOPRIO_PRIO_VALUE(sc->io_class, sc->io_level)) < 0)
+        msg_error(errno, LOG_WARNING,
+                  "Failed setting I/O priority of %s transfer thread",
+                  sc->name);
+#endif /* SYS_ioprio_set */
+}
+
+/*!
+ * Set CPU and I/O priorities of the calling thread.
+ *
+ * Failures are logged, but are not fatal.
+ */
+void schedclass_apply_to_current_thread(enum XferPriority priority)
+{
+    msg_log_assert(priority <= XFER_PRIORITY_LAST);
+
+    const struct SchedClass *sc = &sched_classes[priority];
+
+    if(sc->idle_policy)
+    {
+        const struct sched_param param = { .sched_priority = 0 };
+        const int err = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+        if(err != 0)
+            msg_error(err, LOG_WARNING,
+                      "Failed setting SCHED_IDLE for %s transfer thread",
+                      sc->name);
+    }
+
+    /* on Linux, the nice level is a per-thread attribute, and "who" 0 refers
+     * to the calling thread */
+    if(setpriority(PRIO_PROCESS, 0, sc->nice_level) < 0)
+        msg_error(errno, LOG_WARNING,
+                  "Failed setting nice level %d for %s transfer thread",
+                  sc->nice_level, sc->name);
+
+    set_io_priority(sc);
+
+    msg_info("Transfer thread for %s downloads: nice %d%s, I/O class %d/%d",
+             sc->name, sc->nice_level, sc->idle_policy ? ", SCHED_IDLE" : "",
+             sc->io_class, sc->io_level);
+}
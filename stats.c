@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdatomic.h>
+
+#include "stats.h"
+#include "messages.h"
+
+static atomic_uint_fast64_t counters[STATS_LAST_COUNTER + 1];
+
+static const char *const counter_names[STATS_LAST_COUNTER + 1] =
+{
+    [STATS_TRANSFERS_STARTED]   = "transfers_started",
+    [STATS_TRANSFERS_SUCCEEDED] = "transfers_succeeded",
+    [STATS_TRANSFERS_FAILED]    = "transfers_failed",
+    [STATS_TRANSFERS_CANCELED]  = "transfers_canceled",
+    [STATS_BYTES_RECEIVED]      = "bytes_received",
+    [STATS_BYTES_SENT]          = "bytes_sent",
+    [STATS_CONNECTIONS_OPENED]  = "connections_opened",
+    [STATS_CONNECTIONS_REUSED]  = "connections_reused",
+    [STATS_STREAMS_MULTIPLEXED] = "streams_multiplexed",
+    [STATS_PREWARMS_STARTED]    = "prewarms_started",
+    [STATS_TRANSFERS_DEFERRED]  = "transfers_deferred",
+    [STATS_MEMORY_USED]         = "memory_used_bytes",
+    [STATS_MEMORY_PEAK]         = "memory_peak_bytes",
+    [STATS_MEMORY_PRESSURE_EVENTS] = "memory_pressure_events",
+    [STATS_HEDGES_STARTED]      = "hedges_started",
+    [STATS_HEDGES_WON]          = "hedges_won",
+    [STATS_HEDGES_LOST]         = "hedges_lost",
+    [STATS_HEDGES_FAILED]       = "hedges_failed",
+    [STATS_DEADLINES_MISSED]    = "deadlines_missed",
+    [STATS_LOCAL_COPIES]        = "local_copies",
+    [STATS_TRANSFERS_PAUSED]    = "transfers_paused",
+    [STATS_PAUSED_MS]           = "paused_ms",
+    [STATS_LOG_MESSAGES_DROPPED] = "log_messages_dropped",
+    [STATS_LOG_MESSAGES_SUPPRESSED] = "log_messages_suppressed",
+    [STATS_DELTA_DOWNLOADS] = "delta_downloads",
+    [STATS_DELTA_BYTES_REUSED] = "delta_bytes_reused",
+    [STATS_ARCHIVES_EXTRACTED] = "archives_extracted",
+    [STATS_TRANSFERS_REJECTED] = "transfers_rejected",
+};
+
+void stats_reset(void)
+{
+    for(unsigned int i = 0; i <= STATS_LAST_COUNTER; ++i)
+        atomic_store_explicit(&counters[i], 0, memory_order_relaxed);
+}
+
+void stats_add(enum StatsCounter counter, uint64_t value)
+{
+    msg_log_assert(counter <= STATS_LAST_COUNTER);
+    atomic_fetch_add_explicit(&counters[counter], value, memory_order_relaxed);
+}
+
+void stats_inc(enum StatsCounter counter)
+{
+    stats_add(counter, 1);
+}
+
+void stats_set(enum StatsCounter counter, uint64_t value)
+{
+    msg_log_assert(counter <= STATS_LAST_COUNTER);
+    atomic_store_explicit(&counters[counter], value, memory_order_relaxed);
+}
+
+uint64_t stats_get(enum StatsCounter counter)
+{
+    msg_log_assert(counter <= STATS_LAST_COUNTER);
+    return atomic_load_explicit(&counters[counter], memory_order_relaxed);
+}
+
+const char *stats_get_name(enum StatsCounter counter)
+{
+    msg_log_assert(counter <= STATS_LAST_COUNTER);
+    return counter_names[counter];
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/*!
+ * Statistics counters maintained by the daemon.
+ *
+ * All counters may be updated from any thread. They are exported via D-Bus
+ * using the names returned by #stats_get_name(). The memory usage values are
+ * gauges set by #stats_set(), all others only ever increase.
+ */
+enum StatsCounter
+{
+    STATS_TRANSFERS_STARTED,
+    STATS_TRANSFERS_SUCCEEDED,
+    STATS_TRANSFERS_FAILED,
+    STATS_TRANSFERS_CANCELED,
+    STATS_BYTES_RECEIVED,
+    STATS_BYTES_SENT,
+    STATS_CONNECTIONS_OPENED,
+    STATS_CONNECTIONS_REUSED,
+    STATS_STREAMS_MULTIPLEXED,
+    STATS_PREWARMS_STARTED,
+    STATS_TRANSFERS_DEFERRED,
+    STATS_MEMORY_USED,
+    STATS_MEMORY_PEAK,
+    STATS_MEMORY_PRESSURE_EVENTS,
+    STATS_HEDGES_STARTED,
+    STATS_HEDGES_WON,
+    STATS_HEDGES_LOST,
+    STATS_HEDGES_FAILED,
+    STATS_DEADLINES_MISSED,
+    STATS_LOCAL_COPIES,
+    STATS_TRANSFERS_PAUSED,
+    STATS_PAUSED_MS,
+    STATS_LOG_MESSAGES_DROPPED,
+    STATS_LOG_MESSAGES_SUPPRESSED,
+    STATS_DELTA_DOWNLOADS,
+    STATS_DELTA_BYTES_REUSED,
+    STATS_ARCHIVES_EXTRACTED,
+    STATS_TRANSFERS_REJECTED,
+
+    STATS_LAST_COUNTER = STATS_TRANSFERS_REJECTED,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void stats_reset(void);
+void stats_add(enum StatsCounter counter, uint64_t value);
+void stats_inc(enum StatsCounter counter);
+void stats_set(enum StatsCounter counter, uint64_t value);
+uint64_t stats_get(enum StatsCounter counter);
+const char *stats_get_name(enum StatsCounter counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STATS_H */
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <errno.h>
+#include <sys/statvfs.h>
+
+#include "storagetier.h"
+#include "messages.h"
+
+/*!
+ * Weight of a new write throughput sample in eighths.
+ */
+#define RATE_SAMPLE_WEIGHT          2U
+
+/*!
+ * Writes of fewer bytes mostly measure the page cache, not the device.
+ */
+#define MIN_RATE_SAMPLE_BYTES       (1024U * 1024U)
+
+/*!
+ * A directory downloads may be stored in.
+ */
+struct StorageTier
+{
+    char *path;
+
+    /*! Largest file placed on the tier, 0 for no limit. */
+    uint64_t max_file_size;
+
+    /*! Space claimed by items placed on the tier which are not written
+     *  completely yet. */
+    uint64_t reserved;
+
+    /*! Average write throughput in bytes per second, 0 if unknown. */
+    uint64_t rate;
+};
+
+/*
+ * Items are placed by the main thread and by transfer threads, and write
+ * throughput is measured by the transfer threads, so accesses to
+ * reservations and rates are serialized by a mutex. Paths and file size
+ * limits are not changed after initialization.
+ */
+static struct
+{
+    GMutex lock;
+    struct StorageTier tiers[STORAGETIER_MAX_TIERS];
+    unsigned int count;
+}
+storagetier_data;
+
+void storagetier_init(void)
+{
+    g_mutex_init(&storagetier_data.lock);
+    storagetier_data.count = 0;
+}
+
+void storagetier_deinit(void)
+{
+    for(unsigned int i = 0; i < storagetier_data.count; ++i)
+    {
+        g_free(storagetier_data.tiers[i].path);
+        storagetier_data.tiers[i].path = NULL;
+    }
+
+    storagetier_data.count = 0;
+    g_mutex_clear(&storagetier_data.lock);
+}
+
+/*!
+ * Add directory to store downloads in.
+ *
+ * Tiers should be added fastest first. Until write throughput has been
+ * measured for two tiers, the order of addition decides which of them is
+ * preferred.
+ *
+ * \param path
+ *     Directory to store files in.
+ *
+ * \param max_file_size
+ *     Only files up to this size are placed on the tier, 0 for no limit.
+ *
+ * \param create_path
+ *     Create the directory if it does not exist.
+ *
+ * \returns
+ *     Index of the new tier, or -1 if there are too many tiers already.
+ */
+int storagetier_add(const char *path, uint64_t max_file_size,
+                    bool create_path)
+{
+    msg_log_assert(path != NULL);
+
+    if(storagetier_data.count >= STORAGETIER_MAX_TIERS)
+    {
+        msg_error(0, LOG_ERR, "Too many storage tiers, ignoring \"%s\"",
+                  path);
+        return -1;
+    }
+
+    if(create_path && g_mkdir_with_parents(path, 0770) < 0)
+        msg_error(errno, LOG_ERR, "Failed creating directory \"%s\".", path);
+
+    struct StorageTier *tier =
+        &storagetier_data.tiers[storagetier_data.count];
+
+    tier->path = g_strdup(path);
+    tier->max_file_size = max_file_size;
+    tier->reserved = 0;
+    tier->rate = 0;
+
+    return storagetier_data.count++;
+}
+
+unsigned int storagetier_get_count(void)
+{
+    return storagetier_data.count;
+}
+
+const char *storagetier_get_path(int tier)
+{
+    msg_log_assert(tier >= 0);
+    msg_log_assert((unsigned int)tier < storagetier_data.count);
+
+    return storagetier_data.tiers[tier].path;
+}
+
+/*!
+ * Free space on the tier which is not claimed by items placed on it.
+ */
+static uint64_t get_available_space(const struct StorageTier *tier)
+{
+    struct statvfs buf;
+
+    if(statvfs(tier->path, &buf) < 0)
+        return 0;
+
+    const uint64_t space = (uint64_t)buf.f_bavail * buf.f_frsize;
+
+    return space > tier->reserved ? space - tier->reserved : 0;
+}
+
+/*!
+ * Whether or not \p tier has been measured faster than \p other.
+ */
+static bool is_faster(const struct StorageTier *tier,
+                      const struct StorageTier *other)
+{
+    return tier->rate > 0 && other->rate > 0 && tier->rate > other->rate;
+}
+
+static bool is_suitable(const struct StorageTier *tier, uint64_t size,
+                        bool is_short_lived)
+{
+    if(size == 0)
+        return tier->max_file_size == 0 || is_short_lived;
+
+    return (tier->max_file_size == 0 || size <= tier->max_file_size) &&
+           get_available_space(tier) >= size;
+}
+
+/*!
+ * Choose tier for storing a file, claim space on it.
+ *
+ * The fastest tier which has room for the file and whose file size limit
+ * is not exceeded is chosen. Files of unknown size are placed on tiers
+ * without a file size limit only, unless they are known to be removed
+ * soon after download. If no tier fits, the one with the most free space
+ * is chosen.
+ *
+ * \param size
+ *     Expected size of the file, 0 if unknown.
+ *
+ * \param is_short_lived
+ *     The client is going to remove the file soon after download.
+ *
+ * \returns
+ *     Index of the chosen tier, or -1 if there are no tiers. The claimed
+ *     space must be returned by #storagetier_release().
+ */
+int storagetier_select(uint64_t size, bool is_short_lived)
+{
+    g_mutex_lock(&storagetier_data.lock);
+
+    int best = -1;
+
+    for(unsigned int i = 0; i < storagetier_data.count; ++i)
+    {
+        const struct StorageTier *tier = &storagetier_data.tiers[i];
+
+        if(is_suitable(tier, size, is_short_lived) &&
+           (best < 0 || is_faster(tier, &storagetier_data.tiers[best])))
+            best = i;
+    }
+
+    if(best < 0)
+    {
+        uint64_t most_space = 0;
+
+        for(unsigned int i = 0; i < storagetier_data.count; ++i)
+        {
+            const uint64_t space =
+                get_available_space(&storagetier_data.tiers[i]);
+
+            if(best < 0 || space > most_space)
+            {
+                best = i;
+                most_space = space;
+            }
+        }
+    }
+
+    if(best >= 0)
+        storagetier_data.tiers[best].reserved += size;
+
+    g_mutex_unlock(&storagetier_data.lock);
+
+    return best;
+}
+
+/*!
+ * Claim additional space on a tier an item has been placed on already.
+ *
+ * \returns
+ *     True if the tier has \p size bytes of unclaimed space, which are
+ *     claimed then and must be returned by #storagetier_release(). False
+ *     if there is not enough space, nothing is claimed in this case.
+ */
+bool storagetier_claim(int tier, uint64_t size)
+{
+    msg_log_assert(tier >= 0);
+    msg_log_assert((unsigned int)tier < storagetier_data.count);
+
+    g_mutex_lock(&storagetier_data.lock);
+
+    struct StorageTier *t = &storagetier_data.tiers[tier];
+    const bool have_space = get_available_space(t) >= size;
+
+    if(have_space)
+        t->reserved += size;
+
+    g_mutex_unlock(&storagetier_data.lock);
+
+    return have_space;
+}
+
+/*!
+ * Return space claimed by #storagetier_select() or #storagetier_claim().
+ */
+void storagetier_release(int tier, uint64_t size)
+{
+    if(tier < 0 || size == 0)
+        return;
+
+    msg_log_assert((unsigned int)tier < storagetier_data.count);
+
+    g_mutex_lock(&storagetier_data.lock);
+
+    struct StorageTier *t = &storagetier_data.tiers[tier];
+
+    if(t->reserved >= size)
+        t->reserved -= size;
+    else
+    {
+        msg_error(0, LOG_CRIT,
+                  "BUG: Releasing %" G_GUINT64_FORMAT " bytes on tier %d, "
+                  "only %" G_GUINT64_FORMAT " reserved",
+                  size, tier, t->reserved);
+        t->reserved = 0;
+    }
+
+    g_mutex_unlock(&storagetier_data.lock);
+}
+
+/*!
+ * Take note of time spent writing a file to a tier.
+ *
+ * \param tier
+ *     The tier the file has been written to.
+ *
+ * \param bytes
+ *     Size of the file.
+ *
+ * \param duration_us
+ *     Time spent in writing and closing the file in microseconds.
+ */
+void storagetier_record_write(int tier, uint64_t bytes, uint64_t duration_us)
+{
+    if(tier < 0 || bytes < MIN_RATE_SAMPLE_BYTES || duration_us == 0)
+        return;
+
+    msg_log_assert((unsigned int)tier < storagetier_data.count);
+
+    const uint64_t sample = bytes * G_USEC_PER_SEC / duration_us;
+
+    g_mutex_lock(&storagetier_data.lock);
+
+    struct StorageTier *t = &storagetier_data.tiers[tier];
+
+    if(t->rate == 0)
+        t->rate = sample;
+    else
+        t->rate = (t->rate * (8U - RATE_SAMPLE_WEIGHT) +
+                   sample * RATE_SAMPLE_WEIGHT) / 8U;
+
+    if(t->rate == 0)
+        t->rate = 1;
+
+    g_mutex_unlock(&storagetier_data.lock);
+}
+
+/*!
+ * Average write throughput of a tier in bytes per second, 0 if unknown.
+ */
+uint64_t storagetier_get_rate(int tier)
+{
+    msg_log_assert(tier >= 0);
+    msg_log_assert((unsigned int)tier < storagetier_data.count);
+
+    g_mutex_lock(&storagetier_data.lock);
+    const uint64_t rate = storagetier_data.tiers[tier].rate;
+    g_mutex_unlock(&storagetier_data.lock);
+
+    return rate;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef STORAGETIER_H
+#define STORAGETIER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Maximum number of storage tiers.
+ */
+#define STORAGETIER_MAX_TIERS 4U
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void storagetier_init(void);
+void storagetier_deinit(void);
+int storagetier_add(const char *path, uint64_t max_file_size,
+                    bool create_path);
+unsigned int storagetier_get_count(void);
+const char *storagetier_get_path(int tier);
+int storagetier_select(uint64_t size, bool is_short_lived);
+bool storagetier_claim(int tier, uint64_t size);
+void storagetier_release(int tier, uint64_t size);
+void storagetier_record_write(int tier, uint64_t bytes, uint64_t duration_us);
+uint64_t storagetier_get_rate(int tier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STORAGETIER_H */
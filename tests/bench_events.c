@@ -0,0 +1,588 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+/*
+ * Benchmark and stress test for the event queues and XferItem allocation.
+ *
+ * Several producer threads push events through the queue from the main
+ * thread to the transfer threads, and through the queue from the transfer
+ * threads to the main thread. Throughput, queueing latency, and the number
+ * of heap allocations per event are measured. Each item must be received
+ * exactly once, and all memory accounted for in the memory budget must have
+ * been returned in the end, otherwise the program fails.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "events.h"
+#include "membudget.h"
+#include "messages.h"
+
+ssize_t (*os_read)(int fd, void *dest, size_t count) = read;
+ssize_t (*os_write)(int fd, const void *buf, size_t count) = write;
+
+#define DEFAULT_EVENTS          2000000U
+#define DEFAULT_PRODUCERS       4U
+#define DEFAULT_QUEUE_DEPTH     1024U
+
+#ifdef __GLIBC__
+
+/*
+ * Count heap allocations by interposing the allocator functions of the C
+ * library. GLib allocates through these as well.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_ulong allocations;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if(ptr == NULL)
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+
+    return __libc_realloc(ptr, size);
+}
+
+static unsigned long get_allocations(void)
+{
+    return atomic_load(&allocations);
+}
+
+#define HAVE_ALLOCATION_COUNTER 1
+
+#else /* !__GLIBC__ */
+
+static unsigned long get_allocations(void)
+{
+    return 0;
+}
+
+#define HAVE_ALLOCATION_COUNTER 0
+
+#endif /* __GLIBC__ */
+
+struct Parameters
+{
+    unsigned int events;
+    unsigned int producers;
+    unsigned int queue_depth;
+};
+
+/*!
+ * State shared by all threads of a single benchmark run.
+ */
+struct Run
+{
+    const struct Parameters *params;
+
+    /*! Send time in nanoseconds, indexed by item ID. */
+    uint64_t *sent_at;
+
+    /*! Queueing latency in nanoseconds, one per received item. */
+    uint32_t *latencies;
+    atomic_uint latencies_count;
+
+    /*! How often each item ID has been received. */
+    atomic_uchar *seen;
+
+    /*! Events sent, but not received yet. */
+    atomic_uint in_flight;
+
+    /*! Producers which have not finished yet. */
+    atomic_uint producers_running;
+
+    atomic_uint progress_events_received;
+};
+
+struct Producer
+{
+    struct Run *run;
+    unsigned int index;
+    unsigned int count;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static bool init_run(struct Run *run, const struct Parameters *params)
+{
+    memset(run, 0, sizeof(*run));
+    run->params = params;
+    run->sent_at = g_try_new0(uint64_t, params->events + 1);
+    run->latencies = g_try_new0(uint32_t, params->events);
+    run->seen = g_try_new0(atomic_uchar, params->events + 1);
+    atomic_store(&run->producers_running, params->producers);
+
+    xferitem_init("/tmp/downloads", false);
+
+    return run->sent_at != NULL && run->latencies != NULL && run->seen != NULL;
+}
+
+static void free_run(struct Run *run)
+{
+    g_free(run->sent_at);
+    g_free(run->latencies);
+    g_free(run->seen);
+    xferitem_deinit();
+}
+
+/*!
+ * Keep queues short so that latency reflects the queues, not the backlog.
+ */
+static void wait_for_queue_space(struct Run *run)
+{
+    while(atomic_load_explicit(&run->in_flight, memory_order_relaxed) >=
+          run->params->queue_depth)
+        g_thread_yield();
+}
+
+static void record_receipt(struct Run *run, const struct XferItem *item)
+{
+    const uint64_t latency = now_ns() - run->sent_at[item->item_id];
+    const unsigned int idx = atomic_fetch_add(&run->latencies_count, 1);
+
+    run->latencies[idx] = latency > UINT32_MAX ? UINT32_MAX : latency;
+    atomic_fetch_add(&run->seen[item->item_id], 1);
+    atomic_fetch_sub_explicit(&run->in_flight, 1, memory_order_relaxed);
+}
+
+static struct XferItem *make_item(struct Run *run)
+{
+    struct XferItem *item = xferitem_allocate("http://localhost/file", 100);
+
+    if(item == NULL)
+    {
+        fprintf(stderr, "Failed allocating item\n");
+        abort();
+    }
+
+    if(item->item_id > run->params->events)
+    {
+        fprintf(stderr, "Unexpected item ID %u\n", item->item_id);
+        abort();
+    }
+
+    return item;
+}
+
+static gpointer from_user_producer(gpointer data)
+{
+    struct Producer *p = data;
+    struct Run *run = p->run;
+    const enum XferPriority priority = p->index % (XFER_PRIORITY_LAST + 1);
+
+    for(unsigned int i = 0; i < p->count; ++i)
+    {
+        struct XferItem *item = make_item(run);
+        struct EventFromUser *ev = events_from_user_new_start_download(item);
+
+        wait_for_queue_space(run);
+        atomic_fetch_add_explicit(&run->in_flight, 1, memory_order_relaxed);
+        run->sent_at[item->item_id] = now_ns();
+        events_from_user_send(priority, ev);
+    }
+
+    if(atomic_fetch_sub(&run->producers_running, 1) == 1)
+    {
+        /* last one out tells the consumers to stop */
+        for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+            events_from_user_send(i, events_from_user_new_shutdown());
+    }
+
+    return NULL;
+}
+
+struct Consumer
+{
+    struct Run *run;
+    enum XferPriority priority;
+};
+
+static gpointer from_user_consumer(gpointer data)
+{
+    struct Consumer *c = data;
+
+    while(1)
+    {
+        struct EventFromUser *ev = events_from_user_receive(c->priority, true);
+
+        if(ev->event_id == EVENT_FROM_USER_SHUTDOWN)
+        {
+            events_from_user_free(ev);
+            break;
+        }
+
+        record_receipt(c->run, ev->d.item);
+        xferitem_free(ev->d.item);
+        ev->d.item = NULL;
+        events_from_user_free(ev);
+    }
+
+    return NULL;
+}
+
+static gpointer to_user_producer(gpointer data)
+{
+    struct Producer *p = data;
+    struct Run *run = p->run;
+
+    for(unsigned int i = 0; i < p->count; ++i)
+    {
+        struct XferItem *item = make_item(run);
+
+        wait_for_queue_space(run);
+        atomic_fetch_add_explicit(&run->in_flight, 1, memory_order_relaxed);
+
+        /* the item is owned by the done event, so the progress event must
+         * be sent first */
+        events_to_user_send(events_to_user_new_report_progress(item, 50));
+        run->sent_at[item->item_id] = now_ns();
+        events_to_user_send(events_to_user_new_done(item, LIST_ERROR_OK));
+    }
+
+    return NULL;
+}
+
+static void to_user_consume(struct Run *run)
+{
+    unsigned int remaining = run->params->events;
+
+    while(remaining > 0)
+    {
+        struct EventToUser *ev = events_to_user_receive(true);
+
+        switch(ev->event_id)
+        {
+          case EVENT_TO_USER_REPORT_PROGRESS:
+            atomic_fetch_add(&run->progress_events_received, 1);
+            break;
+
+          case EVENT_TO_USER_DONE:
+            record_receipt(run, ev->xi.const_item);
+            --remaining;
+            break;
+        }
+
+        events_to_user_free(ev, false);
+    }
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    const uint32_t la = *(const uint32_t *)a;
+    const uint32_t lb = *(const uint32_t *)b;
+    return (la > lb) - (la < lb);
+}
+
+static double percentile_us(const uint32_t *sorted, unsigned int count,
+                            double fraction)
+{
+    if(count == 0)
+        return 0.0;
+
+    unsigned int idx = (unsigned int)(fraction * count);
+
+    if(idx >= count)
+        idx = count - 1;
+
+    return sorted[idx] / 1000.0;
+}
+
+/*!
+ * Print results, check that each item has been received exactly once.
+ */
+static bool report(const char *name, struct Run *run, uint64_t elapsed_ns,
+                   unsigned long allocations, unsigned int events_per_item)
+{
+    const struct Parameters *params = run->params;
+    const unsigned int count = atomic_load(&run->latencies_count);
+    const unsigned int total_events = params->events * events_per_item;
+    bool ok = true;
+
+    qsort(run->latencies, count, sizeof(*run->latencies), compare_latencies);
+
+    printf("%-10s %u events, %u producers: %.0f events/s, "
+           "latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us",
+           name, total_events, params->producers,
+           total_events / (elapsed_ns / 1e9),
+           percentile_us(run->latencies, count, 0.5),
+           percentile_us(run->latencies, count, 0.99),
+           percentile_us(run->latencies, count, 0.999),
+           percentile_us(run->latencies, count, 1.0));
+
+    if(HAVE_ALLOCATION_COUNTER)
+        printf(", %.2f allocations/event\n",
+               (double)allocations / total_events);
+    else
+        printf("\n");
+
+    if(count != params->events)
+    {
+        fprintf(stderr, "%s: received %u of %u items\n",
+                name, count, params->events);
+        ok = false;
+    }
+
+    for(unsigned int id = 1; id <= params->events; ++id)
+    {
+        const unsigned char seen = atomic_load(&run->seen[id]);
+
+        if(seen != 1)
+        {
+            fprintf(stderr, "%s: item %u received %u times\n", name, id, seen);
+            ok = false;
+            break;
+        }
+    }
+
+    if(membudget_get_usage(MEMBUDGET_ITEMS) != 0 ||
+       membudget_get_usage(MEMBUDGET_EVENTS) != 0)
+    {
+        fprintf(stderr, "%s: %zu bytes of items, %zu bytes of events leaked "
+                "or freed twice\n", name,
+                membudget_get_usage(MEMBUDGET_ITEMS),
+                membudget_get_usage(MEMBUDGET_EVENTS));
+        ok = false;
+    }
+
+    return ok;
+}
+
+static struct Producer *start_producers(struct Run *run, GThreadFunc fn,
+                                        GThread **threads)
+{
+    const struct Parameters *params = run->params;
+    struct Producer *producers = g_new0(struct Producer, params->producers);
+
+    for(unsigned int i = 0; i < params->producers; ++i)
+    {
+        producers[i].run = run;
+        producers[i].index = i;
+        producers[i].count = params->events / params->producers +
+                             (i < params->events % params->producers ? 1 : 0);
+        threads[i] = g_thread_new("producer", fn, &producers[i]);
+    }
+
+    return producers;
+}
+
+static bool bench_from_user(const struct Parameters *params)
+{
+    struct Run run;
+
+    if(!init_run(&run, params))
+        return false;
+
+    GThread *consumers[XFER_PRIORITY_LAST + 1];
+    struct Consumer consumer_data[XFER_PRIORITY_LAST + 1];
+    GThread **producers = g_new0(GThread *, params->producers);
+
+    const unsigned long allocs_before = get_allocations();
+    const uint64_t start = now_ns();
+
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+    {
+        consumer_data[i].run = &run;
+        consumer_data[i].priority = i;
+        consumers[i] = g_thread_new("consumer", from_user_consumer,
+                                    &consumer_data[i]);
+    }
+
+    struct Producer *p = start_producers(&run, from_user_producer, producers);
+
+    for(unsigned int i = 0; i < params->producers; ++i)
+        g_thread_join(producers[i]);
+
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+        g_thread_join(consumers[i]);
+
+    const uint64_t elapsed = now_ns() - start;
+    const unsigned long allocs = get_allocations() - allocs_before;
+
+    g_free(p);
+    g_free(producers);
+
+    const bool ok = report("from_user", &run, elapsed, allocs, 1);
+    free_run(&run);
+
+    return ok;
+}
+
+static bool bench_to_user(const struct Parameters *params)
+{
+    struct Run run;
+
+    if(!init_run(&run, params))
+        return false;
+
+    GThread **producers = g_new0(GThread *, params->producers);
+
+    const unsigned long allocs_before = get_allocations();
+    const uint64_t start = now_ns();
+
+    struct Producer *p = start_producers(&run, to_user_producer, producers);
+
+    to_user_consume(&run);
+
+    for(unsigned int i = 0; i < params->producers; ++i)
+        g_thread_join(producers[i]);
+
+    const uint64_t elapsed = now_ns() - start;
+    const unsigned long allocs = get_allocations() - allocs_before;
+
+    g_free(p);
+    g_free(producers);
+
+    bool ok = report("to_user", &run, elapsed, allocs, 2);
+
+    if(atomic_load(&run.progress_events_received) != params->events)
+    {
+        fprintf(stderr, "to_user: received %u of %u progress events\n",
+                atomic_load(&run.progress_events_received), params->events);
+        ok = false;
+    }
+
+    free_run(&run);
+
+    return ok;
+}
+
+static void usage(const char *program_name)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Options:\n"
+           "  --help         Show this help.\n"
+           "  --events N     Send N items through each queue (default: %u).\n"
+           "  --producers N  Use N producer threads (default: %u).\n"
+           "  --depth N      Keep at most N events in flight (default: %u).\n",
+           program_name,
+           DEFAULT_EVENTS, DEFAULT_PRODUCERS, DEFAULT_QUEUE_DEPTH);
+}
+
+static bool parse_unsigned(const char *option, const char *arg,
+                           unsigned int *value)
+{
+    char *endptr;
+    const unsigned long temp = strtoul(arg, &endptr, 10);
+
+    if(*endptr != '\0' || temp == 0 || temp > UINT32_MAX / 2)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for option %s.\n", arg, option);
+        return false;
+    }
+
+    *value = temp;
+
+    return true;
+}
+
+static int process_command_line(int argc, char *argv[],
+                                struct Parameters *parameters)
+{
+    parameters->events = DEFAULT_EVENTS;
+    parameters->producers = DEFAULT_PRODUCERS;
+    parameters->queue_depth = DEFAULT_QUEUE_DEPTH;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        unsigned int *value = NULL;
+
+        if(strcmp(argv[i], "--help") == 0)
+            return 1;
+        else if(strcmp(argv[i], "--events") == 0)
+            value = &parameters->events;
+        else if(strcmp(argv[i], "--producers") == 0)
+            value = &parameters->producers;
+        else if(strcmp(argv[i], "--depth") == 0)
+            value = &parameters->queue_depth;
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\". Please try --help.\n", argv[i]);
+            return -1;
+        }
+
+        if(i + 1 >= argc)
+        {
+            fprintf(stderr, "Option %s requires an argument.\n", argv[i]);
+            return -1;
+        }
+
+        ++i;
+
+        if(!parse_unsigned(argv[i - 1], argv[i], value))
+            return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct Parameters parameters;
+    const int ret = process_command_line(argc, argv, &parameters);
+
+    if(ret == -1)
+        return EXIT_FAILURE;
+    else if(ret == 1)
+    {
+        usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    events_init(NULL);
+
+    const bool ok_from_user = bench_from_user(&parameters);
+    const bool ok_to_user = bench_to_user(&parameters);
+
+    events_deinit();
+
+    return ok_from_user && ok_to_user ? EXIT_SUCCESS : EXIT_FAILURE;
+}
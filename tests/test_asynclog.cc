@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <cerrno>
+#include <syslog.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "asynclog.h"
+#include "stats.h"
+
+namespace asynclog_tests
+{
+
+struct Written
+{
+    int error_code;
+    int priority;
+    std::string message;
+    std::thread::id writer;
+};
+
+static std::mutex written_lock;
+static std::vector<Written> written;
+
+/*!
+ * Held by tests to make the writer thread block on the first message.
+ */
+static std::mutex gate;
+
+static void record(int error_code, int priority, const char *message)
+{
+    std::lock_guard<std::mutex> gate_lock(gate);
+    std::lock_guard<std::mutex> lock(written_lock);
+
+    written.push_back({error_code, priority, message,
+                       std::this_thread::get_id()});
+}
+
+void cut_setup()
+{
+    stats_reset();
+    written.clear();
+    asynclog_init(record);
+}
+
+void cut_teardown()
+{
+    asynclog_deinit();
+}
+
+void test_messages_are_written_in_order_by_writer_thread()
+{
+    asynclog_info("First message %d", 1);
+    asynclog_error(EIO, LOG_ERR, "Second message %s", "here");
+    asynclog_deinit();
+
+    cppcut_assert_equal(size_t(2), written.size());
+    cppcut_assert_equal(std::string("First message 1"), written[0].message);
+    cppcut_assert_equal(LOG_INFO, written[0].priority);
+    cppcut_assert_equal(0, written[0].error_code);
+    cppcut_assert_equal(std::string("Second message here"),
+                        written[1].message);
+    cppcut_assert_equal(LOG_ERR, written[1].priority);
+    cppcut_assert_equal(EIO, written[1].error_code);
+    cut_assert_true(written[0].writer != std::this_thread::get_id());
+}
+
+void test_repeated_messages_are_rate_limited()
+{
+    for(int i = 0; i < 30; ++i)
+        asynclog_info("Repeated message %d", i);
+
+    asynclog_info("Other message");
+    asynclog_deinit();
+
+    cppcut_assert_equal(size_t(ASYNCLOG_RATE_LIMIT_BURST + 2),
+                        written.size());
+
+    for(int i = 0; i < ASYNCLOG_RATE_LIMIT_BURST; ++i)
+        cppcut_assert_equal("Repeated message " + std::to_string(i),
+                            written[i].message);
+
+    cppcut_assert_equal(std::string("Other message"),
+                        written[ASYNCLOG_RATE_LIMIT_BURST].message);
+    cppcut_assert_equal(std::string("Suppressed 20 messages like "
+                                    "\"Repeated message %d\""),
+                        written.back().message);
+    cppcut_assert_equal(uint64_t(20),
+                        stats_get(STATS_LOG_MESSAGES_SUPPRESSED));
+}
+
+void test_messages_are_dropped_while_writer_is_blocked()
+{
+    static constexpr unsigned int count = ASYNCLOG_SIZE + 50;
+
+    {
+        std::lock_guard<std::mutex> gate_lock(gate);
+
+        for(unsigned int i = 0; i < count; ++i)
+            asynclog_info("Message %u", i);
+    }
+
+    asynclog_deinit();
+
+    const uint64_t dropped = stats_get(STATS_LOG_MESSAGES_DROPPED);
+    const uint64_t suppressed = stats_get(STATS_LOG_MESSAGES_SUPPRESSED);
+
+    cut_assert_true(dropped >= 50);
+    cppcut_assert_equal(uint64_t(count),
+                        dropped + suppressed + ASYNCLOG_RATE_LIMIT_BURST);
+
+    const std::string report =
+        "Dropped " + std::to_string(dropped) + " log messages, buffer full";
+    bool is_reported = false;
+
+    for(const auto &w : written)
+    {
+        if(w.message == report)
+            is_reported = true;
+    }
+
+    cut_assert_true(is_reported);
+}
+
+void test_long_messages_are_truncated()
+{
+    const std::string long_message(2 * ASYNCLOG_MESSAGE_SIZE, 'x');
+
+    asynclog_info("%s", long_message.c_str());
+    asynclog_deinit();
+
+    cppcut_assert_equal(size_t(1), written.size());
+    cppcut_assert_equal(long_message.substr(0, ASYNCLOG_MESSAGE_SIZE - 1),
+                        written[0].message);
+}
+
+}
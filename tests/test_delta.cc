@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "delta.h"
+
+namespace delta_tests
+{
+
+static const size_t block_size = 4096;
+static const size_t file_size = 20 * block_size + 123;
+
+static std::vector<uint8_t> target;
+static struct DeltaManifest *manifest;
+static FILE *seed_file;
+static FILE *out_file;
+
+static std::vector<uint8_t> make_data(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> data(size);
+
+    for(auto &b : data)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        b = uint8_t(seed);
+    }
+
+    return data;
+}
+
+static FILE *make_file(const std::vector<uint8_t> &data)
+{
+    FILE *f = tmpfile();
+
+    cut_assert_not_null(f);
+    cppcut_assert_equal(data.size(), fwrite(data.data(), 1, data.size(), f));
+    cppcut_assert_equal(0, fflush(f));
+    rewind(f);
+
+    return f;
+}
+
+static GArray *reuse(const std::vector<uint8_t> &seed, uint64_t &reused)
+{
+    seed_file = make_file(seed);
+    return delta_reuse_seed(manifest, fileno(seed_file), fileno(out_file),
+                            &reused);
+}
+
+static const DeltaRange &get_range(GArray *ranges, guint i)
+{
+    return g_array_index(ranges, DeltaRange, i);
+}
+
+void cut_setup()
+{
+    target = make_data(file_size, 42);
+
+    FILE *f = make_file(target);
+    GByteArray *data = delta_manifest_create(fileno(f), block_size, 8);
+
+    fclose(f);
+    cut_assert_not_null(data);
+
+    manifest = delta_manifest_parse(data->data, data->len);
+    g_byte_array_unref(data);
+    cut_assert_not_null(manifest);
+
+    out_file = tmpfile();
+    cut_assert_not_null(out_file);
+    seed_file = nullptr;
+}
+
+void cut_teardown()
+{
+    delta_manifest_free(manifest);
+    manifest = nullptr;
+
+    if(seed_file != nullptr)
+        fclose(seed_file);
+
+    fclose(out_file);
+}
+
+void test_manifest_describes_file()
+{
+    cppcut_assert_equal(uint64_t(file_size),
+                        delta_manifest_get_length(manifest));
+}
+
+void test_identical_seed_leaves_nothing_to_download()
+{
+    uint64_t reused;
+    GArray *ranges = reuse(target, reused);
+
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(0U, ranges->len);
+    cppcut_assert_equal(uint64_t(file_size), reused);
+    cut_assert_true(delta_verify(manifest, fileno(out_file)));
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_modified_block_is_downloaded()
+{
+    std::vector<uint8_t> seed(target);
+    seed[5 * block_size + 10] ^= 0xff;
+
+    uint64_t reused;
+    GArray *ranges = reuse(seed, reused);
+
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(1U, ranges->len);
+    cppcut_assert_equal(uint64_t(5 * block_size), get_range(ranges, 0).offset);
+    cppcut_assert_equal(uint64_t(block_size), get_range(ranges, 0).length);
+    cppcut_assert_equal(uint64_t(file_size - block_size), reused);
+    cut_assert_false(delta_verify(manifest, fileno(out_file)));
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_blocks_are_found_at_shifted_positions()
+{
+    std::vector<uint8_t> seed(make_data(100, 7));
+    seed.insert(seed.end(), target.begin(), target.end());
+
+    uint64_t reused;
+    GArray *ranges = reuse(seed, reused);
+
+    /* the short last block is only looked for at its own position */
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(1U, ranges->len);
+    cppcut_assert_equal(uint64_t(20 * block_size),
+                        get_range(ranges, 0).offset);
+    cppcut_assert_equal(uint64_t(123), get_range(ranges, 0).length);
+    cppcut_assert_equal(uint64_t(20 * block_size), reused);
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_empty_seed_requires_full_download()
+{
+    uint64_t reused;
+    GArray *ranges = reuse(std::vector<uint8_t>(), reused);
+
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(1U, ranges->len);
+    cppcut_assert_equal(uint64_t(0), get_range(ranges, 0).offset);
+    cppcut_assert_equal(uint64_t(file_size), get_range(ranges, 0).length);
+    cppcut_assert_equal(uint64_t(0), reused);
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_downloaded_ranges_complete_the_file()
+{
+    std::vector<uint8_t> seed(target.begin(), target.begin() + 8 * block_size);
+    seed[block_size] ^= 0xff;
+
+    uint64_t reused;
+    GArray *ranges = reuse(seed, reused);
+
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(2U, ranges->len);
+
+    for(guint i = 0; i < ranges->len; ++i)
+    {
+        const DeltaRange &r = get_range(ranges, i);
+        cppcut_assert_equal(ssize_t(r.length),
+                            pwrite(fileno(out_file), &target[r.offset],
+                                   r.length, off_t(r.offset)));
+    }
+
+    cut_assert_true(delta_verify(manifest, fileno(out_file)));
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_seed_is_scanned_in_small_steps()
+{
+    std::vector<uint8_t> seed(make_data(100, 7));
+    seed.insert(seed.end(), target.begin(), target.end());
+    seed[5 * block_size + 110] ^= 0xff;
+    seed_file = make_file(seed);
+
+    struct DeltaScan *scan =
+        delta_scan_new(manifest, fileno(seed_file), fileno(out_file));
+    cut_assert_not_null(scan);
+
+    unsigned int steps = 0;
+    int result;
+
+    while((result = delta_scan_step(scan, 1000)) > 0)
+        ++steps;
+
+    cppcut_assert_equal(0, result);
+    cut_assert_true(steps >= 20);
+
+    uint64_t reused;
+    GArray *ranges = delta_scan_finish(scan, &reused);
+
+    delta_scan_free(scan);
+    cut_assert_not_null(ranges);
+    cppcut_assert_equal(2U, ranges->len);
+    cppcut_assert_equal(uint64_t(5 * block_size), get_range(ranges, 0).offset);
+    cppcut_assert_equal(uint64_t(block_size), get_range(ranges, 0).length);
+    cppcut_assert_equal(uint64_t(20 * block_size),
+                        get_range(ranges, 1).offset);
+    cppcut_assert_equal(uint64_t(19 * block_size), reused);
+
+    g_array_free(ranges, TRUE);
+}
+
+void test_file_is_verified_in_small_steps()
+{
+    uint64_t reused;
+    GArray *ranges = reuse(target, reused);
+
+    cut_assert_not_null(ranges);
+    g_array_free(ranges, TRUE);
+
+    struct DeltaVerifier *v = delta_verifier_new(manifest, fileno(out_file));
+    cut_assert_not_null(v);
+
+    unsigned int steps = 0;
+    int result;
+
+    while((result = delta_verifier_step(v, block_size)) > 0)
+        ++steps;
+
+    delta_verifier_free(v);
+    cppcut_assert_equal(0, result);
+    cut_assert_true(steps > 0);
+
+    const uint8_t byte = target[100] ^ 0xff;
+    cppcut_assert_equal(ssize_t(1), pwrite(fileno(out_file), &byte, 1, 100));
+
+    v = delta_verifier_new(manifest, fileno(out_file));
+
+    while((result = delta_verifier_step(v, block_size)) > 0)
+        ;
+
+    delta_verifier_free(v);
+    cppcut_assert_equal(-1, result);
+}
+
+void test_invalid_manifests_are_rejected()
+{
+#define ZERO_DIGEST \
+    "SHA-256: 0000000000000000000000000000000000000000000000000000000000000000\n"
+
+    static const char *const bad[] =
+    {
+        "",
+        "DBusDL-Delta: 1\nLength: 0\nBlocksize: 4096\nHash-Length: 8\n",
+        "DBusDL-Delta: 1\nLength: 0\nBlocksize: 4096\nHash-Length: 8\n\n",
+        "DBusDL-Delta: 2\nLength: 0\nBlocksize: 4096\nHash-Length: 8\n"
+        ZERO_DIGEST "\n",
+        "DBusDL-Delta: 1\nLength: 10\nBlocksize: 4096\nHash-Length: 8\n"
+        ZERO_DIGEST "\n",
+        "DBusDL-Delta: 1\nLength: 0\nBlocksize: 100\nHash-Length: 8\n"
+        ZERO_DIGEST "\n",
+        "DBusDL-Delta: 1\nLength: 0\nBlocksize: 4096\nHash-Length: 2\n"
+        ZERO_DIGEST "\n",
+        "DBusDL-Delta: 1\nLength: 18446744073709551615\nBlocksize: 4096\n"
+        "Hash-Length: 8\n" ZERO_DIGEST "\n",
+        "DBusDL-Delta: 1\nLength: 9223372036854775808\nBlocksize: 512\n"
+        "Hash-Length: 8\n" ZERO_DIGEST "\n",
+    };
+
+#undef ZERO_DIGEST
+
+    for(const char *m : bad)
+        cut_assert_null(delta_manifest_parse(reinterpret_cast<const uint8_t *>(m),
+                                             strlen(m)));
+}
+
+void test_manifest_is_loaded_from_regular_file()
+{
+    char dir[] = "/tmp/test_delta.XXXXXX";
+    cut_assert_not_null(mkdtemp(dir));
+
+    const std::string path = std::string(dir) + "/manifest";
+    FILE *f = make_file(target);
+    GByteArray *data = delta_manifest_create(fileno(f), block_size, 8);
+
+    fclose(f);
+    cut_assert_not_null(data);
+    cut_assert_true(g_file_set_contents(path.c_str(),
+                                        reinterpret_cast<const gchar *>(data->data),
+                                        data->len, nullptr));
+    g_byte_array_unref(data);
+
+    struct DeltaManifest *loaded = delta_manifest_load(path.c_str());
+
+    unlink(path.c_str());
+    rmdir(dir);
+    cut_assert_not_null(loaded);
+    cppcut_assert_equal(uint64_t(file_size), delta_manifest_get_length(loaded));
+    delta_manifest_free(loaded);
+}
+
+void test_manifest_is_not_loaded_from_fifo()
+{
+    char dir[] = "/tmp/test_delta.XXXXXX";
+    cut_assert_not_null(mkdtemp(dir));
+
+    const std::string path = std::string(dir) + "/manifest";
+
+    cppcut_assert_equal(0, mkfifo(path.c_str(), 0600));
+
+    struct DeltaManifest *loaded = delta_manifest_load(path.c_str());
+
+    unlink(path.c_str());
+    rmdir(dir);
+    cut_assert_null(loaded);
+}
+
+}
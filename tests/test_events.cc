@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -26,6 +26,9 @@
 #include <cppcutter.h>
 #include <ios>
 #include <iomanip>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
 
 #include "events.h"
 
@@ -98,17 +101,46 @@ void test_new_cancel()
     cppcut_assert_equal(42U, event->d.item_id);
 }
 
+void test_new_pause_and_resume()
+{
+    event = events_from_user_new_pause(7);
+
+    cppcut_assert_not_null(event);
+    cppcut_assert_equal(EVENT_FROM_USER_PAUSE, event->event_id);
+    cppcut_assert_equal(7U, event->d.item_id);
+
+    events_from_user_free(event);
+    event = events_from_user_new_resume(7);
+
+    cppcut_assert_not_null(event);
+    cppcut_assert_equal(EVENT_FROM_USER_RESUME, event->event_id);
+    cppcut_assert_equal(7U, event->d.item_id);
+}
+
 void test_send_one_event()
 {
     event = events_from_user_new_cancel(23);
     cppcut_assert_not_null(event);
 
-    events_from_user_send(event);
-    auto received = events_from_user_receive(false);
+    events_from_user_send(XFER_PRIORITY_NORMAL, event);
+    auto received = events_from_user_receive(XFER_PRIORITY_NORMAL, false);
 
     cppcut_assert_equal(event, received);
 }
 
+void test_events_are_queued_per_priority_class()
+{
+    event = events_from_user_new_cancel(23);
+    cppcut_assert_not_null(event);
+
+    events_from_user_send(XFER_PRIORITY_BACKGROUND, event);
+
+    cppcut_assert_null(events_from_user_receive(XFER_PRIORITY_INTERACTIVE, false));
+    cppcut_assert_null(events_from_user_receive(XFER_PRIORITY_NORMAL, false));
+    cppcut_assert_equal(event,
+                        events_from_user_receive(XFER_PRIORITY_BACKGROUND, false));
+}
+
 void test_send_some_events()
 {
     struct XferItem *item = mk_xferitem("foo", 400, 1);
@@ -122,12 +154,12 @@ void test_send_some_events()
     for(const auto &ev : events)
     {
         cppcut_assert_not_null(ev);
-        events_from_user_send(ev);
+        events_from_user_send(XFER_PRIORITY_NORMAL, ev);
     }
 
     for(const auto &ev : events)
     {
-        auto received = events_from_user_receive(false);
+        auto received = events_from_user_receive(XFER_PRIORITY_NORMAL, false);
 
         cppcut_assert_equal(ev, received);
 
@@ -142,6 +174,11 @@ void test_send_some_events()
 
           case EVENT_FROM_USER_SHUTDOWN:
           case EVENT_FROM_USER_CANCEL:
+          case EVENT_FROM_USER_CANCEL_ALL:
+          case EVENT_FROM_USER_PAUSE:
+          case EVENT_FROM_USER_RESUME:
+          case EVENT_FROM_USER_PAUSE_ALL:
+          case EVENT_FROM_USER_RESUME_ALL:
             break;
         }
 
@@ -232,6 +269,57 @@ void test_send_some_events()
     }
 }
 
+static unsigned int notification_count;
+static unsigned int drained_count;
+
+static gboolean drain_events(gpointer user_data)
+{
+    ++notification_count;
+
+    struct EventToUser *received;
+
+    while((received = events_to_user_receive(false)) != NULL)
+    {
+        ++drained_count;
+        events_to_user_free(received, false);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/*!\test
+ * A burst of events sent to the main thread causes a single notification.
+ */
+void test_burst_of_events_is_notified_once()
+{
+    events_deinit();
+    events_init(drain_events);
+    notification_count = 0;
+    drained_count = 0;
+
+    struct XferItem *item = mk_xferitem("burst", 100, 1);
+
+    for(unsigned int i = 0; i < 50; ++i)
+        events_to_user_send(events_to_user_new_report_progress(item, i));
+
+    while(g_main_context_iteration(NULL, false))
+        ;
+
+    cppcut_assert_equal(1U, notification_count);
+    cppcut_assert_equal(50U, drained_count);
+
+    /* the source stays in place for later events */
+    events_to_user_send(events_to_user_new_report_progress(item, 100));
+
+    while(g_main_context_iteration(NULL, false))
+        ;
+
+    cppcut_assert_equal(2U, notification_count);
+    cppcut_assert_equal(51U, drained_count);
+
+    xferitem_free(item);
+}
+
 }
 
 namespace xferitem_tests
@@ -247,10 +335,189 @@ void cut_teardown()
     xferitem_deinit();
 }
 
-void test_path_to_temporary_download_file_can_be_retrieved()
+void test_each_item_has_its_own_temporary_download_file()
 {
-    cppcut_assert_equal("/this/is/my/directory/0000000000.dbusdl",
-                        xferitem_get_tempfile_path());
+    struct XferItem *first = xferitem_allocate("http://foo.bar/a", 10);
+    struct XferItem *second = xferitem_allocate("http://foo.bar/b", 10);
+
+    cppcut_assert_not_null(first);
+    cppcut_assert_not_null(second);
+    cppcut_assert_equal("/this/is/my/directory/0000000001.part",
+                        first->tempfile_path);
+    cppcut_assert_equal("/this/is/my/directory/0000000001.dbusdl",
+                        first->destfile_path);
+    cppcut_assert_equal("/this/is/my/directory/0000000002.part",
+                        second->tempfile_path);
+    cppcut_assert_equal("/this/is/my/directory/0000000002.dbusdl",
+                        second->destfile_path);
+
+    xferitem_free(first);
+    xferitem_free(second);
+}
+
+void test_items_are_kept_in_memory_only_if_enabled()
+{
+    struct XferItem *item = xferitem_allocate("http://foo.bar/icon.png", 1);
+
+    cppcut_assert_not_null(item);
+    cut_assert_false(xferitem_keep_in_memory(item));
+    cppcut_assert_equal(size_t(0), item->max_content_size);
+
+    xferitem_set_content_limit(4096);
+    cut_assert_true(xferitem_keep_in_memory(item));
+    cppcut_assert_equal(size_t(4096), item->max_content_size);
+    cppcut_assert_null(item->content);
+
+    xferitem_free(item);
+}
+
+void test_items_announced_too_large_are_not_kept_in_memory()
+{
+    struct XferItem *item = xferitem_allocate("http://foo.bar/cover.jpg", 1);
+
+    cppcut_assert_not_null(item);
+    xferitem_set_content_limit(4096);
+    item->expected_size = 4097;
+    cut_assert_false(xferitem_keep_in_memory(item));
+    cppcut_assert_equal(size_t(0), item->max_content_size);
+
+    xferitem_free(item);
+}
+
+/*!
+ * Item downloaded to memory, with its temporary file in a directory of its
+ * own.
+ */
+class ContentItem
+{
+  public:
+    struct XferItem *item;
+    FILE *file;
+
+  private:
+    char *download_path_;
+
+  public:
+    explicit ContentItem(size_t limit):
+        item(nullptr),
+        file(nullptr),
+        download_path_(g_dir_make_tmp("test_xferitem-XXXXXX", nullptr))
+    {
+        cppcut_assert_not_null(download_path_);
+        xferitem_deinit();
+        xferitem_init(download_path_, false);
+        xferitem_set_content_limit(limit);
+
+        item = xferitem_allocate("http://foo.bar/file", 1);
+        cppcut_assert_not_null(item);
+        cut_assert_true(xferitem_keep_in_memory(item));
+        item->content = g_byte_array_new();
+    }
+
+    ~ContentItem()
+    {
+        if(file != nullptr)
+            fclose(file);
+
+        remove(item->tempfile_path);
+        xferitem_free(item);
+        rmdir(download_path_);
+        g_free(download_path_);
+    }
+
+    std::string read_file()
+    {
+        cppcut_assert_not_null(file);
+        fflush(file);
+
+        gchar *contents = nullptr;
+        gsize length = 0;
+
+        cut_assert_true(g_file_get_contents(item->tempfile_path,
+                                            &contents, &length, nullptr));
+
+        const std::string result(contents, length);
+        g_free(contents);
+
+        return result;
+    }
+};
+
+void test_data_is_written_to_memory_up_to_the_limit()
+{
+    ContentItem c(16);
+    const size_t charge = c.item->memory_charge;
+
+    cppcut_assert_equal(size_t(10),
+                        xferitem_write(c.item, &c.file, "0123456789", 10));
+    cppcut_assert_equal(size_t(6),
+                        xferitem_write(c.item, &c.file, "abcdef", 6));
+
+    cppcut_assert_null(c.file);
+    cppcut_assert_not_null(c.item->content);
+    cppcut_assert_equal(guint(16), c.item->content->len);
+    const auto *data =
+        reinterpret_cast<const char *>(c.item->content->data);
+    cppcut_assert_equal(std::string("0123456789abcdef"),
+                        std::string(data, c.item->content->len));
+    cppcut_assert_equal(charge + 16, c.item->memory_charge);
+}
+
+void test_data_is_spilled_to_file_once_the_limit_is_passed()
+{
+    ContentItem c(16);
+    const size_t charge = c.item->memory_charge;
+
+    cppcut_assert_equal(size_t(10),
+                        xferitem_write(c.item, &c.file, "0123456789", 10));
+    cppcut_assert_null(c.file);
+
+    cppcut_assert_equal(size_t(7),
+                        xferitem_write(c.item, &c.file, "abcdefg", 7));
+    cppcut_assert_not_null(c.file);
+    cppcut_assert_null(c.item->content);
+    cppcut_assert_equal(charge, c.item->memory_charge);
+
+    /* everything after the spill goes to the file as well */
+    cppcut_assert_equal(size_t(3), xferitem_write(c.item, &c.file, "xyz", 3));
+    cppcut_assert_equal(std::string("0123456789abcdefgxyz"), c.read_file());
+}
+
+void test_spilling_moves_content_to_temporary_file()
+{
+    ContentItem c(16);
+    cppcut_assert_equal(size_t(5), xferitem_write(c.item, &c.file, "hello", 5));
+
+    const size_t charge = c.item->memory_charge - 5;
+
+    c.file = xferitem_spill_content(c.item);
+
+    cppcut_assert_not_null(c.file);
+    cppcut_assert_null(c.item->content);
+    cppcut_assert_equal(charge, c.item->memory_charge);
+    cppcut_assert_equal(std::string("hello"), c.read_file());
+}
+
+void test_failed_spill_keeps_data_in_memory()
+{
+    xferitem_set_content_limit(4);
+
+    struct XferItem *item = xferitem_allocate("http://foo.bar/file", 1);
+    cppcut_assert_not_null(item);
+    cut_assert_true(xferitem_keep_in_memory(item));
+    item->content = g_byte_array_new();
+
+    FILE *file = nullptr;
+
+    cppcut_assert_equal(size_t(4), xferitem_write(item, &file, "abcd", 4));
+
+    /* there is no such download directory */
+    cppcut_assert_equal(size_t(0), xferitem_write(item, &file, "e", 1));
+    cppcut_assert_null(file);
+    cppcut_assert_not_null(item->content);
+    cppcut_assert_equal(guint(4), item->content->len);
+
+    xferitem_free(item);
 }
 
 }
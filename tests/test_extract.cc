@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <gio/gio.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ftw.h>
+#include <stdlib.h>
+
+#include "extract.h"
+
+namespace extract_tests
+{
+
+static std::string base_path;
+static std::string target_path;
+static struct Extractor *extractor;
+
+class Tar
+{
+  private:
+    std::vector<uint8_t> data_;
+
+  public:
+    void add(const std::string &name, char type, const std::string &content)
+    {
+        uint8_t header[512] = {};
+
+        std::memcpy(header, name.c_str(), std::min(name.size(), size_t(100)));
+        std::snprintf(reinterpret_cast<char *>(header) + 100, 8, "%07o", 0644);
+        std::snprintf(reinterpret_cast<char *>(header) + 124, 12, "%011o",
+                      unsigned(content.size()));
+        header[156] = type;
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+        std::memset(header + 148, ' ', 8);
+
+        unsigned int sum = 0;
+
+        for(uint8_t b : header)
+            sum += b;
+
+        std::snprintf(reinterpret_cast<char *>(header) + 148, 8, "%06o", sum);
+
+        data_.insert(data_.end(), header, header + sizeof(header));
+        data_.insert(data_.end(), content.begin(), content.end());
+        data_.resize((data_.size() + 511) / 512 * 512);
+    }
+
+    const std::vector<uint8_t> &finish()
+    {
+        data_.resize(data_.size() + 2 * 512);
+        return data_;
+    }
+
+    std::vector<uint8_t> &get() { return data_; }
+};
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t> &data)
+{
+    GConverter *gz =
+        G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+    std::vector<uint8_t> result(data.size() + 1024);
+    gsize bytes_read;
+    gsize bytes_written;
+
+    cppcut_assert_equal(int(G_CONVERTER_FINISHED),
+                        int(g_converter_convert(gz, data.data(), data.size(),
+                                                result.data(), result.size(),
+                                                G_CONVERTER_INPUT_AT_END,
+                                                &bytes_read, &bytes_written,
+                                                nullptr)));
+    g_object_unref(gz);
+    result.resize(bytes_written);
+
+    return result;
+}
+
+static enum DBusListsErrorCode feed(const std::vector<uint8_t> &data,
+                                    size_t chunk_size)
+{
+    for(size_t i = 0; i < data.size(); i += chunk_size)
+    {
+        const enum DBusListsErrorCode error =
+            extractor_feed(extractor, &data[i],
+                           std::min(chunk_size, data.size() - i));
+
+        if(error != LIST_ERROR_OK)
+            return error;
+    }
+
+    return extractor_finish(extractor);
+}
+
+static std::string read_file(const std::string &name)
+{
+    gchar *contents;
+    gsize length;
+
+    if(!g_file_get_contents((target_path + "/" + name).c_str(),
+                            &contents, &length, nullptr))
+        return "<missing>";
+
+    std::string result(contents, length);
+    g_free(contents);
+
+    return result;
+}
+
+static int remove_entry(const char *path, const struct stat *, int,
+                        struct FTW *)
+{
+    return remove(path);
+}
+
+void cut_setup()
+{
+    char path[] = "/tmp/test_extract.XXXXXX";
+
+    cut_assert_not_null(mkdtemp(path));
+    base_path = path;
+    target_path = base_path + "/out";
+    extractor = extractor_new(target_path.c_str());
+    cut_assert_not_null(extractor);
+}
+
+void cut_teardown()
+{
+    extractor_free(extractor);
+    extractor = nullptr;
+    nftw(base_path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+void test_files_and_directories_are_extracted()
+{
+    Tar tar;
+    tar.add("./", '5', "");
+    tar.add("./dir/", '5', "");
+    tar.add("./dir/a.txt", '0', "Hello");
+    tar.add("./b.bin", '0', std::string(1500, 'x'));
+    tar.add("./implicit/dir/c.txt", '0', "");
+
+    cppcut_assert_equal(LIST_ERROR_OK, feed(tar.finish(), 100000));
+    cppcut_assert_equal(std::string("Hello"), read_file("dir/a.txt"));
+    cppcut_assert_equal(std::string(1500, 'x'), read_file("b.bin"));
+    cppcut_assert_equal(std::string(), read_file("implicit/dir/c.txt"));
+}
+
+void test_compressed_archive_is_extracted_in_small_chunks()
+{
+    Tar tar;
+    tar.add("data/file.txt", '0', std::string(70000, 'z') + "end");
+
+    cppcut_assert_equal(LIST_ERROR_OK, feed(gzip(tar.finish()), 7));
+    cppcut_assert_equal(std::string(70000, 'z') + "end",
+                        read_file("data/file.txt"));
+}
+
+void test_gnu_long_names_are_supported()
+{
+    const std::string name = std::string(150, 'n') + "/" +
+                             std::string(120, 'm');
+
+    Tar tar;
+    tar.add("././@LongLink", 'L', name);
+    tar.add("truncated name", '0', "long");
+
+    cppcut_assert_equal(LIST_ERROR_OK, feed(tar.finish(), 512));
+    cppcut_assert_equal(std::string("long"), read_file(name));
+}
+
+void test_paths_leaving_the_directory_are_refused()
+{
+    Tar tar;
+    tar.add("dir/../../escape.txt", '0', "evil");
+
+    cppcut_assert_equal(LIST_ERROR_PERMISSION_DENIED, feed(tar.finish(), 512));
+    cppcut_assert_equal(std::string("<missing>"),
+                        read_file("../escape.txt"));
+}
+
+void test_links_are_not_supported()
+{
+    Tar tar;
+    tar.add("link", '2', "");
+
+    cppcut_assert_equal(LIST_ERROR_NOT_SUPPORTED, feed(tar.finish(), 512));
+}
+
+void test_corrupt_header_is_detected()
+{
+    Tar tar;
+    tar.add("file.txt", '0', "data");
+    tar.get()[0] = 'F';
+
+    cppcut_assert_equal(LIST_ERROR_INCONSISTENT, feed(tar.finish(), 512));
+}
+
+void test_truncated_archive_is_detected()
+{
+    Tar tar;
+    tar.add("file.txt", '0', std::string(2000, 'a'));
+
+    cppcut_assert_equal(LIST_ERROR_INCONSISTENT, feed(tar.get(), 512));
+}
+
+void test_truncated_compressed_archive_is_detected()
+{
+    Tar tar;
+    tar.add("file.txt", '0', "data");
+
+    std::vector<uint8_t> compressed = gzip(tar.finish());
+    compressed.resize(compressed.size() - 4);
+
+    cppcut_assert_equal(LIST_ERROR_INCONSISTENT, feed(compressed, 512));
+}
+
+void test_number_of_entries_is_limited()
+{
+    extractor_set_limits(extractor, 0, 2);
+
+    Tar tar;
+    tar.add("dir/", '5', "");
+    tar.add("dir/a.txt", '0', "a");
+    tar.add("dir/b.txt", '0', "b");
+
+    cppcut_assert_equal(LIST_ERROR_PHYSICAL_MEDIA_IO,
+                        feed(tar.finish(), 512));
+    cppcut_assert_equal(std::string("a"), read_file("dir/a.txt"));
+    cppcut_assert_equal(std::string("<missing>"), read_file("dir/b.txt"));
+}
+
+void test_total_size_is_limited()
+{
+    extractor_set_limits(extractor, 1000, 0);
+
+    Tar tar;
+    tar.add("a.txt", '0', std::string(600, 'a'));
+    tar.add("b.txt", '0', std::string(400, 'b'));
+    tar.add("c.txt", '0', "c");
+
+    cppcut_assert_equal(LIST_ERROR_PHYSICAL_MEDIA_IO,
+                        feed(tar.finish(), 512));
+    cppcut_assert_equal(std::string(400, 'b'), read_file("b.txt"));
+    cppcut_assert_equal(std::string("<missing>"), read_file("c.txt"));
+}
+
+void test_compressed_archive_exceeding_size_limit_is_not_written()
+{
+    extractor_set_limits(extractor, 64U * 1024U, 0);
+
+    Tar tar;
+    tar.add("bomb", '0', std::string(16U * 1024U * 1024U, '\0'));
+
+    cppcut_assert_equal(LIST_ERROR_PHYSICAL_MEDIA_IO,
+                        feed(gzip(tar.finish()), 4096));
+    cppcut_assert_equal(std::string("<missing>"), read_file("bomb"));
+}
+
+static bool claim_space(uint64_t size, void *user_data)
+{
+    uint64_t *available = static_cast<uint64_t *>(user_data);
+
+    if(size > *available)
+        return false;
+
+    *available -= size;
+    return true;
+}
+
+void test_space_is_claimed_for_each_file()
+{
+    uint64_t available = 1500;
+    extractor_set_space_claim(extractor, claim_space, &available);
+
+    Tar tar;
+    tar.add("a.txt", '0', std::string(1000, 'a'));
+    tar.add("empty.txt", '0', "");
+    tar.add("b.txt", '0', std::string(1000, 'b'));
+
+    cppcut_assert_equal(LIST_ERROR_PHYSICAL_MEDIA_IO,
+                        feed(tar.finish(), 512));
+    cppcut_assert_equal(uint64_t(500), available);
+    cppcut_assert_equal(std::string(), read_file("empty.txt"));
+    cppcut_assert_equal(std::string("<missing>"), read_file("b.txt"));
+}
+
+void test_errors_stick()
+{
+    Tar tar;
+    tar.add("link", '2', "");
+
+    cppcut_assert_equal(LIST_ERROR_NOT_SUPPORTED, feed(tar.get(), 512));
+
+    const uint8_t byte = 0;
+    cppcut_assert_equal(LIST_ERROR_NOT_SUPPORTED,
+                        extractor_feed(extractor, &byte, 1));
+    cppcut_assert_equal(LIST_ERROR_NOT_SUPPORTED,
+                        extractor_get_error(extractor));
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <vector>
+
+#include "flightrec.h"
+
+namespace flightrec_tests
+{
+
+static std::vector<struct FlightrecRecord> records;
+
+void cut_setup()
+{
+    flightrec_reset();
+    records.resize(FLIGHTREC_SIZE);
+}
+
+void cut_teardown()
+{
+    records.clear();
+}
+
+void test_empty_recorder_yields_no_records()
+{
+    cppcut_assert_equal(size_t(0),
+                        flightrec_snapshot(records.data(), records.size()));
+}
+
+void test_records_are_returned_oldest_first()
+{
+    flightrec_record(FLIGHTREC_TRANSFER_START, 5, 0);
+    flightrec_record(FLIGHTREC_CURL_WRITE, 5, 16384);
+    flightrec_record(FLIGHTREC_TRANSFER_DONE, 5, 0);
+
+    cppcut_assert_equal(size_t(3),
+                        flightrec_snapshot(records.data(), records.size()));
+
+    cppcut_assert_equal(FLIGHTREC_TRANSFER_START, records[0].event);
+    cppcut_assert_equal(FLIGHTREC_CURL_WRITE, records[1].event);
+    cppcut_assert_equal(uint64_t(16384), records[1].arg);
+    cppcut_assert_equal(uint32_t(5), records[1].item_id);
+    cppcut_assert_equal(FLIGHTREC_TRANSFER_DONE, records[2].event);
+    cut_assert_true(records[0].timestamp_us <= records[2].timestamp_us);
+}
+
+void test_snapshot_of_limited_size_contains_newest_records()
+{
+    for(uint64_t i = 0; i < 10; ++i)
+        flightrec_record(FLIGHTREC_CURL_PROGRESS, 1, i);
+
+    cppcut_assert_equal(size_t(4), flightrec_snapshot(records.data(), 4));
+
+    for(size_t i = 0; i < 4; ++i)
+        cppcut_assert_equal(uint64_t(6 + i), records[i].arg);
+}
+
+void test_oldest_records_are_overwritten_when_ring_is_full()
+{
+    const uint64_t total = FLIGHTREC_SIZE + 100;
+
+    for(uint64_t i = 0; i < total; ++i)
+        flightrec_record(FLIGHTREC_CURL_WRITE, 2, i);
+
+    cppcut_assert_equal(size_t(FLIGHTREC_SIZE),
+                        flightrec_snapshot(records.data(), records.size()));
+    cppcut_assert_equal(uint64_t(100), records.front().arg);
+    cppcut_assert_equal(total - 1, records.back().arg);
+}
+
+}
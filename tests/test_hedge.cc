@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <glib.h>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "hedge.h"
+#include "xferthread.h"
+#include "events.h"
+#include "stats.h"
+#include "membudget.h"
+#include "storagetier.h"
+#include "hostprofile.h"
+#include "transport.h"
+
+namespace hedge_window_tests
+{
+
+void test_window_must_be_filled_before_stall_is_detected()
+{
+    struct HedgeWindow window;
+    hedge_window_init(&window, 3, 1000);
+
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 11, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 12, 0));
+    cut_assert_true(hedge_window_is_stalled(&window, 13, 0));
+}
+
+void test_fast_request_is_not_stalled()
+{
+    struct HedgeWindow window;
+    hedge_window_init(&window, 2, 1000);
+
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 11, 1000));
+    cut_assert_false(hedge_window_is_stalled(&window, 12, 2000));
+    cut_assert_false(hedge_window_is_stalled(&window, 13, 3000));
+    cut_assert_true(hedge_window_is_stalled(&window, 14, 3500));
+}
+
+void test_only_one_sample_is_taken_per_second()
+{
+    struct HedgeWindow window;
+    hedge_window_init(&window, 1, 1000);
+
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 11, 5000));
+    cut_assert_true(hedge_window_is_stalled(&window, 12, 5000));
+}
+
+void test_reset_window_is_filled_from_scratch()
+{
+    struct HedgeWindow window;
+    hedge_window_init(&window, 1, 1000);
+
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    hedge_window_reset(&window);
+    cut_assert_false(hedge_window_is_stalled(&window, 20, 0));
+    cut_assert_true(hedge_window_is_stalled(&window, 21, 0));
+}
+
+void test_disabled_window_never_detects_stall()
+{
+    struct HedgeWindow window;
+    hedge_window_init(&window, 0, 1000);
+
+    cut_assert_false(hedge_window_is_stalled(&window, 10, 0));
+    cut_assert_false(hedge_window_is_stalled(&window, 20, 0));
+}
+
+void test_data_leaving_a_gap_is_rejected()
+{
+    int64_t position = 200;
+
+    cppcut_assert_equal(ssize_t(-1), hedge_skip_received(100, &position, 50));
+}
+
+void test_data_written_already_is_skipped()
+{
+    int64_t position = 100;
+
+    cppcut_assert_equal(ssize_t(50), hedge_skip_received(200, &position, 50));
+    cppcut_assert_equal(int64_t(150), position);
+    cppcut_assert_equal(ssize_t(50), hedge_skip_received(200, &position, 100));
+    cppcut_assert_equal(int64_t(250), position);
+}
+
+void test_new_data_is_not_skipped()
+{
+    int64_t position = 200;
+
+    cppcut_assert_equal(ssize_t(0), hedge_skip_received(200, &position, 50));
+    cppcut_assert_equal(int64_t(250), position);
+}
+
+}
+
+/*!
+ * Hedged requests started by the transfer threads, run by the mock
+ * transport on a clock driven by the tests.
+ */
+namespace hedge_engine_tests
+{
+
+static const char url[] = "http://example.com/file";
+
+static const unsigned int stall_window_seconds = 2;
+static const unsigned int stall_speed_limit = 100000;
+
+static std::string download_path;
+static struct TransportMockScript *script;
+static struct EventToUser *done_event;
+
+void cut_setup()
+{
+    char path[] = "/tmp/test_hedge.XXXXXX";
+    cut_assert_not_null(mkdtemp(path));
+    download_path = path;
+
+    stats_reset();
+    membudget_init(0, 0);
+    storagetier_init();
+    xferitem_init(download_path.c_str(), false);
+    xferitem_set_content_limit(1024 * 1024);
+    events_init(nullptr);
+    hostprofile_init(nullptr, 1);
+
+    script = transport_mock_script_new();
+    done_event = nullptr;
+
+    struct XferConfig config {};
+
+    config.max_transfers = 1;
+    config.max_streams_per_connection = 1;
+    config.stall_window_seconds = stall_window_seconds;
+    config.stall_speed_limit = stall_speed_limit;
+    config.mock_script = script;
+    xferthread_init(&config);
+}
+
+void cut_teardown()
+{
+    xferthread_deinit();
+
+    struct EventToUser *event;
+
+    while((event = events_to_user_receive(false)) != nullptr)
+        events_to_user_free(event, false);
+
+    events_to_user_free(done_event, false);
+    done_event = nullptr;
+
+    transport_mock_script_free(script);
+    script = nullptr;
+    hostprofile_deinit();
+    events_deinit();
+    xferitem_deinit();
+    storagetier_deinit();
+    rmdir(download_path.c_str());
+}
+
+static void set_response(uint64_t size, uint64_t bytes_per_second,
+                         uint64_t stall_after, CURLcode result = CURLE_OK,
+                         uint64_t fail_after = 0)
+{
+    struct TransportMockResponse response {};
+
+    response.size = size;
+    response.bytes_per_second = bytes_per_second;
+    response.stall_after = stall_after;
+    response.result = result;
+    response.fail_after = fail_after;
+    transport_mock_script_set(script, url, &response);
+}
+
+static uint32_t start_download()
+{
+    struct XferItem *item = xferitem_allocate(url, 1);
+
+    cut_assert_not_null(item);
+    item->priority = XFER_PRIORITY_NORMAL;
+    cut_assert_true(xferitem_keep_in_memory(item));
+
+    const uint32_t item_id = item->item_id;
+    struct EventFromUser *event = events_from_user_new_start_download(item);
+
+    cut_assert_not_null(event);
+    events_from_user_send(XFER_PRIORITY_NORMAL, event);
+
+    return item_id;
+}
+
+static bool is_done()
+{
+    struct EventToUser *event;
+
+    while(done_event == nullptr &&
+          (event = events_to_user_receive(false)) != nullptr)
+    {
+        if(event->event_id == EVENT_TO_USER_DONE)
+            done_event = event;
+        else
+            events_to_user_free(event, false);
+    }
+
+    return done_event != nullptr;
+}
+
+/*!
+ * Move the clock of the mock transport a quarter second ahead.
+ *
+ * The transfer threads are woken up by this, and get a moment to catch up.
+ */
+static void let_quarter_second_pass()
+{
+    transport_mock_script_advance_time(script, G_USEC_PER_SEC / 4);
+    g_usleep(10 * 1000);
+}
+
+/*!
+ * Let time pass for the mock transport until the condition is met.
+ */
+template <typename T>
+static bool pass_time_until(T &&condition)
+{
+    for(unsigned int i = 0; i < 1000; ++i)
+    {
+        if(condition())
+            return true;
+
+        let_quarter_second_pass();
+    }
+
+    return condition();
+}
+
+static void expect_complete_download(uint32_t item_id, uint64_t size)
+{
+    cut_assert_true(pass_time_until(is_done));
+    cppcut_assert_equal(EVENT_TO_USER_DONE, done_event->event_id);
+    cppcut_assert_equal(item_id, done_event->xi.item->item_id);
+    cppcut_assert_equal(LIST_ERROR_OK, done_event->d.error_code);
+
+    const GByteArray *content = done_event->xi.item->content;
+
+    cut_assert_not_null(content);
+    cppcut_assert_equal(size, uint64_t(content->len));
+
+    for(guint i = 0; i < content->len; ++i)
+        cppcut_assert_equal(transport_mock_get_byte(i), content->data[i]);
+}
+
+void test_download_keeping_up_is_not_hedged()
+{
+    set_response(100000, 0, 0);
+
+    const uint32_t item_id = start_download();
+
+    expect_complete_download(item_id, 100000);
+    cppcut_assert_equal(uint64_t(0), stats_get(STATS_HEDGES_STARTED));
+}
+
+void test_hedged_request_completes_stalled_download()
+{
+    set_response(100000, 0, 40000);
+
+    const uint32_t item_id = start_download();
+
+    /* the hedged request resumes at the stall, or the data would not add
+     * up to the file */
+    expect_complete_download(item_id, 100000);
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_STARTED));
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_WON));
+    cppcut_assert_equal(uint64_t(0), stats_get(STATS_HEDGES_LOST));
+    cppcut_assert_equal(uint64_t(0), stats_get(STATS_HEDGES_FAILED));
+}
+
+void test_slow_request_ahead_of_hedged_request_wins()
+{
+    /* too slow for the limit, and the hedged request is not any faster */
+    set_response(200000, stall_speed_limit / 2, 0);
+
+    const uint32_t item_id = start_download();
+
+    expect_complete_download(item_id, 200000);
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_STARTED));
+    cppcut_assert_equal(uint64_t(0), stats_get(STATS_HEDGES_WON));
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_LOST));
+}
+
+void test_failed_hedged_request_is_dropped()
+{
+    /* the server fails any request for data beyond the stall */
+    set_response(100000, 0, 40000, CURLE_RECV_ERROR, 40000);
+
+    const uint32_t item_id = start_download();
+
+    cut_assert_true(pass_time_until(
+        [] { return stats_get(STATS_HEDGES_FAILED) > 0; }));
+
+    /* the stalled request keeps going, and is not hedged again */
+    for(unsigned int i = 0; i < 4 * 2 * stall_window_seconds; ++i)
+        let_quarter_second_pass();
+
+    cut_assert_false(is_done());
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_STARTED));
+
+    events_from_user_send(XFER_PRIORITY_NORMAL,
+                          events_from_user_new_cancel(item_id));
+
+    cut_assert_true(pass_time_until(is_done));
+    cppcut_assert_equal(item_id, done_event->xi.item->item_id);
+    cppcut_assert_equal(LIST_ERROR_INTERRUPTED, done_event->d.error_code);
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_STARTED));
+    cppcut_assert_equal(uint64_t(1), stats_get(STATS_HEDGES_FAILED));
+}
+
+}
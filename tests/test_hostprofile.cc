@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <cstdio>
+#include <ctime>
+
+#include "hostprofile.h"
+
+namespace hostprofile_tests
+{
+
+static const char profiles_file[] = "/tmp/test_hostprofile.ini";
+
+static const char cdn[] = "https://cdn.example.com:443";
+static const char radio[] = "http://radio.example.org:8000";
+
+static struct HostObservation success(unsigned int http_major,
+                                      uint64_t bytes_per_second)
+{
+    struct HostObservation obs {};
+
+    obs.succeeded = true;
+    obs.http_major = http_major;
+    obs.connect_time_us = 20000;
+    obs.bytes = 4U * 1024U * 1024U;
+    obs.bytes_per_second = bytes_per_second;
+
+    return obs;
+}
+
+void cut_setup()
+{
+    std::remove(profiles_file);
+    hostprofile_init(nullptr, 4);
+}
+
+void cut_teardown()
+{
+    hostprofile_deinit();
+    std::remove(profiles_file);
+}
+
+void test_unknown_hosts_get_defaults()
+{
+    struct HostProfile profile;
+    hostprofile_get(cdn, &profile);
+
+    cppcut_assert_equal(size_t(0), profile.receive_buffer_size);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_ANY, profile.http_version);
+    cppcut_assert_equal(45000U, profile.connect_timeout_ms);
+    cppcut_assert_equal(0U, profile.max_concurrency);
+    cppcut_assert_equal(uint64_t(0), profile.bytes_per_second);
+
+    hostprofile_get(nullptr, &profile);
+    cppcut_assert_equal(45000U, profile.connect_timeout_ms);
+}
+
+void test_buffer_size_follows_transfer_rate()
+{
+    const struct HostObservation fast = success(2, 10U * 1024U * 1024U);
+    const struct HostObservation slow = success(1, 16U * 1024U);
+
+    hostprofile_learn(cdn, &fast);
+    hostprofile_learn(radio, &slow);
+
+    struct HostProfile profile;
+
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(size_t(128U * 1024U), profile.receive_buffer_size);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_2, profile.http_version);
+
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(size_t(16U * 1024U), profile.receive_buffer_size);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_ANY, profile.http_version);
+}
+
+void test_small_transfers_do_not_affect_buffer_size()
+{
+    struct HostObservation obs = success(2, 10U * 1024U * 1024U);
+    obs.bytes = 1000;
+
+    hostprofile_learn(cdn, &obs);
+
+    struct HostProfile profile;
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(size_t(0), profile.receive_buffer_size);
+}
+
+void test_connect_timeout_adapts_to_connect_time()
+{
+    struct HostObservation obs = success(1, 0);
+    obs.connect_time_us = 2000000;
+
+    hostprofile_learn(radio, &obs);
+
+    struct HostProfile profile;
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(16000U, profile.connect_timeout_ms);
+
+    obs.connect_time_us = 1000000;
+    hostprofile_learn(radio, &obs);
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(14000U, profile.connect_timeout_ms);
+
+    struct HostObservation failed {};
+    failed.connect_failed = true;
+    hostprofile_learn(radio, &failed);
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(45000U, profile.connect_timeout_ms);
+}
+
+void test_concurrency_is_halved_on_throttling_and_recovers()
+{
+    struct HostObservation throttled {};
+    throttled.throttled = true;
+
+    struct HostProfile profile;
+
+    hostprofile_learn(cdn, &throttled);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(2U, profile.max_concurrency);
+
+    hostprofile_learn(cdn, &throttled);
+    hostprofile_learn(cdn, &throttled);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(1U, profile.max_concurrency);
+
+    const struct HostObservation ok = success(2, 0);
+
+    hostprofile_learn(cdn, &ok);
+    hostprofile_learn(cdn, &ok);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(3U, profile.max_concurrency);
+
+    hostprofile_learn(cdn, &ok);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(0U, profile.max_concurrency);
+}
+
+void test_broken_http2_falls_back_to_http1()
+{
+    const struct HostObservation ok = success(2, 0);
+    hostprofile_learn(cdn, &ok);
+
+    struct HostObservation obs {};
+    obs.http2_failed = true;
+    obs.http_major = 2;
+    hostprofile_learn(cdn, &obs);
+
+    struct HostProfile profile;
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_1, profile.http_version);
+
+    /* transfers made with HTTP/1.1 keep the host pinned */
+    const struct HostObservation http1 = success(1, 0);
+    hostprofile_learn(cdn, &http1);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_1, profile.http_version);
+}
+
+void test_http1_responses_do_not_pin_http1()
+{
+    const struct HostObservation http2 = success(2, 0);
+    const struct HostObservation http1 = success(1, 0);
+
+    struct HostProfile profile;
+
+    hostprofile_learn(radio, &http1);
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_ANY, profile.http_version);
+
+    hostprofile_learn(cdn, &http2);
+    hostprofile_learn(cdn, &http1);
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_ANY, profile.http_version);
+}
+
+void test_http2_is_tried_again_some_time_after_failure()
+{
+    const long long now = std::time(nullptr);
+    FILE *f = std::fopen(profiles_file, "w");
+
+    cppcut_assert_not_null(f);
+    std::fprintf(f,
+                 "[%s]\nhttp=1\nhttp2_failed_at=%lld\n"
+                 "[%s]\nhttp=1\nhttp2_failed_at=%lld\n",
+                 cdn, now - 60, radio, now - 2 * 24 * 60 * 60);
+    std::fclose(f);
+
+    hostprofile_deinit();
+    hostprofile_init(profiles_file, 4);
+
+    struct HostProfile profile;
+
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_1, profile.http_version);
+
+    hostprofile_get(radio, &profile);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_ANY, profile.http_version);
+}
+
+void test_profiles_survive_restart()
+{
+    hostprofile_deinit();
+    hostprofile_init(profiles_file, 4);
+
+    struct HostObservation throttled {};
+    throttled.throttled = true;
+
+    const struct HostObservation fast = success(2, 10U * 1024U * 1024U);
+
+    hostprofile_learn(cdn, &fast);
+    hostprofile_learn(cdn, &throttled);
+    hostprofile_learn("http://[::1]:80", &throttled);
+    cut_assert_true(hostprofile_save());
+
+    hostprofile_deinit();
+    hostprofile_init(profiles_file, 4);
+
+    struct HostProfile profile;
+
+    hostprofile_get(cdn, &profile);
+    cppcut_assert_equal(size_t(128U * 1024U), profile.receive_buffer_size);
+    cppcut_assert_equal(HOSTPROFILE_HTTP_2, profile.http_version);
+    cppcut_assert_equal(2U, profile.max_concurrency);
+    cut_assert_true(profile.connect_timeout_ms < 45000U);
+
+    hostprofile_get("http://[::1]:80", &profile);
+    cppcut_assert_equal(0U, profile.max_concurrency);
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+
+#include "membudget.h"
+#include "stats.h"
+
+namespace membudget_tests
+{
+
+void cut_setup()
+{
+    stats_reset();
+    membudget_init(0, 0);
+
+    cppcut_assert_equal(size_t(0), membudget_get_total_usage());
+}
+
+void cut_teardown()
+{
+    cppcut_assert_equal(size_t(0), membudget_get_total_usage());
+}
+
+void test_charges_are_accounted_per_category()
+{
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, 1000);
+    membudget_charge(MEMBUDGET_WRITE_BUFFERS, 200);
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, 30);
+
+    cppcut_assert_equal(size_t(1030),
+                        membudget_get_usage(MEMBUDGET_RECEIVE_BUFFERS));
+    cppcut_assert_equal(size_t(200),
+                        membudget_get_usage(MEMBUDGET_WRITE_BUFFERS));
+    cppcut_assert_equal(size_t(0), membudget_get_usage(MEMBUDGET_ITEMS));
+    cppcut_assert_equal(size_t(1230), membudget_get_total_usage());
+    cppcut_assert_equal(uint64_t(1230), stats_get(STATS_MEMORY_USED));
+
+    membudget_release(MEMBUDGET_RECEIVE_BUFFERS, 1030);
+    membudget_release(MEMBUDGET_WRITE_BUFFERS, 200);
+
+    cppcut_assert_equal(uint64_t(0), stats_get(STATS_MEMORY_USED));
+    cppcut_assert_equal(uint64_t(1230), stats_get(STATS_MEMORY_PEAK));
+}
+
+void test_unlimited_budget_always_fits()
+{
+    cut_assert_true(membudget_fits(SIZE_MAX / 2));
+    cut_assert_false(membudget_is_under_pressure());
+}
+
+void test_charges_beyond_budget_do_not_fit()
+{
+    membudget_init(1000, 0);
+    membudget_charge(MEMBUDGET_ITEMS, 600);
+
+    cut_assert_true(membudget_fits(400));
+    cut_assert_false(membudget_fits(401));
+
+    membudget_release(MEMBUDGET_ITEMS, 600);
+}
+
+void test_items_may_use_half_of_the_budget()
+{
+    cut_assert_true(membudget_items_fit());
+
+    membudget_init(1000, 0);
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, 400);
+    membudget_charge(MEMBUDGET_ITEMS, 500);
+
+    cut_assert_true(membudget_items_fit());
+
+    membudget_charge(MEMBUDGET_ITEMS, 1);
+
+    cut_assert_false(membudget_items_fit());
+
+    membudget_release(MEMBUDGET_ITEMS, 501);
+    membudget_release(MEMBUDGET_RECEIVE_BUFFERS, 400);
+
+    cut_assert_true(membudget_items_fit());
+}
+
+void test_usage_close_to_budget_means_pressure()
+{
+    membudget_init(1000, 0);
+    membudget_charge(MEMBUDGET_EVENTS, 750);
+
+    cut_assert_false(membudget_is_under_pressure());
+
+    membudget_charge(MEMBUDGET_EVENTS, 50);
+
+    cut_assert_true(membudget_is_under_pressure());
+
+    membudget_release(MEMBUDGET_EVENTS, 800);
+
+    cut_assert_false(membudget_is_under_pressure());
+}
+
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+#include <cppcutter.h>
+#include <glib.h>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <ftw.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pathroots.h"
+
+namespace pathroots_tests
+{
+
+static std::string base_path;
+static std::string root_path;
+
+static int remove_entry(const char *path, const struct stat *, int,
+                        struct FTW *)
+{
+    return remove(path);
+}
+
+static void make_file(const std::string &name)
+{
+    cut_assert_true(g_file_set_contents((base_path + "/" + name).c_str(),
+                                        "data", 4, nullptr));
+}
+
+static void make_dir(const std::string &name)
+{
+    cppcut_assert_equal(0, mkdir((base_path + "/" + name).c_str(), 0700));
+}
+
+static void make_symlink(const std::string &target, const std::string &name)
+{
+    cppcut_assert_equal(0, symlink(target.c_str(),
+                                   (base_path + "/" + name).c_str()));
+}
+
+/*!
+ * Resolve path relative to the test directory, expect failure with given
+ * error code.
+ */
+static void expect_refused(char *(*resolve)(const char *),
+                           const std::string &name, int expected_error)
+{
+    errno = 0;
+    char *result = resolve((base_path + "/" + name).c_str());
+
+    cppcut_assert_null(result);
+    cppcut_assert_equal(expected_error, errno);
+}
+
+static void expect_resolved(char *(*resolve)(const char *),
+                            const std::string &name,
+                            const std::string &expected)
+{
+    char *result = resolve((base_path + "/" + name).c_str());
+
+    cppcut_assert_not_null(result);
+    cppcut_assert_equal(base_path + "/" + expected, std::string(result));
+    g_free(result);
+}
+
+void cut_setup()
+{
+    char path[] = "/tmp/test_pathroots.XXXXXX";
+
+    cut_assert_not_null(mkdtemp(path));
+
+    /* /tmp may be a symlink */
+    char *resolved = realpath(path, nullptr);
+    cut_assert_not_null(resolved);
+    base_path = resolved;
+    free(resolved);
+
+    root_path = base_path + "/root";
+    make_dir("root");
+    make_dir("root/sub");
+    make_dir("root2");
+    make_dir("outside");
+    make_file("root/file");
+    make_file("root/sub/file");
+    make_file("root2/file");
+    make_file("outside/file");
+
+    pathroots_init();
+    cut_assert_true(pathroots_add(root_path.c_str()));
+}
+
+void cut_teardown()
+{
+    pathroots_deinit();
+    nftw(base_path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+void test_sources_below_allowed_directories_are_resolved()
+{
+    expect_resolved(pathroots_resolve_source, "root/file", "root/file");
+    expect_resolved(pathroots_resolve_source, "root/sub/file",
+                    "root/sub/file");
+    expect_resolved(pathroots_resolve_source, "root/sub/../file",
+                    "root/file");
+}
+
+void test_sources_outside_allowed_directories_are_refused()
+{
+    expect_refused(pathroots_resolve_source, "outside/file", EACCES);
+    expect_refused(pathroots_resolve_source, "root/../outside/file", EACCES);
+    expect_refused(pathroots_resolve_source, "root2/file", EACCES);
+}
+
+void test_sources_linked_from_outside_are_refused()
+{
+    make_symlink(base_path + "/outside/file", "root/link");
+    make_symlink(base_path + "/outside", "root/dirlink");
+
+    expect_refused(pathroots_resolve_source, "root/link", EACCES);
+    expect_refused(pathroots_resolve_source, "root/dirlink/file", EACCES);
+}
+
+void test_missing_sources_are_reported()
+{
+    expect_refused(pathroots_resolve_source, "root/missing", ENOENT);
+}
+
+static std::string file_url(const std::string &name)
+{
+    return "file://" + base_path + "/" + name;
+}
+
+void test_network_urls_are_taken_as_they_are()
+{
+    char *result = pathroots_resolve_url("http://example.com/root/file");
+
+    cppcut_assert_equal(std::string("http://example.com/root/file"),
+                        std::string(result));
+    g_free(result);
+}
+
+void test_file_urls_below_allowed_directories_are_resolved()
+{
+    char *result = pathroots_resolve_url(file_url("root/sub/../file").c_str());
+
+    cppcut_assert_not_null(result);
+    cppcut_assert_equal(file_url("root/file"), std::string(result));
+    g_free(result);
+}
+
+void test_file_urls_outside_allowed_directories_are_refused()
+{
+    make_symlink(base_path + "/outside/file", "root/link");
+
+    errno = 0;
+    cppcut_assert_null(pathroots_resolve_url(file_url("outside/file").c_str()));
+    cppcut_assert_equal(EACCES, errno);
+
+    errno = 0;
+    cppcut_assert_null(pathroots_resolve_url(file_url("root/link").c_str()));
+    cppcut_assert_equal(EACCES, errno);
+
+    errno = 0;
+    cppcut_assert_null(pathroots_resolve_url("FILE:///etc/passwd"));
+    cppcut_assert_equal(EACCES, errno);
+}
+
+void test_file_urls_of_other_hosts_are_refused()
+{
+    const std::string url = "file://example.com" + root_path + "/file";
+
+    errno = 0;
+    cppcut_assert_null(pathroots_resolve_url(url.c_str()));
+    cppcut_assert_equal(EINVAL, errno);
+}
+
+void test_destinations_below_allowed_directories_are_resolved()
+{
+    expect_resolved(pathroots_resolve_destination, "root/new", "root/new");
+    expect_resolved(pathroots_resolve_destination, "root/sub/../new",
+                    "root/new");
+    expect_resolved(pathroots_resolve_destination, "root/file", "root/file");
+}
+
+void test_destinations_outside_allowed_directories_are_refused()
+{
+    make_symlink(base_path + "/outside", "root/dirlink");
+
+    expect_refused(pathroots_resolve_destination, "outside/new", EACCES);
+    expect_refused(pathroots_resolve_destination, "root2/new", EACCES);
+    expect_refused(pathroots_resolve_destination, "root/dirlink/new", EACCES);
+    expect_refused(pathroots_resolve_destination, "root/missing/new", ENOENT);
+}
+
+void test_destinations_must_end_with_a_name()
+{
+    expect_refused(pathroots_resolve_destination, "root/sub/..", EINVAL);
+    expect_refused(pathroots_resolve_destination, "root/sub/.", EINVAL);
+    expect_refused(pathroots_resolve_destination, "root/sub/", EINVAL);
+
+    errno = 0;
+    cppcut_assert_null(pathroots_resolve_destination("root/new"));
+    cppcut_assert_equal(EINVAL, errno);
+}
+
+void test_allowed_directory_itself_is_not_a_destination_below_it()
+{
+    /* the root's parent is not allowed, so the root cannot be replaced */
+    expect_refused(pathroots_resolve_destination, "root", EACCES);
+}
+
+void test_directories_must_exist_to_be_allowed()
+{
+    cut_assert_false(pathroots_add((base_path + "/missing").c_str()));
+}
+
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <set>
+#include <string>
+
+#include "registry.h"
+
+namespace registry_tests
+{
+
+static std::set<uint32_t> collected;
+
+static void collect_id(const struct RegistryEntry *entry, void *)
+{
+    collected.insert(entry->item_id);
+}
+
+void cut_setup()
+{
+    collected.clear();
+    registry_init();
+}
+
+void cut_teardown()
+{
+    registry_deinit();
+}
+
+void test_registered_items_can_be_looked_up_by_id()
+{
+    cut_assert_true(registry_add(5, XFER_PRIORITY_BACKGROUND, ":1.23", "covers",
+                                 nullptr));
+
+    const struct RegistryEntry *entry = registry_lookup(5);
+
+    cppcut_assert_not_null(entry);
+    cppcut_assert_equal(uint32_t(5), entry->item_id);
+    cppcut_assert_equal(XFER_PRIORITY_BACKGROUND, entry->priority);
+    cppcut_assert_equal(":1.23", entry->sender);
+    cppcut_assert_equal("covers", entry->tag);
+    cppcut_assert_null(registry_lookup(6));
+}
+
+void test_items_can_be_registered_only_once()
+{
+    cut_assert_true(registry_add(5, XFER_PRIORITY_NORMAL, ":1.23", NULL, nullptr));
+    cut_assert_false(registry_add(5, XFER_PRIORITY_NORMAL, ":1.24", NULL, nullptr));
+    cppcut_assert_equal(1U, registry_get_count());
+}
+
+void test_items_are_indexed_by_sender_and_tag()
+{
+    registry_add(1, XFER_PRIORITY_NORMAL, ":1.10", "a", nullptr);
+    registry_add(2, XFER_PRIORITY_NORMAL, ":1.11", "a", nullptr);
+    registry_add(3, XFER_PRIORITY_NORMAL, ":1.10", NULL, nullptr);
+    registry_add(4, XFER_PRIORITY_NORMAL, NULL, "b", nullptr);
+
+    cppcut_assert_equal(2U, registry_foreach_by_sender(":1.10", collect_id, nullptr));
+    cut_assert_true(collected == std::set<uint32_t>({1, 3}));
+
+    collected.clear();
+    cppcut_assert_equal(2U, registry_foreach_by_tag("a", collect_id, nullptr));
+    cut_assert_true(collected == std::set<uint32_t>({1, 2}));
+
+    cppcut_assert_equal(0U, registry_foreach_by_sender(":1.99", collect_id, nullptr));
+    cppcut_assert_equal(0U, registry_foreach_by_tag("c", collect_id, nullptr));
+}
+
+void test_removed_items_disappear_from_all_indices()
+{
+    registry_add(1, XFER_PRIORITY_NORMAL, ":1.10", "a", nullptr);
+    registry_add(2, XFER_PRIORITY_NORMAL, ":1.10", "a", nullptr);
+
+    registry_remove(1);
+    registry_remove(1);
+
+    cppcut_assert_null(registry_lookup(1));
+    cppcut_assert_equal(1U, registry_get_count());
+    cppcut_assert_equal(1U, registry_foreach_by_sender(":1.10", collect_id, nullptr));
+    cppcut_assert_equal(1U, registry_foreach_by_tag("a", collect_id, nullptr));
+
+    registry_remove(2);
+
+    cppcut_assert_equal(0U, registry_get_count());
+    cppcut_assert_equal(0U, registry_foreach_by_sender(":1.10", collect_id, nullptr));
+    cppcut_assert_equal(0U, registry_foreach_by_tag("a", collect_id, nullptr));
+}
+
+void test_entries_share_status_with_transfer_thread()
+{
+    struct XferStatus *status = xferstatus_new();
+
+    registry_add(7, XFER_PRIORITY_NORMAL, ":1.10", NULL, status);
+
+    const struct XferStatusSnapshot published =
+        { XFER_STATE_PAUSED, 1000, 5000, 250, 3000 };
+    xferstatus_publish(status, &published);
+    xferstatus_unref(status);
+
+    struct XferStatusSnapshot snapshot;
+    xferstatus_read(registry_lookup(7)->status, &snapshot);
+
+    cppcut_assert_equal(XFER_STATE_PAUSED, snapshot.state);
+    cppcut_assert_equal(uint64_t(1000), snapshot.bytes);
+    cppcut_assert_equal(uint64_t(5000), snapshot.total);
+    cppcut_assert_equal(uint64_t(250), snapshot.rate);
+    cppcut_assert_equal(uint64_t(3000), snapshot.paused_us);
+}
+
+void test_state_values_sent_to_clients_are_stable()
+{
+    cppcut_assert_equal(0, int(XFER_STATE_QUEUED));
+    cppcut_assert_equal(1, int(XFER_STATE_RUNNING));
+    cppcut_assert_equal(2, int(XFER_STATE_DONE));
+    cppcut_assert_equal(3, int(XFER_STATE_PAUSED));
+}
+
+void test_many_items_from_many_clients()
+{
+    static constexpr uint32_t count = 50000;
+
+    for(uint32_t id = 1; id <= count; ++id)
+    {
+        const std::string sender = ":1." + std::to_string(id % 7);
+        cut_assert_true(registry_add(id, XFER_PRIORITY_BACKGROUND,
+                                     sender.c_str(), "prefetch", nullptr));
+    }
+
+    cppcut_assert_equal(count, registry_get_count());
+    cppcut_assert_equal(count, registry_foreach_by_tag("prefetch", collect_id, nullptr));
+
+    for(uint32_t id = 1; id <= count; id += 2)
+        registry_remove(id);
+
+    cppcut_assert_equal(count / 2, registry_get_count());
+    cppcut_assert_not_null(registry_lookup(count));
+    cppcut_assert_null(registry_lookup(count - 1));
+}
+
+}
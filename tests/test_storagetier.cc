@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+
+#include "storagetier.h"
+
+namespace storagetier_tests
+{
+
+static const char fast_path[] = "/tmp/test_storagetier/fast";
+static const char slow_path[] = "/tmp/test_storagetier/slow";
+
+static const uint64_t small_file = 4U * 1024U;
+static const uint64_t large_file = 4U * 1024U * 1024U;
+
+static int fast_tier;
+static int slow_tier;
+
+void cut_setup()
+{
+    storagetier_init();
+    fast_tier = storagetier_add(fast_path, 1024U * 1024U, true);
+    slow_tier = storagetier_add(slow_path, 0, true);
+}
+
+void cut_teardown()
+{
+    storagetier_deinit();
+}
+
+void test_tiers_are_numbered_in_order()
+{
+    cppcut_assert_equal(2U, storagetier_get_count());
+    cppcut_assert_equal(0, fast_tier);
+    cppcut_assert_equal(1, slow_tier);
+    cppcut_assert_equal(fast_path, storagetier_get_path(fast_tier));
+    cppcut_assert_equal(slow_path, storagetier_get_path(slow_tier));
+}
+
+void test_no_tier_without_configuration()
+{
+    storagetier_deinit();
+    storagetier_init();
+
+    cppcut_assert_equal(0U, storagetier_get_count());
+    cppcut_assert_equal(-1, storagetier_select(small_file, false));
+}
+
+void test_small_files_go_to_first_tier()
+{
+    const int tier = storagetier_select(small_file, false);
+
+    cppcut_assert_equal(fast_tier, tier);
+    storagetier_release(tier, small_file);
+}
+
+void test_large_files_go_to_unlimited_tier()
+{
+    const int tier = storagetier_select(large_file, false);
+
+    cppcut_assert_equal(slow_tier, tier);
+    storagetier_release(tier, large_file);
+}
+
+void test_files_of_unknown_size_go_to_unlimited_tier()
+{
+    cppcut_assert_equal(slow_tier, storagetier_select(0, false));
+}
+
+void test_short_lived_files_of_unknown_size_go_to_first_tier()
+{
+    cppcut_assert_equal(fast_tier, storagetier_select(0, true));
+}
+
+void test_space_is_claimed_only_while_available()
+{
+    cut_assert_true(storagetier_claim(slow_tier, small_file));
+    cut_assert_false(storagetier_claim(slow_tier, UINT64_MAX - small_file));
+    storagetier_release(slow_tier, small_file);
+    cut_assert_true(storagetier_claim(slow_tier, small_file));
+    storagetier_release(slow_tier, small_file);
+}
+
+void test_measured_throughput_overrides_order()
+{
+    storagetier_record_write(fast_tier, large_file, 1000000);
+    cppcut_assert_equal(fast_tier, storagetier_select(0, true));
+
+    storagetier_record_write(slow_tier, large_file, 100000);
+    cppcut_assert_equal(slow_tier, storagetier_select(0, true));
+    cppcut_assert_equal(slow_tier, storagetier_select(small_file, false));
+    storagetier_release(slow_tier, small_file);
+}
+
+void test_throughput_is_averaged()
+{
+    cppcut_assert_equal(uint64_t(0), storagetier_get_rate(fast_tier));
+
+    storagetier_record_write(fast_tier, 8U * 1024U * 1024U, 1000000);
+    cppcut_assert_equal(uint64_t(8U * 1024U * 1024U),
+                        storagetier_get_rate(fast_tier));
+
+    storagetier_record_write(fast_tier, 16U * 1024U * 1024U, 1000000);
+    cppcut_assert_equal(uint64_t(10U * 1024U * 1024U),
+                        storagetier_get_rate(fast_tier));
+}
+
+void test_small_writes_are_not_measured()
+{
+    storagetier_record_write(fast_tier, small_file, 1);
+    cppcut_assert_equal(uint64_t(0), storagetier_get_rate(fast_tier));
+}
+
+}
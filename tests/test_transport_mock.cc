@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "transport.h"
+
+namespace transport_mock_tests
+{
+
+static const char script_file[] = "/tmp/test_transport_mock.ini";
+
+static const char url[] = "http://example.com/file";
+
+static const int64_t second_us = 1000000;
+
+/*!
+ * Requests are identified by their handle only, so any unique address
+ * will do.
+ */
+static int dummy_handles[2];
+static CURL *const handle = static_cast<CURL *>(&dummy_handles[0]);
+static CURL *const other_handle = static_cast<CURL *>(&dummy_handles[1]);
+
+struct Received
+{
+    std::vector<uint8_t> data;
+    size_t write_limit;
+    curl_off_t dltotal;
+    curl_off_t dlnow;
+    unsigned int progress_calls;
+    size_t upload_size;
+    curl_off_t ulnow;
+};
+
+static Received received;
+static struct TransportMockScript *script;
+static struct Transport *transport;
+
+static size_t write_data(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    auto *r = static_cast<Received *>(userdata);
+    const size_t len = std::min(size * nmemb, r->write_limit - r->data.size());
+
+    r->data.insert(r->data.end(), ptr, ptr + len);
+
+    return len;
+}
+
+static size_t read_data(char *buffer, size_t size, size_t nitems,
+                        void *userdata)
+{
+    auto *r = static_cast<Received *>(userdata);
+    const size_t len = std::min(size * nitems, r->upload_size);
+
+    std::fill(buffer, buffer + len, 'x');
+    r->upload_size -= len;
+
+    return len;
+}
+
+static int progress(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+                    curl_off_t /* ultotal */, curl_off_t ulnow)
+{
+    auto *r = static_cast<Received *>(clientp);
+
+    r->dltotal = dltotal;
+    r->dlnow = dlnow;
+    r->ulnow = ulnow;
+    ++r->progress_calls;
+
+    return 0;
+}
+
+static struct TransportRequest make_request(const char *request_url)
+{
+    struct TransportRequest request {};
+
+    request.url = request_url;
+    request.write = write_data;
+    request.progress = progress;
+    request.data = &received;
+
+    return request;
+}
+
+static struct TransportMockResponse make_response(uint64_t size)
+{
+    struct TransportMockResponse response {};
+
+    response.size = size;
+    response.result = CURLE_OK;
+
+    return response;
+}
+
+static CURL *run_until_finished(CURLcode &result)
+{
+    CURL *finished = nullptr;
+
+    for(int i = 0; i < 1000 && finished == nullptr; ++i)
+    {
+        transport_perform(transport);
+        finished = transport_next_finished(transport, &result);
+
+        if(finished == nullptr)
+            transport_wait(transport, 10);
+    }
+
+    return finished;
+}
+
+static void expect_pattern(uint64_t first_offset, size_t count)
+{
+    cppcut_assert_equal(count, received.data.size());
+
+    for(size_t i = 0; i < count; ++i)
+        cppcut_assert_equal(transport_mock_get_byte(first_offset + i),
+                            received.data[i]);
+}
+
+void cut_setup()
+{
+    received = Received();
+    received.write_limit = SIZE_MAX;
+    script = transport_mock_script_new();
+    transport = transport_mock_new(script);
+}
+
+void cut_teardown()
+{
+    transport_remove(transport, handle);
+    transport_remove(transport, other_handle);
+    transport_free(transport);
+    transport = nullptr;
+    transport_mock_script_free(script);
+    script = nullptr;
+}
+
+void test_scripted_resource_is_delivered_completely()
+{
+    const auto response = make_response(100000);
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    cppcut_assert_equal(CURLM_OK, transport_add(transport, handle, &request));
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(0, 100000);
+
+    cppcut_assert_equal(curl_off_t(100000), received.dltotal);
+    cppcut_assert_equal(curl_off_t(100000), received.dlnow);
+    cppcut_assert_null(transport_next_finished(transport, &result));
+}
+
+void test_unknown_url_fails_like_unknown_host()
+{
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_OK;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_COULDNT_RESOLVE_HOST, result);
+    cut_assert_true(received.data.empty());
+}
+
+void test_wildcard_matches_any_other_url()
+{
+    const auto response = make_response(10);
+    transport_mock_script_set(script, "*", &response);
+
+    const auto request = make_request("http://other.example.com/");
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(0, 10);
+}
+
+void test_scripted_error_after_partial_data()
+{
+    auto response = make_response(50000);
+    response.result = CURLE_RECV_ERROR;
+    response.fail_after = 20000;
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_OK;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_RECV_ERROR, result);
+    expect_pattern(0, 20000);
+}
+
+void test_resumed_request_gets_remainder()
+{
+    const auto response = make_response(30000);
+    transport_mock_script_set(script, url, &response);
+
+    auto request = make_request(url);
+    request.resume_from = 12345;
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(12345, 30000 - 12345);
+    cppcut_assert_equal(curl_off_t(30000 - 12345), received.dltotal);
+}
+
+void test_range_request_gets_requested_bytes_only()
+{
+    const auto response = make_response(30000);
+    transport_mock_script_set(script, url, &response);
+
+    auto request = make_request(url);
+    request.resume_from = 1000;
+    request.range_end = 5000;
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(1000, 4000);
+    cppcut_assert_equal(curl_off_t(4000), received.dltotal);
+}
+
+void test_short_write_fails_request()
+{
+    const auto response = make_response(1000);
+    transport_mock_script_set(script, url, &response);
+    received.write_limit = 100;
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_OK;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_WRITE_ERROR, result);
+    expect_pattern(0, 100);
+}
+
+void test_nothing_is_delivered_before_delay()
+{
+    auto response = make_response(1000);
+    response.delay_ms = 60000;
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+    transport_perform(transport);
+
+    CURLcode result;
+    cppcut_assert_null(transport_next_finished(transport, &result));
+    cut_assert_true(received.data.empty());
+    cppcut_assert_equal(0U, received.progress_calls);
+}
+
+void test_rate_limits_data_per_perform()
+{
+    auto response = make_response(1000000);
+    response.bytes_per_second = 1000;
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+    transport_perform(transport);
+
+    /* far less than a second has passed */
+    cut_assert_true(received.data.size() < 1000);
+    expect_pattern(0, received.data.size());
+
+    CURLcode result;
+    cppcut_assert_null(transport_next_finished(transport, &result));
+}
+
+void test_advancing_time_lets_rate_limited_data_through()
+{
+    auto response = make_response(1000000);
+    response.bytes_per_second = 1000;
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+    transport_mock_script_advance_time(script, 5 * second_us);
+    transport_perform(transport);
+
+    cut_assert_true(received.data.size() >= 5000);
+    cut_assert_true(received.data.size() < 6000);
+    expect_pattern(0, received.data.size());
+}
+
+void test_stalled_request_reports_progress_without_data()
+{
+    auto response = make_response(50000);
+    response.stall_after = 20000;
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+
+    CURLcode result;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        transport_mock_script_advance_time(script, second_us);
+        transport_perform(transport);
+        cppcut_assert_null(transport_next_finished(transport, &result));
+    }
+
+    expect_pattern(0, 20000);
+    cppcut_assert_equal(curl_off_t(20000), received.dlnow);
+    cppcut_assert_equal(3U, received.progress_calls);
+}
+
+void test_resumed_request_does_not_stall()
+{
+    auto response = make_response(50000);
+    response.stall_after = 20000;
+    transport_mock_script_set(script, url, &response);
+
+    auto request = make_request(url);
+    request.resume_from = 20000;
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(20000, 30000);
+}
+
+void test_paused_request_moves_no_data_until_resumed()
+{
+    const auto response = make_response(1000);
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+    cppcut_assert_equal(CURLE_OK, transport_pause(transport, handle, true));
+    transport_perform(transport);
+
+    CURLcode result;
+    cppcut_assert_null(transport_next_finished(transport, &result));
+    cut_assert_true(received.data.empty());
+
+    cppcut_assert_equal(CURLE_OK, transport_pause(transport, handle, false));
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    expect_pattern(0, 1000);
+}
+
+void test_upload_is_read_before_response()
+{
+    const auto response = make_response(16);
+    transport_mock_script_set(script, url, &response);
+    received.upload_size = 70000;
+
+    auto request = make_request(url);
+    request.read = read_data;
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_FAILED_INIT;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_OK, result);
+    cppcut_assert_equal(size_t(0), received.upload_size);
+    cppcut_assert_equal(curl_off_t(70000), received.ulnow);
+    expect_pattern(0, 16);
+}
+
+void test_requests_finish_in_order_of_addition()
+{
+    const auto response = make_response(10);
+    transport_mock_script_set(script, url, &response);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+    transport_add(transport, other_handle, &request);
+    transport_perform(transport);
+
+    CURLcode result;
+    cppcut_assert_equal(handle, transport_next_finished(transport, &result));
+    cppcut_assert_equal(other_handle,
+                        transport_next_finished(transport, &result));
+}
+
+void test_script_is_loaded_from_file()
+{
+    static const char contents[] =
+        "[http://example.com/file]\n"
+        "size=2000\n"
+        "result=56\n"
+        "fail_after=1500\n";
+
+    FILE *f = std::fopen(script_file, "w");
+    cppcut_assert_not_null(f);
+    std::fputs(contents, f);
+    std::fclose(f);
+
+    transport_free(transport);
+    transport_mock_script_free(script);
+    script = transport_mock_script_load(script_file);
+    cppcut_assert_not_null(script);
+    transport = transport_mock_new(script);
+    std::remove(script_file);
+
+    const auto request = make_request(url);
+    transport_add(transport, handle, &request);
+
+    CURLcode result = CURLE_OK;
+    cppcut_assert_equal(handle, run_until_finished(result));
+    cppcut_assert_equal(CURLE_RECV_ERROR, result);
+    expect_pattern(0, 1500);
+}
+
+}
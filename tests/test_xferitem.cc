@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+#include <vector>
+
+#include "xferitem.h"
+
+namespace xferitem_tests
+{
+
+static GQueue queue;
+static struct XferItem items[6];
+
+void cut_setup()
+{
+    g_queue_init(&queue);
+
+    for(size_t i = 0; i < G_N_ELEMENTS(items); ++i)
+    {
+        items[i] = {};
+        items[i].item_id = i + 1;
+    }
+}
+
+void cut_teardown()
+{
+    g_queue_clear(&queue);
+}
+
+static void queue_with_deadline(uint32_t item_id, int64_t deadline)
+{
+    struct XferItem *item = &items[item_id - 1];
+
+    item->deadline = deadline;
+
+    const GList *link = xferitem_queue_by_deadline(&queue, item);
+
+    cppcut_assert_not_null(link);
+    cppcut_assert_equal(static_cast<gpointer>(item), link->data);
+}
+
+static void assert_queue_order(const std::vector<uint32_t> &expected)
+{
+    std::vector<uint32_t> ids;
+
+    for(const GList *it = queue.head; it != NULL; it = it->next)
+        ids.push_back(static_cast<const struct XferItem *>(it->data)->item_id);
+
+    cppcut_assert_equal(expected.size(), ids.size());
+
+    for(size_t i = 0; i < expected.size(); ++i)
+        cppcut_assert_equal(expected[i], ids[i]);
+}
+
+void test_items_without_deadline_are_queued_in_order_of_arrival()
+{
+    queue_with_deadline(1, 0);
+    queue_with_deadline(2, 0);
+    queue_with_deadline(3, 0);
+
+    assert_queue_order({1, 2, 3});
+}
+
+void test_items_are_queued_earliest_deadline_first()
+{
+    queue_with_deadline(1, 3000);
+    queue_with_deadline(2, 1000);
+    queue_with_deadline(3, 2000);
+
+    assert_queue_order({2, 3, 1});
+}
+
+void test_items_with_deadline_are_queued_ahead_of_those_without()
+{
+    queue_with_deadline(1, 0);
+    queue_with_deadline(2, 5000);
+    queue_with_deadline(3, 0);
+    queue_with_deadline(4, 1000);
+
+    assert_queue_order({4, 2, 1, 3});
+}
+
+void test_items_with_equal_deadlines_are_queued_in_order_of_arrival()
+{
+    queue_with_deadline(1, 2000);
+    queue_with_deadline(2, 1000);
+    queue_with_deadline(3, 2000);
+    queue_with_deadline(4, 1000);
+    queue_with_deadline(5, 0);
+    queue_with_deadline(6, 2000);
+
+    assert_queue_order({2, 4, 1, 3, 6, 5});
+}
+
+void test_returned_links_stay_valid_when_more_items_are_queued()
+{
+    items[0].deadline = 2000;
+    GList *link = xferitem_queue_by_deadline(&queue, &items[0]);
+
+    queue_with_deadline(2, 1000);
+    queue_with_deadline(3, 3000);
+
+    g_queue_delete_link(&queue, link);
+
+    assert_queue_order({2, 3});
+}
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "transport.h"
+
+/*!
+ * Hand request over to the transport.
+ *
+ * The request is not started before the next call of #transport_perform().
+ * Requests without a #TransportRequest (\c NULL) are run with the options
+ * set on the easy handle only.
+ */
+CURLMcode transport_add(struct Transport *transport, CURL *handle,
+                        const struct TransportRequest *request)
+{
+    return transport->ops->add(transport, handle, request);
+}
+
+/*!
+ * Stop request, finished or not. The easy handle is not freed.
+ */
+void transport_remove(struct Transport *transport, CURL *handle)
+{
+    transport->ops->remove(transport, handle);
+}
+
+/*!
+ * Stop moving data of a request, or continue.
+ *
+ * The connection of a paused request is kept open, and no data is lost.
+ */
+CURLcode transport_pause(struct Transport *transport, CURL *handle,
+                         bool is_paused)
+{
+    return transport->ops->pause(transport, handle, is_paused);
+}
+
+/*!
+ * Move data of all requests as far as possible without blocking.
+ */
+void transport_perform(struct Transport *transport)
+{
+    transport->ops->perform(transport);
+}
+
+/*!
+ * Get next request which has finished, \c NULL if there is none.
+ */
+CURL *transport_next_finished(struct Transport *transport, CURLcode *result)
+{
+    return transport->ops->next_finished(transport, result);
+}
+
+/*!
+ * Block until there is something to do, but no longer than \p timeout_ms.
+ */
+void transport_wait(struct Transport *transport, int timeout_ms)
+{
+    transport->ops->wait(transport, timeout_ms);
+}
+
+/*!
+ * Interrupt #transport_wait(), may be called from any thread.
+ */
+void transport_wakeup(struct Transport *transport)
+{
+    transport->ops->wakeup(transport);
+}
+
+/*!
+ * Monotonic time in microseconds as seen by the transport.
+ *
+ * This is the monotonic system time unless the transport simulates the
+ * passing of time. Decisions based on the progress of requests must use
+ * this clock.
+ */
+int64_t transport_get_time(struct Transport *transport)
+{
+    return transport->ops->get_time(transport);
+}
+
+/*!
+ * Free transport. All requests must have been removed.
+ */
+void transport_free(struct Transport *transport)
+{
+    transport->ops->free(transport);
+}
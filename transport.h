@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <curl/curl.h>
+
+/*!
+ * How the data of a request is passed in and out, and where it starts.
+ *
+ * The callbacks have the same semantics as their cURL counterparts, no
+ * matter which transport runs the request.
+ */
+struct TransportRequest
+{
+    /*! URL of the request, must match the URL set on the easy handle. */
+    const char *url;
+
+    /*! Number of bytes of the resource to skip, 0 to get all of it. */
+    curl_off_t resume_from;
+
+    /*! Position behind the last byte wanted, 0 for all bytes up to the
+     *  end of the resource. */
+    curl_off_t range_end;
+
+    /*! Called with data received. */
+    curl_write_callback write;
+
+    /*! Called for data to be sent, \c NULL if nothing is sent. */
+    curl_read_callback read;
+
+    /*! Called with the number of bytes transferred, may be \c NULL. */
+    curl_xferinfo_callback progress;
+
+    /*! Passed to each of the callbacks. */
+    void *data;
+};
+
+struct Transport;
+
+/*!
+ * Functions implementing a transport.
+ */
+struct TransportOps
+{
+    CURLMcode (*add)(struct Transport *transport, CURL *handle,
+                     const struct TransportRequest *request);
+    void (*remove)(struct Transport *transport, CURL *handle);
+    CURLcode (*pause)(struct Transport *transport, CURL *handle,
+                      bool is_paused);
+    void (*perform)(struct Transport *transport);
+    CURL *(*next_finished)(struct Transport *transport, CURLcode *result);
+    void (*wait)(struct Transport *transport, int timeout_ms);
+    void (*wakeup)(struct Transport *transport);
+    int64_t (*get_time)(struct Transport *transport);
+    void (*free)(struct Transport *transport);
+};
+
+/*!
+ * Something which moves the data of requests.
+ *
+ * There is one transport per transfer thread. Requests are represented by
+ * cURL easy handles carrying their options in any case, but whether or not
+ * they go to the network is up to the transport.
+ *
+ * The mock transport never performs the easy handles. Their options are
+ * ignored, and all transfer information read back with
+ * \c curl_easy_getinfo() is meaningless: \c CURLINFO_RESPONSE_CODE,
+ * \c CURLINFO_HTTP_VERSION, \c CURLINFO_NUM_CONNECTS,
+ * \c CURLINFO_CONNECT_TIME_T, \c CURLINFO_TOTAL_TIME_T,
+ * \c CURLINFO_SIZE_DOWNLOAD_T, \c CURLINFO_SIZE_UPLOAD_T,
+ * \c CURLINFO_SPEED_DOWNLOAD_T, \c CURLINFO_SPEED_UPLOAD_T, and
+ * \c CURLINFO_CONTENT_LENGTH_DOWNLOAD_T. Callers must check
+ * #Transport::has_request_info before reading any of them, and rely on the
+ * callbacks of #TransportRequest and on the result of the request instead.
+ */
+struct Transport
+{
+    const struct TransportOps *ops;
+
+    /*! \c curl_easy_getinfo() tells about the requests, false for the mock
+     *  transport. */
+    bool has_request_info;
+};
+
+/*!
+ * Responses served by the mock transport.
+ */
+struct TransportMockScript;
+
+/*!
+ * Scripted response of the mock transport to requests for a URL.
+ */
+struct TransportMockResponse
+{
+    /*! Size of the resource in bytes. */
+    uint64_t size;
+
+    /*! Transfer rate in bytes per second, 0 for no limit. */
+    uint64_t bytes_per_second;
+
+    /*! Time between start of request and first byte in milliseconds. */
+    unsigned int delay_ms;
+
+    /*! Result of the request, \c CURLE_OK for success. */
+    CURLcode result;
+
+    /*! Number of bytes transferred before failing with
+     *  #TransportMockResponse::result, ignored on success. */
+    uint64_t fail_after;
+
+    /*! Number of bytes after which requests for the whole resource stop
+     *  receiving data without ever ending, 0 for no stall. Requests
+     *  resumed from a later offset are served normally, as if they went
+     *  over a fresh connection. */
+    uint64_t stall_after;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+CURLMcode transport_add(struct Transport *transport, CURL *handle,
+                        const struct TransportRequest *request);
+void transport_remove(struct Transport *transport, CURL *handle);
+CURLcode transport_pause(struct Transport *transport, CURL *handle,
+                         bool is_paused);
+void transport_perform(struct Transport *transport);
+CURL *transport_next_finished(struct Transport *transport, CURLcode *result);
+void transport_wait(struct Transport *transport, int timeout_ms);
+void transport_wakeup(struct Transport *transport);
+int64_t transport_get_time(struct Transport *transport);
+void transport_free(struct Transport *transport);
+
+struct Transport *transport_curl_new(unsigned int max_host_connections,
+                                     unsigned int max_streams_per_connection);
+
+struct TransportMockScript *transport_mock_script_new(void);
+struct TransportMockScript *transport_mock_script_load(const char *path);
+void transport_mock_script_set(struct TransportMockScript *script,
+                               const char *url,
+                               const struct TransportMockResponse *response);
+void transport_mock_script_advance_time(struct TransportMockScript *script,
+                                        int64_t us);
+void transport_mock_script_free(struct TransportMockScript *script);
+uint8_t transport_mock_get_byte(uint64_t offset);
+struct Transport *transport_mock_new(struct TransportMockScript *script);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !TRANSPORT_H */
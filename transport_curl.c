@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "transport.h"
+#include "messages.h"
+
+/*!
+ * Transport which sends requests over the network using a cURL multi
+ * handle.
+ */
+struct CurlTransport
+{
+    struct Transport base;
+    CURLM *multi;
+};
+
+static CURLMcode network_add(struct Transport *transport, CURL *handle,
+                             const struct TransportRequest *request)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+
+    if(request != NULL)
+    {
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, request->write);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, request->data);
+
+        if(request->read != NULL)
+        {
+            curl_easy_setopt(handle, CURLOPT_READFUNCTION, request->read);
+            curl_easy_setopt(handle, CURLOPT_READDATA, request->data);
+        }
+
+        if(request->progress != NULL)
+        {
+            curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION,
+                             request->progress);
+            curl_easy_setopt(handle, CURLOPT_XFERINFODATA, request->data);
+        }
+
+        if(request->range_end > 0)
+        {
+            char range[2 * 21 + 2];
+
+            snprintf(range, sizeof(range),
+                     "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T,
+                     request->resume_from, request->range_end - 1);
+            curl_easy_setopt(handle, CURLOPT_RANGE, range);
+        }
+        else if(request->resume_from > 0)
+            curl_easy_setopt(handle, CURLOPT_RESUME_FROM_LARGE,
+                             request->resume_from);
+    }
+
+    return curl_multi_add_handle(t->multi, handle);
+}
+
+static void network_remove(struct Transport *transport, CURL *handle)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+    curl_multi_remove_handle(t->multi, handle);
+}
+
+static CURLcode network_pause(struct Transport *transport, CURL *handle,
+                              bool is_paused)
+{
+    (void)transport;
+    return curl_easy_pause(handle, is_paused ? CURLPAUSE_ALL : CURLPAUSE_CONT);
+}
+
+static void network_perform(struct Transport *transport)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+    int still_running;
+
+    curl_multi_perform(t->multi, &still_running);
+}
+
+static CURL *network_next_finished(struct Transport *transport,
+                                   CURLcode *result)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+    CURLMsg *msg;
+    int msgs_in_queue;
+
+    while((msg = curl_multi_info_read(t->multi, &msgs_in_queue)) != NULL)
+    {
+        if(msg->msg == CURLMSG_DONE)
+        {
+            *result = msg->data.result;
+            return msg->easy_handle;
+        }
+    }
+
+    return NULL;
+}
+
+static void network_wait(struct Transport *transport, int timeout_ms)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+
+#if CURL_AT_LEAST_VERSION(7, 68, 0)
+    curl_multi_poll(t->multi, NULL, 0, timeout_ms, NULL);
+#else /* older than 7.68.0 */
+    curl_multi_wait(t->multi, NULL, 0, timeout_ms, NULL);
+#endif /* version 7.68.0 and up */
+}
+
+static void network_wakeup(struct Transport *transport)
+{
+#if CURL_AT_LEAST_VERSION(7, 68, 0)
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+    curl_multi_wakeup(t->multi);
+#endif /* version 7.68.0 and up */
+}
+
+static int64_t network_get_time(struct Transport *transport)
+{
+    return g_get_monotonic_time();
+}
+
+static void network_free(struct Transport *transport)
+{
+    struct CurlTransport *t = (struct CurlTransport *)transport;
+
+    curl_multi_cleanup(t->multi);
+    g_free(t);
+}
+
+static const struct TransportOps network_ops =
+{
+    .add = network_add,
+    .remove = network_remove,
+    .pause = network_pause,
+    .perform = network_perform,
+    .next_finished = network_next_finished,
+    .wait = network_wait,
+    .wakeup = network_wakeup,
+    .get_time = network_get_time,
+    .free = network_free,
+};
+
+struct Transport *transport_curl_new(unsigned int max_host_connections,
+                                     unsigned int max_streams_per_connection)
+{
+    struct CurlTransport *t = g_try_new0(struct CurlTransport, 1);
+
+    if(t == NULL)
+    {
+        msg_out_of_memory("CurlTransport");
+        return NULL;
+    }
+
+    t->base.ops = &network_ops;
+    t->base.has_request_info = true;
+    t->multi = curl_multi_init();
+
+    if(t->multi == NULL)
+    {
+        msg_error(0, LOG_ERR, "Failed initializing cURL multi handle");
+        g_free(t);
+        return NULL;
+    }
+
+    curl_multi_setopt(t->multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(t->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      (long)max_host_connections);
+#if CURL_AT_LEAST_VERSION(7, 67, 0)
+    curl_multi_setopt(t->multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                      (long)max_streams_per_connection);
+#endif /* version 7.67.0 and up */
+
+    return &t->base;
+}
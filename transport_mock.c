@@ -0,0 +1,701 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <glib.h>
+#include <stdatomic.h>
+
+#include "transport.h"
+#include "messages.h"
+
+/*!
+ * Group in script files which applies to all URLs not listed explicitly.
+ */
+#define ANY_URL "*"
+
+struct TransportMockScript
+{
+    /*! Map of URL to #TransportMockResponse. */
+    GHashTable *responses;
+
+    /*! How far the clock of the transports is ahead of the monotonic
+     *  system time in microseconds. */
+    _Atomic int64_t time_offset;
+
+    /*! Transports sharing the script wait on this for being woken up, and
+     *  for time to pass. */
+    GMutex lock;
+    GCond wakeup_cond;
+};
+
+/*!
+ * State of a request served by the mock transport.
+ */
+struct MockRequest
+{
+    CURL *handle;
+    char *url;
+
+    /*! Callbacks, \c NULL for requests without a #TransportRequest. */
+    struct TransportRequest *request;
+
+    /*! What to serve, \c NULL if the URL is not in the script. */
+    const struct TransportMockResponse *response;
+
+    int64_t start_time;
+
+    /*! Offset of the first byte served. */
+    uint64_t first_position;
+
+    /*! Offset of the next byte to be served. */
+    uint64_t position;
+
+    /*! Offset at which serving ends, successfully or not. */
+    uint64_t end_position;
+
+    /*! Offset behind the last byte requested. */
+    uint64_t range_end;
+
+    /*! Offset at which data stops coming in without the request ending,
+     *  \c UINT64_MAX if the request does not stall. */
+    uint64_t stall_position;
+
+    uint64_t bytes_sent;
+
+    /*! When the request was paused, 0 if it is not paused. */
+    int64_t paused_since;
+
+    bool is_upload_done;
+    bool is_finished;
+    CURLcode result;
+};
+
+/*!
+ * Transport which serves scripted responses without ever touching the
+ * network.
+ *
+ * Each response is a stream of bytes generated by
+ * #transport_mock_get_byte(), delivered at a configured rate after some
+ * delay, and ends with a configured result unless it stalls. Requests are
+ * served in order of addition, so runs are repeatable.
+ */
+struct MockTransport
+{
+    struct Transport base;
+    struct TransportMockScript *script;
+
+    /*! All requests, #MockRequest objects in order of addition. */
+    GQueue requests;
+
+    /*! Requests finished, but not collected yet. */
+    GQueue finished;
+
+    /*! Protected by #TransportMockScript::lock. */
+    bool is_woken_up;
+
+    char buffer[CURL_MAX_WRITE_SIZE];
+};
+
+/*!
+ * Byte at given offset of any resource served by the mock transport.
+ *
+ * The modulus is prime so that the pattern does not line up with buffer
+ * sizes, making misplaced blocks detectable.
+ */
+uint8_t transport_mock_get_byte(uint64_t offset)
+{
+    return (uint8_t)(offset % 251U);
+}
+
+static struct MockRequest *find_request(struct MockTransport *t, CURL *handle)
+{
+    for(GList *it = t->requests.head; it != NULL; it = it->next)
+    {
+        struct MockRequest *req = it->data;
+
+        if(req->handle == handle)
+            return req;
+    }
+
+    return NULL;
+}
+
+/*!
+ * How far the transport is ahead of the monotonic system time, see
+ * #transport_mock_script_advance_time().
+ */
+static int64_t get_time_offset(const struct MockTransport *t)
+{
+    return atomic_load_explicit(&t->script->time_offset, memory_order_relaxed);
+}
+
+static int64_t get_time(const struct MockTransport *t)
+{
+    return g_get_monotonic_time() + get_time_offset(t);
+}
+
+static void free_request(struct MockRequest *req)
+{
+    g_free(req->url);
+    g_free(req->request);
+    g_free(req);
+}
+
+static void finish_request(struct MockTransport *t, struct MockRequest *req,
+                           CURLcode result)
+{
+    req->is_finished = true;
+    req->result = result;
+    g_queue_push_tail(&t->finished, req);
+}
+
+/*!
+ * Number of bytes the request may move until \p now.
+ */
+static uint64_t get_budget(const struct MockRequest *req, int64_t elapsed_us)
+{
+    const uint64_t rate = req->response->bytes_per_second;
+
+    if(rate == 0)
+        return UINT64_MAX;
+
+    const uint64_t elapsed = (uint64_t)elapsed_us;
+    const uint64_t allowed =
+        elapsed / G_USEC_PER_SEC * rate +
+        elapsed % G_USEC_PER_SEC * rate / G_USEC_PER_SEC;
+    const uint64_t moved =
+        req->bytes_sent + (req->position - req->first_position);
+
+    return allowed > moved ? allowed - moved : 0;
+}
+
+static CURLcode send_data(struct MockTransport *t, struct MockRequest *req,
+                          uint64_t *budget)
+{
+    while(*budget > 0)
+    {
+        const size_t len = MIN(*budget, sizeof(t->buffer));
+        const size_t n =
+            req->request->read(t->buffer, 1, len, req->request->data);
+
+        if(n == CURL_READFUNC_ABORT)
+            return CURLE_ABORTED_BY_CALLBACK;
+
+        if(n == CURL_READFUNC_PAUSE)
+            break;
+
+        if(n > len)
+            return CURLE_READ_ERROR;
+
+        if(n == 0)
+        {
+            req->is_upload_done = true;
+            break;
+        }
+
+        req->bytes_sent += n;
+        *budget -= n;
+    }
+
+    return CURLE_OK;
+}
+
+static CURLcode receive_data(struct MockTransport *t, struct MockRequest *req,
+                             uint64_t *budget)
+{
+    const uint64_t end = MIN(req->end_position, req->stall_position);
+
+    while(*budget > 0 && req->position < end)
+    {
+        const size_t len =
+            MIN(MIN(*budget, sizeof(t->buffer)), end - req->position);
+
+        for(size_t i = 0; i < len; ++i)
+            t->buffer[i] = (char)transport_mock_get_byte(req->position + i);
+
+        const size_t n =
+            req->request->write(t->buffer, 1, len, req->request->data);
+
+        if(n == CURL_WRITEFUNC_PAUSE)
+            break;
+
+        if(n != len)
+            return CURLE_WRITE_ERROR;
+
+        req->position += n;
+        *budget -= n;
+    }
+
+    return CURLE_OK;
+}
+
+static CURLcode report_progress(const struct MockRequest *req)
+{
+    if(req->request->progress == NULL)
+        return CURLE_OK;
+
+    const curl_off_t dltotal = req->range_end - req->first_position;
+    const int ret =
+        req->request->progress(req->request->data,
+                               dltotal,
+                               req->position - req->first_position,
+                               0, req->bytes_sent);
+
+    return ret == 0 ? CURLE_OK : CURLE_ABORTED_BY_CALLBACK;
+}
+
+static int64_t get_first_byte_time(const struct MockRequest *req)
+{
+    return req->start_time + (int64_t)req->response->delay_ms * 1000;
+}
+
+static void run_request(struct MockTransport *t, struct MockRequest *req,
+                        int64_t now)
+{
+    if(req->response == NULL)
+    {
+        finish_request(t, req, CURLE_COULDNT_RESOLVE_HOST);
+        return;
+    }
+
+    if(now < get_first_byte_time(req))
+        return;
+
+    /* nothing to transfer, like DNS lookups for prewarming */
+    if(req->request == NULL)
+    {
+        finish_request(t, req, CURLE_OK);
+        return;
+    }
+
+    uint64_t budget = get_budget(req, now - get_first_byte_time(req));
+    CURLcode result = CURLE_OK;
+
+    if(req->request->read != NULL && !req->is_upload_done)
+        result = send_data(t, req, &budget);
+
+    if(result == CURLE_OK &&
+       (req->request->read == NULL || req->is_upload_done))
+        result = receive_data(t, req, &budget);
+
+    if(result == CURLE_OK)
+        result = report_progress(req);
+
+    if(result != CURLE_OK)
+        finish_request(t, req, result);
+    else if(req->position >= req->end_position &&
+            req->position < req->stall_position &&
+            (req->request->read == NULL || req->is_upload_done))
+        finish_request(t, req, req->response->result);
+}
+
+/*!
+ * When the request can make progress next, in monotonic time.
+ */
+static int64_t get_due_time(const struct MockRequest *req, int64_t now)
+{
+    if(req->response == NULL)
+        return now;
+
+    /* only progress is reported, about once per second like cURL does */
+    if(req->position >= req->stall_position)
+        return now + G_USEC_PER_SEC;
+
+    if(req->response->bytes_per_second == 0)
+        return now;
+
+    const int64_t first_byte = get_first_byte_time(req);
+
+    if(now < first_byte || req->request == NULL)
+        return first_byte;
+
+    const uint64_t remaining = req->end_position - req->position;
+    const uint64_t next_moved =
+        req->bytes_sent + (req->position - req->first_position) +
+        (remaining > 0 ? MIN(remaining, CURL_MAX_WRITE_SIZE)
+                       : CURL_MAX_WRITE_SIZE);
+
+    return first_byte +
+           (int64_t)(next_moved * G_USEC_PER_SEC /
+                     req->response->bytes_per_second);
+}
+
+static CURLMcode mock_add(struct Transport *transport, CURL *handle,
+                          const struct TransportRequest *request)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+
+    if(find_request(t, handle) != NULL)
+        return CURLM_ADDED_ALREADY;
+
+    struct MockRequest *req = g_try_new0(struct MockRequest, 1);
+
+    if(req == NULL)
+        return CURLM_OUT_OF_MEMORY;
+
+    req->handle = handle;
+    req->start_time = get_time(t);
+    req->stall_position = UINT64_MAX;
+
+    if(request != NULL)
+    {
+        req->url = g_strdup(request->url);
+        req->request = g_new(struct TransportRequest, 1);
+        *req->request = *request;
+        req->request->url = req->url;
+
+        req->response = g_hash_table_lookup(t->script->responses, req->url);
+
+        if(req->response == NULL)
+            req->response =
+                g_hash_table_lookup(t->script->responses, ANY_URL);
+    }
+    else
+        req->response = g_hash_table_lookup(t->script->responses, ANY_URL);
+
+    if(req->response != NULL)
+    {
+        const uint64_t size = req->response->size;
+
+        req->range_end =
+            request != NULL && request->range_end > 0
+            ? MIN((uint64_t)request->range_end, size)
+            : size;
+        req->first_position =
+            request != NULL && request->resume_from > 0
+            ? MIN((uint64_t)request->resume_from, req->range_end)
+            : 0;
+        req->position = req->first_position;
+        req->end_position = req->response->result == CURLE_OK
+            ? req->range_end
+            : MAX(req->first_position,
+                  MIN(req->response->fail_after, req->range_end));
+
+        if(req->first_position == 0 && req->response->stall_after > 0)
+            req->stall_position = req->response->stall_after;
+    }
+
+    g_queue_push_tail(&t->requests, req);
+
+    return CURLM_OK;
+}
+
+static void mock_remove(struct Transport *transport, CURL *handle)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+    struct MockRequest *req = find_request(t, handle);
+
+    if(req == NULL)
+        return;
+
+    g_queue_remove(&t->requests, req);
+    g_queue_remove(&t->finished, req);
+    free_request(req);
+}
+
+static CURLcode mock_pause(struct Transport *transport, CURL *handle,
+                           bool is_paused)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+    struct MockRequest *req = find_request(t, handle);
+
+    if(req == NULL)
+        return CURLE_BAD_FUNCTION_ARGUMENT;
+
+    const int64_t now = get_time(t);
+
+    if(is_paused)
+    {
+        if(req->paused_since == 0)
+            req->paused_since = now;
+    }
+    else if(req->paused_since != 0)
+    {
+        /* the rate applies to the time spent unpaused, so there is no burst
+         * to make up for the pause */
+        req->start_time += now - req->paused_since;
+        req->paused_since = 0;
+    }
+
+    return CURLE_OK;
+}
+
+static void mock_perform(struct Transport *transport)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+    const int64_t now = get_time(t);
+
+    for(GList *it = t->requests.head; it != NULL; it = it->next)
+    {
+        struct MockRequest *req = it->data;
+
+        if(!req->is_finished && req->paused_since == 0)
+            run_request(t, req, now);
+    }
+}
+
+static CURL *mock_next_finished(struct Transport *transport, CURLcode *result)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+    struct MockRequest *req = g_queue_pop_head(&t->finished);
+
+    if(req == NULL)
+        return NULL;
+
+    *result = req->result;
+    return req->handle;
+}
+
+static void mock_wait(struct Transport *transport, int timeout_ms)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+
+    if(!g_queue_is_empty(&t->finished))
+        return;
+
+    /* requests are due on the clock of the transport, but waiting is done
+     * on the system clock */
+    const int64_t offset = get_time_offset(t);
+    const int64_t now = g_get_monotonic_time();
+    int64_t until = now + (int64_t)timeout_ms * 1000;
+
+    for(GList *it = t->requests.head; it != NULL; it = it->next)
+    {
+        const struct MockRequest *req = it->data;
+
+        if(!req->is_finished && req->paused_since == 0)
+            until = MIN(until, get_due_time(req, now + offset) - offset);
+    }
+
+    struct TransportMockScript *script = t->script;
+
+    g_mutex_lock(&script->lock);
+
+    while(!t->is_woken_up && get_time_offset(t) == offset && until > now)
+    {
+        if(!g_cond_wait_until(&script->wakeup_cond, &script->lock, until))
+            break;
+    }
+
+    t->is_woken_up = false;
+    g_mutex_unlock(&script->lock);
+}
+
+static void mock_wakeup(struct Transport *transport)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+
+    g_mutex_lock(&t->script->lock);
+    t->is_woken_up = true;
+    g_cond_broadcast(&t->script->wakeup_cond);
+    g_mutex_unlock(&t->script->lock);
+}
+
+static int64_t mock_get_time(struct Transport *transport)
+{
+    return get_time((const struct MockTransport *)transport);
+}
+
+static void mock_free(struct Transport *transport)
+{
+    struct MockTransport *t = (struct MockTransport *)transport;
+
+    if(!g_queue_is_empty(&t->requests))
+        msg_error(0, LOG_CRIT, "BUG: Freeing mock transport with %u requests",
+                  t->requests.length);
+
+    struct MockRequest *req;
+
+    while((req = g_queue_pop_head(&t->requests)) != NULL)
+        free_request(req);
+
+    g_queue_clear(&t->finished);
+    g_free(t);
+}
+
+static const struct TransportOps mock_ops =
+{
+    .add = mock_add,
+    .remove = mock_remove,
+    .pause = mock_pause,
+    .perform = mock_perform,
+    .next_finished = mock_next_finished,
+    .wait = mock_wait,
+    .wakeup = mock_wakeup,
+    .get_time = mock_get_time,
+    .free = mock_free,
+};
+
+/*!
+ * Create mock transport serving responses from \p script.
+ *
+ * The script is not copied and must outlive the transport. It may be
+ * shared by several transports.
+ */
+struct Transport *transport_mock_new(struct TransportMockScript *script)
+{
+    msg_log_assert(script != NULL);
+
+    struct MockTransport *t = g_try_new0(struct MockTransport, 1);
+
+    if(t == NULL)
+    {
+        msg_out_of_memory("MockTransport");
+        return NULL;
+    }
+
+    t->base.ops = &mock_ops;
+    t->base.has_request_info = false;
+    t->script = script;
+    g_queue_init(&t->requests);
+    g_queue_init(&t->finished);
+
+    return &t->base;
+}
+
+/*!
+ * Create empty script. All requests fail as if the host did not exist.
+ */
+struct TransportMockScript *transport_mock_script_new(void)
+{
+    struct TransportMockScript *script = g_new(struct TransportMockScript, 1);
+
+    script->responses =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    atomic_init(&script->time_offset, 0);
+    g_mutex_init(&script->lock);
+    g_cond_init(&script->wakeup_cond);
+
+    return script;
+}
+
+/*!
+ * Define response to requests for \p url, "*" for any other URL.
+ */
+void transport_mock_script_set(struct TransportMockScript *script,
+                               const char *url,
+                               const struct TransportMockResponse *response)
+{
+    msg_log_assert(script != NULL);
+    msg_log_assert(url != NULL);
+    msg_log_assert(response != NULL);
+
+    struct TransportMockResponse *copy = g_new(struct TransportMockResponse, 1);
+
+    *copy = *response;
+    g_hash_table_replace(script->responses, g_strdup(url), copy);
+}
+
+/*!
+ * Read script from key file.
+ *
+ * Each group is named after a URL, or "*" for any other URL, and may
+ * contain the keys \c size, \c rate (bytes per second), \c delay_ms,
+ * \c result (a \c CURLcode), \c fail_after (bytes), and \c stall_after
+ * (bytes), all defaulting to 0. For example:
+ *
+ * \code
+ * [http://example.com/big]
+ * size=104857600
+ * rate=2000000
+ *
+ * [*]
+ * size=4096
+ * delay_ms=30
+ * result=28
+ * fail_after=1024
+ * \endcode
+ */
+struct TransportMockScript *transport_mock_script_load(const char *path)
+{
+    GKeyFile *kf = g_key_file_new();
+    GError *error = NULL;
+
+    if(!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, &error))
+    {
+        msg_error(0, LOG_ERR, "Failed loading mock transport script \"%s\": %s",
+                  path, error->message);
+        g_error_free(error);
+        g_key_file_free(kf);
+        return NULL;
+    }
+
+    struct TransportMockScript *script = transport_mock_script_new();
+    gsize count;
+    char **groups = g_key_file_get_groups(kf, &count);
+
+    for(gsize i = 0; i < count; ++i)
+    {
+        const char *url = groups[i];
+        const struct TransportMockResponse response =
+        {
+            .size = g_key_file_get_uint64(kf, url, "size", NULL),
+            .bytes_per_second = g_key_file_get_uint64(kf, url, "rate", NULL),
+            .delay_ms = g_key_file_get_integer(kf, url, "delay_ms", NULL),
+            .result = g_key_file_get_integer(kf, url, "result", NULL),
+            .fail_after = g_key_file_get_uint64(kf, url, "fail_after", NULL),
+            .stall_after = g_key_file_get_uint64(kf, url, "stall_after", NULL),
+        };
+
+        transport_mock_script_set(script, url, &response);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(kf);
+
+    msg_info("Mock transport serving %zu URLs from \"%s\"", count, path);
+
+    return script;
+}
+
+/*!
+ * Move the clock of all mock transports serving \p script ahead.
+ *
+ * Lets tests have time pass without waiting for it, may be called from any
+ * thread. Requests catch up with the time skipped as far as their rate
+ * allows, stalled requests report progress again. Transports waiting in
+ * #transport_wait() are woken up.
+ */
+void transport_mock_script_advance_time(struct TransportMockScript *script,
+                                        int64_t us)
+{
+    msg_log_assert(script != NULL);
+    msg_log_assert(us >= 0);
+
+    g_mutex_lock(&script->lock);
+    atomic_fetch_add_explicit(&script->time_offset, us, memory_order_relaxed);
+    g_cond_broadcast(&script->wakeup_cond);
+    g_mutex_unlock(&script->lock);
+}
+
+void transport_mock_script_free(struct TransportMockScript *script)
+{
+    if(script == NULL)
+        return;
+
+    g_hash_table_unref(script->responses);
+    g_mutex_clear(&script->lock);
+    g_cond_clear(&script->wakeup_cond);
+    g_free(script);
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019, 2023  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2023, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -25,32 +25,47 @@
 
 #include <glib.h>
 #include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdatomic.h>
 
 #include "xferitem.h"
+#include "membudget.h"
+#include "storagetier.h"
+#include "asynclog.h"
 #include "messages.h"
 
 static struct
 {
     const char *download_path;
-    char *tempfile_path;
-    uint32_t next_free_id;
+
+    /*! Largest download kept in memory, 0 if downloads are always written
+     *  to file. */
+    size_t content_limit;
+
+    /*! Atomic so that items may be allocated by any thread. */
+    _Atomic uint32_t next_free_id;
 }
 xferitem_data;
 
-static char *construct_path(const char *prefix, uint32_t id)
+static char *construct_path(const char *prefix, uint32_t id,
+                            const char *suffix)
 {
     char buffer[32];
-    g_snprintf(buffer, sizeof(buffer), "%010u.dbusdl", id);
+    g_snprintf(buffer, sizeof(buffer), "%010u.%s", id, suffix);
 
     return g_build_filename(prefix, buffer, NULL);
 }
 
 static uint32_t next_id(void)
 {
-    uint32_t id = xferitem_data.next_free_id++;
+    uint32_t id;
 
-    if(xferitem_data.next_free_id == 0)
-        ++xferitem_data.next_free_id;
+    /* 0 is not a valid ID, skip it on wraparound */
+    do
+        id = atomic_fetch_add_explicit(&xferitem_data.next_free_id, 1,
+                                       memory_order_relaxed);
+    while(id == 0);
 
     return id;
 }
@@ -60,8 +75,8 @@ void xferitem_init(const char *download_path, bool create_path)
     msg_log_assert(download_path != NULL);
 
     xferitem_data.download_path = download_path;
-    xferitem_data.tempfile_path = construct_path(download_path, 0);
-    xferitem_data.next_free_id = 1;
+    xferitem_data.content_limit = 0;
+    atomic_store(&xferitem_data.next_free_id, 1);
 
     if(create_path &&
        g_mkdir_with_parents(xferitem_data.download_path, 0770) < 0)
@@ -73,15 +88,33 @@ void xferitem_init(const char *download_path, bool create_path)
 
 void xferitem_deinit(void)
 {
-    g_free(xferitem_data.tempfile_path);
-    xferitem_data.tempfile_path = NULL;
+    xferitem_data.download_path = NULL;
 }
 
-struct XferItem *xferitem_allocate(const char *url, uint32_t ticks)
+static size_t string_size(const char *str)
+{
+    return str != NULL ? strlen(str) + 1 : 0;
+}
+
+static struct XferItem *charge_item(struct XferItem *item)
+{
+    item->memory_charge = sizeof(*item) +
+                          string_size(item->url) +
+                          string_size(item->srcfile_path) +
+                          string_size(item->destfile_path) +
+                          string_size(item->tempfile_path) +
+                          string_size(item->delta_manifest_path) +
+                          string_size(item->delta_seed_path);
+    membudget_charge(MEMBUDGET_ITEMS, item->memory_charge);
+
+    return item;
+}
+
+static struct XferItem *allocate_item(const char *url, uint32_t ticks)
 {
     msg_log_assert(url != NULL);
 
-    struct XferItem *const item = g_try_malloc(sizeof(*item));
+    struct XferItem *const item = g_try_malloc0(sizeof(*item));
 
     if(item == NULL)
     {
@@ -89,19 +122,427 @@ struct XferItem *xferitem_allocate(const char *url, uint32_t ticks)
         return NULL;
     }
 
+    item->status = xferstatus_new();
+
+    if(item->status == NULL)
+    {
+        g_free(item);
+        return NULL;
+    }
+
     item->item_id = next_id();
     item->total_ticks = ticks;
+    item->priority = XFER_PRIORITY_NORMAL;
+    item->method = XFER_METHOD_GET;
     item->url = g_strdup(url);
-    item->destfile_path =
-        construct_path(xferitem_data.download_path, item->item_id);
+    item->destfile_fd = -1;
+    item->storage_tier = -1;
+
+    return item;
+}
+
+/*!
+ * Allocate #XferItem for downloading to the download directory.
+ *
+ * If storage tiers have been configured, the item is placed on the tier
+ * suitable for files of unknown size. It may be moved to another tier by
+ * #xferitem_place() as long as nothing has been written yet.
+ */
+struct XferItem *xferitem_allocate(const char *url, uint32_t ticks)
+{
+    struct XferItem *const item = allocate_item(url, ticks);
+
+    if(item == NULL)
+        return NULL;
+
+    item->storage_tier = storagetier_select(0, false);
+
+    const char *path = item->storage_tier >= 0
+        ? storagetier_get_path(item->storage_tier)
+        : xferitem_data.download_path;
+
+    item->destfile_path = construct_path(path, item->item_id, "dbusdl");
+    item->tempfile_path = construct_path(path, item->item_id, "part");
+
+    if(item->url == NULL || item->destfile_path == NULL ||
+       item->tempfile_path == NULL)
+    {
+        xferitem_free(item);
+        return NULL;
+    }
+    else
+        return charge_item(item);
+}
+
+/*!
+ * Allocate #XferItem for downloading to a location chosen by the client.
+ *
+ * Either \p destfile_path or \p destfile_fd must be given, but not both. A
+ * file name is used as final location of the downloaded file, with a
+ * temporary file placed next to it. A file descriptor is written to
+ * directly, and ownership of the descriptor is passed to the #XferItem.
+ */
+struct XferItem *xferitem_allocate_to(const char *url, uint32_t ticks,
+                                      const char *destfile_path,
+                                      int destfile_fd)
+{
+    msg_log_assert((destfile_path == NULL) != (destfile_fd < 0));
+
+    struct XferItem *const item = allocate_item(url, ticks);
+
+    if(item == NULL)
+        return NULL;
+
+    item->destfile_fd = destfile_fd;
+
+    if(destfile_path != NULL)
+    {
+        item->destfile_path = g_strdup(destfile_path);
+        item->tempfile_path = g_strdup_printf("%s.%010u.part",
+                                              destfile_path, item->item_id);
+    }
 
-    if(item->url == NULL || item->destfile_path == NULL)
+    if(item->url == NULL ||
+       (destfile_path != NULL &&
+        (item->destfile_path == NULL || item->tempfile_path == NULL)))
     {
         xferitem_free(item);
         return NULL;
     }
     else
-        return item;
+        return charge_item(item);
+}
+
+/*!
+ * Allocate #XferItem for uploading a local file.
+ *
+ * The file is opened only when the upload is started.
+ */
+struct XferItem *xferitem_allocate_upload(const char *url, uint32_t ticks,
+                                          const char *srcfile_path,
+                                          enum XferMethod method)
+{
+    msg_log_assert(srcfile_path != NULL);
+    msg_log_assert(method != XFER_METHOD_GET);
+
+    struct XferItem *const item = allocate_item(url, ticks);
+
+    if(item == NULL)
+        return NULL;
+
+    item->method = method;
+    item->srcfile_path = g_strdup(srcfile_path);
+
+    if(item->url == NULL || item->srcfile_path == NULL)
+    {
+        xferitem_free(item);
+        return NULL;
+    }
+    else
+        return charge_item(item);
+}
+
+/*!
+ * Move item to the storage tier suitable for the given file size.
+ *
+ * This function only changes file names, the caller must take care of any
+ * file created already.
+ *
+ * \param item
+ *     An item allocated by #xferitem_allocate(). Items not placed on a
+ *     storage tier are left alone.
+ *
+ * \param size
+ *     Expected size of the downloaded file, 0 if unknown.
+ *
+ * \returns
+ *     True if the file names have been changed, false if the item stays on
+ *     its tier.
+ */
+bool xferitem_place(struct XferItem *item, uint64_t size)
+{
+    if(item->storage_tier < 0)
+        return false;
+
+    storagetier_release(item->storage_tier, item->storage_reservation);
+    item->storage_reservation = 0;
+
+    const int tier = storagetier_select(size, item->is_short_lived);
+
+    if(tier == item->storage_tier)
+    {
+        item->storage_reservation = size;
+        return false;
+    }
+
+    const char *path = storagetier_get_path(tier);
+    char *destfile_path = construct_path(path, item->item_id, "dbusdl");
+    char *tempfile_path = construct_path(path, item->item_id, "part");
+
+    if(destfile_path == NULL || tempfile_path == NULL)
+    {
+        g_free(destfile_path);
+        g_free(tempfile_path);
+        storagetier_release(tier, size);
+        return false;
+    }
+
+    g_free(item->destfile_path);
+    g_free(item->tempfile_path);
+    item->destfile_path = destfile_path;
+    item->tempfile_path = tempfile_path;
+    item->storage_tier = tier;
+    item->storage_reservation = size;
+
+    membudget_release(MEMBUDGET_ITEMS, item->memory_charge);
+    charge_item(item);
+
+    return true;
+}
+
+/*!
+ * Set largest size of downloads which may be kept in memory.
+ */
+void xferitem_set_content_limit(size_t limit)
+{
+    xferitem_data.content_limit = limit;
+}
+
+/*!
+ * Request keeping downloaded data in memory instead of writing it to file.
+ *
+ * Data exceeding the limit set by #xferitem_set_content_limit() is written
+ * to the temporary file after all, so the item must have been allocated by
+ * #xferitem_allocate().
+ *
+ * \returns
+ *     True if the data will be kept in memory, false if not because the
+ *     limit is 0 or the size expected by the client exceeds it.
+ */
+bool xferitem_keep_in_memory(struct XferItem *item)
+{
+    msg_log_assert(item->tempfile_path != NULL);
+    msg_log_assert(item->destfile_fd < 0);
+
+    if(xferitem_data.content_limit == 0 ||
+       item->expected_size > xferitem_data.content_limit)
+        return false;
+
+    item->max_content_size = xferitem_data.content_limit;
+
+    return true;
+}
+
+/*!
+ * Place temporary file into the download directory.
+ *
+ * This is meant for cases in which the temporary file cannot be created next
+ * to a destination file chosen by the client.
+ *
+ * \returns
+ *     True if the temporary file name has been changed, false if it was in
+ *     the download directory already or if there is no temporary file.
+ */
+bool xferitem_use_fallback_tempfile(struct XferItem *item)
+{
+    if(item->tempfile_path == NULL)
+        return false;
+
+    char *path =
+        construct_path(xferitem_data.download_path, item->item_id, "part");
+
+    if(path == NULL || strcmp(path, item->tempfile_path) == 0)
+    {
+        g_free(path);
+        return false;
+    }
+
+    g_free(item->tempfile_path);
+    item->tempfile_path = path;
+
+    return true;
+}
+
+/*!
+ * Create temporary file of a download for writing.
+ *
+ * In case the temporary file cannot be created next to a destination file
+ * chosen by the client, it is created in the download directory.
+ *
+ * \returns
+ *     The opened file, or \c NULL with \c errno set on error.
+ */
+FILE *xferitem_open_tempfile(struct XferItem *item)
+{
+    FILE *f = fopen(item->tempfile_path, "wb");
+
+    if(f != NULL)
+        return f;
+
+    const int error = errno;
+
+    asynclog_error(error, LOG_ERR, "Failed creating temporary file \"%s\"",
+                   item->tempfile_path);
+
+    if(xferitem_use_fallback_tempfile(item))
+        f = fopen(item->tempfile_path, "wb");
+    else
+        errno = error;
+
+    return f;
+}
+
+/*!
+ * Free data downloaded to memory.
+ */
+void xferitem_drop_content(struct XferItem *item)
+{
+    if(item->content == NULL)
+        return;
+
+    membudget_release(MEMBUDGET_ITEMS, item->content->len);
+    item->memory_charge -= item->content->len;
+    g_byte_array_unref(item->content);
+    item->content = NULL;
+}
+
+/*!
+ * Move data downloaded to memory so far to the temporary file, so that the
+ * download continues to file.
+ *
+ * \returns
+ *     The temporary file, positioned behind the data moved into it. On
+ *     error, \c NULL is returned, no file is left behind, and the data
+ *     stays in memory.
+ */
+FILE *xferitem_spill_content(struct XferItem *item)
+{
+    msg_log_assert(item->content != NULL);
+
+    asynclog_info("Download exceeds %zu bytes, writing to file (ID %u)",
+                  item->max_content_size, item->item_id);
+
+    FILE *f = xferitem_open_tempfile(item);
+
+    if(f == NULL)
+        return NULL;
+
+    const size_t len = item->content->len;
+
+    if(len > 0 && fwrite(item->content->data, 1, len, f) != len)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed writing file \"%s\"",
+                       item->tempfile_path);
+        fclose(f);
+        remove(item->tempfile_path);
+        return NULL;
+    }
+
+    xferitem_drop_content(item);
+
+    return f;
+}
+
+/*!
+ * Append downloaded data to #XferItem::content, or to the output file once
+ * the data does not fit into memory anymore.
+ *
+ * \param item
+ *     The download.
+ *
+ * \param file
+ *     The output file, \c NULL while the data is kept in memory. When the
+ *     data is moved to file by #xferitem_spill_content(), the temporary file
+ *     is returned here.
+ *
+ * \param data, len
+ *     Data to be appended.
+ *
+ * \returns
+ *     Number of bytes written, less than \p len on error.
+ */
+size_t xferitem_write(struct XferItem *item, FILE **file,
+                      const void *data, size_t len)
+{
+    if(item->content != NULL)
+    {
+        if(item->content->len + len <= item->max_content_size)
+        {
+            g_byte_array_append(item->content, data, len);
+            membudget_charge(MEMBUDGET_ITEMS, len);
+            item->memory_charge += len;
+            return len;
+        }
+
+        *file = xferitem_spill_content(item);
+
+        if(*file == NULL)
+            return 0;
+    }
+
+    return fwrite(data, 1, len, *file);
+}
+
+/*!
+ * Download only the parts of the file not found in a local seed file.
+ *
+ * \param item
+ *     A download to file.
+ *
+ * \param manifest_path
+ *     Manifest of the file to be downloaded, see #delta_manifest_parse().
+ *
+ * \param seed_path
+ *     Previous version of the file to be downloaded.
+ */
+void xferitem_set_delta(struct XferItem *item, const char *manifest_path,
+                        const char *seed_path)
+{
+    msg_log_assert(item->method == XFER_METHOD_GET);
+
+    g_free(item->delta_manifest_path);
+    g_free(item->delta_seed_path);
+    item->delta_manifest_path = g_strdup(manifest_path);
+    item->delta_seed_path = g_strdup(seed_path);
+
+    membudget_release(MEMBUDGET_ITEMS, item->memory_charge);
+    charge_item(item);
+}
+
+/*!
+ * Queue item, earliest deadline first.
+ *
+ * Items with a deadline are queued ahead of those without one, which are
+ * queued in order of arrival. Items with equal deadlines are queued in
+ * order of arrival as well.
+ *
+ * \returns
+ *     The link of \p item in \p queue.
+ */
+GList *xferitem_queue_by_deadline(GQueue *queue, struct XferItem *item)
+{
+    GList *sibling = NULL;
+
+    if(item->deadline != 0)
+    {
+        for(sibling = queue->head; sibling != NULL; sibling = sibling->next)
+        {
+            const struct XferItem *other = sibling->data;
+
+            if(other->deadline == 0 || other->deadline > item->deadline)
+                break;
+        }
+    }
+
+    if(sibling == NULL)
+    {
+        g_queue_push_tail(queue, item);
+        return g_queue_peek_tail_link(queue);
+    }
+
+    g_queue_insert_before(queue, sibling, item);
+
+    return sibling->prev;
 }
 
 void xferitem_free(struct XferItem *item)
@@ -110,12 +551,21 @@ void xferitem_free(struct XferItem *item)
         return;
 
     g_free(item->url);
+    g_free(item->srcfile_path);
     g_free(item->destfile_path);
-    g_free(item);
-}
+    g_free(item->tempfile_path);
+    g_free(item->delta_manifest_path);
+    g_free(item->delta_seed_path);
 
-const char *xferitem_get_tempfile_path(void)
-{
-    msg_log_assert(xferitem_data.tempfile_path != NULL);
-    return xferitem_data.tempfile_path;
+    if(item->destfile_fd >= 0)
+        close(item->destfile_fd);
+
+    if(item->content != NULL)
+        g_byte_array_unref(item->content);
+
+    storagetier_release(item->storage_tier, item->storage_reservation);
+
+    xferstatus_unref(item->status);
+    membudget_release(MEMBUDGET_ITEMS, item->memory_charge);
+    g_free(item);
 }
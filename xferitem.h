@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -22,15 +22,120 @@
 #ifndef XFERITEM_H
 #define XFERITEM_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include "xferstatus.h"
+
+/*!
+ * Priority classes of downloads.
+ *
+ * Each class is served by its own transfer thread running with CPU and I/O
+ * priorities according to the class.
+ */
+enum XferPriority
+{
+    /*! Downloads a user is waiting for. */
+    XFER_PRIORITY_INTERACTIVE,
+
+    /*! Default class. */
+    XFER_PRIORITY_NORMAL,
+
+    /*! Downloads which must not interfere with anything else. */
+    XFER_PRIORITY_BACKGROUND,
+
+    XFER_PRIORITY_LAST = XFER_PRIORITY_BACKGROUND,
+};
+
+/*!
+ * What to do with the URL of an #XferItem.
+ */
+enum XferMethod
+{
+    /*! Download from URL. */
+    XFER_METHOD_GET,
+
+    /*! Upload file to URL, replacing the resource (HTTP PUT, FTP STOR). */
+    XFER_METHOD_PUT,
+
+    /*! Upload file as request body of an HTTP POST. */
+    XFER_METHOD_POST,
+};
 
 struct XferItem
 {
     uint32_t item_id;
     uint32_t total_ticks;
+    enum XferPriority priority;
+    enum XferMethod method;
     char *url;
+
+    /*! File to be uploaded, \c NULL for downloads. */
+    char *srcfile_path;
+
+    /*! Where the file is stored, \c NULL if #XferItem::destfile_fd is
+     *  used or for uploads. */
     char *destfile_path;
+
+    /*! Where the file is written to during download, \c NULL if
+     *  #XferItem::destfile_fd is used. */
+    char *tempfile_path;
+
+    /*! File descriptor passed in by the client, -1 if not used. Owned by
+     *  the #XferItem. */
+    int destfile_fd;
+
+    /*! Storage tier #XferItem::destfile_path and #XferItem::tempfile_path
+     *  are placed on, -1 if not placed on a tier. */
+    int storage_tier;
+
+    /*! Space claimed on #XferItem::storage_tier. */
+    uint64_t storage_reservation;
+
+    /*! Hint by the client: the file is removed soon after download. */
+    bool is_short_lived;
+
+    /*! Unpack the downloaded tar archive into directory
+     *  #XferItem::destfile_path while it is received, using
+     *  #XferItem::tempfile_path as temporary directory. */
+    bool extract_archive;
+
+    /*! Replace a non-empty directory at #XferItem::destfile_path by the
+     *  extracted archive. Without this, extraction fails if the directory
+     *  exists and is not empty. */
+    bool replace_existing;
+
+    /*! Size announced by the client, 0 if unknown. */
+    uint64_t expected_size;
+
+    /*! Monotonic time in microseconds by which the transfer must have
+     *  finished, 0 for no deadline. */
+    int64_t deadline;
+
+    /*! Keep downloaded data in memory if it does not exceed this many
+     *  bytes, 0 to write it to file. */
+    size_t max_content_size;
+
+    /*! Data downloaded to memory, \c NULL if downloaded to file. Charged
+     *  to #XferItem::memory_charge. */
+    GByteArray *content;
+
+    /*! Status for clients, shared with the main thread. */
+    struct XferStatus *status;
+
+    /*! Amount of memory charged to the memory budget for this item. */
+    size_t memory_charge;
+
+    /*! Local file listing the blocks of the file to be downloaded, \c NULL
+     *  if the file is downloaded in full. */
+    char *delta_manifest_path;
+
+    /*! Previous version of the file to be downloaded, blocks found in it
+     *  are not downloaded again. */
+    char *delta_seed_path;
 };
 
 #ifdef __cplusplus
@@ -41,8 +146,25 @@ void xferitem_init(const char *download_path, bool create_path);
 void xferitem_deinit(void);
 
 struct XferItem *xferitem_allocate(const char *url, uint32_t ticks);
+struct XferItem *xferitem_allocate_to(const char *url, uint32_t ticks,
+                                      const char *destfile_path,
+                                      int destfile_fd);
+struct XferItem *xferitem_allocate_upload(const char *url, uint32_t ticks,
+                                          const char *srcfile_path,
+                                          enum XferMethod method);
+bool xferitem_place(struct XferItem *item, uint64_t size);
+void xferitem_set_content_limit(size_t limit);
+bool xferitem_keep_in_memory(struct XferItem *item);
+bool xferitem_use_fallback_tempfile(struct XferItem *item);
+FILE *xferitem_open_tempfile(struct XferItem *item);
+void xferitem_drop_content(struct XferItem *item);
+FILE *xferitem_spill_content(struct XferItem *item);
+size_t xferitem_write(struct XferItem *item, FILE **file,
+                      const void *data, size_t len);
+void xferitem_set_delta(struct XferItem *item, const char *manifest_path,
+                        const char *seed_path);
+GList *xferitem_queue_by_deadline(GQueue *queue, struct XferItem *item);
 void xferitem_free(struct XferItem *item);
-const char *xferitem_get_tempfile_path(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdatomic.h>
+#include <glib.h>
+
+#include "xferstatus.h"
+#include "messages.h"
+
+/*
+ * A sequence lock: the writer makes the sequence number odd while updating
+ * the fields, readers retry until they have read all fields between two
+ * loads of the same even sequence number.
+ */
+struct XferStatus
+{
+    atomic_uint refcount;
+    atomic_uint_fast32_t sequence;
+    atomic_uint_fast32_t state;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t total;
+    atomic_uint_fast64_t rate;
+    atomic_uint_fast64_t paused_us;
+};
+
+struct XferStatus *xferstatus_new(void)
+{
+    struct XferStatus *status = g_try_malloc0(sizeof(*status));
+
+    if(status == NULL)
+    {
+        msg_out_of_memory("XferStatus");
+        return NULL;
+    }
+
+    atomic_init(&status->refcount, 1);
+    atomic_init(&status->state, XFER_STATE_QUEUED);
+
+    return status;
+}
+
+struct XferStatus *xferstatus_ref(struct XferStatus *status)
+{
+    if(status != NULL)
+        atomic_fetch_add_explicit(&status->refcount, 1, memory_order_relaxed);
+
+    return status;
+}
+
+void xferstatus_unref(struct XferStatus *status)
+{
+    if(status == NULL)
+        return;
+
+    if(atomic_fetch_sub_explicit(&status->refcount, 1,
+                                 memory_order_acq_rel) == 1)
+        g_free(status);
+}
+
+/*!
+ * Publish new status.
+ *
+ * Only one thread may write to a given \p status object at a time.
+ */
+void xferstatus_publish(struct XferStatus *status,
+                        const struct XferStatusSnapshot *snapshot)
+{
+    const uint_fast32_t seq =
+        atomic_load_explicit(&status->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&status->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&status->state, snapshot->state,
+                          memory_order_relaxed);
+    atomic_store_explicit(&status->bytes, snapshot->bytes,
+                          memory_order_relaxed);
+    atomic_store_explicit(&status->total, snapshot->total,
+                          memory_order_relaxed);
+    atomic_store_explicit(&status->rate, snapshot->rate,
+                          memory_order_relaxed);
+    atomic_store_explicit(&status->paused_us, snapshot->paused_us,
+                          memory_order_relaxed);
+
+    atomic_store_explicit(&status->sequence, seq + 2, memory_order_release);
+}
+
+/*!
+ * Change state, keep the other fields.
+ */
+void xferstatus_set_state(struct XferStatus *status, enum XferState state)
+{
+    struct XferStatusSnapshot snapshot;
+
+    xferstatus_read(status, &snapshot);
+    snapshot.state = state;
+    xferstatus_publish(status, &snapshot);
+}
+
+void xferstatus_read(const struct XferStatus *status,
+                     struct XferStatusSnapshot *snapshot)
+{
+    uint_fast32_t before;
+    uint_fast32_t after;
+
+    do
+    {
+        before = atomic_load_explicit(&status->sequence, memory_order_acquire);
+
+        snapshot->state = atomic_load_explicit(&status->state,
+                                               memory_order_relaxed);
+        snapshot->bytes = atomic_load_explicit(&status->bytes,
+                                               memory_order_relaxed);
+        snapshot->total = atomic_load_explicit(&status->total,
+                                               memory_order_relaxed);
+        snapshot->rate = atomic_load_explicit(&status->rate,
+                                              memory_order_relaxed);
+        snapshot->paused_us = atomic_load_explicit(&status->paused_us,
+                                                   memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&status->sequence, memory_order_relaxed);
+    }
+    while(before != after || (before & 1) != 0);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of D-Bus DL.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef XFERSTATUS_H
+#define XFERSTATUS_H
+
+#include <stdint.h>
+
+/*!
+ * Life cycle of a download as seen by clients.
+ *
+ * The values are sent over D-Bus, new states must be appended.
+ */
+enum XferState
+{
+    XFER_STATE_QUEUED,
+    XFER_STATE_RUNNING,
+    XFER_STATE_DONE,
+    XFER_STATE_PAUSED,
+};
+
+/*!
+ * Consistent copy of the status of a download.
+ */
+struct XferStatusSnapshot
+{
+    enum XferState state;
+
+    /*! Bytes received so far. */
+    uint64_t bytes;
+
+    /*! Expected size in bytes, 0 if unknown. */
+    uint64_t total;
+
+    /*! Average download rate in bytes per second. */
+    uint64_t rate;
+
+    /*! Total time spent paused in microseconds. */
+    uint64_t paused_us;
+};
+
+/*!
+ * Status of a download, written by a single transfer thread, readable by
+ * any thread without locking.
+ */
+struct XferStatus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct XferStatus *xferstatus_new(void);
+struct XferStatus *xferstatus_ref(struct XferStatus *status);
+void xferstatus_unref(struct XferStatus *status);
+void xferstatus_publish(struct XferStatus *status,
+                        const struct XferStatusSnapshot *snapshot);
+void xferstatus_set_state(struct XferStatus *status, enum XferState state);
+void xferstatus_read(const struct XferStatus *status,
+                     struct XferStatusSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !XFERSTATUS_H */
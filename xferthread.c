@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019--2021, 2023  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019--2021, 2023, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -27,17 +27,108 @@
 #include <glib.h>
 #include <curl/curl.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 
 #include "xferthread.h"
+#include "asynclog.h"
+#include "fileops.h"
 #include "events.h"
+#include "stats.h"
+#include "membudget.h"
+#include "hostprofile.h"
+#include "storagetier.h"
+#include "schedclass.h"
+#include "flightrec.h"
+#include "probes.h"
+#include "transport.h"
+#include "delta.h"
+#include "extract.h"
+#include "hedge.h"
 #include "messages.h"
 
+/*!
+ * Upper limit for a single wait for network activity.
+ *
+ * Events sent to the thread wake it up immediately if supported by cURL, so
+ * this value only matters for older versions of cURL.
+ */
+#define MAX_POLL_TIMEOUT_MS 250
+
+/*!
+ * For how long a host is considered warm after it has been contacted.
+ *
+ * This is well below the default maximum age of idle connections and the
+ * DNS cache timeout of cURL.
+ */
+#define WARM_ORIGIN_SECONDS 30U
+
+/*!
+ * How many queued downloads to look at for one whose host has not reached
+ * its concurrency limit.
+ */
+#define HOST_LIMIT_LOOKAHEAD 8U
+
+/*!
+ * Running transfers are not judged by their average rate before this many
+ * microseconds have passed.
+ */
+#define MIN_PREDICTION_TIME_US (2 * G_USEC_PER_SEC)
+
+/*!
+ * Buffer sizes used for each download.
+ *
+ * The reduced sizes are used while memory is tight, trading throughput for
+ * a smaller footprint.
+ */
+#define RECEIVE_BUFFER_SIZE             (64U * 1024U)
+#define RECEIVE_BUFFER_SIZE_REDUCED     (16U * 1024U)
+#define WRITE_BUFFER_SIZE               (64U * 1024U)
+#define WRITE_BUFFER_SIZE_REDUCED       (4U * 1024U)
+
+/*!
+ * Maximum amount of data copied from a local file in one go.
+ *
+ * Copying is interleaved with network transfers of the same priority class,
+ * so this should take well below a second even on slow media.
+ */
+#define LOCAL_COPY_CHUNK_SIZE           (1024U * 1024U)
+
+/*!
+ * Maximum amount of data of a delta download scanned or verified in one go.
+ *
+ * Scanning a seed file takes about a second per 64 MiB on slow devices, so
+ * it is interleaved with network transfers just like local copies.
+ */
+#define DELTA_CHUNK_SIZE                (1024U * 1024U)
+
+/*!
+ * Maximum number of ranges of a delta download requested at the same time.
+ *
+ * Over HTTP/2, the requests are multiplexed over a single connection. Over
+ * HTTP/1.1, each takes a connection of its own, within the limit of
+ * connections per host.
+ */
+#define DELTA_MAX_REQUESTS              4U
+
+/*!
+ * Protocols cURL may use for anything but local files.
+ *
+ * FTP is needed for uploads with STOR.
+ */
+#define NETWORK_PROTOCOLS               "http,https,ftp,ftps"
+
 static void send_progress_report(const struct XferItem *item, uint32_t tick)
 {
     struct EventToUser *ev = events_to_user_new_report_progress(item, tick);
 
     if(ev != NULL)
+    {
+        flightrec_record(FLIGHTREC_PROGRESS_SENT, item->item_id, tick);
         events_to_user_send(ev);
+    }
 }
 
 /*!
@@ -49,6 +140,8 @@ static void send_progress_report(const struct XferItem *item, uint32_t tick)
 static void send_download_done(struct XferItem *item,
                                enum DBusListsErrorCode error_code)
 {
+    xferstatus_set_state(item->status, XFER_STATE_DONE);
+
     struct EventToUser *ev = events_to_user_new_done(item, error_code);
 
     if(ev != NULL)
@@ -61,65 +154,311 @@ static void send_download_done(struct XferItem *item,
     }
 }
 
-static bool download_must_be_canceled(struct EventFromUser *event,
-                                      uint32_t current_item_id)
+G_STATIC_ASSERT(XFER_STALL_WINDOW_MAX_SECONDS <= HEDGE_WINDOW_MAX_SECONDS);
+
+struct Transfer;
+
+/*!
+ * Second request for a stalled download, resuming where the first one got
+ * stuck.
+ */
+struct Hedge
 {
-    if(event == NULL)
-        return false;
+    struct Transfer *xfer;
+    CURL *handle;
 
-    switch(event->event_id)
-    {
-      case EVENT_FROM_USER_START_DOWNLOAD:
-      case EVENT_FROM_USER_SHUTDOWN:
-        break;
+    /*! Position the request was resumed from. */
+    curl_off_t offset;
 
-      case EVENT_FROM_USER_CANCEL:
-        if(event->d.item_id != current_item_id)
-        {
-            events_from_user_free(event);
-            return false;
-        }
+    /*! Position in the output file of the next byte received. */
+    curl_off_t position;
 
-        break;
-    }
+    char error_buffer[CURL_ERROR_SIZE];
+};
 
-    return true;
-}
+/*!
+ * One of the requests of a delta download, asking for one range after
+ * another.
+ */
+struct DeltaRequest
+{
+    struct Transfer *xfer;
+
+    /*! The request, \c NULL if not running. */
+    CURL *handle;
+
+    /*! Index of the range being received. */
+    guint range;
+
+    /*! Position in the output file of the next byte received. */
+    curl_off_t position;
+
+    /*! Amount of memory charged to the memory budget for this request. */
+    size_t memory_charge;
+
+    char error_buffer[CURL_ERROR_SIZE];
+};
 
-struct ProgressCallbackData
+/*!
+ * Download of only those parts of a file which are not found in a local
+ * seed file.
+ */
+struct Delta
+{
+    struct DeltaManifest *manifest;
+
+    /*! Parts of the file still missing, array of #DeltaRange. They are
+     *  requested by up to #DELTA_MAX_REQUESTS requests at the same time.
+     *  \c NULL while the seed is scanned. */
+    GArray *ranges;
+
+    /*! Previous version of the file, -1 once it has been scanned. */
+    int seed_fd;
+
+    /*! Search for blocks in #Delta::seed_fd, \c NULL when done. */
+    struct DeltaScan *scan;
+
+    /*! Check of the assembled file, \c NULL unless all ranges have been
+     *  received. */
+    struct DeltaVerifier *verifier;
+
+    /*! The assembled file matches the manifest. */
+    bool is_verified;
+
+    /*! Index of the next range to be requested. */
+    guint next_range;
+
+    /*! Number of ranges received completely. */
+    guint ranges_done;
+
+    /*! The server has answered a range request with the whole file. */
+    bool is_range_ignored;
+
+    /*! Requests for the ranges in #Delta::ranges. The first one is used
+     *  for the first range, further ones are added while there are enough
+     *  ranges and memory. */
+    struct DeltaRequest requests[DELTA_MAX_REQUESTS];
+};
+
+/*!
+ * State of a download which has been handed over to cURL.
+ */
+struct Transfer
 {
-    const struct XferItem *const current_xfer;
-    struct EventFromUser *next_event;
+    struct XferItem *item;
+    const struct XferConfig *config;
+
+    /*! Copy of #Transport::has_request_info of the transport running the
+     *  requests. Information about the requests is not read from cURL
+     *  unless this is set. */
+    bool has_request_info;
+
+    /*! Origin of the URL, \c NULL if it could not be determined. */
+    char *origin;
+
+    /*! Settings learned for #Transfer::origin. */
+    struct HostProfile profile;
+
+    /*! The request started first, \c NULL if it has failed while the
+     *  hedged request is still running. */
+    CURL *rx;
+
+    /*! Hedged request, \c NULL if none is running. */
+    struct Hedge *hedge;
+
+    /*! Delta download state, \c NULL for regular transfers. */
+    struct Delta *delta;
+
+    /*! Where downloaded data is written to, \c NULL for uploads, for
+     *  archives being extracted, and while downloading to
+     *  #XferItem::content. */
+    FILE *output_file;
+
+    /*! Unpacks the download into a directory, \c NULL if the download is
+     *  not an archive to be extracted. */
+    struct Extractor *extractor;
+
+    /*! File being uploaded, -1 for downloads. */
+    int input_fd;
+
+    /*! Local file being downloaded by copying it in the kernel instead of
+     *  through cURL, -1 for regular transfers. */
+    int source_fd;
+
+    char *write_buffer;
+    size_t write_buffer_size;
+    size_t receive_buffer_size;
     uint32_t previously_sent_tick;
+    char error_buffer[CURL_ERROR_SIZE];
+
+    /*! Number of bytes written to #Transfer::output_file. */
+    curl_off_t bytes_written;
+
+    /*! Position in the output file of the next byte received by
+     *  #Transfer::rx. */
+    curl_off_t rx_position;
+
+    /*! Size of the file to be downloaded, 0 if not known (yet). */
+    curl_off_t expected_size;
+
+    /*! Time spent in writing #Transfer::output_file in microseconds. */
+    uint64_t write_time_us;
+
+    /*! The size announced by the server has been taken into account for
+     *  choosing the storage tier. */
+    bool is_placed;
+
+    /*! Number of bytes received by #Transfer::rx of a download so far. */
+    curl_off_t rx_received;
+
+    /*! Throughput of #Transfer::rx during the last
+     *  #XferConfig::stall_window_seconds seconds. */
+    struct HedgeWindow window;
+
+    /*! Throughput has fallen below #XferConfig::stall_speed_limit. */
+    bool is_stalled;
+
+    /*! A hedged request has been started, there is only one per transfer. */
+    bool was_hedged;
+
+    /*! The transfer is dropped because it cannot meet its deadline. */
+    bool is_late;
+
+    /*! No data is moved, but connections are kept open. */
+    bool is_paused;
+
+    /*!
+     * The transfer has been paused on its own, not only with its class.
+     *
+     * Resuming the class does not resume such transfers.
+     */
+    bool is_paused_individually;
+
+    /*! Monotonic time the transfer was paused at in microseconds. */
+    int64_t paused_since;
+
+    /*! Time spent paused before #Transfer::paused_since in microseconds. */
+    uint64_t paused_us;
 };
 
+static bool is_upload(const struct XferItem *item)
+{
+    return item->method != XFER_METHOD_GET;
+}
+
+static const char *get_transfer_verb(const struct XferItem *item)
+{
+    return is_upload(item) ? "uploading" : "downloading";
+}
+
+static uint64_t get_paused_time_us(const struct Transfer *xfer)
+{
+    if(!xfer->is_paused)
+        return xfer->paused_us;
+
+    return xfer->paused_us +
+           (uint64_t)(g_get_monotonic_time() - xfer->paused_since);
+}
+
+static void publish_status(const struct Transfer *xfer, CURL *handle,
+                           curl_off_t total, curl_off_t now)
+{
+    curl_off_t rate = 0;
+
+    /* there is no cURL handle for local copies */
+    if(handle != NULL && xfer->has_request_info)
+        curl_easy_getinfo(handle,
+                          is_upload(xfer->item)
+                          ? CURLINFO_SPEED_UPLOAD_T
+                          : CURLINFO_SPEED_DOWNLOAD_T,
+                          &rate);
+
+    const struct XferStatusSnapshot snapshot =
+    {
+        .state = xfer->is_paused ? XFER_STATE_PAUSED : XFER_STATE_RUNNING,
+        .bytes = now > 0 ? (uint64_t)now : 0,
+        .total = total > 0 ? (uint64_t)total : 0,
+        .rate = rate > 0 ? (uint64_t)rate : 0,
+        .paused_us = get_paused_time_us(xfer),
+    };
+
+    xferstatus_publish(xfer->item->status, &snapshot);
+}
+
+static guint get_monotonic_seconds(void)
+{
+    return (guint)(g_get_monotonic_time() / G_USEC_PER_SEC);
+}
+
+/*!
+ * Report progress of a transfer to the main thread.
+ *
+ * \param xfer
+ *     The transfer.
+ *
+ * \param handle
+ *     The request which has made progress, used for determining the rate.
+ *
+ * \param total, now
+ *     Expected and current size of the transferred data. For downloads,
+ *     these are the values for the output file, not for the request.
+ */
+static void update_progress(struct Transfer *xfer, CURL *handle,
+                            curl_off_t total, curl_off_t now)
+{
+    const struct XferItem *item = xfer->item;
+
+    flightrec_record(FLIGHTREC_CURL_PROGRESS, item->item_id, (uint64_t)now);
+    DBUSDL_PROBE3(transfer_progress, item->item_id, (uint64_t)now,
+                  (uint64_t)total);
+    publish_status(xfer, handle, total, now);
+
+    uint32_t tick = total > 0
+        ? (uint32_t)(item->total_ticks * ((double)now / (double)total))
+        : 0;
+
+    if((tick > xfer->previously_sent_tick ||
+        xfer->previously_sent_tick == UINT32_MAX) &&
+       tick <= item->total_ticks)
+    {
+        send_progress_report(item, tick);
+        xfer->previously_sent_tick = tick;
+    }
+}
+
 static int progress_callback(void *clientp,
                              curl_off_t dltotal, curl_off_t dlnow,
                              curl_off_t ultotal, curl_off_t ulnow)
 {
-    struct ProgressCallbackData *data = clientp;
-    struct EventFromUser *ev = events_from_user_receive(false);
+    struct Transfer *xfer = clientp;
 
-    if(download_must_be_canceled(ev, data->current_xfer->item_id))
+    if(is_upload(xfer->item))
     {
-        data->next_event = ev;
-        return 1;
+        update_progress(xfer, xfer->rx, ultotal, ulnow);
+        return 0;
     }
 
-    uint32_t tick = dltotal > 0
-        ? (uint32_t)(data->current_xfer->total_ticks * ((double)dlnow / (double)dltotal))
-        : 0;
+    if(dltotal > 0)
+        xfer->expected_size = dltotal;
 
-    if((tick > data->previously_sent_tick ||
-        data->previously_sent_tick == UINT32_MAX) &&
-       tick <= data->current_xfer->total_ticks)
-    {
-        msg_info("Download progress %u/%u (%lu/%lu bytes)",
-                 tick, data->current_xfer->total_ticks,
-                 (unsigned long)dlnow, (unsigned long)dltotal);
-        send_progress_report(data->current_xfer, tick);
-        data->previously_sent_tick = tick;
-    }
+    update_progress(xfer, xfer->rx, xfer->expected_size, xfer->bytes_written);
+    xfer->rx_received = dlnow;
+
+    return 0;
+}
+
+static int hedge_progress_callback(void *clientp,
+                                   curl_off_t dltotal, curl_off_t dlnow,
+                                   curl_off_t ultotal, curl_off_t ulnow)
+{
+    struct Hedge *hedge = clientp;
+    struct Transfer *xfer = hedge->xfer;
+
+    if(dltotal > 0)
+        xfer->expected_size = hedge->offset + dltotal;
+
+    update_progress(xfer, hedge->handle,
+                    xfer->expected_size, xfer->bytes_written);
 
     return 0;
 }
@@ -127,348 +466,3368 @@ static int progress_callback(void *clientp,
 static void remove_file(const char *filename)
 {
     if(remove(filename) < 0)
-        msg_error(errno, LOG_ERR, "Failed deleting file \"%s\"", filename);
+        asynclog_error(errno, LOG_ERR, "Failed deleting file \"%s\"", filename);
 }
 
-static void close_and_remove(FILE *output_file, const char *filename)
+/*!
+ * Append data to #XferItem::content, or to the output file once the data
+ * does not fit into memory anymore.
+ */
+static size_t write_output(struct Transfer *xfer, const char *ptr, size_t len)
 {
-    fclose(output_file);
-    remove_file(filename);
+    if(xfer->extractor != NULL)
+        return extractor_feed(xfer->extractor, (const uint8_t *)ptr,
+                              len) == LIST_ERROR_OK ? len : 0;
+
+    return xferitem_write(xfer->item, &xfer->output_file, ptr, len);
 }
 
-static enum DBusListsErrorCode map_curl_error_to_list_error(CURLcode error)
+/*!
+ * Append data received by a request to the output file.
+ *
+ * While a download is hedged, data received by the request which is behind
+ * is skipped, see #hedge_skip_received().
+ */
+static size_t write_received(struct Transfer *xfer, curl_off_t *position,
+                             const char *ptr, size_t len)
 {
-    switch(error)
+    const ssize_t skipped = hedge_skip_received(xfer->bytes_written,
+                                                position, len);
+
+    if(skipped < 0)
     {
-      case CURLE_OK:
-        return LIST_ERROR_OK;
+        msg_error(0, LOG_CRIT, "BUG: Gap in data received for ID %u",
+                  xfer->item->item_id);
+        return 0;
+    }
 
-      case CURLE_ABORTED_BY_CALLBACK:
-        return LIST_ERROR_INTERRUPTED;
+    if((size_t)skipped == len)
+        return len;
 
-      case CURLE_WRITE_ERROR:
-      case CURLE_READ_ERROR:
-      case CURLE_FILE_COULDNT_READ_FILE:
-      case CURLE_SSL_CACERT_BADFILE:
-      case CURLE_SSL_CRL_BADFILE:
-        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    const size_t skip = (size_t)skipped;
+    const gint64 t = g_get_monotonic_time();
+    const size_t written = write_output(xfer, ptr + skip, len - skip);
 
-      case CURLE_COULDNT_RESOLVE_PROXY:
-      case CURLE_COULDNT_RESOLVE_HOST:
-      case CURLE_COULDNT_CONNECT:
-      case CURLE_FTP_ACCEPT_TIMEOUT:
-      case CURLE_OPERATION_TIMEDOUT:
-      case CURLE_LDAP_CANNOT_BIND:
-      case CURLE_INTERFACE_FAILED:
-      case CURLE_SEND_ERROR:
-      case CURLE_RECV_ERROR:
-      case CURLE_TFTP_NOTFOUND:
-      case CURLE_REMOTE_DISK_FULL:
-      case CURLE_REMOTE_FILE_EXISTS:
-      case CURLE_REMOTE_FILE_NOT_FOUND:
-      case CURLE_SSH:
-#if CURL_AT_LEAST_VERSION(7, 68, 0)
-      case CURLE_HTTP3:
-#endif /* version 7.68.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 69, 0)
-      case CURLE_QUIC_CONNECT_ERROR:
-#endif /* version 7.69.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 73, 0)
-      case CURLE_PROXY:
-#endif /* version 7.73.0 and up */
-        return LIST_ERROR_NET_IO;
+    xfer->write_time_us += g_get_monotonic_time() - t;
+    xfer->bytes_written += (curl_off_t)written;
+    flightrec_record(FLIGHTREC_CURL_WRITE, xfer->item->item_id, written);
+    DBUSDL_PROBE3(transfer_write, xfer->item->item_id, written,
+                  (uint64_t)xfer->bytes_written);
 
-      case CURLE_UNSUPPORTED_PROTOCOL:
-      case CURLE_URL_MALFORMAT:
-      case CURLE_NOT_BUILT_IN:
-#if !CURL_AT_LEAST_VERSION(7, 51, 0)
-      case CURLE_FTP_WEIRD_SERVER_REPLY:
-#endif /* removed 7.51.0 */
-#if CURL_AT_LEAST_VERSION(7, 51, 0)
-      case CURLE_WEIRD_SERVER_REPLY:
-#endif /* version 7.51.0 and up */
-      case CURLE_FTP_ACCEPT_FAILED:
-      case CURLE_FTP_WEIRD_PASS_REPLY:
-      case CURLE_FTP_WEIRD_PASV_REPLY:
-      case CURLE_FTP_WEIRD_227_FORMAT:
-      case CURLE_FTP_COULDNT_SET_TYPE:
-      case CURLE_PARTIAL_FILE:
-      case CURLE_FTP_COULDNT_RETR_FILE:
-      case CURLE_QUOTE_ERROR:
-      case CURLE_HTTP_RETURNED_ERROR:
-      case CURLE_FTP_PORT_FAILED:
-      case CURLE_FTP_COULDNT_USE_REST:
-      case CURLE_RANGE_ERROR:
-      case CURLE_HTTP_POST_ERROR:
-      case CURLE_BAD_DOWNLOAD_RESUME:
-      case CURLE_LDAP_SEARCH_FAILED:
-      case CURLE_TOO_MANY_REDIRECTS:
-      case CURLE_TELNET_OPTION_SYNTAX:
-      case CURLE_GOT_NOTHING:
-      case CURLE_BAD_CONTENT_ENCODING:
-      case CURLE_LDAP_INVALID_URL:
-      case CURLE_FILESIZE_EXCEEDED:
-      case CURLE_SEND_FAIL_REWIND:
-      case CURLE_TFTP_ILLEGAL:
-      case CURLE_TFTP_UNKNOWNID:
-      case CURLE_SSL_SHUTDOWN_FAILED:
-      case CURLE_FTP_PRET_FAILED:
-      case CURLE_RTSP_CSEQ_ERROR:
-      case CURLE_RTSP_SESSION_ERROR:
-      case CURLE_FTP_BAD_FILE_LIST:
-#if CURL_AT_LEAST_VERSION(7, 49, 0)
-      case CURLE_HTTP2_STREAM:
-#endif /* version 7.49.0 and up */
-        return LIST_ERROR_PROTOCOL;
+    return written == len - skip ? len : 0;
+}
+
+/*!
+ * Move still empty temporary file to the storage tier which fits the size
+ * announced by the server.
+ *
+ * Downloads to memory announced too large to fit are written to a
+ * temporary file on a fitting tier right from the start.
+ *
+ * \returns
+ *     False if the file could not be moved or created, true otherwise.
+ */
+static bool place_output_file(struct Transfer *xfer)
+{
+    xfer->is_placed = true;
+
+    struct XferItem *item = xfer->item;
+
+    if(xfer->bytes_written > 0 || xfer->extractor != NULL)
+        return true;
+
+    curl_off_t size = -1;
+
+    if(xfer->rx != NULL && xfer->has_request_info)
+        curl_easy_getinfo(xfer->rx, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    else
+        size = xfer->expected_size;
+
+    if(item->content != NULL)
+    {
+        if(size <= 0 || (uint64_t)size <= item->max_content_size)
+            return true;
+
+        xferitem_place(item, (uint64_t)size);
+        xfer->output_file = xferitem_spill_content(item);
+        return xfer->output_file != NULL;
+    }
+
+    if(item->storage_tier < 0)
+        return true;
+
+    if(size <= 0 || (uint64_t)size == item->storage_reservation)
+        return true;
+
+    char *previous_path = g_strdup(item->tempfile_path);
+
+    if(!xferitem_place(item, (uint64_t)size))
+    {
+        g_free(previous_path);
+        return true;
+    }
+
+    asynclog_info("Placing %" CURL_FORMAT_CURL_OFF_T
+                  " bytes for ID %u in \"%s\"",
+                  size, item->item_id,
+                  storagetier_get_path(item->storage_tier));
+
+    fclose(xfer->output_file);
+    remove_file(previous_path);
+    g_free(previous_path);
+
+    xfer->output_file = fopen(item->tempfile_path, "wb");
+
+    if(xfer->output_file == NULL)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed creating temporary file \"%s\"",
+                       item->tempfile_path);
+        return false;
+    }
+
+    if(xfer->write_buffer != NULL)
+        setvbuf(xfer->output_file, xfer->write_buffer, _IOFBF,
+                xfer->write_buffer_size);
+
+    return true;
+}
+
+static size_t write_callback(char *ptr, size_t size, size_t nmemb,
+                             void *userdata)
+{
+    struct Transfer *xfer = userdata;
+
+    if(!xfer->is_placed && !place_output_file(xfer))
+        return 0;
+
+    return write_received(xfer, &xfer->rx_position, ptr, size * nmemb);
+}
+
+static size_t hedge_write_callback(char *ptr, size_t size, size_t nmemb,
+                                   void *userdata)
+{
+    struct Hedge *hedge = userdata;
+    return write_received(hedge->xfer, &hedge->position, ptr, size * nmemb);
+}
+
+static const struct DeltaRange *get_delta_range(const struct Delta *delta,
+                                                guint index)
+{
+    return &g_array_index(delta->ranges, struct DeltaRange, index);
+}
+
+/*!
+ * Write data received for a range of a delta download to its place in the
+ * output file.
+ *
+ * Servers which ignore the range request answer with status 200 and the
+ * whole file. The request is failed then, and #finish_delta_request()
+ * downloads the file in full.
+ */
+static size_t delta_write_callback(char *ptr, size_t size, size_t nmemb,
+                                   void *userdata)
+{
+    struct DeltaRequest *req = userdata;
+    struct Transfer *xfer = req->xfer;
+    struct Delta *delta = xfer->delta;
+    const struct DeltaRange *range = get_delta_range(delta, req->range);
+    const size_t len = size * nmemb;
+
+    if((uint64_t)req->position == range->offset && xfer->has_request_info)
+    {
+        long response_code = 0;
+
+        curl_easy_getinfo(req->handle, CURLINFO_RESPONSE_CODE, &response_code);
+
+        if(response_code == 200)
+        {
+            delta->is_range_ignored = true;
+            return 0;
+        }
+    }
+
+    if((uint64_t)req->position + len > range->offset + range->length)
+    {
+        asynclog_error(0, LOG_ERR,
+                       "Received data beyond requested range for ID %u",
+                       xfer->item->item_id);
+        return 0;
+    }
+
+    const gint64 t = g_get_monotonic_time();
+    const ssize_t written = pwrite(fileno(xfer->output_file), ptr, len,
+                                   (off_t)req->position);
+
+    xfer->write_time_us += g_get_monotonic_time() - t;
+
+    if(written != (ssize_t)len)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed writing file for ID %u",
+                       xfer->item->item_id);
+        return 0;
+    }
+
+    req->position += (curl_off_t)len;
+    xfer->bytes_written += (curl_off_t)len;
+    flightrec_record(FLIGHTREC_CURL_WRITE, xfer->item->item_id, len);
+    DBUSDL_PROBE3(transfer_write, xfer->item->item_id, len,
+                  (uint64_t)xfer->bytes_written);
+
+    return len;
+}
+
+/*!
+ * Report progress of a delta download.
+ *
+ * The size of the file is taken from the manifest, and progress includes
+ * the data taken from the seed file. There is no stall detection because
+ * delta downloads are never hedged.
+ */
+static int delta_progress_callback(void *clientp,
+                                   curl_off_t dltotal, curl_off_t dlnow,
+                                   curl_off_t ultotal, curl_off_t ulnow)
+{
+    struct DeltaRequest *req = clientp;
+    struct Transfer *xfer = req->xfer;
+    update_progress(xfer, req->handle, xfer->expected_size,
+                    xfer->bytes_written);
+    return 0;
+}
+
+/*!
+ * Fill upload buffer of cURL directly from the file being uploaded.
+ *
+ * There is no intermediate buffer, and the file is never held in memory as
+ * a whole. Reads are as large as cURL's upload buffer.
+ */
+static size_t read_callback(char *buffer, size_t size, size_t nitems,
+                            void *userdata)
+{
+    struct Transfer *xfer = userdata;
+    ssize_t len;
+
+    do
+        len = read(xfer->input_fd, buffer, size * nitems);
+    while(len < 0 && errno == EINTR);
+
+    if(len < 0)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed reading file \"%s\"",
+                       xfer->item->srcfile_path);
+        return CURL_READFUNC_ABORT;
+    }
+
+    flightrec_record(FLIGHTREC_CURL_READ, xfer->item->item_id, (uint64_t)len);
+    DBUSDL_PROBE2(transfer_read, xfer->item->item_id, (uint64_t)len);
+
+    return (size_t)len;
+}
+
+/*!
+ * Ignore response body sent by the server after an upload.
+ */
+static size_t discard_callback(char *ptr, size_t size, size_t nmemb,
+                               void *userdata)
+{
+    return size * nmemb;
+}
+
+static bool is_regular_file(int fd)
+{
+    struct stat buf;
+    return fstat(fd, &buf) == 0 && S_ISREG(buf.st_mode);
+}
+
+/*!
+ * Open file the downloaded data is written to.
+ *
+ * This is either the temporary file of the \p item, or a duplicate of the
+ * file descriptor passed in by the client. In case the temporary file cannot
+ * be created next to a destination file chosen by the client, it is created
+ * in the download directory.
+ */
+static FILE *open_output_file(struct XferItem *item)
+{
+    if(item->destfile_fd < 0)
+        return xferitem_open_tempfile(item);
+
+    if(is_regular_file(item->destfile_fd) &&
+       (ftruncate(item->destfile_fd, 0) < 0 ||
+        lseek(item->destfile_fd, 0, SEEK_SET) < 0))
+        return NULL;
+
+    const int fd = dup(item->destfile_fd);
+
+    if(fd < 0)
+        return NULL;
+
+    FILE *f = fdopen(fd, "wb");
+
+    if(f == NULL)
+    {
+        const int error = errno;
+        close(fd);
+        errno = error;
+    }
+
+    return f;
+}
+
+/*!
+ * Open regular file for reading.
+ *
+ * The file is opened without blocking so that a FIFO or device put in
+ * place of the file after it has been checked by the main thread cannot
+ * stall the transfer thread. Blocking is turned on again once the file is
+ * known to be a regular file.
+ *
+ * \param path
+ *     The file to be opened.
+ *
+ * \param[out] size
+ *     Size of the file, left untouched on error.
+ *
+ * \returns
+ *     File descriptor, or -1 on error with \c errno set to \c EINVAL if
+ *     the file is not a regular file.
+ */
+static int open_regular_file(const char *path, curl_off_t *size)
+{
+    const int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+
+    if(fd < 0)
+        return -1;
+
+    struct stat buf;
+    int error = 0;
+
+    if(fstat(fd, &buf) < 0)
+        error = errno;
+    else if(!S_ISREG(buf.st_mode))
+        error = EINVAL;
+    else if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK) < 0)
+        error = errno;
+
+    if(error != 0)
+    {
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    *size = buf.st_size;
+
+    return fd;
+}
+
+/*!
+ * Open file to be uploaded, tell the kernel it is going to be read
+ * sequentially.
+ *
+ * Only regular files are uploaded.
+ *
+ * \param item
+ *     The item to be uploaded.
+ *
+ * \param[out] size
+ *     Size of the file, left untouched on error.
+ *
+ * \returns
+ *     File descriptor, or -1 on error.
+ */
+static int open_input_file(const struct XferItem *item, curl_off_t *size)
+{
+    const int fd = open_regular_file(item->srcfile_path, size);
+
+    if(fd >= 0)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return fd;
+}
+
+/*!
+ * Path of the file a URL refers to, if it is a local file.
+ *
+ * Only \c file:// URLs without host name or with host name \c localhost
+ * are recognized.
+ *
+ * \returns
+ *     Newly allocated path, or \c NULL if the URL does not refer to a file
+ *     on this machine.
+ */
+static char *get_local_path(const char *url)
+{
+    if(g_ascii_strncasecmp(url, "file://", 7) != 0)
+        return NULL;
+
+    char *hostname = NULL;
+    char *path = g_filename_from_uri(url, &hostname, NULL);
+
+    if(hostname != NULL && g_ascii_strcasecmp(hostname, "localhost") != 0)
+    {
+        g_free(path);
+        path = NULL;
+    }
+
+    g_free(hostname);
+
+    return path;
+}
+
+static bool is_local_url(const char *url)
+{
+    char *path = get_local_path(url);
+    const bool result = path != NULL;
+
+    g_free(path);
+
+    return result;
+}
+
+/*!
+ * Open local file to be downloaded without cURL.
+ *
+ * Only regular files are taken, downloads of anything else fail. The file
+ * is opened without blocking so that FIFOs and devices cannot stall the
+ * transfer thread before they are found not to be regular files.
+ *
+ * \param item
+ *     The item to be downloaded.
+ *
+ * \param[out] size
+ *     Size of the file, left untouched on error.
+ *
+ * \returns
+ *     File descriptor, or -1 if the item cannot be copied locally.
+ */
+static int open_local_source(const struct XferItem *item, curl_off_t *size)
+{
+    char *path = get_local_path(item->url);
+
+    if(path == NULL)
+        return -1;
+
+    const int fd = open_regular_file(path, size);
+
+    g_free(path);
+
+    if(fd < 0)
+        return -1;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return fd;
+}
+
+/*!
+ * Whether or not the local file to be downloaded is a regular file.
+ *
+ * Used for downloads of local files which cannot be copied in the kernel,
+ * but are read by cURL.
+ */
+static bool is_regular_local_source(const struct XferItem *item)
+{
+    curl_off_t size;
+    const int fd = open_local_source(item, &size);
+
+    if(fd < 0)
+        return false;
+
+    close(fd);
+
+    return true;
+}
+
+/*!
+ * Close output file, remove any partially downloaded data.
+ */
+static void discard_output(FILE *output_file, const struct XferItem *item)
+{
+    if(item->destfile_fd < 0)
+    {
+        fclose(output_file);
+        remove_file(item->tempfile_path);
+        return;
+    }
+
+    if(is_regular_file(fileno(output_file)) &&
+       ftruncate(fileno(output_file), 0) < 0)
+        asynclog_error(errno, LOG_ERR,
+                       "Failed truncating file passed for ID %u",
+                       item->item_id);
+
+    fclose(output_file);
+}
+
+/*!
+ * Close output file, move downloaded data to its final location.
+ */
+static enum DBusListsErrorCode publish_output(FILE *output_file,
+                                              const struct XferItem *item)
+{
+    if(fclose(output_file) != 0)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed writing file for ID %u",
+                       item->item_id);
+
+        if(item->destfile_fd < 0)
+            remove_file(item->tempfile_path);
+
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    if(item->destfile_fd >= 0)
+        return LIST_ERROR_OK;
+
+    if(fileops_publish(item->tempfile_path, item->destfile_path) < 0)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed moving \"%s\" to \"%s\"",
+                       item->tempfile_path, item->destfile_path);
+        remove_file(item->tempfile_path);
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    return LIST_ERROR_OK;
+}
+
+/*!
+ * Close files of a failed or canceled #Transfer, drop data downloaded to
+ * memory.
+ */
+static void discard_files(struct Transfer *xfer)
+{
+    xferitem_drop_content(xfer->item);
+
+    if(xfer->output_file != NULL)
+    {
+        discard_output(xfer->output_file, xfer->item);
+        xfer->output_file = NULL;
+    }
+
+    if(xfer->input_fd >= 0)
+    {
+        close(xfer->input_fd);
+        xfer->input_fd = -1;
+    }
+
+    if(xfer->source_fd >= 0)
+    {
+        close(xfer->source_fd);
+        xfer->source_fd = -1;
+    }
+
+    if(xfer->extractor != NULL)
+    {
+        extractor_free(xfer->extractor);
+        xfer->extractor = NULL;
+
+        if(fileops_remove_tree(xfer->item->tempfile_path) < 0)
+            asynclog_error(errno, LOG_ERR, "Failed removing directory \"%s\"",
+                           xfer->item->tempfile_path);
+    }
+}
+
+/*!
+ * Check that the archive has been extracted completely, move the directory
+ * holding its contents to its final location.
+ */
+static enum DBusListsErrorCode publish_extracted(struct Transfer *xfer)
+{
+    const struct XferItem *item = xfer->item;
+    enum DBusListsErrorCode error = extractor_finish(xfer->extractor);
+
+    extractor_free(xfer->extractor);
+    xfer->extractor = NULL;
+
+    if(error == LIST_ERROR_OK &&
+       fileops_publish_directory(item->tempfile_path, item->destfile_path,
+                                 item->replace_existing) < 0)
+    {
+        if(!item->replace_existing && (errno == ENOTEMPTY || errno == EEXIST))
+        {
+            asynclog_error(0, LOG_ERR,
+                           "Not replacing non-empty directory \"%s\"",
+                           item->destfile_path);
+            error = LIST_ERROR_PERMISSION_DENIED;
+        }
+        else
+        {
+            asynclog_error(errno, LOG_ERR, "Failed moving \"%s\" to \"%s\"",
+                           item->tempfile_path, item->destfile_path);
+            error = LIST_ERROR_PHYSICAL_MEDIA_IO;
+        }
+    }
+
+    if(error == LIST_ERROR_OK)
+        stats_inc(STATS_ARCHIVES_EXTRACTED);
+    else if(fileops_remove_tree(item->tempfile_path) < 0)
+        asynclog_error(errno, LOG_ERR, "Failed removing directory \"%s\"",
+                       item->tempfile_path);
+
+    return error;
+}
+
+/*!
+ * Close files of a successful #Transfer, move downloaded data to its final
+ * location.
+ */
+static enum DBusListsErrorCode publish_files(struct Transfer *xfer)
+{
+    enum DBusListsErrorCode error = LIST_ERROR_OK;
+
+    if(xfer->extractor != NULL)
+        error = publish_extracted(xfer);
+
+    if(xfer->output_file != NULL)
+    {
+        const gint64 t = g_get_monotonic_time();
+
+        error = publish_output(xfer->output_file, xfer->item);
+        xfer->output_file = NULL;
+
+        if(error == LIST_ERROR_OK)
+            storagetier_record_write(xfer->item->storage_tier,
+                                     (uint64_t)xfer->bytes_written,
+                                     xfer->write_time_us +
+                                     (g_get_monotonic_time() - t));
+    }
+
+    if(xfer->input_fd >= 0)
+    {
+        close(xfer->input_fd);
+        xfer->input_fd = -1;
+    }
+
+    if(xfer->source_fd >= 0)
+    {
+        close(xfer->source_fd);
+        xfer->source_fd = -1;
+    }
+
+    return error;
+}
+
+static enum DBusListsErrorCode map_curl_error_to_list_error(CURLcode error)
+{
+    switch(error)
+    {
+      case CURLE_OK:
+        return LIST_ERROR_OK;
+
+      case CURLE_ABORTED_BY_CALLBACK:
+        return LIST_ERROR_INTERRUPTED;
+
+      case CURLE_WRITE_ERROR:
+      case CURLE_READ_ERROR:
+      case CURLE_FILE_COULDNT_READ_FILE:
+      case CURLE_SSL_CACERT_BADFILE:
+      case CURLE_SSL_CRL_BADFILE:
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+
+      case CURLE_COULDNT_RESOLVE_PROXY:
+      case CURLE_COULDNT_RESOLVE_HOST:
+      case CURLE_COULDNT_CONNECT:
+      case CURLE_FTP_ACCEPT_TIMEOUT:
+      case CURLE_OPERATION_TIMEDOUT:
+      case CURLE_LDAP_CANNOT_BIND:
+      case CURLE_INTERFACE_FAILED:
+      case CURLE_SEND_ERROR:
+      case CURLE_RECV_ERROR:
+      case CURLE_TFTP_NOTFOUND:
+      case CURLE_REMOTE_DISK_FULL:
+      case CURLE_REMOTE_FILE_EXISTS:
+      case CURLE_REMOTE_FILE_NOT_FOUND:
+      case CURLE_SSH:
+#if CURL_AT_LEAST_VERSION(7, 68, 0)
+      case CURLE_HTTP3:
+#endif /* version 7.68.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 69, 0)
+      case CURLE_QUIC_CONNECT_ERROR:
+#endif /* version 7.69.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 73, 0)
+      case CURLE_PROXY:
+#endif /* version 7.73.0 and up */
+        return LIST_ERROR_NET_IO;
+
+      case CURLE_UNSUPPORTED_PROTOCOL:
+      case CURLE_URL_MALFORMAT:
+      case CURLE_NOT_BUILT_IN:
+#if !CURL_AT_LEAST_VERSION(7, 51, 0)
+      case CURLE_FTP_WEIRD_SERVER_REPLY:
+#endif /* removed 7.51.0 */
+#if CURL_AT_LEAST_VERSION(7, 51, 0)
+      case CURLE_WEIRD_SERVER_REPLY:
+#endif /* version 7.51.0 and up */
+      case CURLE_FTP_ACCEPT_FAILED:
+      case CURLE_FTP_WEIRD_PASS_REPLY:
+      case CURLE_FTP_WEIRD_PASV_REPLY:
+      case CURLE_FTP_WEIRD_227_FORMAT:
+      case CURLE_FTP_COULDNT_SET_TYPE:
+      case CURLE_PARTIAL_FILE:
+      case CURLE_FTP_COULDNT_RETR_FILE:
+      case CURLE_QUOTE_ERROR:
+      case CURLE_HTTP_RETURNED_ERROR:
+      case CURLE_FTP_PORT_FAILED:
+      case CURLE_FTP_COULDNT_USE_REST:
+      case CURLE_RANGE_ERROR:
+      case CURLE_HTTP_POST_ERROR:
+      case CURLE_BAD_DOWNLOAD_RESUME:
+      case CURLE_LDAP_SEARCH_FAILED:
+      case CURLE_TOO_MANY_REDIRECTS:
+      case CURLE_TELNET_OPTION_SYNTAX:
+      case CURLE_GOT_NOTHING:
+      case CURLE_BAD_CONTENT_ENCODING:
+      case CURLE_LDAP_INVALID_URL:
+      case CURLE_FILESIZE_EXCEEDED:
+      case CURLE_SEND_FAIL_REWIND:
+      case CURLE_TFTP_ILLEGAL:
+      case CURLE_TFTP_UNKNOWNID:
+      case CURLE_SSL_SHUTDOWN_FAILED:
+      case CURLE_FTP_PRET_FAILED:
+      case CURLE_RTSP_CSEQ_ERROR:
+      case CURLE_RTSP_SESSION_ERROR:
+      case CURLE_FTP_BAD_FILE_LIST:
+#if CURL_AT_LEAST_VERSION(7, 49, 0)
+      case CURLE_HTTP2_STREAM:
+#endif /* version 7.49.0 and up */
+        return LIST_ERROR_PROTOCOL;
+
+      case CURLE_REMOTE_ACCESS_DENIED:
+      case CURLE_UPLOAD_FAILED:
+      case CURLE_SSL_CONNECT_ERROR:
+      case CURLE_PEER_FAILED_VERIFICATION:
+      case CURLE_SSL_CERTPROBLEM:
+      case CURLE_SSL_CIPHER:
+#if !CURL_AT_LEAST_VERSION(7, 62, 0)
+      case CURLE_SSL_CACERT:
+#endif /* removed in version 7.62.0 */
+      case CURLE_USE_SSL_FAILED:
+      case CURLE_LOGIN_DENIED:
+      case CURLE_TFTP_PERM:
+      case CURLE_TFTP_NOSUCHUSER:
+      case CURLE_SSL_ISSUER_ERROR:
+#if CURL_AT_LEAST_VERSION(7, 39, 0)
+      case CURLE_SSL_PINNEDPUBKEYNOTMATCH:
+#endif /* version 7.39.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 41, 0)
+      case CURLE_SSL_INVALIDCERTSTATUS:
+#endif /* version 7.41.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 66, 0)
+      case CURLE_AUTH_ERROR:
+#endif /* version 7.66.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 77, 0)
+      case CURLE_SSL_CLIENTCERT:
+#endif /* version 7.77.0 and up */
+        return LIST_ERROR_AUTHENTICATION;
+
+      case CURLE_FAILED_INIT:
+      case CURLE_FTP_CANT_GET_HOST:
+      case CURLE_OUT_OF_MEMORY:
+      case CURLE_FUNCTION_NOT_FOUND:
+      case CURLE_BAD_FUNCTION_ARGUMENT:
+      case CURLE_UNKNOWN_OPTION:
+      case CURLE_SSL_ENGINE_NOTFOUND:
+      case CURLE_SSL_ENGINE_SETFAILED:
+      case CURLE_SSL_ENGINE_INITFAILED:
+      case CURLE_CONV_FAILED:
+      case CURLE_CONV_REQD:
+      case CURLE_AGAIN:
+      case CURLE_CHUNK_FAILED:
+      case CURLE_NO_CONNECTION_AVAILABLE:
+      case CURLE_OBSOLETE16:
+      case CURLE_OBSOLETE20:
+      case CURLE_OBSOLETE24:
+      case CURLE_OBSOLETE29:
+      case CURLE_OBSOLETE32:
+      case CURLE_OBSOLETE40:
+      case CURLE_OBSOLETE44:
+      case CURLE_OBSOLETE46:
+      case CURLE_OBSOLETE50:
+#if CURL_AT_LEAST_VERSION(7, 62, 0)
+      case CURLE_OBSOLETE51:
+#endif /* version 7.62.0 and up */
+      case CURLE_OBSOLETE57:
+#if CURL_AT_LEAST_VERSION(7, 59, 0)
+      case CURLE_RECURSIVE_API_CALL:
+#endif /* version 7.59.0 and up */
+#if CURL_AT_LEAST_VERSION(7, 84, 0)
+      case CURLE_UNRECOVERABLE_POLL:
+#endif /* version 7.84.0 and up */
+      case CURL_LAST:
+        break;
+    }
+
+    return LIST_ERROR_INTERNAL;
+}
+
+/*!
+ * Transfer thread serving a single priority class.
+ */
+struct Engine
+{
+    enum XferPriority priority;
+    GThread *thread;
+
+    struct Transport *transport;
+    struct XferConfig config;
+
+    /*! Downloads not started yet, earliest deadline first, then in order
+     *  of request. */
+    GQueue pending;
+
+    /*! Map of item ID to link in #Engine::pending. */
+    GHashTable *pending_by_id;
+
+    /*! Downloads handed over to cURL, map of CURL easy handle to
+     *  #Transfer. Hedged requests map to the same #Transfer as the request
+     *  they are hedging. */
+    GHashTable *active;
+
+    /*! Map of item ID to #Transfer in #Engine::active,
+     *  #Engine::local_copies, and #Engine::delta_jobs. */
+    GHashTable *active_by_id;
+
+    /*! Number of transfers in #Engine::active_by_id which have a
+     *  deadline. */
+    unsigned int deadline_count;
+
+    /*! Downloads of local files, copied without cURL, #Transfer objects in
+     *  order of start. */
+    GQueue local_copies;
+
+    /*! Delta downloads scanning their seed file or verifying the assembled
+     *  file, #Transfer objects in order of start. */
+    GQueue delta_jobs;
+
+    /*! Handles for preparing queued downloads, map of CURL easy handle to
+     *  item ID. */
+    GHashTable *warming;
+
+    /*! Recently contacted origins, map of "scheme://host:port" string to
+     *  expiry time in seconds. */
+    GHashTable *warm_origins;
+
+    /*! Number of active transfers per origin, map of "scheme://host:port"
+     *  string to count. */
+    GHashTable *origin_counts;
+
+    /*! Queued downloads are held back until this monotonic time in
+     *  microseconds to be started as a batch, 0 if not collecting. */
+    int64_t batch_release_time;
+
+    /*! Queued downloads are held back because of the memory budget. */
+    bool is_deferring;
+
+    /*! The whole class has been paused, queued downloads are not started. */
+    bool is_paused;
+
+    bool shutdown_requested;
+};
+
+static struct
+{
+    struct Engine engines[XFER_PRIORITY_LAST + 1];
+}
+xferthread_data;
+
+/*!
+ * Extract "scheme://host:port" part from URL.
+ *
+ * \returns
+ *     The origin as newly allocated string, or \c NULL in case the URL could
+ *     not be parsed.
+ */
+static char *get_origin(const char *url)
+{
+#if CURL_AT_LEAST_VERSION(7, 62, 0)
+    CURLU *u = curl_url();
+
+    if(u == NULL)
+        return NULL;
+
+    char *scheme = NULL;
+    char *host = NULL;
+    char *port = NULL;
+    char *result = NULL;
+
+    if(curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+       curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+       curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+       curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK)
+        result = g_strdup_printf("%s://%s:%s", scheme, host, port);
+
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(u);
+
+    return result;
+#else /* older than 7.62.0 */
+    return NULL;
+#endif /* version 7.62.0 and up */
+}
+
+static void forget_expired_origins(struct Engine *engine, guint now)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, engine->warm_origins);
+
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+        if(GPOINTER_TO_UINT(value) <= now)
+            g_hash_table_iter_remove(&iter);
+}
+
+/*!
+ * Check whether given origin has been contacted recently.
+ *
+ * \returns
+ *     True if the origin is warm, false if it is cold or if the URL could not
+ *     be parsed.
+ */
+static bool is_origin_warm(struct Engine *engine, const char *url)
+{
+    char *origin = get_origin(url);
+
+    if(origin == NULL)
+        return false;
+
+    const guint expiry =
+        GPOINTER_TO_UINT(g_hash_table_lookup(engine->warm_origins,
+                                             origin));
+
+    g_free(origin);
+
+    return expiry > get_monotonic_seconds();
+}
+
+/*!
+ * Remember that given origin has been contacted just now.
+ */
+static void mark_origin_warm(struct Engine *engine, const char *url)
+{
+    char *origin = get_origin(url);
+
+    if(origin == NULL)
+        return;
+
+    const guint now = get_monotonic_seconds();
+
+    if(g_hash_table_size(engine->warm_origins) >= 64)
+        forget_expired_origins(engine, now);
+
+    g_hash_table_replace(engine->warm_origins, origin,
+                         GUINT_TO_POINTER(now + WARM_ORIGIN_SECONDS));
+}
+
+/*!
+ * Receive buffer size for a transfer started now.
+ *
+ * \param profile
+ *     Settings learned for the host, \c NULL if not known.
+ */
+static size_t get_receive_buffer_size(const struct HostProfile *profile)
+{
+    if(membudget_is_under_pressure())
+        return RECEIVE_BUFFER_SIZE_REDUCED;
+
+    return profile != NULL && profile->receive_buffer_size > 0
+        ? profile->receive_buffer_size
+        : RECEIVE_BUFFER_SIZE;
+}
+
+static size_t get_write_buffer_size(void)
+{
+    return membudget_is_under_pressure()
+        ? WRITE_BUFFER_SIZE_REDUCED
+        : WRITE_BUFFER_SIZE;
+}
+
+/*!
+ * Amount of memory charged to the budget for a transfer started now.
+ *
+ * \param profile
+ *     Settings learned for the host, \c NULL if not known.
+ */
+static size_t get_transfer_cost(const struct HostProfile *profile)
+{
+    return sizeof(struct Transfer) +
+           get_receive_buffer_size(profile) + get_write_buffer_size();
+}
+
+/*!
+ * Choose buffer sizes for the #Transfer, charge them to the memory budget.
+ *
+ * Must be called right after opening the output file. For uploads, the
+ * write buffer is cURL's upload buffer, owned by cURL, and sized like the
+ * receive buffer because cURL does not accept upload buffers as small as
+ * our reduced write buffer. Downloads to memory and archives being
+ * extracted need no write buffer.
+ */
+static void allocate_buffers(struct Transfer *xfer)
+{
+    xfer->receive_buffer_size = get_receive_buffer_size(&xfer->profile);
+
+    if(xfer->item->content != NULL || xfer->extractor != NULL)
+    {
+        xfer->write_buffer_size = 0;
+        membudget_charge(MEMBUDGET_RECEIVE_BUFFERS,
+                         sizeof(*xfer) + xfer->receive_buffer_size);
+        return;
+    }
+
+    if(xfer->output_file == NULL)
+    {
+        xfer->write_buffer_size = xfer->receive_buffer_size;
+        membudget_charge(MEMBUDGET_RECEIVE_BUFFERS,
+                         sizeof(*xfer) + xfer->receive_buffer_size);
+        membudget_charge(MEMBUDGET_WRITE_BUFFERS, xfer->write_buffer_size);
+        return;
+    }
+
+    xfer->write_buffer_size = get_write_buffer_size();
+    xfer->write_buffer = g_try_malloc(xfer->write_buffer_size);
+
+    if(xfer->write_buffer == NULL ||
+       setvbuf(xfer->output_file, xfer->write_buffer, _IOFBF,
+               xfer->write_buffer_size) != 0)
+    {
+        /* stdio picks a buffer on its own, not accounted for */
+        g_free(xfer->write_buffer);
+        xfer->write_buffer = NULL;
+        xfer->write_buffer_size = 0;
+    }
+
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS,
+                     sizeof(*xfer) + xfer->receive_buffer_size);
+    membudget_charge(MEMBUDGET_WRITE_BUFFERS, xfer->write_buffer_size);
+}
+
+static void free_delta(struct Delta *delta)
+{
+    if(delta == NULL)
+        return;
+
+    if(delta->seed_fd >= 0)
+        close(delta->seed_fd);
+
+    delta_scan_free(delta->scan);
+    delta_verifier_free(delta->verifier);
+    delta_manifest_free(delta->manifest);
+
+    if(delta->ranges != NULL)
+        g_array_free(delta->ranges, TRUE);
+
+    g_free(delta);
+}
+
+/*!
+ * Free #Transfer and its buffers.
+ *
+ * The output file must have been closed already.
+ */
+static void free_transfer(struct Transfer *xfer)
+{
+    free_delta(xfer->delta);
+    membudget_release(MEMBUDGET_RECEIVE_BUFFERS,
+                      sizeof(*xfer) + xfer->receive_buffer_size);
+    membudget_release(MEMBUDGET_WRITE_BUFFERS, xfer->write_buffer_size);
+    g_free(xfer->write_buffer);
+    g_free(xfer->origin);
+    g_free(xfer);
+}
+
+/*!
+ * Restrict cURL to the protocols expected for a request.
+ *
+ * Local files are only read for downloads of \c file:// URLs, which have
+ * been checked against the allowed directories when they were queued.
+ * Anything else goes to the network, also when following redirects.
+ */
+static void set_protocols(CURL *handle, const char *url, bool is_sending)
+{
+    const bool is_local = !is_sending && is_local_url(url);
+
+#if CURL_AT_LEAST_VERSION(7, 85, 0)
+    curl_easy_setopt(handle, CURLOPT_PROTOCOLS_STR,
+                     is_local ? "file" : NETWORK_PROTOCOLS);
+    curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS_STR, NETWORK_PROTOCOLS);
+#else /* version below 7.85.0 */
+    const long network = CURLPROTO_HTTP | CURLPROTO_HTTPS |
+                         CURLPROTO_FTP | CURLPROTO_FTPS;
+
+    curl_easy_setopt(handle, CURLOPT_PROTOCOLS,
+                     is_local ? (long)CURLPROTO_FILE : network);
+    curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS, network);
+#endif /* version 7.85.0 and up */
+}
+
+/*!
+ * Options shared by all requests made for a #Transfer.
+ */
+static void set_common_options(CURL *handle, struct Transfer *xfer,
+                               char *error_buffer)
+{
+    curl_easy_setopt(handle, CURLOPT_URL, xfer->item->url);
+    set_protocols(handle, xfer->item->url, is_upload(xfer->item));
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, xfer);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS,
+                     (long)xfer->profile.connect_timeout_ms);
+    curl_easy_setopt(handle, CURLOPT_ACCEPTTIMEOUT_MS, 45000L);
+    curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, error_buffer);
+    curl_easy_setopt(handle, CURLOPT_BUFFERSIZE,
+                     (long)xfer->receive_buffer_size);
+}
+
+/*!
+ * Ask for HTTP/2 unless the host is known to speak HTTP/1.x only.
+ *
+ * \param handle
+ *     The request.
+ *
+ * \param profile
+ *     Settings learned for the host.
+ *
+ * \param may_wait
+ *     Rather wait for an existing connection to the same host to become
+ *     available for multiplexing than opening a new one.
+ */
+static void set_http_version(CURL *handle, const struct HostProfile *profile,
+                             bool may_wait)
+{
+    if(profile->http_version == HOSTPROFILE_HTTP_1)
+    {
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION,
+                         (long)CURL_HTTP_VERSION_1_1);
+        return;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+
+    if(may_wait)
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+}
+
+static unsigned int get_origin_count(struct Engine *engine, const char *origin)
+{
+    return GPOINTER_TO_UINT(g_hash_table_lookup(engine->origin_counts, origin));
+}
+
+static void count_origin(struct Engine *engine, const char *origin, int delta)
+{
+    if(origin == NULL)
+        return;
+
+    const unsigned int count = get_origin_count(engine, origin) + delta;
+
+    if(count > 0)
+        g_hash_table_replace(engine->origin_counts, g_strdup(origin),
+                             GUINT_TO_POINTER(count));
+    else
+        g_hash_table_remove(engine->origin_counts, origin);
+}
+
+/*!
+ * Book-keeping for a #Transfer which has just been started.
+ */
+static void mark_transfer_started(struct Engine *engine, struct Transfer *xfer)
+{
+    struct XferItem *item = xfer->item;
+
+    g_hash_table_insert(engine->active_by_id,
+                        GUINT_TO_POINTER(item->item_id), xfer);
+
+    if(item->deadline != 0)
+        ++engine->deadline_count;
+
+    count_origin(engine, xfer->origin, 1);
+    mark_origin_warm(engine, item->url);
+    xferstatus_set_state(item->status, XFER_STATE_RUNNING);
+    stats_inc(STATS_TRANSFERS_STARTED);
+    flightrec_record(FLIGHTREC_TRANSFER_START, item->item_id, 0);
+    DBUSDL_PROBE3(transfer_start, item->item_id, engine->priority,
+                  item->method);
+}
+
+/*!
+ * Download a local file by copying it in the kernel, bypassing cURL.
+ *
+ * The copy is made in chunks by #copy_local_transfers(), and reported
+ * just like a download.
+ */
+static enum DBusListsErrorCode start_local_copy(struct Engine *engine,
+                                                struct Transfer *xfer)
+{
+    struct XferItem *item = xfer->item;
+
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, sizeof(*xfer));
+
+    if(!place_output_file(xfer))
+    {
+        discard_files(xfer);
+        free_transfer(xfer);
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    xfer->previously_sent_tick = UINT32_MAX;
+    g_strlcpy(xfer->error_buffer, "[details unknown]",
+              sizeof(xfer->error_buffer));
+
+    g_queue_push_tail(&engine->local_copies, xfer);
+    mark_transfer_started(engine, xfer);
+    stats_inc(STATS_LOCAL_COPIES);
+
+    asynclog_info("Copying local file of %" CURL_FORMAT_CURL_OFF_T " bytes "
+                  "for ID %u", xfer->expected_size, item->item_id);
+
+    return LIST_ERROR_OK;
+}
+
+/*!
+ * Prepare for filling the output file with the blocks found in the seed
+ * file of a delta download.
+ *
+ * If the manifest or the seed file cannot be used, the file is downloaded
+ * in full.
+ *
+ * \returns
+ *     #LIST_ERROR_OK if the transfer can go on, either with the scan set up
+ *     in #Transfer::delta or as a regular download.
+ */
+static enum DBusListsErrorCode prepare_delta(struct Transfer *xfer)
+{
+    struct XferItem *item = xfer->item;
+    struct DeltaManifest *manifest =
+        delta_manifest_load(item->delta_manifest_path);
+
+    if(manifest == NULL)
+    {
+        asynclog_info("Cannot use delta manifest \"%s\", downloading "
+                      "ID %u in full", item->delta_manifest_path,
+                      item->item_id);
+        return LIST_ERROR_OK;
+    }
+
+    curl_off_t seed_size;
+    const int seed_fd = open_regular_file(item->delta_seed_path, &seed_size);
+
+    if(seed_fd < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed opening seed file \"%s\", downloading "
+                       "ID %u in full", item->delta_seed_path, item->item_id);
+        delta_manifest_free(manifest);
+        return LIST_ERROR_OK;
+    }
+
+    xfer->expected_size = (curl_off_t)delta_manifest_get_length(manifest);
+
+    if(!place_output_file(xfer))
+    {
+        close(seed_fd);
+        delta_manifest_free(manifest);
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    xfer->delta = g_try_new0(struct Delta, 1);
+
+    if(xfer->delta == NULL)
+    {
+        msg_out_of_memory("Delta");
+        close(seed_fd);
+        delta_manifest_free(manifest);
+        return LIST_ERROR_INTERNAL;
+    }
+
+    xfer->delta->manifest = manifest;
+    xfer->delta->seed_fd = seed_fd;
+    xfer->delta->scan =
+        delta_scan_new(manifest, seed_fd, fileno(xfer->output_file));
+
+    if(xfer->delta->scan == NULL)
+    {
+        asynclog_info("Cannot scan seed file \"%s\", downloading ID %u "
+                      "in full", item->delta_seed_path, item->item_id);
+        free_delta(xfer->delta);
+        xfer->delta = NULL;
+        xfer->expected_size = 0;
+    }
+
+    return LIST_ERROR_OK;
+}
+
+static void finish_transfer(struct Engine *engine, struct Transfer *xfer,
+                            CURLcode rx_result, bool was_canceled);
+
+/*!
+ * Claim space for a file unpacked from an archive.
+ *
+ * Items placed on a storage tier claim the space on the tier. For other
+ * items, the file system must have enough free space left.
+ */
+static bool claim_extracted_space(uint64_t size, void *user_data)
+{
+    struct XferItem *item = user_data;
+
+    if(item->storage_tier < 0)
+    {
+        struct statvfs buf;
+
+        return statvfs(item->tempfile_path, &buf) == 0 &&
+               (uint64_t)buf.f_bavail * buf.f_frsize >= size;
+    }
+
+    if(!storagetier_claim(item->storage_tier, size))
+        return false;
+
+    item->storage_reservation += size;
+
+    return true;
+}
+
+/*!
+ * Create temporary directory for extracting an archive into.
+ */
+static struct Extractor *open_extractor(struct XferItem *item,
+                                        const struct XferConfig *config)
+{
+    /* left over by an earlier, interrupted run */
+    if(fileops_remove_tree(item->tempfile_path) < 0 && errno != ENOENT)
+        asynclog_error(errno, LOG_ERR, "Failed removing directory \"%s\"",
+                       item->tempfile_path);
+
+    struct Extractor *extractor = extractor_new(item->tempfile_path);
+
+    if(extractor != NULL)
+    {
+        extractor_set_limits(extractor,
+                             (uint64_t)config->max_extracted_mib << 20,
+                             config->max_extracted_entries);
+        extractor_set_space_claim(extractor, claim_extracted_space, item);
+    }
+
+    return extractor;
+}
+
+/*!
+ * Create the cURL request of a #Transfer and hand it over to the transport.
+ *
+ * \param engine
+ *     The engine running the transfer.
+ *
+ * \param xfer
+ *     The transfer, with its files opened already.
+ *
+ * \param input_size
+ *     Size of the file to be uploaded, -1 if unknown or not an upload.
+ *
+ * \returns
+ *     #LIST_ERROR_OK on success. On failure, the #Transfer is left without
+ *     request, and the caller must clean it up.
+ */
+static enum DBusListsErrorCode start_request(struct Engine *engine,
+                                             struct Transfer *xfer,
+                                             curl_off_t input_size)
+{
+    const struct XferItem *item = xfer->item;
+
+    xfer->rx = curl_easy_init();
+
+    if(xfer->rx == NULL)
+    {
+        asynclog_error(ENOENT, LOG_ERR, "Failed initializing cURL object");
+        return LIST_ERROR_INTERNAL;
+    }
+
+    xfer->previously_sent_tick = UINT32_MAX;
+    g_strlcpy(xfer->error_buffer, "[details unknown]",
+              sizeof(xfer->error_buffer));
+
+    CURL *const rx = xfer->rx;
+
+    set_common_options(rx, xfer, xfer->error_buffer);
+
+    struct TransportRequest request =
+    {
+        .url = item->url,
+        .write = write_callback,
+        .progress = progress_callback,
+        .data = xfer,
+    };
+
+    if(is_upload(item))
+    {
+        request.write = discard_callback;
+        request.read = read_callback;
+#if CURL_AT_LEAST_VERSION(7, 62, 0)
+        curl_easy_setopt(rx, CURLOPT_UPLOAD_BUFFERSIZE,
+                         (long)xfer->write_buffer_size);
+#endif /* version 7.62.0 and up */
+
+        /* files of unknown size are sent chunked */
+        if(item->method == XFER_METHOD_POST)
+        {
+            curl_easy_setopt(rx, CURLOPT_POST, 1L);
+            curl_easy_setopt(rx, CURLOPT_POSTFIELDSIZE_LARGE, input_size);
+        }
+        else
+        {
+            curl_easy_setopt(rx, CURLOPT_UPLOAD, 1L);
+            curl_easy_setopt(rx, CURLOPT_INFILESIZE_LARGE, input_size);
+        }
+    }
+
+    set_http_version(rx, &xfer->profile, true);
+
+    const CURLMcode mc = transport_add(engine->transport, rx, &request);
+
+    if(mc != CURLM_OK)
+    {
+        asynclog_error(0, LOG_ERR, "Failed adding transfer ID %u: %s",
+                       item->item_id, curl_multi_strerror(mc));
+        curl_easy_cleanup(rx);
+        xfer->rx = NULL;
+        return LIST_ERROR_INTERNAL;
+    }
+
+    g_hash_table_insert(engine->active, rx, xfer);
+
+    return LIST_ERROR_OK;
+}
+
+/*!
+ * Scan the seed file of a delta download in chunks before downloading
+ * anything.
+ *
+ * The scan is done by #process_delta_jobs(), which starts the download of
+ * the missing ranges afterwards.
+ */
+static enum DBusListsErrorCode start_delta_scan(struct Engine *engine,
+                                                struct Transfer *xfer)
+{
+    xfer->previously_sent_tick = UINT32_MAX;
+    g_strlcpy(xfer->error_buffer, "[details unknown]",
+              sizeof(xfer->error_buffer));
+
+    g_queue_push_tail(&engine->delta_jobs, xfer);
+    mark_transfer_started(engine, xfer);
+
+    asynclog_info("Scanning seed file \"%s\" for ID %u",
+                  xfer->item->delta_seed_path, xfer->item->item_id);
+
+    return LIST_ERROR_OK;
+}
+
+/*!
+ * Set up a #Transfer for given item and hand it over to the transport.
+ *
+ * The #Transfer takes ownership of the \p item on success. On failure, the
+ * item remains owned by the caller and an error code is returned.
+ */
+static enum DBusListsErrorCode start_transfer(struct Engine *engine,
+                                              struct XferItem *item)
+{
+    asynclog_info("Start %s URL \"%s\", ID %u",
+                  get_transfer_verb(item), item->url, item->item_id);
+
+    struct Transfer *xfer = g_try_malloc0(sizeof(*xfer));
+
+    if(xfer == NULL)
+    {
+        msg_out_of_memory("Transfer");
+        return LIST_ERROR_INTERNAL;
+    }
+
+    curl_off_t input_size = -1;
+
+    xfer->item = item;
+    xfer->config = &engine->config;
+    xfer->has_request_info = engine->transport->has_request_info;
+    hedge_window_init(&xfer->window, engine->config.stall_window_seconds,
+                      engine->config.stall_speed_limit);
+    xfer->origin = get_origin(item->url);
+    xfer->input_fd = -1;
+    xfer->source_fd = -1;
+    hostprofile_get(xfer->origin, &xfer->profile);
+
+    if(is_upload(item))
+        xfer->input_fd = open_input_file(item, &input_size);
+    else if(item->extract_archive)
+        xfer->extractor = open_extractor(item, &engine->config);
+    else if(item->max_content_size > 0)
+        item->content = g_byte_array_new();
+    else
+        xfer->output_file = open_output_file(item);
+
+    if(xfer->output_file == NULL && xfer->input_fd < 0 &&
+       item->content == NULL && xfer->extractor == NULL)
+    {
+        asynclog_error(errno, LOG_ERR, "Failed opening %s file for ID %u",
+                       is_upload(item) ? "input" : "output", item->item_id);
+        g_free(xfer->origin);
+        g_free(xfer);
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    if(xfer->output_file != NULL)
+        xfer->source_fd = open_local_source(item, &xfer->expected_size);
+
+    if(xfer->source_fd >= 0)
+        return start_local_copy(engine, xfer);
+
+    allocate_buffers(xfer);
+
+    if(!is_upload(item) && is_local_url(item->url) &&
+       (xfer->output_file != NULL || !is_regular_local_source(item)))
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Cannot read \"%s\", must be a regular file (ID %u)",
+                       item->url, item->item_id);
+        discard_files(xfer);
+        free_transfer(xfer);
+        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+    }
+
+    if(xfer->output_file != NULL && item->delta_manifest_path != NULL)
+    {
+        const enum DBusListsErrorCode error = prepare_delta(xfer);
+
+        if(error != LIST_ERROR_OK)
+        {
+            discard_files(xfer);
+            free_transfer(xfer);
+            return error;
+        }
+
+        if(xfer->delta != NULL)
+            return start_delta_scan(engine, xfer);
+    }
+
+    const enum DBusListsErrorCode error =
+        start_request(engine, xfer, input_size);
+
+    if(error != LIST_ERROR_OK)
+    {
+        discard_files(xfer);
+        free_transfer(xfer);
+        return error;
+    }
+
+    mark_transfer_started(engine, xfer);
+
+    return LIST_ERROR_OK;
+}
+
+static void collect_connection_statistics(CURL *rx)
+{
+    long num_connects = 0;
+    long http_version = CURL_HTTP_VERSION_NONE;
+    curl_off_t bytes = 0;
+
+    if(curl_easy_getinfo(rx, CURLINFO_NUM_CONNECTS, &num_connects) != CURLE_OK)
+        return;
+
+    curl_easy_getinfo(rx, CURLINFO_HTTP_VERSION, &http_version);
+
+    if(curl_easy_getinfo(rx, CURLINFO_SIZE_DOWNLOAD_T, &bytes) == CURLE_OK &&
+       bytes > 0)
+        stats_add(STATS_BYTES_RECEIVED, (uint64_t)bytes);
+
+    if(curl_easy_getinfo(rx, CURLINFO_SIZE_UPLOAD_T, &bytes) == CURLE_OK &&
+       bytes > 0)
+        stats_add(STATS_BYTES_SENT, (uint64_t)bytes);
+
+    if(num_connects > 0)
+        stats_add(STATS_CONNECTIONS_OPENED, (uint64_t)num_connects);
+    else if(http_version == CURL_HTTP_VERSION_2_0)
+        stats_inc(STATS_STREAMS_MULTIPLEXED);
+    else
+        stats_inc(STATS_CONNECTIONS_REUSED);
+}
+
+/*!
+ * Remove a request of a #Transfer from the transport and free it.
+ */
+static void release_request(struct Engine *engine, CURL *handle)
+{
+    g_hash_table_remove(engine->active, handle);
+    transport_remove(engine->transport, handle);
+
+    if(engine->transport->has_request_info)
+        collect_connection_statistics(handle);
+
+    curl_easy_cleanup(handle);
+}
+
+static void drop_hedge(struct Engine *engine, struct Transfer *xfer)
+{
+    release_request(engine, xfer->hedge->handle);
+    membudget_release(MEMBUDGET_RECEIVE_BUFFERS,
+                      sizeof(*xfer->hedge) + xfer->receive_buffer_size);
+    g_free(xfer->hedge);
+    xfer->hedge = NULL;
+}
+
+/*!
+ * Hand request for the next missing range of a delta download over to the
+ * transport.
+ */
+static CURLMcode add_delta_request(struct Engine *engine,
+                                   struct DeltaRequest *req)
+{
+    struct Delta *delta = req->xfer->delta;
+
+    req->range = delta->next_range++;
+
+    const struct DeltaRange *range = get_delta_range(delta, req->range);
+    const struct TransportRequest request =
+    {
+        .url = req->xfer->item->url,
+        .resume_from = (curl_off_t)range->offset,
+        .range_end = (curl_off_t)(range->offset + range->length),
+        .write = delta_write_callback,
+        .progress = delta_progress_callback,
+        .data = req,
+    };
+
+    req->position = (curl_off_t)range->offset;
+
+    return transport_add(engine->transport, req->handle, &request);
+}
+
+static void release_delta_request(struct Engine *engine,
+                                  struct DeltaRequest *req)
+{
+    release_request(engine, req->handle);
+    req->handle = NULL;
+    membudget_release(MEMBUDGET_RECEIVE_BUFFERS, req->memory_charge);
+    req->memory_charge = 0;
+}
+
+static void drop_delta_requests(struct Engine *engine, struct Transfer *xfer)
+{
+    if(xfer->delta == NULL)
+        return;
+
+    for(size_t i = 0; i < G_N_ELEMENTS(xfer->delta->requests); ++i)
+        if(xfer->delta->requests[i].handle != NULL)
+            release_delta_request(engine, &xfer->delta->requests[i]);
+}
+
+static struct DeltaRequest *find_delta_request(struct Delta *delta,
+                                               CURL *handle)
+{
+    for(size_t i = 0; i < G_N_ELEMENTS(delta->requests); ++i)
+        if(delta->requests[i].handle == handle)
+            return &delta->requests[i];
+
+    return NULL;
+}
+
+/*!
+ * Request the missing ranges of a delta download.
+ *
+ * Up to #DELTA_MAX_REQUESTS ranges are requested at the same time so that
+ * many small ranges do not cost one round trip each. The first request is
+ * covered by the memory charged for the #Transfer, further requests are
+ * only made if the memory budget has room for their receive buffers.
+ *
+ * \returns
+ *     True if at least one request has been handed over to the transport.
+ */
+static bool start_delta_requests(struct Engine *engine, struct Transfer *xfer)
+{
+    struct Delta *delta = xfer->delta;
+    const guint count = MIN(DELTA_MAX_REQUESTS, delta->ranges->len);
+
+    xfer->previously_sent_tick = UINT32_MAX;
+    g_strlcpy(xfer->error_buffer, "[details unknown]",
+              sizeof(xfer->error_buffer));
+
+    for(guint i = 0; i < count; ++i)
+    {
+        struct DeltaRequest *req = &delta->requests[i];
+        const size_t cost = i > 0 ? xfer->receive_buffer_size : 0;
+
+        if(cost > 0 && !membudget_fits(cost))
+            break;
+
+        req->handle = curl_easy_init();
+
+        if(req->handle == NULL)
+        {
+            asynclog_error(ENOENT, LOG_ERR, "Failed initializing cURL object");
+            break;
+        }
+
+        req->xfer = xfer;
+        g_strlcpy(req->error_buffer, "[details unknown]",
+                  sizeof(req->error_buffer));
+
+        set_common_options(req->handle, xfer, req->error_buffer);
+        set_http_version(req->handle, &xfer->profile, true);
+
+        const CURLMcode mc = add_delta_request(engine, req);
+
+        if(mc != CURLM_OK)
+        {
+            asynclog_error(0, LOG_ERR, "Failed adding transfer ID %u: %s",
+                           xfer->item->item_id, curl_multi_strerror(mc));
+            --delta->next_range;
+            curl_easy_cleanup(req->handle);
+            req->handle = NULL;
+            break;
+        }
+
+        g_hash_table_insert(engine->active, req->handle, xfer);
+        req->memory_charge = cost;
+        membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, cost);
+    }
+
+    return delta->requests[0].handle != NULL;
+}
+
+/*!
+ * Give up on a delta download and prepare for downloading the file in
+ * full.
+ *
+ * \returns
+ *     False if the output file could not be emptied.
+ */
+static bool drop_delta(struct Engine *engine, struct Transfer *xfer)
+{
+    drop_delta_requests(engine, xfer);
+    free_delta(xfer->delta);
+    xfer->delta = NULL;
+    xfer->expected_size = 0;
+    xfer->bytes_written = 0;
+    xfer->rx_position = 0;
+
+    if(ftruncate(fileno(xfer->output_file), 0) < 0)
+    {
+        asynclog_error(errno, LOG_ERR,
+                       "Failed truncating file for ID %u", xfer->item->item_id);
+        return false;
+    }
+
+    rewind(xfer->output_file);
+
+    return true;
+}
+
+/*!
+ * Start a second request for a stalled download.
+ *
+ * The new request asks for the data not written to the output file yet,
+ * over a fresh connection. Servers which do not support ranges make the
+ * hedged request fail, and the download continues with the first request.
+ */
+static void start_hedge(struct Engine *engine, struct Transfer *xfer)
+{
+    const struct XferItem *item = xfer->item;
+    const size_t cost = sizeof(struct Hedge) + xfer->receive_buffer_size;
+
+    /* try again later */
+    if(!membudget_fits(cost))
+        return;
+
+    xfer->is_stalled = false;
+    xfer->was_hedged = true;
+
+    struct Hedge *hedge = g_try_malloc0(sizeof(*hedge));
+
+    if(hedge == NULL)
+    {
+        msg_out_of_memory("Hedge");
+        return;
+    }
+
+    hedge->handle = curl_easy_init();
+
+    if(hedge->handle == NULL)
+    {
+        asynclog_error(ENOENT, LOG_ERR, "Failed initializing cURL object");
+        g_free(hedge);
+        return;
+    }
+
+    hedge->xfer = xfer;
+    hedge->offset = xfer->bytes_written;
+    hedge->position = hedge->offset;
+    g_strlcpy(hedge->error_buffer, "[details unknown]",
+              sizeof(hedge->error_buffer));
+
+    CURL *const handle = hedge->handle;
+
+    set_common_options(handle, xfer, hedge->error_buffer);
+
+    /* must not end up on the stalled connection */
+    set_http_version(handle, &xfer->profile, false);
+    curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT, 1L);
+
+    const struct TransportRequest request =
+    {
+        .url = item->url,
+        .resume_from = hedge->offset,
+        .write = hedge_write_callback,
+        .progress = hedge_progress_callback,
+        .data = hedge,
+    };
+
+    const CURLMcode mc = transport_add(engine->transport, handle, &request);
+
+    if(mc != CURLM_OK)
+    {
+        asynclog_error(0, LOG_ERR, "Failed adding hedged request for ID %u: %s",
+                       item->item_id, curl_multi_strerror(mc));
+        curl_easy_cleanup(handle);
+        g_free(hedge);
+        return;
+    }
+
+    xfer->hedge = hedge;
+    g_hash_table_insert(engine->active, handle, xfer);
+    membudget_charge(MEMBUDGET_RECEIVE_BUFFERS, cost);
+    stats_inc(STATS_HEDGES_STARTED);
+    flightrec_record(FLIGHTREC_HEDGE_START, item->item_id,
+                     (uint64_t)hedge->offset);
+    DBUSDL_PROBE2(hedge_start, item->item_id, (uint64_t)hedge->offset);
+
+    asynclog_info("Download ID %u stalled, hedging from offset %" CURL_FORMAT_CURL_OFF_T,
+                  item->item_id, hedge->offset);
+}
+
+static unsigned int get_http_major(CURL *handle)
+{
+    long http_version = CURL_HTTP_VERSION_NONE;
+
+    curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &http_version);
+
+    switch(http_version)
+    {
+      case CURL_HTTP_VERSION_1_0:
+      case CURL_HTTP_VERSION_1_1:
+        return 1;
+
+      case CURL_HTTP_VERSION_2_0:
+        return 2;
+
+      default:
+        return 0;
+    }
+}
+
+/*!
+ * Feed what has been observed during a transfer into the profile of its
+ * host.
+ */
+static void learn_host_profile(const struct Transfer *xfer, CURL *handle,
+                               CURLcode result)
+{
+    if(xfer->origin == NULL)
+        return;
+
+    long response_code = 0;
+    long num_connects = 0;
+    curl_off_t connect_time = 0;
+    curl_off_t bytes = 0;
+    curl_off_t rate = 0;
+    unsigned int http_major = 0;
+
+    /* otherwise, only the result is known */
+    if(xfer->has_request_info)
+    {
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+        curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects);
+#if CURL_AT_LEAST_VERSION(7, 61, 0)
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect_time);
+#endif /* version 7.61.0 and up */
+        curl_easy_getinfo(handle,
+                          is_upload(xfer->item)
+                          ? CURLINFO_SIZE_UPLOAD_T
+                          : CURLINFO_SIZE_DOWNLOAD_T,
+                          &bytes);
+        curl_easy_getinfo(handle,
+                          is_upload(xfer->item)
+                          ? CURLINFO_SPEED_UPLOAD_T
+                          : CURLINFO_SPEED_DOWNLOAD_T,
+                          &rate);
+        http_major = get_http_major(handle);
+    }
+
+    const struct HostObservation observation =
+    {
+        .succeeded = result == CURLE_OK,
+        .connect_failed = result == CURLE_COULDNT_CONNECT ||
+                          (result == CURLE_OPERATION_TIMEDOUT &&
+                           connect_time == 0),
+        .throttled = response_code == 429 || response_code == 503,
+        .http2_failed = result == CURLE_HTTP2 || result == CURLE_HTTP2_STREAM,
+        .http_major = http_major,
+        .connect_time_us =
+            num_connects > 0 && connect_time > 0 ? (uint64_t)connect_time : 0,
+        .bytes = bytes > 0 ? (uint64_t)bytes : 0,
+        .bytes_per_second = rate > 0 ? (uint64_t)rate : 0,
+    };
+
+    hostprofile_learn(xfer->origin, &observation);
+}
+
+/*!
+ * Whether or not the #Transfer is waiting for #process_delta_jobs().
+ */
+static bool is_delta_job(const struct Transfer *xfer)
+{
+    return xfer->delta != NULL &&
+           (xfer->delta->scan != NULL || xfer->delta->verifier != NULL);
+}
+
+/*!
+ * Whether or not the file assembled by a delta download has been found to
+ * match its manifest.
+ *
+ * \returns
+ *     True if the file matches, or if the #Transfer is not a delta
+ *     download.
+ */
+static bool verify_delta(const struct Transfer *xfer)
+{
+    if(xfer->delta == NULL || xfer->delta->is_verified)
+        return true;
+
+    asynclog_error(0, LOG_ERR,
+                   "Delta download of \"%s\" does not match its manifest",
+                   xfer->item->url);
+
+    return false;
+}
+
+/*!
+ * Remove #Transfer from transport, clean up, notify main thread.
+ *
+ * The downloaded file is moved to its final location on success, otherwise
+ * the temporary file is removed.
+ */
+static void finish_transfer(struct Engine *engine, struct Transfer *xfer,
+                            CURLcode rx_result, bool was_canceled)
+{
+    struct XferItem *item = xfer->item;
+    enum DBusListsErrorCode error = was_canceled
+        ? (xfer->is_late ? LIST_ERROR_BUSY : LIST_ERROR_INTERRUPTED)
+        : map_curl_error_to_list_error(rx_result);
+
+    /* more specific than the write error reported by cURL */
+    if(!was_canceled && xfer->extractor != NULL &&
+       extractor_get_error(xfer->extractor) != LIST_ERROR_OK)
+        error = extractor_get_error(xfer->extractor);
+
+    if(g_hash_table_remove(engine->active_by_id,
+                           GUINT_TO_POINTER(item->item_id)) &&
+       item->deadline != 0)
+        --engine->deadline_count;
+
+    count_origin(engine, xfer->origin, -1);
+
+    if(xfer->is_paused)
+        stats_add(STATS_PAUSED_MS,
+                  (uint64_t)(g_get_monotonic_time() - xfer->paused_since) /
+                  1000);
+
+    if(xfer->source_fd >= 0)
+        g_queue_remove(&engine->local_copies, xfer);
+    else if(is_delta_job(xfer))
+        g_queue_remove(&engine->delta_jobs, xfer);
+    else if(!was_canceled && (xfer->rx != NULL || xfer->hedge != NULL))
+        learn_host_profile(xfer,
+                           xfer->rx != NULL ? xfer->rx : xfer->hedge->handle,
+                           rx_result);
+
+    if(xfer->rx != NULL)
+    {
+        release_request(engine, xfer->rx);
+        xfer->rx = NULL;
+    }
+
+    if(xfer->hedge != NULL)
+        drop_hedge(engine, xfer);
+
+    drop_delta_requests(engine, xfer);
+
+    if(error == LIST_ERROR_OK && !verify_delta(xfer))
+    {
+        error = LIST_ERROR_INCONSISTENT;
+        discard_files(xfer);
+    }
+    else if(error == LIST_ERROR_OK)
+    {
+        error = publish_files(xfer);
+
+        if(error == LIST_ERROR_OK)
+        {
+            /* in case 100% completion has not been sent from the progress
+             * callback for any reason, do it now for the sake of UX */
+            if(xfer->previously_sent_tick != item->total_ticks)
+                send_progress_report(item, item->total_ticks);
+
+            if(is_upload(item))
+                asynclog_info("Finished uploading \"%s\" to \"%s\"",
+                              item->srcfile_path, item->url);
+            else if(item->content != NULL)
+                asynclog_info("Finished downloading \"%s\" to memory, %u bytes",
+                              item->url, item->content->len);
+            else
+                asynclog_info("Finished downloading \"%s\" to \"%s\"", item->url,
+                              item->destfile_path != NULL
+                              ? item->destfile_path
+                              : "file descriptor");
+        }
+    }
+    else
+    {
+        if(xfer->is_late)
+            asynclog_info("Transfer dropped, deadline cannot be met (ID %u)",
+                          item->item_id);
+        else if(was_canceled)
+            asynclog_info("Transfer canceled as requested (ID %u)",
+                          item->item_id);
+        else
+            asynclog_error(0, LOG_ERR, "Failed %s URL \"%s\": %s (%s)",
+                           get_transfer_verb(item), item->url,
+                           xfer->error_buffer, curl_easy_strerror(rx_result));
+
+        discard_files(xfer);
+    }
+
+    if(xfer->is_late)
+        stats_inc(STATS_DEADLINES_MISSED);
+    else if(was_canceled)
+        stats_inc(STATS_TRANSFERS_CANCELED);
+    else if(error == LIST_ERROR_OK)
+        stats_inc(STATS_TRANSFERS_SUCCEEDED);
+    else
+        stats_inc(STATS_TRANSFERS_FAILED);
+
+    flightrec_record(FLIGHTREC_TRANSFER_DONE, item->item_id, error);
+    DBUSDL_PROBE3(transfer_done, item->item_id, error,
+                  (uint64_t)xfer->bytes_written);
+    send_download_done(item, error);
+    free_transfer(xfer);
+}
+
+/*!
+ * Check assembled file of a delta download against its manifest in chunks.
+ *
+ * The check is done by #process_delta_jobs(), which finishes the
+ * #Transfer afterwards.
+ */
+static void start_delta_verification(struct Engine *engine,
+                                     struct Transfer *xfer)
+{
+    struct Delta *delta = xfer->delta;
+
+    delta->verifier =
+        delta_verifier_new(delta->manifest, fileno(xfer->output_file));
+
+    if(delta->verifier == NULL)
+    {
+        finish_transfer(engine, xfer, CURLE_OUT_OF_MEMORY, false);
+        return;
+    }
+
+    if(!xfer->is_paused)
+        g_queue_push_tail(&engine->delta_jobs, xfer);
+}
+
+/*!
+ * Continue delta download after one of its requests has ended.
+ *
+ * A request which has received its range completely is handed over to the
+ * transport again for the next missing range, keeping its connection.
+ * After the last range, the file is verified. If the server has ignored
+ * the range request, the file is downloaded in full instead.
+ */
+static void finish_delta_request(struct Engine *engine, struct Transfer *xfer,
+                                 CURL *handle, CURLcode result)
+{
+    struct Delta *delta = xfer->delta;
+    struct DeltaRequest *req = find_delta_request(delta, handle);
+
+    if(req == NULL)
+    {
+        msg_error(0, LOG_CRIT, "BUG: Unknown request for delta ID %u",
+                  xfer->item->item_id);
+        finish_transfer(engine, xfer, CURLE_FAILED_INIT, false);
+        return;
+    }
+
+    if(result == CURLE_OK)
+    {
+        const struct DeltaRange *range = get_delta_range(delta, req->range);
+
+        if((uint64_t)req->position != range->offset + range->length)
+            result = CURLE_PARTIAL_FILE;
+    }
+
+    if(result != CURLE_OK && delta->is_range_ignored)
+    {
+        asynclog_info("Server ignores ranges, downloading ID %u in full",
+                      xfer->item->item_id);
+        learn_host_profile(xfer, handle, CURLE_OK);
+
+        if(!drop_delta(engine, xfer))
+            finish_transfer(engine, xfer, CURLE_WRITE_ERROR, false);
+        else if(start_request(engine, xfer, -1) != LIST_ERROR_OK)
+            finish_transfer(engine, xfer, CURLE_FAILED_INIT, false);
+
+        return;
+    }
+
+    if(result != CURLE_OK)
+    {
+        g_strlcpy(xfer->error_buffer, req->error_buffer,
+                  sizeof(xfer->error_buffer));
+        learn_host_profile(xfer, handle, result);
+        finish_transfer(engine, xfer, result, false);
+        return;
+    }
+
+    ++delta->ranges_done;
+
+    if(delta->next_range < delta->ranges->len)
+    {
+        transport_remove(engine->transport, handle);
+
+        const CURLMcode mc = add_delta_request(engine, req);
+
+        if(mc != CURLM_OK)
+        {
+            asynclog_error(0, LOG_ERR, "Failed adding transfer ID %u: %s",
+                           xfer->item->item_id, curl_multi_strerror(mc));
+            finish_transfer(engine, xfer, CURLE_FAILED_INIT, false);
+        }
+
+        return;
+    }
+
+    if(delta->ranges_done < delta->ranges->len)
+    {
+        /* other requests are still receiving their ranges */
+        release_delta_request(engine, req);
+        return;
+    }
+
+    learn_host_profile(xfer, handle, CURLE_OK);
+    release_delta_request(engine, req);
+    start_delta_verification(engine, xfer);
+}
+
+/*!
+ * Handle end of one of the requests of a #Transfer.
+ *
+ * The first request to complete successfully wins, and the transfer is
+ * finished with it. A failed request does not fail the transfer as long as
+ * the other one is still running.
+ */
+static void finish_request(struct Engine *engine, struct Transfer *xfer,
+                           CURL *handle, CURLcode result)
+{
+    if(xfer->delta != NULL)
+    {
+        finish_delta_request(engine, xfer, handle, result);
+        return;
+    }
+
+    if(xfer->hedge == NULL)
+    {
+        finish_transfer(engine, xfer, result, false);
+        return;
+    }
+
+    const bool is_hedge = handle == xfer->hedge->handle;
+    const uint32_t item_id = xfer->item->item_id;
+
+    if(result == CURLE_OK)
+    {
+        stats_inc(is_hedge ? STATS_HEDGES_WON : STATS_HEDGES_LOST);
+        finish_transfer(engine, xfer, result, false);
+    }
+    else if(!is_hedge)
+    {
+        asynclog_info("Stalled request for ID %u failed, "
+                      "continuing with hedged request: %s",
+                      item_id, xfer->error_buffer);
+        release_request(engine, xfer->rx);
+        xfer->rx = NULL;
+    }
+    else
+    {
+        stats_inc(STATS_HEDGES_FAILED);
+        asynclog_info("Hedged request for ID %u failed: %s",
+                      item_id, xfer->hedge->error_buffer);
+
+        if(xfer->rx != NULL)
+            drop_hedge(engine, xfer);
+        else
+        {
+            g_strlcpy(xfer->error_buffer, xfer->hedge->error_buffer,
+                      sizeof(xfer->error_buffer));
+            finish_transfer(engine, xfer, result, false);
+        }
+    }
+}
+
+static void push_pending_item(struct Engine *engine, struct XferItem *item)
+{
+    GList *link = xferitem_queue_by_deadline(&engine->pending, item);
+
+    g_hash_table_insert(engine->pending_by_id,
+                        GUINT_TO_POINTER(item->item_id), link);
+}
+
+static struct XferItem *pop_pending_item(struct Engine *engine)
+{
+    struct XferItem *item = g_queue_pop_head(&engine->pending);
+
+    if(item != NULL)
+        g_hash_table_remove(engine->pending_by_id,
+                            GUINT_TO_POINTER(item->item_id));
+
+    return item;
+}
+
+static struct XferItem *steal_pending_item(struct Engine *engine,
+                                           uint32_t item_id)
+{
+    GList *link = g_hash_table_lookup(engine->pending_by_id,
+                                      GUINT_TO_POINTER(item_id));
+
+    if(link == NULL)
+        return NULL;
+
+    struct XferItem *item = link->data;
+
+    g_hash_table_remove(engine->pending_by_id, GUINT_TO_POINTER(item_id));
+    g_queue_delete_link(&engine->pending, link);
+
+    return item;
+}
+
+static struct Transfer *find_active_transfer(struct Engine *engine,
+                                             uint32_t item_id)
+{
+    return g_hash_table_lookup(engine->active_by_id,
+                               GUINT_TO_POINTER(item_id));
+}
+
+static void cancel_transfer(struct Engine *engine, uint32_t item_id)
+{
+    struct XferItem *item = steal_pending_item(engine, item_id);
+
+    if(item != NULL)
+    {
+        asynclog_info("Download canceled before start (ID %u)", item_id);
+        stats_inc(STATS_TRANSFERS_CANCELED);
+        send_download_done(item, LIST_ERROR_INTERRUPTED);
+        return;
+    }
+
+    struct Transfer *xfer = find_active_transfer(engine, item_id);
+
+    if(xfer != NULL)
+        finish_transfer(engine, xfer, CURLE_ABORTED_BY_CALLBACK, true);
+}
+
+static void cancel_all_transfers(struct Engine *engine);
+
+/*!
+ * Publish state of a transfer without new progress, keeping the counters.
+ */
+static void publish_pause_state(const struct Transfer *xfer)
+{
+    struct XferStatusSnapshot snapshot;
+
+    xferstatus_read(xfer->item->status, &snapshot);
+    snapshot.state = xfer->is_paused ? XFER_STATE_PAUSED : XFER_STATE_RUNNING;
+    snapshot.paused_us = get_paused_time_us(xfer);
+
+    if(xfer->is_paused)
+        snapshot.rate = 0;
+
+    xferstatus_publish(xfer->item->status, &snapshot);
+}
+
+static void pause_request(struct Engine *engine, const struct Transfer *xfer,
+                          CURL *handle, bool is_paused)
+{
+    if(handle == NULL)
+        return;
+
+    const CURLcode result =
+        transport_pause(engine->transport, handle, is_paused);
+
+    if(result != CURLE_OK)
+        asynclog_error(0, LOG_ERR, "Failed %s transfer ID %u: %s",
+                       is_paused ? "pausing" : "resuming", xfer->item->item_id,
+                       curl_easy_strerror(result));
+}
+
+/*!
+ * Stop moving data of a running transfer, keeping its connections open.
+ *
+ * Local copies and delta downloads scanning or verifying files are taken
+ * out of #Engine::local_copies and #Engine::delta_jobs until resumed.
+ */
+static void pause_transfer(struct Engine *engine, struct Transfer *xfer)
+{
+    if(xfer->is_paused)
+        return;
+
+    pause_request(engine, xfer, xfer->rx, true);
+
+    if(xfer->hedge != NULL)
+        pause_request(engine, xfer, xfer->hedge->handle, true);
+
+    if(xfer->delta != NULL)
+        for(size_t i = 0; i < G_N_ELEMENTS(xfer->delta->requests); ++i)
+            pause_request(engine, xfer, xfer->delta->requests[i].handle, true);
+
+    if(xfer->source_fd >= 0)
+        g_queue_remove(&engine->local_copies, xfer);
+    else if(is_delta_job(xfer))
+        g_queue_remove(&engine->delta_jobs, xfer);
+
+    xfer->is_paused = true;
+    xfer->paused_since = g_get_monotonic_time();
+    publish_pause_state(xfer);
+    stats_inc(STATS_TRANSFERS_PAUSED);
+    asynclog_info("Transfer paused (ID %u)", xfer->item->item_id);
+}
+
+/*!
+ * Continue moving data of a paused transfer.
+ *
+ * The throughput window starts over so that the pause is not mistaken for
+ * a stall.
+ */
+static void resume_transfer(struct Engine *engine, struct Transfer *xfer)
+{
+    if(!xfer->is_paused)
+        return;
+
+    const uint64_t duration =
+        (uint64_t)(g_get_monotonic_time() - xfer->paused_since);
+
+    xfer->is_paused = false;
+    xfer->paused_us += duration;
+    hedge_window_reset(&xfer->window);
+    xfer->is_stalled = false;
+
+    if(xfer->source_fd >= 0)
+        g_queue_push_tail(&engine->local_copies, xfer);
+    else if(is_delta_job(xfer))
+        g_queue_push_tail(&engine->delta_jobs, xfer);
+
+    pause_request(engine, xfer, xfer->rx, false);
+
+    if(xfer->hedge != NULL)
+        pause_request(engine, xfer, xfer->hedge->handle, false);
+
+    if(xfer->delta != NULL)
+        for(size_t i = 0; i < G_N_ELEMENTS(xfer->delta->requests); ++i)
+            pause_request(engine, xfer, xfer->delta->requests[i].handle, false);
+
+    publish_pause_state(xfer);
+    stats_add(STATS_PAUSED_MS, duration / 1000);
+    asynclog_info("Transfer resumed after %" G_GUINT64_FORMAT " ms (ID %u)",
+                  duration / 1000, xfer->item->item_id);
+}
+
+/*!
+ * Pause or resume a transfer according to its own and its class' state.
+ */
+static void apply_pause_state(struct Engine *engine, struct Transfer *xfer)
+{
+    if(xfer->is_paused_individually || engine->is_paused)
+        pause_transfer(engine, xfer);
+    else
+        resume_transfer(engine, xfer);
+}
+
+static void pause_or_resume_transfer(struct Engine *engine, uint32_t item_id,
+                                     bool is_paused)
+{
+    struct Transfer *xfer = find_active_transfer(engine, item_id);
+
+    if(xfer == NULL)
+    {
+        asynclog_info("Cannot %s ID %u, transfer is not running",
+                      is_paused ? "pause" : "resume", item_id);
+        return;
+    }
+
+    xfer->is_paused_individually = is_paused;
+
+    if(!is_paused && engine->is_paused)
+        asynclog_info("Transfer ID %u stays paused with its class", item_id);
+
+    apply_pause_state(engine, xfer);
+}
+
+/*!
+ * Pause or resume the whole class, running transfers and the queue.
+ *
+ * Transfers paused individually stay paused when the class is resumed.
+ */
+static void pause_or_resume_all_transfers(struct Engine *engine,
+                                          bool is_paused)
+{
+    engine->is_paused = is_paused;
+
+    GList *xfers = g_hash_table_get_values(engine->active_by_id);
+
+    for(GList *it = xfers; it != NULL; it = it->next)
+        apply_pause_state(engine, it->data);
+
+    g_list_free(xfers);
+
+    asynclog_info("%s %s transfers", is_paused ? "Paused" : "Resumed",
+                  schedclass_get_name(engine->priority));
+}
+
+/*!
+ * Predicted transfer time in microseconds, 0 if unknown.
+ */
+static uint64_t predict_duration_us(uint64_t bytes, uint64_t bytes_per_second)
+{
+    if(bytes == 0 || bytes_per_second == 0)
+        return 0;
+
+    return bytes * G_USEC_PER_SEC / bytes_per_second;
+}
+
+/*!
+ * Whether or not a queued item cannot be transferred before its deadline.
+ *
+ * The prediction is based on the size announced by the client and the
+ * average rate observed for the host. Items of unknown size or for unknown
+ * hosts are late only when their deadline has passed.
+ */
+static bool is_item_late(const struct XferItem *item, int64_t now)
+{
+    if(item->deadline == 0)
+        return false;
+
+    if(now >= item->deadline)
+        return true;
+
+    if(item->expected_size == 0)
+        return false;
+
+    char *origin = get_origin(item->url);
+    struct HostProfile profile;
+
+    hostprofile_get(origin, &profile);
+    g_free(origin);
+
+    const uint64_t duration =
+        predict_duration_us(item->expected_size, profile.bytes_per_second);
+
+    return duration > 0 && now + (int64_t)duration > item->deadline;
+}
+
+static bool have_curl_handles(struct Engine *engine)
+{
+    return g_hash_table_size(engine->active) > 0 ||
+           g_hash_table_size(engine->warming) > 0;
+}
+
+/*!
+ * Whether or not there are local copies or delta downloads working on
+ * files, which keep going without waiting for the network.
+ */
+static bool have_local_work(struct Engine *engine)
+{
+    return !g_queue_is_empty(&engine->local_copies) ||
+           !g_queue_is_empty(&engine->delta_jobs);
+}
+
+/*!
+ * Whether or not there are queued downloads which may be started.
+ */
+static bool have_startable_items(struct Engine *engine)
+{
+    return !engine->is_paused && !g_queue_is_empty(&engine->pending);
+}
+
+/*!
+ * Start collecting a batch of downloads if the item is the first one for an
+ * idle background class.
+ *
+ * Items with a deadline are not kept waiting, they release the batch.
+ */
+static void collect_batch(struct Engine *engine, const struct XferItem *item)
+{
+    if(engine->priority != XFER_PRIORITY_BACKGROUND ||
+       engine->config.batch_window_ms == 0)
+        return;
+
+    if(item->deadline != 0)
+        engine->batch_release_time = 0;
+    else if(engine->batch_release_time == 0 && !have_curl_handles(engine) &&
+            !have_local_work(engine) &&
+            g_queue_get_length(&engine->pending) == 1)
+        engine->batch_release_time =
+            g_get_monotonic_time() +
+            (int64_t)engine->config.batch_window_ms * 1000;
+}
+
+/*!
+ * Whether or not queued downloads are held back for collecting a batch.
+ */
+static bool is_batch_held(struct Engine *engine)
+{
+    if(engine->batch_release_time == 0)
+        return false;
+
+    if(g_queue_is_empty(&engine->pending))
+    {
+        /* all collected downloads have been canceled */
+        engine->batch_release_time = 0;
+        return false;
+    }
+
+    if(g_get_monotonic_time() < engine->batch_release_time)
+        return true;
+
+    asynclog_info("Starting batch of %u %s downloads",
+                  g_queue_get_length(&engine->pending),
+                  schedclass_get_name(engine->priority));
+    engine->batch_release_time = 0;
+
+    return false;
+}
+
+static void reject_late_item(struct XferItem *item)
+{
+    asynclog_info("Download of \"%s\" cannot finish before its deadline "
+                  "(ID %u)", item->url, item->item_id);
+    stats_inc(STATS_DEADLINES_MISSED);
+    send_download_done(item, LIST_ERROR_BUSY);
+}
+
+/*!
+ * Refuse queuing more downloads while queued downloads use up their share of
+ * the memory budget, so that clients back off instead of the queue growing
+ * without bounds.
+ */
+static void reject_item_over_budget(struct XferItem *item)
+{
+    asynclog_info("Too many downloads queued, rejecting \"%s\" (ID %u)",
+                  item->url, item->item_id);
+    stats_inc(STATS_TRANSFERS_REJECTED);
+    send_download_done(item, LIST_ERROR_BUSY);
+}
+
+/*!
+ * Process event received from main thread.
+ *
+ * Ownership of the event is taken over by this function.
+ */
+static void handle_event(struct Engine *engine, struct EventFromUser *event)
+{
+    switch(event->event_id)
+    {
+      case EVENT_FROM_USER_SHUTDOWN:
+        engine->shutdown_requested = true;
+        break;
+
+      case EVENT_FROM_USER_START_DOWNLOAD:
+        if(is_item_late(event->d.item, g_get_monotonic_time()))
+            reject_late_item(event->d.item);
+        else if(!membudget_items_fit())
+            reject_item_over_budget(event->d.item);
+        else
+        {
+            push_pending_item(engine, event->d.item);
+            collect_batch(engine, event->d.item);
+        }
+
+        event->d.item = NULL;
+        break;
+
+      case EVENT_FROM_USER_CANCEL:
+        cancel_transfer(engine, event->d.item_id);
+        break;
+
+      case EVENT_FROM_USER_CANCEL_ALL:
+        cancel_all_transfers(engine);
+        break;
+
+      case EVENT_FROM_USER_PAUSE:
+        pause_or_resume_transfer(engine, event->d.item_id, true);
+        break;
+
+      case EVENT_FROM_USER_RESUME:
+        pause_or_resume_transfer(engine, event->d.item_id, false);
+        break;
+
+      case EVENT_FROM_USER_PAUSE_ALL:
+        pause_or_resume_all_transfers(engine, true);
+        break;
+
+      case EVENT_FROM_USER_RESUME_ALL:
+        pause_or_resume_all_transfers(engine, false);
+        break;
+    }
+
+    events_from_user_free(event);
+}
+
+/*!
+ * Number of downloads allowed to run concurrently right now.
+ *
+ * Concurrency is halved while memory is tight.
+ */
+static unsigned int get_max_transfers(struct Engine *engine)
+{
+    const unsigned int max = engine->config.max_transfers;
+
+    if(!membudget_is_under_pressure())
+        return max;
+
+    return max > 1 ? max / 2 : 1;
+}
+
+/*!
+ * Whether or not the memory budget allows starting another transfer to a
+ * host with given profile.
+ *
+ * A single transfer is always allowed so that queued downloads cannot get
+ * stuck.
+ */
+static bool is_transfer_affordable(struct Engine *engine,
+                                   const struct HostProfile *profile)
+{
+    if(g_hash_table_size(engine->active_by_id) == 0 ||
+       membudget_fits(get_transfer_cost(profile)))
+    {
+        engine->is_deferring = false;
+        return true;
+    }
+
+    if(!engine->is_deferring)
+    {
+        asynclog_info("Memory budget exhausted, deferring queued downloads");
+        stats_inc(STATS_TRANSFERS_DEFERRED);
+        engine->is_deferring = true;
+    }
+
+    return false;
+}
+
+/*!
+ * Whether or not the host of given URL may take another transfer.
+ *
+ * The settings learned for the host are returned in \p profile.
+ */
+static bool is_host_available(struct Engine *engine, const char *url,
+                              struct HostProfile *profile)
+{
+    char *origin = get_origin(url);
+
+    hostprofile_get(origin, profile);
+
+    if(origin == NULL)
+        return true;
+
+    const bool result = profile->max_concurrency == 0 ||
+                        get_origin_count(engine, origin) < profile->max_concurrency;
+
+    g_free(origin);
+
+    return result;
+}
+
+/*!
+ * Take next queued item whose host has not reached its concurrency limit.
+ *
+ * Only the first few queued items are considered so that a busy host does
+ * not make us scan a long queue over and over again. Nothing is taken if
+ * the memory budget does not allow starting the first such item, with the
+ * buffer size learned for its host.
+ */
+static struct XferItem *take_startable_item(struct Engine *engine)
+{
+    unsigned int count = 0;
+
+    for(const GList *it = engine->pending.head;
+        it != NULL && count < HOST_LIMIT_LOOKAHEAD;
+        it = it->next, ++count)
+    {
+        const struct XferItem *item = it->data;
+        struct HostProfile profile;
+
+        if(!is_host_available(engine, item->url, &profile))
+            continue;
+
+        if(!is_transfer_affordable(engine, &profile))
+            return NULL;
+
+        return steal_pending_item(engine, item->item_id);
+    }
+
+    return NULL;
+}
+
+/*!
+ * Remove queued items which cannot meet their deadline anymore.
+ *
+ * Only the head of the queue needs to be checked because items with a
+ * deadline are queued first.
+ */
+static void reject_late_pending_items(struct Engine *engine)
+{
+    const int64_t now = g_get_monotonic_time();
+    GList *it = engine->pending.head;
+
+    while(it != NULL)
+    {
+        struct XferItem *item = it->data;
+
+        if(item->deadline == 0)
+            break;
+
+        it = it->next;
+
+        if(is_item_late(item, now))
+            reject_late_item(steal_pending_item(engine, item->item_id));
+    }
+}
+
+static void start_pending_transfers(struct Engine *engine)
+{
+    reject_late_pending_items(engine);
+
+    if(engine->is_paused || is_batch_held(engine))
+        return;
+
+    while(g_hash_table_size(engine->active_by_id) < get_max_transfers(engine) &&
+          !g_queue_is_empty(&engine->pending))
+    {
+        struct XferItem *item = take_startable_item(engine);
+
+        if(item == NULL)
+            break;
+
+        const enum DBusListsErrorCode error = start_transfer(engine, item);
+
+        if(error != LIST_ERROR_OK)
+        {
+            stats_inc(STATS_TRANSFERS_FAILED);
+            send_download_done(item, error);
+        }
+    }
+}
 
-      case CURLE_REMOTE_ACCESS_DENIED:
-      case CURLE_UPLOAD_FAILED:
-      case CURLE_SSL_CONNECT_ERROR:
-      case CURLE_PEER_FAILED_VERIFICATION:
-      case CURLE_SSL_CERTPROBLEM:
-      case CURLE_SSL_CIPHER:
-#if !CURL_AT_LEAST_VERSION(7, 62, 0)
-      case CURLE_SSL_CACERT:
-#endif /* removed in version 7.62.0 */
-      case CURLE_USE_SSL_FAILED:
-      case CURLE_LOGIN_DENIED:
-      case CURLE_TFTP_PERM:
-      case CURLE_TFTP_NOSUCHUSER:
-      case CURLE_SSL_ISSUER_ERROR:
-#if CURL_AT_LEAST_VERSION(7, 39, 0)
-      case CURLE_SSL_PINNEDPUBKEYNOTMATCH:
-#endif /* version 7.39.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 41, 0)
-      case CURLE_SSL_INVALIDCERTSTATUS:
-#endif /* version 7.41.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 66, 0)
-      case CURLE_AUTH_ERROR:
-#endif /* version 7.66.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 77, 0)
-      case CURLE_SSL_CLIENTCERT:
-#endif /* version 7.77.0 and up */
-        return LIST_ERROR_AUTHENTICATION;
+static curl_socket_t refuse_socket(void *clientp, curlsocktype purpose,
+                                   struct curl_sockaddr *address)
+{
+    /* the host name has been resolved and cached at this point, which is
+     * all we want */
+    return CURL_SOCKET_BAD;
+}
 
-      case CURLE_FAILED_INIT:
-      case CURLE_FTP_CANT_GET_HOST:
-      case CURLE_OUT_OF_MEMORY:
-      case CURLE_FUNCTION_NOT_FOUND:
-      case CURLE_BAD_FUNCTION_ARGUMENT:
-      case CURLE_UNKNOWN_OPTION:
-      case CURLE_SSL_ENGINE_NOTFOUND:
-      case CURLE_SSL_ENGINE_SETFAILED:
-      case CURLE_SSL_ENGINE_INITFAILED:
-      case CURLE_CONV_FAILED:
-      case CURLE_CONV_REQD:
-      case CURLE_AGAIN:
-      case CURLE_CHUNK_FAILED:
-      case CURLE_NO_CONNECTION_AVAILABLE:
-      case CURLE_OBSOLETE16:
-      case CURLE_OBSOLETE20:
-      case CURLE_OBSOLETE24:
-      case CURLE_OBSOLETE29:
-      case CURLE_OBSOLETE32:
-      case CURLE_OBSOLETE40:
-      case CURLE_OBSOLETE44:
-      case CURLE_OBSOLETE46:
-      case CURLE_OBSOLETE50:
-#if CURL_AT_LEAST_VERSION(7, 62, 0)
-      case CURLE_OBSOLETE51:
-#endif /* version 7.62.0 and up */
-      case CURLE_OBSOLETE57:
-#if CURL_AT_LEAST_VERSION(7, 59, 0)
-      case CURLE_RECURSIVE_API_CALL:
-#endif /* version 7.59.0 and up */
-#if CURL_AT_LEAST_VERSION(7, 84, 0)
-      case CURLE_UNRECOVERABLE_POLL:
-#endif /* version 7.84.0 and up */
-      case CURL_LAST:
+static void start_prewarm(struct Engine *engine, const struct XferItem *item)
+{
+    CURL *const handle = curl_easy_init();
+
+    if(handle == NULL)
+        return;
+
+    /* same settings as the real request so that it reuses the connection */
+    struct HostProfile profile;
+    char *origin = get_origin(item->url);
+
+    hostprofile_get(origin, &profile);
+    g_free(origin);
+
+    curl_easy_setopt(handle, CURLOPT_URL, item->url);
+    set_protocols(handle, item->url, is_upload(item));
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS,
+                     (long)profile.connect_timeout_ms);
+    set_http_version(handle, &profile, true);
+
+    switch(engine->config.prewarm)
+    {
+      case XFER_PREWARM_NONE:
+        break;
+
+      case XFER_PREWARM_DNS:
+        curl_easy_setopt(handle, CURLOPT_OPENSOCKETFUNCTION, refuse_socket);
+        break;
+
+      case XFER_PREWARM_CONNECTION:
+        /* a HEAD request leaves an idle connection in the cache of the
+         * multi handle, ready to be picked up by the real download */
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
         break;
     }
 
-    return LIST_ERROR_INTERNAL;
+    if(transport_add(engine->transport, handle, NULL) != CURLM_OK)
+    {
+        curl_easy_cleanup(handle);
+        return;
+    }
+
+    mark_origin_warm(engine, item->url);
+    g_hash_table_insert(engine->warming, handle,
+                        GUINT_TO_POINTER(item->item_id));
+    stats_inc(STATS_PREWARMS_STARTED);
+    flightrec_record(FLIGHTREC_PREWARM_START, item->item_id,
+                     engine->config.prewarm);
 }
 
 /*!
- * Perform download of given URL, write to file with given name.
- *
- * In case of error, this function will remove any temporary files it may have
- * created.
+ * Resolve host names or connect to hosts of next few queued downloads.
  */
-static enum DBusListsErrorCode do_download(const struct XferItem *const item,
-                                           const char *const filename,
-                                           struct EventFromUser **next_event)
+static void prewarm_pending_transfers(struct Engine *engine)
 {
-    *next_event = NULL;
+    if(engine->config.prewarm == XFER_PREWARM_NONE || engine->is_paused ||
+       engine->batch_release_time != 0 || membudget_is_under_pressure())
+        return;
 
-    FILE *output_file = fopen(filename, "wb");
+    unsigned int count = 0;
 
-    if(output_file == NULL)
+    for(const GList *it = engine->pending.head;
+        it != NULL && count < engine->config.prewarm_lookahead;
+        it = it->next, ++count)
     {
-        msg_error(errno, LOG_ERR,
-                  "Failed creating temporary file \"%s\"", filename);
+        const struct XferItem *item = it->data;
 
-        return LIST_ERROR_PHYSICAL_MEDIA_IO;
+        if(!is_local_url(item->url) && !is_origin_warm(engine, item->url))
+            start_prewarm(engine, item);
     }
+}
+
+static void finish_prewarm(struct Engine *engine, CURL *handle,
+                           CURLcode result)
+{
+    const uint32_t item_id =
+        GPOINTER_TO_UINT(g_hash_table_lookup(engine->warming, handle));
+
+    g_hash_table_remove(engine->warming, handle);
+    transport_remove(engine->transport, handle);
+    curl_easy_cleanup(handle);
+
+    flightrec_record(FLIGHTREC_PREWARM_DONE, item_id, result);
+}
+
+static void collect_finished_transfers(struct Engine *engine)
+{
+    CURL *handle;
+    CURLcode result;
 
-    CURL *rx = curl_easy_init();
-    if(rx == NULL)
+    while((handle = transport_next_finished(engine->transport,
+                                            &result)) != NULL)
     {
-        msg_error(ENOENT, LOG_ERR, "Failed initializing cURL object");
-        close_and_remove(output_file, filename);
+        struct Transfer *xfer = g_hash_table_lookup(engine->active, handle);
 
-        return LIST_ERROR_INTERNAL;
+        if(xfer != NULL)
+            finish_request(engine, xfer, handle, result);
+        else if(g_hash_table_contains(engine->warming, handle))
+            finish_prewarm(engine, handle, result);
+        else
+            msg_error(0, LOG_CRIT, "BUG: Finished cURL handle %p unknown",
+                      (void *)handle);
+    }
+}
+
+/*!
+ * Copy next chunk of a local file, finish the #Transfer at end of file.
+ */
+static void copy_local_chunk(struct Engine *engine, struct Transfer *xfer)
+{
+    const gint64 t = g_get_monotonic_time();
+    const int out_fd = fileno(xfer->output_file);
+    ssize_t copied;
+
+    if(xfer->bytes_written == 0 && xfer->expected_size > 0 &&
+       fileops_clone(xfer->source_fd, out_fd) == 0)
+    {
+        xfer->bytes_written = xfer->expected_size;
+        copied = 0;
     }
+    else
+        copied = fileops_copy_chunk(xfer->source_fd, out_fd,
+                                    LOCAL_COPY_CHUNK_SIZE);
 
-    struct ProgressCallbackData data =
+    xfer->write_time_us += g_get_monotonic_time() - t;
+
+    if(copied < 0)
     {
-        .current_xfer = item,
-        .previously_sent_tick = UINT32_MAX,
-    };
+        g_strlcpy(xfer->error_buffer, g_strerror(errno),
+                  sizeof(xfer->error_buffer));
+        finish_transfer(engine, xfer, CURLE_WRITE_ERROR, false);
+        return;
+    }
 
-    char error_buffer[CURL_ERROR_SIZE] = "[details unknown]";
+    xfer->bytes_written += copied;
+    flightrec_record(FLIGHTREC_CURL_WRITE, xfer->item->item_id,
+                     (uint64_t)copied);
+    DBUSDL_PROBE3(transfer_write, xfer->item->item_id, (uint64_t)copied,
+                  (uint64_t)xfer->bytes_written);
 
-    curl_easy_setopt(rx, CURLOPT_URL, item->url);
-    curl_easy_setopt(rx, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(rx, CURLOPT_MAXREDIRS, 5L);
-    curl_easy_setopt(rx, CURLOPT_WRITEFUNCTION, NULL);
-    curl_easy_setopt(rx, CURLOPT_WRITEDATA, output_file);
-    curl_easy_setopt(rx, CURLOPT_XFERINFOFUNCTION, progress_callback);
-    curl_easy_setopt(rx, CURLOPT_XFERINFODATA, &data);
-    curl_easy_setopt(rx, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(rx, CURLOPT_FAILONERROR, 1L);
-    curl_easy_setopt(rx, CURLOPT_CONNECTTIMEOUT, 45L);
-    curl_easy_setopt(rx, CURLOPT_ACCEPTTIMEOUT_MS, 45000L);
-    curl_easy_setopt(rx, CURLOPT_ERRORBUFFER, error_buffer);
+    if(xfer->bytes_written > xfer->expected_size)
+        xfer->expected_size = xfer->bytes_written;
 
-    const CURLcode rx_result = curl_easy_perform(rx);
-    enum DBusListsErrorCode error = map_curl_error_to_list_error(rx_result);
+    update_progress(xfer, NULL, xfer->expected_size, xfer->bytes_written);
 
-    curl_easy_cleanup(rx);
-    rx = NULL;
+    if(copied == 0)
+        finish_transfer(engine, xfer, CURLE_OK, false);
+}
 
-    *next_event = data.next_event;
+/*!
+ * Copy next chunk of each local file being downloaded.
+ *
+ * The chunks are limited in size so that large local files do not hold up
+ * network transfers of the same priority class.
+ */
+static void copy_local_transfers(struct Engine *engine)
+{
+    GList *it = engine->local_copies.head;
 
-    if(error == LIST_ERROR_OK)
+    while(it != NULL)
     {
-        fclose(output_file);
+        struct Transfer *xfer = it->data;
 
-        /* in case 100% completion has not been sent from the progress
-         * callback for any reason, do it now for the sake of UX */
-        if(data.previously_sent_tick != item->total_ticks)
-            send_progress_report(item, item->total_ticks);
+        /* the transfer may be finished and removed */
+        it = it->next;
+        copy_local_chunk(engine, xfer);
+    }
+}
+
+/*!
+ * Download the ranges of a delta download not found in its seed file.
+ *
+ * If the seed could not be scanned, the file is downloaded in full. If
+ * the seed has it all, the file is verified right away.
+ */
+static void finish_delta_scan(struct Engine *engine, struct Transfer *xfer,
+                              bool is_scanned)
+{
+    struct XferItem *item = xfer->item;
+    struct Delta *delta = xfer->delta;
+    uint64_t reused = 0;
+    GArray *ranges =
+        is_scanned ? delta_scan_finish(delta->scan, &reused) : NULL;
+
+    delta_scan_free(delta->scan);
+    delta->scan = NULL;
+    close(delta->seed_fd);
+    delta->seed_fd = -1;
+
+    if(ranges == NULL)
+    {
+        asynclog_error(0, LOG_ERR, "Failed reusing seed file \"%s\", "
+                       "downloading ID %u in full",
+                       item->delta_seed_path, item->item_id);
+
+        if(!drop_delta(engine, xfer))
+        {
+            finish_transfer(engine, xfer, CURLE_WRITE_ERROR, false);
+            return;
+        }
     }
     else
     {
-        if(rx_result != CURLE_ABORTED_BY_CALLBACK)
-            msg_error(0, LOG_ERR, "Failed downloading file %s: %s (%s)",
-                      filename, error_buffer, curl_easy_strerror(rx_result));
-        else
+        delta->ranges = ranges;
+        xfer->bytes_written = (curl_off_t)reused;
+
+        stats_inc(STATS_DELTA_DOWNLOADS);
+        stats_add(STATS_DELTA_BYTES_REUSED, reused);
+
+        asynclog_info("Reusing %" G_GUINT64_FORMAT " of %"
+                      CURL_FORMAT_CURL_OFF_T " bytes from \"%s\", "
+                      "%u ranges left to download for ID %u",
+                      reused, xfer->expected_size, item->delta_seed_path,
+                      ranges->len, item->item_id);
+
+        if(ranges->len == 0)
         {
-            msg_info("Download canceled as requested (%s)", filename);
-            error = LIST_ERROR_INTERRUPTED;
+            /* nothing to download, the seed has it all */
+            start_delta_verification(engine, xfer);
+            return;
         }
 
-        close_and_remove(output_file, filename);
+        if(!start_delta_requests(engine, xfer))
+            finish_transfer(engine, xfer, CURLE_FAILED_INIT, false);
+
+        return;
     }
 
-    return error;
+    if(start_request(engine, xfer, -1) != LIST_ERROR_OK)
+        finish_transfer(engine, xfer, CURLE_FAILED_INIT, false);
+}
+
+/*!
+ * Scan next chunk of the seed file of a delta download, or verify next
+ * chunk of the assembled file.
+ */
+static void process_delta_chunk(struct Engine *engine, struct Transfer *xfer)
+{
+    struct Delta *delta = xfer->delta;
+
+    if(delta->scan != NULL)
+    {
+        const int result = delta_scan_step(delta->scan, DELTA_CHUNK_SIZE);
+
+        if(result > 0)
+            return;
+
+        g_queue_remove(&engine->delta_jobs, xfer);
+        finish_delta_scan(engine, xfer, result == 0);
+        return;
+    }
+
+    const int result = delta_verifier_step(delta->verifier, DELTA_CHUNK_SIZE);
+
+    if(result > 0)
+        return;
+
+    g_queue_remove(&engine->delta_jobs, xfer);
+    delta_verifier_free(delta->verifier);
+    delta->verifier = NULL;
+    delta->is_verified = result == 0;
+    finish_transfer(engine, xfer, CURLE_OK, false);
+}
+
+/*!
+ * Process next chunk of each delta download scanning its seed or verifying
+ * its file.
+ */
+static void process_delta_jobs(struct Engine *engine)
+{
+    GList *it = engine->delta_jobs.head;
+
+    while(it != NULL)
+    {
+        struct Transfer *xfer = it->data;
+
+        /* the transfer may be finished and removed */
+        it = it->next;
+        process_delta_chunk(engine, xfer);
+    }
 }
 
 /*!
- * Take ownership of #XferItem and attempt to download it.
+ * Track throughput of downloads, start hedged requests for stalled ones.
  *
- * While the download proceeds, the event queue is regularly checked for new
- * messages. In case a cancellation request for the current transfer is
- * received, or in case a new download or application shutdown is requested,
- * the download is interrupted and any temporary files are removed.
+ * Time is taken from the transport, so that a transport simulating the
+ * passing of time gets its requests hedged.
+ */
+static void hedge_stalled_transfers(struct Engine *engine)
+{
+    if(engine->config.stall_window_seconds == 0)
+        return;
+
+    const guint second =
+        (guint)(transport_get_time(engine->transport) / G_USEC_PER_SEC);
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, engine->active_by_id);
+
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        struct Transfer *xfer = value;
+
+        if(xfer->was_hedged || xfer->is_paused || xfer->rx == NULL ||
+           is_upload(xfer->item))
+            continue;
+
+        if(!xfer->is_stalled &&
+           hedge_window_is_stalled(&xfer->window, second, xfer->rx_received))
+            xfer->is_stalled = true;
+
+        if(xfer->is_stalled)
+            start_hedge(engine, xfer);
+    }
+}
+
+/*!
+ * Whether or not a running transfer cannot finish before its deadline.
  *
- * \returns
- *     The event that was read from the incoming queue and that caused
- *     interuption of the download, or \c NULL in case the download was not
- *     interrupted by an event. Note that \c NULL does not indicate a
- *     successful download.
+ * Downloads are predicted from their average rate so far, once they have
+ * been running for a while. Time spent paused does not count, and there is
+ * no prediction while paused since the transfer may be resumed at any time.
  */
-static struct EventFromUser *download(struct XferItem *item)
+static bool is_transfer_late(const struct Transfer *xfer, int64_t now)
 {
-    msg_log_assert(item != NULL);
+    const struct XferItem *item = xfer->item;
 
-    msg_info("Start downloading URL \"%s\", ID %u", item->url, item->item_id);
+    if(item->deadline == 0)
+        return false;
 
-    struct EventFromUser *next_event;
-    enum DBusListsErrorCode error =
-        do_download(item, xferitem_get_tempfile_path(), &next_event);
+    if(now >= item->deadline)
+        return true;
 
-    if(error == LIST_ERROR_OK)
+    if(xfer->is_paused || is_upload(item) || xfer->rx == NULL ||
+       !xfer->has_request_info || xfer->expected_size <= xfer->bytes_written)
+        return false;
+
+    curl_off_t elapsed = 0;
+    curl_off_t received = 0;
+
+    /* cURL's own average rate includes the time spent paused */
+    curl_easy_getinfo(xfer->rx, CURLINFO_TOTAL_TIME_T, &elapsed);
+
+    const uint64_t paused = get_paused_time_us(xfer);
+
+    if(elapsed < 0 || (uint64_t)elapsed < paused + MIN_PREDICTION_TIME_US)
+        return false;
+
+    curl_easy_getinfo(xfer->rx, CURLINFO_SIZE_DOWNLOAD_T, &received);
+
+    const uint64_t active = (uint64_t)elapsed - paused;
+    const uint64_t rate =
+        received > 0 ? (uint64_t)received * G_USEC_PER_SEC / active : 0;
+
+    const uint64_t duration =
+        predict_duration_us(xfer->expected_size - xfer->bytes_written, rate);
+
+    return duration > 0 && now + (int64_t)duration > item->deadline;
+}
+
+/*!
+ * Drop running transfers which cannot meet their deadline, so that no
+ * bandwidth is spent on data which is stale by the time it arrives.
+ */
+static void drop_late_transfers(struct Engine *engine)
+{
+    if(engine->deadline_count == 0)
+        return;
+
+    const int64_t now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, engine->active_by_id);
+
+    while(g_hash_table_iter_next(&iter, NULL, &value))
     {
-        if(rename(xferitem_get_tempfile_path(), item->destfile_path) < 0)
-        {
-            error = LIST_ERROR_PHYSICAL_MEDIA_IO;
-            remove_file(xferitem_get_tempfile_path());
-        }
-        else
-            msg_info("Finished downloading \"%s\" to \"%s\"",
-                     item->url, item->destfile_path);
+        struct Transfer *xfer = value;
+
+        if(!is_transfer_late(xfer, now))
+            continue;
+
+        /* taken out here so that the iterator stays valid, late transfers
+         * always have a deadline */
+        g_hash_table_iter_steal(&iter);
+        --engine->deadline_count;
+
+        xfer->is_late = true;
+        finish_transfer(engine, xfer, CURLE_ABORTED_BY_CALLBACK, true);
     }
+}
 
-    send_download_done(item, error);
+static void wait_for_network(struct Engine *engine)
+{
+    int timeout_ms = MAX_POLL_TIMEOUT_MS;
+
+    if(engine->batch_release_time != 0)
+    {
+        const int64_t remaining_ms =
+            (engine->batch_release_time - g_get_monotonic_time()) / 1000 + 1;
+
+        if(remaining_ms < timeout_ms)
+            timeout_ms = remaining_ms > 0 ? (int)remaining_ms : 0;
+    }
 
-    return next_event;
+    transport_wait(engine->transport, timeout_ms);
 }
 
-static struct
+static void cancel_all_transfers(struct Engine *engine)
 {
-    struct EventFromUser *current_xfer_event;
+    struct XferItem *item;
+
+    while((item = pop_pending_item(engine)) != NULL)
+    {
+        stats_inc(STATS_TRANSFERS_CANCELED);
+        send_download_done(item, LIST_ERROR_INTERRUPTED);
+    }
+
+    GList *xfers = g_hash_table_get_values(engine->active_by_id);
+
+    for(GList *it = xfers; it != NULL; it = it->next)
+        finish_transfer(engine, it->data, CURLE_ABORTED_BY_CALLBACK, true);
+
+    g_list_free(xfers);
+
+    GList *handles = g_hash_table_get_keys(engine->warming);
+
+    for(GList *it = handles; it != NULL; it = it->next)
+        finish_prewarm(engine, it->data, CURLE_ABORTED_BY_CALLBACK);
+
+    g_list_free(handles);
 }
-xferthread_data;
 
 static gpointer xferthread_main(gpointer data)
 {
-    struct EventFromUser *next_event = NULL;
+    struct Engine *engine = data;
 
-    while(1)
-    {
-        xferthread_data.current_xfer_event =
-            (next_event != NULL) ? next_event : events_from_user_receive(true);
+    schedclass_apply_to_current_thread(engine->priority);
 
-        next_event = NULL;
+    while(!engine->shutdown_requested)
+    {
+        const bool is_idle =
+            !have_curl_handles(engine) && !have_local_work(engine) &&
+            !have_startable_items(engine);
 
-        if(xferthread_data.current_xfer_event == NULL)
-            continue;
+        struct EventFromUser *event =
+            events_from_user_receive(engine->priority, is_idle);
 
-        switch(xferthread_data.current_xfer_event->event_id)
+        while(event != NULL)
         {
-          case EVENT_FROM_USER_SHUTDOWN:
-            events_from_user_free(xferthread_data.current_xfer_event);
-            return NULL;
+            handle_event(engine, event);
+            event = events_from_user_receive(engine->priority, false);
+        }
 
-          case EVENT_FROM_USER_START_DOWNLOAD:
-            next_event = download(xferthread_data.current_xfer_event->d.item);
-            xferthread_data.current_xfer_event->d.item = NULL;
+        if(engine->shutdown_requested)
             break;
 
-          case EVENT_FROM_USER_CANCEL:
-            /* spurious cancel, doesn't make sense at this point */
-            break;
+        membudget_update_pressure();
+        start_pending_transfers(engine);
+        prewarm_pending_transfers(engine);
+
+        if(!have_curl_handles(engine) && !have_local_work(engine))
+        {
+            /* sleep while collecting a batch, new events wake us up */
+            if(engine->batch_release_time != 0)
+                wait_for_network(engine);
+
+            continue;
         }
 
-        events_from_user_free(xferthread_data.current_xfer_event);
+        transport_perform(engine->transport);
+        collect_finished_transfers(engine);
+        copy_local_transfers(engine);
+        process_delta_jobs(engine);
+        hedge_stalled_transfers(engine);
+        drop_late_transfers(engine);
+
+        /* local copies keep going without waiting for the network */
+        if(have_curl_handles(engine) && !have_local_work(engine))
+            wait_for_network(engine);
     }
+
+    cancel_all_transfers(engine);
+
+    return NULL;
+}
+
+static void wake_up_thread(void *user_data)
+{
+    transport_wakeup(user_data);
+}
+
+/*!
+ * Number of connections per host a priority class may open.
+ *
+ * Each class has its own cURL multi handle, and thus its own connection
+ * cache. cURL cannot share connections between multi handles used by
+ * different threads, so the configured limit is split among the classes
+ * instead, with higher priorities getting the remainder. Each class gets
+ * at least one connection.
+ */
+static unsigned int get_max_host_connections(const struct XferConfig *config,
+                                             enum XferPriority priority)
+{
+    const unsigned int total = config->max_host_connections;
+    const unsigned int classes = XFER_PRIORITY_LAST + 1;
+
+    if(total == 0)
+        return 0;
+
+    const unsigned int share =
+        total / classes + ((unsigned int)priority < total % classes ? 1 : 0);
+
+    return share > 0 ? share : 1;
 }
 
-static GThread *thread;
+static void start_engine(struct Engine *engine, enum XferPriority priority,
+                         const struct XferConfig *config)
+{
+    engine->priority = priority;
+    engine->config = *config;
+    engine->transport = config->mock_script != NULL
+        ? transport_mock_new(config->mock_script)
+        : transport_curl_new(get_max_host_connections(config, priority),
+                             config->max_streams_per_connection);
+    msg_log_assert(engine->transport != NULL);
+    g_queue_init(&engine->pending);
+    engine->pending_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    engine->active = g_hash_table_new(g_direct_hash, g_direct_equal);
+    engine->active_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    engine->deadline_count = 0;
+    g_queue_init(&engine->local_copies);
+    g_queue_init(&engine->delta_jobs);
+    engine->warming = g_hash_table_new(g_direct_hash, g_direct_equal);
+    engine->warm_origins =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    engine->origin_counts =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    engine->batch_release_time = 0;
+    engine->is_deferring = false;
+    engine->is_paused = false;
+    engine->shutdown_requested = false;
+
+    char name[16];
+    g_snprintf(name, sizeof(name), "xfer-%s", schedclass_get_name(priority));
+
+    events_from_user_set_notification(priority, wake_up_thread,
+                                      engine->transport);
+    engine->thread = g_thread_new(name, xferthread_main, engine);
+}
 
-void xferthread_init(void)
+void xferthread_init(const struct XferConfig *config)
 {
-    msg_log_assert(thread == NULL);
+    msg_log_assert(config != NULL);
+    msg_log_assert(config->max_transfers > 0);
+    msg_log_assert(config->stall_window_seconds <=
+                   XFER_STALL_WINDOW_MAX_SECONDS);
 
     curl_global_init(CURL_GLOBAL_DEFAULT);
-    thread = g_thread_new("Transfer thread", xferthread_main, NULL);
+
+    msg_info("Up to %u concurrent downloads per priority class, "
+             "%u connections per host shared by all classes, "
+             "%u streams per connection",
+             config->max_transfers, config->max_host_connections,
+             config->max_streams_per_connection);
+
+    if(config->stall_window_seconds > 0)
+        msg_info("Hedging downloads slower than %u bytes/s over %u seconds",
+                 config->stall_speed_limit, config->stall_window_seconds);
+
+    if(config->batch_window_ms > 0)
+        msg_info("Batching %s downloads over %u ms",
+                 schedclass_get_name(XFER_PRIORITY_BACKGROUND),
+                 config->batch_window_ms);
+
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+    {
+        msg_log_assert(xferthread_data.engines[i].thread == NULL);
+        start_engine(&xferthread_data.engines[i], i, config);
+    }
 }
 
-void xferthread_deinit(void)
+static void stop_engine(struct Engine *engine)
 {
-    msg_log_assert(thread != NULL);
+    msg_log_assert(engine->thread != NULL);
 
     unsigned int tries = 10;
 
@@ -485,18 +3844,44 @@ void xferthread_deinit(void)
         }
         else
         {
-            events_from_user_send(shutdown_event);
+            events_from_user_send(engine->priority, shutdown_event);
             break;
         }
     }
 
     if(tries > 0)
-        g_thread_join(thread);
+        g_thread_join(engine->thread);
     else
         msg_error(0, LOG_ERR, "Failed joining thread, just quitting now.");
 
-    g_thread_unref(thread);
-    thread = NULL;
+    g_thread_unref(engine->thread);
+    engine->thread = NULL;
+
+    events_from_user_set_notification(engine->priority, NULL, NULL);
+
+    if(tries > 0)
+    {
+        g_hash_table_unref(engine->pending_by_id);
+        engine->pending_by_id = NULL;
+        g_hash_table_unref(engine->active);
+        engine->active = NULL;
+        g_hash_table_unref(engine->active_by_id);
+        engine->active_by_id = NULL;
+        g_hash_table_unref(engine->warming);
+        engine->warming = NULL;
+        g_hash_table_unref(engine->warm_origins);
+        engine->warm_origins = NULL;
+        g_hash_table_unref(engine->origin_counts);
+        engine->origin_counts = NULL;
+        transport_free(engine->transport);
+        engine->transport = NULL;
+    }
+}
+
+void xferthread_deinit(void)
+{
+    for(unsigned int i = 0; i <= XFER_PRIORITY_LAST; ++i)
+        stop_engine(&xferthread_data.engines[i]);
 
     curl_global_cleanup();
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015, 2019  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2015, 2019, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of D-Bus DL.
  *
@@ -22,11 +22,82 @@
 #ifndef XFERTHREAD_H
 #define XFERTHREAD_H
 
+struct TransportMockScript;
+
+/*!
+ * Upper limit for #XferConfig::stall_window_seconds.
+ */
+#define XFER_STALL_WINDOW_MAX_SECONDS 60U
+
+/*!
+ * How to prepare for downloads which are queued, but not started yet.
+ */
+enum XferPrewarm
+{
+    /*! Nothing is done before a download is started. */
+    XFER_PREWARM_NONE,
+
+    /*! Host names are resolved and cached in advance. */
+    XFER_PREWARM_DNS,
+
+    /*! Connections to the hosts are established in advance. */
+    XFER_PREWARM_CONNECTION,
+};
+
+/*!
+ * Configuration of the transfer threads, applied to each priority class.
+ */
+struct XferConfig
+{
+    /*! Maximum number of downloads of a priority class running at the same
+     *  time. */
+    unsigned int max_transfers;
+
+    /*! Maximum number of connections to a single host, 0 for no limit.
+     *  The limit is split among the priority classes, each class gets at
+     *  least one connection. */
+    unsigned int max_host_connections;
+
+    /*! Maximum number of HTTP/2 streams multiplexed over a connection. */
+    unsigned int max_streams_per_connection;
+
+    /*! What to do in advance for queued downloads. */
+    enum XferPrewarm prewarm;
+
+    /*! Number of queued downloads to prepare in advance. */
+    unsigned int prewarm_lookahead;
+
+    /*! Length of the window over which download throughput is averaged
+     *  for detecting stalls, 0 to disable hedged requests. */
+    unsigned int stall_window_seconds;
+
+    /*! Downloads slower than this many bytes per second over the whole
+     *  window are considered stalled and get a hedged request. */
+    unsigned int stall_speed_limit;
+
+    /*! Background downloads requested while the background class is idle
+     *  are collected for this many milliseconds and started together, 0
+     *  to start them right away. Other classes are not affected. */
+    unsigned int batch_window_ms;
+
+    /*! Maximum total size of the files unpacked from an archive in MiB, 0
+     *  for no limit. */
+    unsigned int max_extracted_mib;
+
+    /*! Maximum number of files and directories unpacked from an archive,
+     *  0 for no limit. */
+    unsigned int max_extracted_entries;
+
+    /*! Serve all requests from this script instead of the network, for
+     *  tests and benchmarks. \c NULL for normal operation. */
+    struct TransportMockScript *mock_script;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void xferthread_init(void);
+void xferthread_init(const struct XferConfig *config);
 void xferthread_deinit(void);
 
 #ifdef __cplusplus